@@ -28,6 +28,7 @@ import {
   mqttTopics,
 } from '../types/mqtt.types';
 import { classifyImage, ClassificationResponse } from './classification.client';
+import { SnapshotAssembler, SnapshotMeta } from './snapshot-assembler';
 
 // Type-safe EventEmitter
 interface TypedEventEmitter {
@@ -64,6 +65,9 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
   private pendingRotations: Map<string, PendingRotation> = new Map();
   private readonly ROTATION_ACK_TIMEOUT_MS = 30 * 1000; // 30 seconds
 
+  // Reassembly of binary (chunked) camera snapshots
+  private snapshotAssembler = new SnapshotAssembler();
+
   constructor(config: MqttConfig, dbPool: Pool) {
     super();
     this.config = config;
@@ -219,6 +223,9 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
       { topic: 'tenant/+/device/+/ota/progress', qos: this.config.qos.default },
       // Subscribe to all camera snapshots
       { topic: 'tenant/+/device/+/camera/snapshot', qos: this.config.qos.default },
+      // Binary snapshot transport: JSON metadata + raw JPEG chunks
+      { topic: 'tenant/+/device/+/camera/snapshot/meta', qos: this.config.qos.default },
+      { topic: 'tenant/+/device/+/camera/snapshot/bin', qos: this.config.qos.default },
       // Subscribe to all device alerts/traps
       { topic: 'tenant/+/device/+/alert', qos: this.config.qos.default },
       // Subscribe to alert cleared notifications from devices
@@ -246,6 +253,13 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
   private async handleMessage(topic: string, payload: Buffer): Promise<void> {
     try {
       const parsedTopic = this.parseTopic(topic);
+
+      // Binary chunks are not JSON - handle before parsing
+      if (parsedTopic.type === 'camera_snapshot_chunk') {
+        await this.handleSnapshotChunk(parsedTopic, payload);
+        return;
+      }
+
       const message = JSON.parse(payload.toString());
 
       console.log(`[MQTT] Message received on ${topic}:`, message);
@@ -263,6 +277,10 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
           await this.handleCameraSnapshot(parsedTopic, message);
           break;
 
+        case 'camera_snapshot_meta':
+          await this.handleSnapshotMeta(parsedTopic, message as SnapshotMeta);
+          break;
+
         case 'device_alert':
           await this.handleDeviceAlert(parsedTopic, message);
           break;
@@ -311,8 +329,26 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
       };
     }
 
+    // tenant/{tenantId}/device/{macAddress}/camera/snapshot/meta
+    if (parts[0] === 'tenant' && parts[2] === 'device' && parts[4] === 'camera' && parts[5] === 'snapshot' && parts[6] === 'meta') {
+      return {
+        type: 'camera_snapshot_meta',
+        tenantId: parts[1],
+        macAddress: parts[3],
+      };
+    }
+
+    // tenant/{tenantId}/device/{macAddress}/camera/snapshot/bin
+    if (parts[0] === 'tenant' && parts[2] === 'device' && parts[4] === 'camera' && parts[5] === 'snapshot' && parts[6] === 'bin') {
+      return {
+        type: 'camera_snapshot_chunk',
+        tenantId: parts[1],
+        macAddress: parts[3],
+      };
+    }
+
     // tenant/{tenantId}/device/{macAddress}/camera/snapshot
-    if (parts[0] === 'tenant' && parts[2] === 'device' && parts[4] === 'camera' && parts[5] === 'snapshot') {
+    if (parts[0] === 'tenant' && parts[2] === 'device' && parts[4] === 'camera' && parts[5] === 'snapshot' && parts.length === 6) {
       return {
         type: 'camera_snapshot',
         tenantId: parts[1],
@@ -515,6 +551,38 @@ export class MqttService extends EventEmitter implements TypedEventEmitter {
     }
   }
 
+  /**
+   * Handle binary snapshot metadata (camera/snapshot/meta)
+   */
+  private async handleSnapshotMeta(parsedTopic: ParsedTopic, meta: SnapshotMeta): Promise<void> {
+    const { tenantId, macAddress } = parsedTopic;
+    if (!tenantId || !macAddress) return;
+
+    const snapshot = this.snapshotAssembler.addMeta(tenantId, macAddress, meta);
+    if (snapshot) {
+      await this.handleCameraSnapshot(parsedTopic, {
+        image: snapshot.image.toString('base64'),
+        timestamp: snapshot.meta.timestamp,
+      });
+    }
+  }
+
+  /**
+   * Handle one binary snapshot chunk (camera/snapshot/bin)
+   */
+  private async handleSnapshotChunk(parsedTopic: ParsedTopic, payload: Buffer): Promise<void> {
+    const { tenantId, macAddress } = parsedTopic;
+    if (!tenantId || !macAddress) return;
+
+    const snapshot = this.snapshotAssembler.addChunk(tenantId, macAddress, payload);
+    if (snapshot) {
+      await this.handleCameraSnapshot(parsedTopic, {
+        image: snapshot.image.toString('base64'),
+        timestamp: snapshot.meta.timestamp,
+      });
+    }
+  }
+
   /**
    * Handle OTA progress message
    */
@@ -0,0 +1,187 @@
+/**
+ * Snapshot Assembler
+ *
+ * Reassembles binary camera snapshots sent by devices with the "snapBin"
+ * setting enabled. The device publishes:
+ *
+ *   tenant/{tenantId}/device/{mac}/camera/snapshot/meta  - JSON metadata
+ *     { id, timestamp, filename?, size, chunks, chunk_size, crc32, format }
+ *   tenant/{tenantId}/device/{mac}/camera/snapshot/bin   - raw JPEG chunks
+ *     16-byte little-endian header: "SNP1" | id u32 | seq u16 | total u16 | crc32 u32
+ *
+ * Chunks may arrive before their metadata (separate topics are not ordered
+ * relative to each other by every broker), so both are buffered per
+ * tenant/device/id until the image is complete or times out.
+ */
+
+import { logger } from './logger.service';
+
+export interface SnapshotMeta {
+  id: number;
+  timestamp?: number;
+  filename?: string;
+  size: number;
+  chunks: number;
+  chunk_size?: number;
+  crc32: number;
+  format?: string;
+}
+
+export interface AssembledSnapshot {
+  tenantId: string;
+  macAddress: string;
+  meta: SnapshotMeta;
+  image: Buffer;
+}
+
+interface PendingSnapshot {
+  meta?: SnapshotMeta;
+  total: number;
+  parts: Map<number, Buffer>;
+  createdAt: number;
+}
+
+const HEADER_SIZE = 16;
+const MAGIC = 'SNP1';
+const PENDING_TIMEOUT_MS = 30000;
+const MAX_PENDING = 64;
+const MAX_IMAGE_BYTES = 4 * 1024 * 1024;
+
+// Standard zlib CRC-32 (reflected, poly 0xEDB88320) - matches esp_rom_crc32_le
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) {
+      c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    }
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+export function crc32(data: Buffer): number {
+  let crc = 0xffffffff;
+  for (let i = 0; i < data.length; i++) {
+    crc = CRC_TABLE[(crc ^ data[i]) & 0xff] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xffffffff) >>> 0;
+}
+
+export class SnapshotAssembler {
+  private pending = new Map<string, PendingSnapshot>();
+
+  private key(tenantId: string, macAddress: string, id: number): string {
+    return `${tenantId}/${macAddress.toUpperCase()}/${id >>> 0}`;
+  }
+
+  private getOrCreate(key: string, total: number): PendingSnapshot {
+    this.evictExpired();
+    let entry = this.pending.get(key);
+    if (!entry) {
+      if (this.pending.size >= MAX_PENDING) {
+        // Drop the oldest; Map iteration order is insertion order
+        const oldest = this.pending.keys().next().value;
+        if (oldest !== undefined) this.pending.delete(oldest);
+      }
+      entry = { total, parts: new Map(), createdAt: Date.now() };
+      this.pending.set(key, entry);
+    }
+    return entry;
+  }
+
+  private evictExpired(): void {
+    const now = Date.now();
+    for (const [key, entry] of this.pending) {
+      if (now - entry.createdAt > PENDING_TIMEOUT_MS) {
+        logger.warn('Binary snapshot timed out', {
+          key,
+          received: entry.parts.size,
+          total: entry.total,
+        });
+        this.pending.delete(key);
+      }
+    }
+  }
+
+  /**
+   * Record snapshot metadata. Returns the snapshot if all chunks were already here.
+   */
+  addMeta(tenantId: string, macAddress: string, meta: SnapshotMeta): AssembledSnapshot | null {
+    if (typeof meta?.id !== 'number' || !Number.isInteger(meta.chunks) || meta.chunks <= 0) {
+      logger.warn('Invalid binary snapshot metadata', { tenantId, macAddress, meta });
+      return null;
+    }
+    if (meta.size > MAX_IMAGE_BYTES) {
+      logger.warn('Binary snapshot too large', { tenantId, macAddress, size: meta.size });
+      return null;
+    }
+
+    const key = this.key(tenantId, macAddress, meta.id);
+    const entry = this.getOrCreate(key, meta.chunks);
+    entry.meta = meta;
+    entry.total = meta.chunks;
+    return this.tryComplete(key, tenantId, macAddress, entry);
+  }
+
+  /**
+   * Record one binary chunk. Returns the snapshot once the last piece has arrived.
+   */
+  addChunk(tenantId: string, macAddress: string, payload: Buffer): AssembledSnapshot | null {
+    if (payload.length < HEADER_SIZE || payload.toString('ascii', 0, 4) !== MAGIC) {
+      logger.warn('Invalid binary snapshot chunk header', { tenantId, macAddress, length: payload.length });
+      return null;
+    }
+
+    const id = payload.readUInt32LE(4);
+    const seq = payload.readUInt16LE(8);
+    const total = payload.readUInt16LE(10);
+    const chunkCrc = payload.readUInt32LE(12);
+    const data = payload.subarray(HEADER_SIZE);
+
+    if (total === 0 || seq >= total) {
+      logger.warn('Binary snapshot chunk out of range', { tenantId, macAddress, id, seq, total });
+      return null;
+    }
+    if (crc32(data) !== chunkCrc) {
+      logger.warn('Binary snapshot chunk CRC mismatch', { tenantId, macAddress, id, seq });
+      return null;
+    }
+
+    const key = this.key(tenantId, macAddress, id);
+    const entry = this.getOrCreate(key, total);
+    if (total !== entry.total) {
+      logger.warn('Binary snapshot chunk count mismatch', { tenantId, macAddress, id, total, expected: entry.total });
+      return null;
+    }
+    // Copy: the MQTT client may reuse the payload buffer
+    entry.parts.set(seq, Buffer.from(data));
+    return this.tryComplete(key, tenantId, macAddress, entry);
+  }
+
+  private tryComplete(key: string, tenantId: string, macAddress: string, entry: PendingSnapshot): AssembledSnapshot | null {
+    if (!entry.meta || entry.parts.size < entry.total) return null;
+    this.pending.delete(key);
+
+    const ordered: Buffer[] = [];
+    for (let seq = 0; seq < entry.total; seq++) {
+      const part = entry.parts.get(seq);
+      if (!part) return null;
+      ordered.push(part);
+    }
+    const image = Buffer.concat(ordered);
+
+    if (image.length !== entry.meta.size || crc32(image) !== entry.meta.crc32 >>> 0) {
+      logger.warn('Binary snapshot failed verification', {
+        tenantId,
+        macAddress,
+        id: entry.meta.id,
+        size: image.length,
+        expectedSize: entry.meta.size,
+      });
+      return null;
+    }
+
+    return { tenantId, macAddress, meta: entry.meta, image };
+  }
+}
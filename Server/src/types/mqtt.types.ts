@@ -215,7 +215,7 @@ export interface MqttServiceEvents {
  * Parsed MQTT topic components
  */
 export interface ParsedTopic {
-  type: 'device_status' | 'ota_progress' | 'firmware_update' | 'filesystem_update' | 'device_command' | 'camera_snapshot' | 'device_alert' | 'alert_cleared' | 'rotation_ack' | 'motion_event' | 'unknown';
+  type: 'device_status' | 'ota_progress' | 'firmware_update' | 'filesystem_update' | 'device_command' | 'camera_snapshot' | 'camera_snapshot_meta' | 'camera_snapshot_chunk' | 'device_alert' | 'alert_cleared' | 'rotation_ack' | 'motion_event' | 'unknown';
   tenantId?: string;
   macAddress?: string;
   commandType?: string;
@@ -0,0 +1,16 @@
+// b64_util.h
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include "mbedtls/base64.h"
+
+/*  Base64 helpers on top of mbedtls (kept for legacy callers; the tunnel
+    encodes straight into its frame buffer instead). Host-buildable for
+    bench/ against the host shim.                                           */
+
+static String b64Enc(const uint8_t* data,size_t n){ size_t cap=4*((n+2)/3)+1, out=0; std::unique_ptr<unsigned char[]>buf(new unsigned char[cap]); if(mbedtls_base64_encode(buf.get(),cap,&out,data,n)!=0)return String(); buf[ out ]=0; return String((char*)buf.get());}
+static bool   b64Dec(const String&s,std::unique_ptr<uint8_t[]>&out,size_t&n){ size_t cap=(s.length()*3)/4+3; out.reset(new uint8_t[cap]); size_t got=0; int rc=mbedtls_base64_decode(out.get(),cap,&got,(const unsigned char*)s.c_str(),s.length()); if(rc!=0)return false; n=got; return true; }
+
+// If your project already has b64Enc / b64Dec, provide aliases used by newer code
+static inline String b64Encode(const uint8_t* p, size_t n) { return b64Enc(p, n); }
+static inline bool   b64Decode(const String& in, std::unique_ptr<uint8_t[]>& out, size_t& outLen) { return b64Dec(in, out, outLen); }
@@ -0,0 +1,298 @@
+// Host benchmark for the firmware's hot kernels: `make bench`.
+//
+//   build/bench [-v] [--frames DIR]
+//
+// Prints the same "bench ..." / "check ..." lines as a TRAP_BENCH=1 boot on
+// the device and exits 1 if any check failed. --frames replays a recorded sequence of binary PGM (P5)
+// grayscale frames, in file-name order, through the scout's
+// MotionDetector; without it a synthetic 320x240 sequence is used.
+
+#define BENCH_HOST
+#include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <vector>
+
+#include "../bench_kernels.h"
+#include "../capture_catalog.h"
+#include "../../scout_arduino/motion_detect.h"
+
+bool g_benchVerbose = false;
+HostSerial Serial;
+HostLittleFS LittleFS;
+
+// ---- allocation counting (allocs/op) ----
+static std::atomic<uint64_t> g_allocs{0};
+void benchCountAlloc() { g_allocs++; }
+uint64_t benchAllocCount() { return g_allocs; }
+
+// Every replaceable form goes through these two, so each new/delete pair
+// ends in one malloc/free pair.
+static void *benchNew(size_t n, size_t align = 0) {
+  g_allocs++;
+  if (!n) n = 1;
+  void *p = align > alignof(std::max_align_t) ? aligned_alloc(align, (n + align - 1) / align * align) : malloc(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+static void benchDelete(void *p) noexcept { free(p); }
+
+void *operator new(size_t n) { return benchNew(n); }
+void *operator new[](size_t n) { return benchNew(n); }
+void *operator new(size_t n, std::align_val_t a) { return benchNew(n, (size_t)a); }
+void *operator new[](size_t n, std::align_val_t a) { return benchNew(n, (size_t)a); }
+void operator delete(void *p) noexcept { benchDelete(p); }
+void operator delete[](void *p) noexcept { benchDelete(p); }
+void operator delete(void *p, size_t) noexcept { benchDelete(p); }
+void operator delete[](void *p, size_t) noexcept { benchDelete(p); }
+void operator delete(void *p, std::align_val_t) noexcept { benchDelete(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { benchDelete(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { benchDelete(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { benchDelete(p); }
+
+static void printLine(const char *line) { puts(line); }
+
+// ---- frame sequences ----
+struct Frame {
+  std::vector<uint8_t> px;
+  uint16_t w, h;
+};
+
+static bool loadPgm(const std::string &path, Frame &f) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int w, h, maxval;
+  if (!(in >> magic >> w >> h >> maxval) || magic != "P5" || maxval > 255) return false;
+  in.get();  // single whitespace before the raster
+  f.w = w;
+  f.h = h;
+  f.px.resize((size_t)w * h);
+  return (bool)in.read((char *)f.px.data(), f.px.size());
+}
+
+static std::vector<Frame> loadFrames(const char *dir) {
+  std::vector<std::string> names;
+  for (auto &e : std::filesystem::directory_iterator(dir))
+    if (e.path().extension() == ".pgm") names.push_back(e.path().string());
+  std::sort(names.begin(), names.end());
+  std::vector<Frame> frames;
+  for (auto &n : names) {
+    Frame f;
+    if (loadPgm(n, f)) frames.push_back(std::move(f));
+    else fprintf(stderr, "skipping %s (not an 8-bit P5 PGM)\n", n.c_str());
+  }
+  return frames;
+}
+
+// Textured still scene with sensor noise; a 40x40 dark object crosses it
+// during frames 40..79.
+#define SYNTH_OBJECT_FIRST 40
+#define SYNTH_OBJECT_LAST 79
+static std::vector<Frame> syntheticFrames() {
+  const uint16_t w = 320, h = 240;
+  std::vector<Frame> frames(120);
+  for (size_t i = 0; i < frames.size(); i++) {
+    Frame &f = frames[i];
+    f.w = w;
+    f.h = h;
+    f.px.resize((size_t)w * h);
+    for (uint16_t y = 0; y < h; y++)
+      for (uint16_t x = 0; x < w; x++)
+        f.px[y * w + x] = (uint8_t)(90 + ((x / 20 + y / 20) & 1) * 40 + (int)(benchRand() % 9) - 4);
+    if (i >= SYNTH_OBJECT_FIRST && i <= SYNTH_OBJECT_LAST) {
+      int ox = 20 + (int)(i - SYNTH_OBJECT_FIRST) * 6, oy = 100;
+      for (int y = oy; y < oy + 40; y++)
+        for (int x = ox; x < ox + 40; x++) f.px[y * w + x] = 25;
+    }
+  }
+  return frames;
+}
+
+// synthetic: expectations are known; recorded frames are only reported
+static void benchMotion(const std::vector<Frame> &frames, bool synthetic) {
+  if (frames.empty()) return;
+  static MotionDetector det;
+  MotionConfig cfg = det.getConfig();
+  cfg.cooldownMs = 0;  // every frame is compared
+  det.setConfig(cfg);
+
+  static const std::vector<Frame> *seq;
+  static size_t next;
+  static uint32_t detected, filtered, stray, diffUs;
+  seq = &frames;
+  next = 0;
+  auto step = [] {
+    size_t i = next++ % seq->size();
+    const Frame &f = (*seq)[i];
+    camera_fb_t fb = {(uint8_t *)f.px.data(), f.px.size(), f.w, f.h, PIXFORMAT_GRAYSCALE};
+    MotionResult r = det.detect(&fb);
+    detected += r.detected;
+    filtered += r.sizeFiltered;
+    // the frame after the object leaves still differs from the one before
+    stray += r.detected && (i < SYNTH_OBJECT_FIRST || i > SYNTH_OBJECT_LAST + 1);
+    diffUs += det.getTiming().diffUs;
+  };
+
+  // one pass for the behaviour check, then timed passes
+  det.reset();
+  det.setConfig(cfg);
+  for (size_t i = 0; i < frames.size(); i++) step();
+  const uint32_t objectFrames = SYNTH_OBJECT_LAST - SYNTH_OBJECT_FIRST + 1;
+  bool ok = !synthetic || (detected >= objectFrames - 1 && stray == 0 && filtered == 0);
+  benchCheck(printLine, ok, "motion/detect frames=%u size=%ux%u detected=%u filtered=%u%s",
+             (unsigned)frames.size(), frames[0].w, frames[0].h, (unsigned)detected, (unsigned)filtered,
+             synthetic ? (stray ? " outside-object" : "") : " (recorded, not judged)");
+
+  char name[48];
+  snprintf(name, sizeof(name), "motion/detect-gray/%ux%u", frames[0].w, frames[0].h);
+  diffUs = 0;
+  next = 0;
+  uint32_t samples = std::min<size_t>(BENCH_MAX_SAMPLES, frames.size() * 2);
+  benchRun(printLine, name, samples, 1, (size_t)frames[0].w * frames[0].h, step);
+  benchPrintf(printLine, "bench motion/detect-gray diffUs(avg)=%.1f (MotionTiming, as the scout's /api/status)",
+              (double)diffUs / (samples + 1));
+
+  // JPEG-size pre-filter on a synthetic size trace: steady scene, one event
+  // at 120..129 (its end shows too, while the average still holds it)
+  static size_t sizes[200];
+  for (int i = 0; i < 200; i++) sizes[i] = 30000 + benchRand() % 600 + (i >= 120 && i < 130 ? 6000 : 0);
+  uint32_t inEvent = 0, outside = 0;
+  det.reset();
+  det.setConfig(cfg);
+  for (int i = 0; i < 200; i++) {
+    camera_fb_t fb = {nullptr, sizes[i], 640, 480, PIXFORMAT_JPEG};
+    bool hit = det.detectFromJpegSize(&fb).detected;
+    if (i >= 120 && i < 136) inEvent += hit;
+    else outside += hit;
+  }
+  benchCheck(printLine, inEvent > 0 && outside == 0, "motion/detectFromJpegSize event=%u outside=%u",
+             (unsigned)inEvent, (unsigned)outside);
+
+  static uint32_t jpegHits;
+  jpegHits = 0;
+  next = 0;
+  benchRun(printLine, "motion/detectFromJpegSize", 200, 16, 0, [] {
+    camera_fb_t fb = {nullptr, sizes[next++ % 200], 640, 480, PIXFORMAT_JPEG};
+    jpegHits += det.detectFromJpegSize(&fb).detected;
+  });
+}
+
+// motionBandRow2() against the per-block kernels it replaces on 2 px blocks
+static void checkBandRow2() {
+  alignas(4) static uint8_t a[84], b[84];
+  bool same = true;
+  for (int round = 0; round < 64 && same; round++) {
+    for (size_t i = 0; i < sizeof(a); i++) {
+      a[i] = (uint8_t)benchRand();
+      b[i] = round & 1 ? (uint8_t)benchRand() : (uint8_t)(a[i] ^ (benchRand() & 7));
+    }
+    uint16_t blocks = 40 + (round & 1);  // even and odd block counts
+    uint32_t sad[41] = {0}, sum[41] = {0};
+    motionBandRow2(a, b, blocks, sad, sum, true);
+    for (uint16_t k = 0; k < blocks; k++)
+      same &= sad[k] == motionSadRow(a + 2 * k, b + 2 * k, 2) && sum[k] == motionSumRow(a + 2 * k, 2);
+  }
+  benchCheck(printLine, same, "motion/bandRow2 matches motionSadRow/motionSumRow");
+}
+
+// Catalog order with every capture prefix mixed in: eviction and listings
+// must follow the stamp in the name, not the prefix.
+static void checkCatalog() {
+  static const char *const byTime[] = {
+      "snap_20250419_151200.jpg", "vid_20250419_1513.mjpg",    "img_20250419_1514_a.jpg",
+      "img_20250419_1514_b.jpg",  "snap_20250419_151430.jpg",  "img_20250420_080000.jpg",
+      "notes.jpg",  // no stamp: sorts by ts (now), so newest
+  };
+  static const int addOrder[] = {5, 2, 0, 6, 4, 1, 3};
+  const size_t n = sizeof(byTime) / sizeof(byTime[0]);
+  catalogLoad("/captures");
+  for (int k : addOrder) catalogAdd(byTime[k], 1000 + k, false);
+  catalogRemove("img_20250419_1514_a.jpg");
+  catalogAdd("img_20250419_1514_a.jpg", 1002, true);  // re-added keeps its slot
+  catalogSetThumb("/captures/img_20250419_1514_b.jpg");
+
+  unsigned wrong = catalogCount() != n;
+  size_t k = 0;
+  catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &e) {
+    wrong += k >= n || strcmp(e.name, byTime[k]) || e.thumb != (k == 3);
+    k++;
+  }, true);
+  wrong += k != n;
+  CatalogEntry e;
+  wrong += !catalogOldest(CAPTURE_IMAGE, e) || strcmp(e.name, byTime[0]);
+  wrong += !catalogOldest(CAPTURE_VIDEO, e) || strcmp(e.name, byTime[1]);
+  CatalogEntry page[2];
+  wrong += catalogPage(1, 2, CAPTURE_ANY, page) != 2 || strcmp(page[0].name, byTime[5]) || strcmp(page[1].name, byTime[4]);
+  // hostile paging arguments
+  wrong += catalogArg(-5, 0, CATALOG_MAX) != 0 || catalogArg(-1, 1, 24) != 1 || catalogArg(1L << 40, 1, 24) != 24;
+  k = 0;
+  catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &) { k++; }, false, SIZE_MAX - 3, SIZE_MAX);
+  wrong += k != 0;
+  benchCheck(printLine, wrong == 0, "catalog/order mixed prefixes=%u wrong=%u", (unsigned)n, wrong);
+}
+
+// The device's default compare: VGA decoded to an 80x60 plane, 16 px blocks
+// = 2 plane pixels. The synthetic frames are box-filtered down to match.
+static void benchMotionPlane(const std::vector<Frame> &frames) {
+  if (frames.empty() || frames[0].w < 8 || frames[0].h < 8) return;
+  static std::vector<Frame> planes;
+  planes.clear();
+  for (const Frame &f : frames) {
+    Frame p;
+    p.w = f.w / 4;
+    p.h = f.h / 4;
+    p.px.resize((size_t)p.w * p.h);
+    for (uint16_t y = 0; y < p.h; y++)
+      for (uint16_t x = 0; x < p.w; x++) {
+        unsigned acc = 0;
+        for (int dy = 0; dy < 4; dy++)
+          for (int dx = 0; dx < 4; dx++) acc += f.px[(size_t)(y * 4 + dy) * f.w + x * 4 + dx];
+        p.px[(size_t)y * p.w + x] = (uint8_t)(acc / 16);
+      }
+    planes.push_back(std::move(p));
+  }
+
+  static MotionDetector det;
+  MotionConfig cfg = det.getConfig();
+  cfg.cooldownMs = 0;
+  cfg.blockSize = 2;  // grayscale frames compare at scale 1
+  det.setConfig(cfg);
+  static size_t next;
+  next = 0;
+  char name[48];
+  snprintf(name, sizeof(name), "motion/compare-2px/%ux%u", planes[0].w, planes[0].h);
+  benchRun(printLine, name, std::min<size_t>(BENCH_MAX_SAMPLES, planes.size() * 2), 1,
+           (size_t)planes[0].w * planes[0].h, [] {
+             const Frame &f = planes[next++ % planes.size()];
+             camera_fb_t fb = {(uint8_t *)f.px.data(), f.px.size(), f.w, f.h, PIXFORMAT_GRAYSCALE};
+             det.detect(&fb);
+           });
+}
+
+int main(int argc, char **argv) {
+  const char *framesDir = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-v")) g_benchVerbose = true;
+    else if (!strcmp(argv[i], "--frames") && i + 1 < argc) framesDir = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [-v] [--frames DIR]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  benchTrapKernels(printLine, "*");
+  checkCatalog();
+  std::vector<Frame> frames = framesDir ? loadFrames(framesDir) : syntheticFrames();
+  benchMotion(frames, !framesDir);
+  checkBandRow2();
+  benchMotionPlane(frames);
+  if (g_benchFailures) {
+    fprintf(stderr, "%u check(s) failed\n", (unsigned)g_benchFailures);
+    return 1;
+  }
+  return 0;
+}
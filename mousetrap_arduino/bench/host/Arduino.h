@@ -0,0 +1,89 @@
+// Host stand-in for the parts of Arduino.h the benchmarked headers use.
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <math.h>  // global float abs(), as on the target
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <strings.h>
+#include <thread>
+
+using std::max;
+using std::min;
+
+#define IRAM_ATTR
+#define PROGMEM
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
+
+// glibc before 2.38 has no strlcpy (macOS and newlib do)
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+static inline size_t strlcpy(char *dst, const char *src, size_t cap) {
+  size_t n = strlen(src);
+  if (cap) {
+    size_t k = n < cap - 1 ? n : cap - 1;
+    memcpy(dst, src, k);
+    dst[k] = '\0';
+  }
+  return n;
+}
+#endif
+
+// FreeRTOS mutexes (Arduino.h pulls them in on the target); the bench is
+// single-threaded, so take/give always succeed
+typedef void *SemaphoreHandle_t;
+#define portMAX_DELAY 0xffffffffu
+static inline SemaphoreHandle_t xSemaphoreCreateMutex() { static int m; return &m; }
+static inline int xSemaphoreTake(SemaphoreHandle_t, uint32_t) { return 1; }
+static inline int xSemaphoreGive(SemaphoreHandle_t) { return 1; }
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+static inline uint32_t benchHostUs() {
+  using namespace std::chrono;
+  static const auto t0 = steady_clock::now();
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
+static inline uint32_t micros() { return benchHostUs(); }
+static inline uint32_t millis() { return benchHostUs() / 1000; }
+static inline void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// Just enough of Arduino's String (heap-backed, like the real one)
+class String {
+public:
+  String(const char *s = "") : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  const char *c_str() const { return s_.c_str(); }
+  size_t length() const { return s_.size(); }
+  bool reserve(size_t n) { s_.reserve(n); return true; }
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *o) { s_ += o; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  bool operator==(const char *o) const { return s_ == o; }
+  char operator[](size_t i) const { return s_[i]; }
+
+private:
+  std::string s_;
+};
+
+// Serial output from the kernels; off unless the bench runs with -v
+extern bool g_benchVerbose;
+struct HostSerial {
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (!g_benchVerbose) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  void println(const char *s) { if (g_benchVerbose) puts(s); }
+  void println(const String &s) { println(s.c_str()); }
+};
+extern HostSerial Serial;
@@ -0,0 +1,20 @@
+// Host stand-in for LittleFS.h: an empty filesystem, so headers that list a
+// directory at load time (capture_catalog.h) compile and find nothing.
+#pragma once
+#include <Arduino.h>
+
+class File {
+public:
+  explicit operator bool() const { return false; }
+  bool isDirectory() const { return false; }
+  File openNextFile() { return File(); }
+  const char *name() const { return ""; }
+  size_t size() const { return 0; }
+  time_t getLastWrite() { return 0; }
+  void close() {}
+};
+
+struct HostLittleFS {
+  File open(const char *, const char *) { return File(); }
+};
+extern HostLittleFS LittleFS;
@@ -0,0 +1,18 @@
+// Host stand-in for esp_heap_caps.h: plain malloc, counted for allocs/op.
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void benchCountAlloc();  // bench_host.cpp
+
+static inline void *heap_caps_malloc(size_t n, uint32_t) { benchCountAlloc(); return malloc(n); }
+static inline void *heap_caps_calloc(size_t c, size_t n, uint32_t) { benchCountAlloc(); return calloc(c, n); }
+static inline void *heap_caps_aligned_alloc(size_t a, size_t n, uint32_t) {
+  benchCountAlloc();
+  return aligned_alloc(a, (n + a - 1) / a * a);
+}
+static inline void heap_caps_free(void *p) { free(p); }
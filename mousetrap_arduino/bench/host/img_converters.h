@@ -0,0 +1,14 @@
+// Host stand-in for img_converters.h. There is no ROM JPEG decoder on the
+// host, so esp_jpg_decode() always fails and JPEG frames take the
+// detector's JPEG-size fallback; use grayscale (PGM) frames for the
+// block-compare path.
+#pragma once
+#include "esp_camera.h"
+
+typedef enum { JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X } jpg_scale_t;
+typedef size_t (*jpg_reader_cb)(void *arg, size_t index, uint8_t *buf, size_t len);
+typedef bool (*jpg_writer_cb)(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
+
+static inline esp_err_t esp_jpg_decode(size_t, jpg_scale_t, jpg_reader_cb, jpg_writer_cb, void *) {
+  return ESP_FAIL;
+}
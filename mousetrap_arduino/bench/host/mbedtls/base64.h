@@ -0,0 +1,68 @@
+// Host stand-in for mbedtls/base64.h (same API and error codes). The
+// algorithm is a plain table encoder, not the ROM one - compare base64
+// speed on the target; on the host, b64Enc's allocation pattern is what
+// shows.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+#define MBEDTLS_ERR_BASE64_INVALID_CHARACTER -0x002C
+
+static inline int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                                        const unsigned char *src, size_t slen) {
+  static const char t[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t need = 4 * ((slen + 2) / 3);
+  if (dlen < need + 1) {
+    *olen = need + 1;
+    return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+  }
+  unsigned char *o = dst;
+  size_t i = 0;
+  for (; i + 2 < slen; i += 3) {
+    uint32_t v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+    *o++ = t[v >> 18];
+    *o++ = t[(v >> 12) & 63];
+    *o++ = t[(v >> 6) & 63];
+    *o++ = t[v & 63];
+  }
+  if (i < slen) {
+    uint32_t v = src[i] << 16 | (i + 1 < slen ? src[i + 1] << 8 : 0);
+    *o++ = t[v >> 18];
+    *o++ = t[(v >> 12) & 63];
+    *o++ = i + 1 < slen ? t[(v >> 6) & 63] : '=';
+    *o++ = '=';
+  }
+  *o = 0;
+  *olen = o - dst;
+  return 0;
+}
+
+static inline int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen,
+                                        const unsigned char *src, size_t slen) {
+  auto val = [](unsigned char c) -> int {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+  };
+  size_t n = 0;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < slen; i++) {
+    if (src[i] == '=') break;
+    int v = val(src[i]);
+    if (v < 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (n >= dlen) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+      dst[n++] = (acc >> bits) & 0xFF;
+    }
+  }
+  *olen = n;
+  return 0;
+}
@@ -0,0 +1,165 @@
+// bench_kernels.h
+#pragma once
+#include <Arduino.h>
+#include "bench_stats.h"
+#include "b64_util.h"
+#include "ip_allowlist.h"
+#include "log_format.h"
+#include "light_heuristics.h"
+#include "http_range.h"
+
+/*  Trap-side hot kernels under bench_stats.h: base64, the IP allowlist, log
+    line formatting into the RAM ring, and the flash/no-flash decision over a
+    synthetic day of JPEG sizes. `check` lines compare known answers and
+    decision counts against expectations (a naive reference matcher, fixed
+    strings, the shape of the day), so a change that alters behaviour fails
+    even when it only looks like a speed change.
+    Pure helpers with no timing worth measuring (Range header parsing) get
+    a table of check cases only.
+
+    restoreAllowlist: the allowlist bench compiles its own rules into the
+    live list; the device passes ipWhitelist so it is put back afterwards.   */
+
+#define BENCH_LOG_SLOTS 64
+#define BENCH_LOG_SLOT_BYTES 160  // SYSLOG_SLOT_BYTES
+
+static volatile uint32_t g_benchSink;  // keeps results alive
+
+static void benchTrapKernels(BenchPrintFn out, const char *restoreAllowlist) {
+  // ---- base64 ----
+  static uint8_t blob[16384];
+  for (size_t i = 0; i < sizeof(blob); i++) blob[i] = (uint8_t)benchRand();
+  benchRun(out, "b64Enc/2K", 200, 4, 2048, [] { g_benchSink += b64Enc(blob, 2048).length(); });
+  benchRun(out, "b64Enc/16K", 100, 1, 16384, [] { g_benchSink += b64Enc(blob, 16384).length(); });
+  {
+    bool known = b64Enc((const uint8_t *)"foobar", 6) == "Zm9vYmFy" && b64Enc((const uint8_t *)"fo", 2) == "Zm8=";
+    std::unique_ptr<uint8_t[]> back;
+    size_t n = 0;
+    bool round = b64Dec(b64Enc(blob, 2048), back, n) && n == 2048 && !memcmp(back.get(), blob, n);
+    benchCheck(out, known && round, "b64 known=%u roundtrip/2K=%u", known, round);
+  }
+
+  // ---- IP allowlist: 16 mixed-prefix rules, mostly-miss traffic ----
+  static const char spec[] = "192.168.1.0/24, 10.0.0.0/8, 172.16.5.7, 172.16.6.0/23, 100.64.0.0/10,"
+                             "192.168.77.10, 192.168.77.11, 192.168.77.12, 203.0.113.0/24,"
+                             "198.51.100.0/25, 198.51.100.200, 169.254.0.0/16, 8.8.8.8,"
+                             "1.1.1.0/30, 192.0.2.64/26, 127.0.0.1";
+  ipAllowlistCompile(spec);
+  IpRule ref[IPLIST_MAX];  // same entries, matched by a plain linear scan
+  size_t refCount = 0;
+  for (const char *p = spec; *p;) {
+    const char *end = strchr(p, ',');
+    if (!end) end = p + strlen(p);
+    while (*p == ' ') p++;
+    if (refCount < IPLIST_MAX && ipParseRule(p, end, ref[refCount])) refCount++;
+    p = *end ? end + 1 : end;
+  }
+  auto refMatch = [&](uint32_t ip) {
+    for (size_t r = 0; r < refCount; r++)
+      if ((ip & ref[r].mask) == ref[r].net) return true;
+    return false;
+  };
+  static uint32_t ips[256];
+  for (uint32_t &ip : ips) ip = (benchRand() << 8) ^ benchRand();
+  // edges of a few rules, so the check does not rest on random misses
+  const uint32_t edges[] = {0xC0A80100, 0xC0A801FF, 0xC0A80200, 0xAC100507, 0xAC100508, 0xAC1005FF,
+                            0xAC100600, 0xAC1007FF, 0xAC100800, 0x01010103, 0x01010104, 0x7F000001};
+  for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) ips[i] = edges[i];
+  uint32_t hits = 0, refHits = 0;
+  for (uint32_t ip : ips) {
+    hits += ipAllowlistMatch(ip);
+    refHits += refMatch(ip);
+  }
+  benchRun(out, "ipAllowlistMatch/16", 200, 256, 0, [] {
+    static uint8_t i = 0;
+    g_benchSink += ipAllowlistMatch(ips[i++]);
+  });
+  benchCheck(out, ipAllowlistSize() == 16 && hits == refHits, "ipAllowlistMatch/16 rules=%u hits=%u/256 reference=%u",
+             (unsigned)ipAllowlistSize(), (unsigned)hits, (unsigned)refHits);
+  ipAllowlistCompile(restoreAllowlist);
+
+  // ---- Range header parsing (download / clip seeking) ----
+  {
+    static const struct {
+      const char *hdr;
+      size_t size;
+      HttpRangeResult want;
+      size_t start, end;
+    } cases[] = {
+      {"bytes=-500", 1000, HTTP_RANGE_OK, 500, 999},  // suffix: last 500 bytes
+      {"bytes=-5000", 1000, HTTP_RANGE_OK, 0, 999},
+      {"bytes=0-99", 1000, HTTP_RANGE_OK, 0, 99},
+      {"bytes=900-", 1000, HTTP_RANGE_OK, 900, 999},
+      {"bytes=990-2000", 1000, HTTP_RANGE_OK, 990, 999},
+      {"bytes=1000-", 1000, HTTP_RANGE_BAD, 0, 0},
+      {"bytes=-0", 1000, HTTP_RANGE_BAD, 0, 0},
+      {"bytes=-500", 0, HTTP_RANGE_BAD, 0, 0},
+      {"bytes=5-2", 1000, HTTP_RANGE_NONE, 0, 0},
+      {"bytes=0-1,5-6", 1000, HTTP_RANGE_NONE, 0, 0},
+      {"bytes=-", 1000, HTTP_RANGE_NONE, 0, 0},
+      {"bytes=x-5", 1000, HTTP_RANGE_NONE, 0, 0},
+      {"items=0-5", 1000, HTTP_RANGE_NONE, 0, 0},
+    };
+    unsigned bad = 0;
+    const size_t n = sizeof(cases) / sizeof(cases[0]);
+    for (size_t i = 0; i < n; i++) {
+      size_t a, b;
+      HttpRangeResult r = httpParseRange(cases[i].hdr, cases[i].size, a, b);
+      bool ok = r == cases[i].want && (r != HTTP_RANGE_OK || (a == cases[i].start && b == cases[i].end));
+      if (!ok) benchPrintf(out, "  range \"%s\" size=%u -> %u %u-%u", cases[i].hdr, (unsigned)cases[i].size,
+                           (unsigned)r, (unsigned)a, (unsigned)b);
+      bad += !ok;
+    }
+    benchCheck(out, bad == 0, "httpParseRange cases=%u wrong=%u", (unsigned)n, bad);
+  }
+
+  // ---- log line: pieces + printf, copied into a ring slot ----
+  static char ring[BENCH_LOG_SLOTS][BENCH_LOG_SLOT_BYTES];
+  benchRun(out, "logLine/pieces", 200, 32, 0, [] {
+    static uint32_t n = 0;
+    LogLine l;
+    logPutAll(l, "Heartbeat POST rc=", (int)(n & 0x1FF), " in ", (unsigned long)n * 7, " ms, rssi=", -61.5f);
+    strlcpy(ring[n++ % BENCH_LOG_SLOTS], l.buf, BENCH_LOG_SLOT_BYTES);
+  });
+  benchRun(out, "logLine/printf", 200, 32, 0, [] {
+    static uint32_t n = 0;
+    LogLine l;
+    l.putf("Light probe: %u B vs %u -> %s (ae=%u)", (unsigned)n, 28000u, (n & 1) ? "flash" : "no flash", (unsigned)n * 3);
+    strlcpy(ring[n++ % BENCH_LOG_SLOTS], l.buf, BENCH_LOG_SLOT_BYTES);
+  });
+  {
+    LogLine l;
+    logPutAll(l, "Heartbeat POST rc=", 200, " in ", 35ul, " ms, rssi=", -61.5f, " ", logHex(0xBEEF));
+    benchCheck(out, !strcmp(l.buf, "Heartbeat POST rc=200 in 35 ms, rssi=-61.50 beef"), "logLine/pieces \"%s\"", l.buf);
+  }
+
+  // ---- flash decision over one synthetic day (one probe a minute, SVGA) ----
+  static uint16_t sizes[1440];  // JPEG bytes / 4
+  for (int m = 0; m < 1440; m++) {
+    float daylight = 0.5f - 0.5f * cosf((m - 120) * 2 * (float)M_PI / 1440);  // dark ~02:00
+    int base = 9000 + (int)(31000 * daylight);
+    int noise = (int)(benchRand() % 6001) - 3000;
+    sizes[m] = (uint16_t)((base + noise) / 4);
+  }
+  const size_t threshold = jpegDarkThreshold(800, 600) - 12000;  // as grabAutoLitJpeg
+  benchRun(out, "light/decide", 100, 1440, 0, [threshold] {
+    static int m = 0;
+    static bool have = false, dark = false;
+    dark = lightProbeIsDark((size_t)sizes[m] * 4, threshold, have, dark);
+    have = true;
+    if (++m == 1440) m = 0;
+    g_benchSink += dark;
+  });
+  unsigned flips = 0, flashMin = 0;
+  bool have = false, dark = false;
+  for (int m = 0; m < 1440; m++) {
+    bool d = lightProbeIsDark((size_t)sizes[m] * 4, threshold, have, dark);
+    flips += have && d != dark;
+    flashMin += d;
+    have = true;
+    dark = d;
+  }
+  // one dusk and one dawn: the hysteresis has to absorb the noise
+  benchCheck(out, flips == 2 && flashMin > 600 && flashMin < 1000, "light/decide threshold=%u flips=%u flash=%u/1440",
+             (unsigned)threshold, flips, flashMin);
+}
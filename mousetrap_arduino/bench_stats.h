@@ -0,0 +1,109 @@
+// bench_stats.h
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+/*  Micro-benchmark harness shared by the host bench (bench/, `make bench`)
+    and the on-device run (TRAP_BENCH=1), so both print the same lines:
+
+      bench b64Enc/2K n=200 p50=4210ns p99=5120ns ops/s=236406 MB/s=484.2 allocs/op=2.0
+
+    Each sample times `batch` calls and stores the per-call average, so
+    p50/p99 are over batches; pick batch so one sample is >= ~20 us on the
+    target (micro-second timer). allocs/op is counted on the host only.
+
+    benchCheck() prints a "check" line with its verdict and counts failures;
+    `make bench` exits non-zero if any check failed:
+
+      check ipAllowlistMatch/16 rules=16 hits=9/256 reference=9 ok         */
+
+#define BENCH_MAX_SAMPLES 256
+
+typedef void (*BenchPrintFn)(const char *line);
+
+#ifdef BENCH_HOST
+#include <chrono>
+static inline uint64_t benchNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+uint64_t benchAllocCount();  // bench_host.cpp: operator new + heap_caps_malloc
+#else
+#include "esp_timer.h"
+static inline uint64_t benchNowNs() { return (uint64_t)esp_timer_get_time() * 1000ULL; }
+static inline uint64_t benchAllocCount() { return 0; }
+#endif
+
+// Deterministic input data: same sequence on host and target
+static uint32_t g_benchSeed = 12345;
+static inline uint32_t benchRand() {
+  g_benchSeed = g_benchSeed * 1664525u + 1013904223u;
+  return g_benchSeed >> 8;
+}
+
+static int benchCmpFloat(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void benchPrintf(BenchPrintFn out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void benchPrintf(BenchPrintFn out, const char *fmt, ...) {
+  char line[192];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  out(line);
+}
+
+static uint32_t g_benchFailures = 0;
+
+// "check <fmt> ok" or "check <fmt> FAIL"; ok is the expectation for the line
+static void benchCheck(BenchPrintFn out, bool ok, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+static void benchCheck(BenchPrintFn out, bool ok, const char *fmt, ...) {
+  char line[176];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (!ok) g_benchFailures++;
+  benchPrintf(out, "check %s %s", line, ok ? "ok" : "FAIL");
+}
+
+// Runs fn() samples × batch times. bytesPerOp (0 = none) adds MB/s.
+template <typename Fn>
+static void benchRun(BenchPrintFn out, const char *name, uint32_t samples, uint32_t batch,
+                     size_t bytesPerOp, Fn fn) {
+  static float ns[BENCH_MAX_SAMPLES];
+  if (samples > BENCH_MAX_SAMPLES) samples = BENCH_MAX_SAMPLES;
+  if (!samples || !batch) return;
+
+  fn();  // warm caches and lazy allocations outside the measurement
+  uint64_t allocs0 = benchAllocCount();
+  uint64_t total = 0;
+  for (uint32_t s = 0; s < samples; s++) {
+    uint64_t t0 = benchNowNs();
+    for (uint32_t b = 0; b < batch; b++) fn();
+    uint64_t dt = benchNowNs() - t0;
+    total += dt;
+    ns[s] = (float)dt / batch;
+  }
+  uint64_t allocs = benchAllocCount() - allocs0;
+  qsort(ns, samples, sizeof(float), benchCmpFloat);
+
+  const double ops = (double)samples * batch;
+  const double opsPerSec = total ? ops * 1e9 / total : 0;
+  char extra[48] = "";
+  if (bytesPerOp) snprintf(extra, sizeof(extra), " MB/s=%.1f", opsPerSec * bytesPerOp / 1e6);
+#ifdef BENCH_HOST
+  char alloc[32];
+  snprintf(alloc, sizeof(alloc), "%.1f", allocs / ops);
+#else
+  const char *alloc = "-";
+  (void)allocs;
+#endif
+  benchPrintf(out, "bench %s n=%u p50=%.0fns p99=%.0fns ops/s=%.0f%s allocs/op=%s", name,
+              (unsigned)samples, ns[samples / 2], ns[(samples * 99) / 100], opsPerSec, extra, alloc);
+}
@@ -42,6 +42,16 @@ mkdir -p "$STAGING_DIR/app"
 # Copy dist files to staging/app/
 cp -r "$DIST_DIR"/* "$STAGING_DIR/app/"
 
+# Pre-compress text assets; the firmware sends name.gz with Content-Encoding
+# when the browser accepts gzip (originals stay for the MQTT tunnel / curl)
+echo "Compressing SPA assets..."
+find "$STAGING_DIR/app" -type f \( -name '*.js' -o -name '*.css' -o -name '*.html' -o -name '*.svg' \) |
+while read -r f; do
+    gzip -9 -n -k -f "$f"
+    # keep the .gz only when it actually saves space
+    if [ "$(wc -c < "$f.gz")" -ge "$(wc -c < "$f")" ]; then rm -f "$f.gz"; fi
+done
+
 # Copy version.json to root of staging (firmware reads from /version.json)
 cp "$DIST_DIR/version.json" "$STAGING_DIR/version.json"
 
@@ -0,0 +1,315 @@
+// capture_catalog.h
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "esp_heap_caps.h"
+
+/*  In-RAM index of CAPTURE_DIR.
+
+    catalogLoad() walks the directory once at boot; after that every writer
+    calls catalogAdd() and every delete catalogRemove(), so listings, paging
+    and FIFO eviction never touch the directory again. Entries sit in one
+    PSRAM array kept in capture-time order, entry 0 the oldest. The time
+    comes from the "YYYYmmdd_HHMM[SS]" stamp in the name, not the name
+    itself: img_, snap_ and vid_ files interleave by time rather than by
+    prefix, and the order survives a reboot even where mtimes don't. Names
+    without a stamp fall back to ts; equal times sort by name. All calls
+    are thread-safe (one mutex).                                            */
+
+#define CATALOG_MAX 2048  // ~100 KB PSRAM; far more than the partition holds
+#define CATALOG_NAME 40
+#define CATALOG_THUMB_EXT ".thm"  // "<capture>.thm" thumbnail sidecar
+
+enum : uint8_t {
+  CAPTURE_IMAGE = 1,
+  CAPTURE_VIDEO = 2,
+  CAPTURE_ANY = CAPTURE_IMAGE | CAPTURE_VIDEO,
+};
+
+struct CatalogEntry {
+  char name[CATALOG_NAME];  // basename, e.g. "img_20250419_1513_a.jpg"
+  uint32_t size;
+  uint32_t ts;              // capture time (file mtime for entries found at boot)
+  uint32_t order;           // sort key: local capture time, seconds since 2000
+  uint8_t kind;             // CAPTURE_IMAGE / CAPTURE_VIDEO
+  bool flash;               // 1 W LED was used (unknown → false for boot entries)
+  bool thumb;               // "<name>.thm" exists
+};
+
+static CatalogEntry *g_catalog = nullptr;
+static size_t g_catalogCount = 0;
+static uint64_t g_catalogBytes = 0;
+static SemaphoreHandle_t g_catalogMux = nullptr;
+
+static inline void catalogLock() { xSemaphoreTake(g_catalogMux, portMAX_DELAY); }
+static inline void catalogUnlock() { xSemaphoreGive(g_catalogMux); }
+
+static inline const char *catalogBase(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+// 0 = not a catalogued capture (sidecars, locks, unknown types)
+static uint8_t catalogKindOf(const char *name) {
+  const char *dot = strrchr(name, '.');
+  if (!dot) return 0;
+  if (!strcasecmp(dot, ".jpg") || !strcasecmp(dot, ".jpeg") || !strcasecmp(dot, ".png")) return CAPTURE_IMAGE;
+  if (!strcasecmp(dot, ".mjpg") || !strcasecmp(dot, ".mjpeg")) return CAPTURE_VIDEO;
+  return 0;
+}
+
+// Local wall-clock time as seconds since 2000-01-01 (no time zone applied,
+// so keys from names and from localtime() agree)
+static uint32_t catalogCivilKey(int y, int mon, int d, int h, int m, int s) {
+  y -= mon <= 2;  // days-from-civil, March-based year
+  int era = y / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long days = era * 146097L + yoe * 365 + yoe / 4 - yoe / 100 + doy - 730425;  // day 0 = 2000-01-01
+  if (days < 0) return 0;
+  return (uint32_t)(days * 86400 + h * 3600 + m * 60 + s);
+}
+
+static bool catalogDigits(const char *p, int n, int &out) {
+  out = 0;
+  for (int i = 0; i < n; i++) {
+    if (p[i] < '0' || p[i] > '9') return false;
+    out = out * 10 + (p[i] - '0');
+  }
+  return true;
+}
+
+// Sort key from the "YYYYmmdd_HHMM" or "YYYYmmdd_HHMMSS" stamp in a name;
+// false if the name carries none
+static bool catalogNameKey(const char *name, uint32_t &key) {
+  for (const char *p = name; *p; p++) {
+    int ymd, hm, sec = 0;
+    if (!catalogDigits(p, 8, ymd) || p[8] != '_' || !catalogDigits(p + 9, 4, hm)) continue;
+    if (catalogDigits(p + 13, 2, sec)) {
+      if (p[15] >= '0' && p[15] <= '9') continue;  // longer digit run, not a stamp
+    } else if (p[13] >= '0' && p[13] <= '9') {
+      continue;
+    }
+    key = catalogCivilKey(ymd / 10000, ymd / 100 % 100, ymd % 100, hm / 100, hm % 100, sec);
+    return true;
+  }
+  return false;
+}
+
+static uint32_t catalogKeyOf(const char *name, uint32_t ts) {
+  uint32_t key;
+  if (catalogNameKey(name, key)) return key;
+  if (!ts) return 0;
+  time_t t = ts;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  return catalogCivilKey(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+// first index not ordered before (key, name) (caller holds the lock)
+static size_t catalogLowerBound(uint32_t key, const char *name) {
+  size_t lo = 0, hi = g_catalogCount;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    const CatalogEntry &e = g_catalog[mid];
+    if (e.order < key || (e.order == key && strcmp(e.name, name) < 0)) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// index of name, or g_catalogCount if absent (caller holds the lock)
+static size_t catalogFindLocked(const char *name) {
+  uint32_t key;
+  if (catalogNameKey(name, key)) {
+    size_t i = catalogLowerBound(key, name);
+    return i < g_catalogCount && strcmp(g_catalog[i].name, name) == 0 ? i : g_catalogCount;
+  }
+  for (size_t i = 0; i < g_catalogCount; i++) {  // key came from ts; rare
+    if (strcmp(g_catalog[i].name, name) == 0) return i;
+  }
+  return g_catalogCount;
+}
+
+// caller holds the lock
+static void catalogEraseLocked(size_t i) {
+  g_catalogBytes -= g_catalog[i].size;
+  memmove(&g_catalog[i], &g_catalog[i + 1], (g_catalogCount - i - 1) * sizeof(CatalogEntry));
+  g_catalogCount--;
+}
+
+// caller holds the lock
+static void catalogInsertLocked(const char *name, uint32_t size, uint32_t ts, uint8_t kind, bool flash) {
+  size_t i = catalogFindLocked(name);
+  if (i < g_catalogCount) catalogEraseLocked(i);  // overwritten (same-minute name)
+  if (g_catalogCount == CATALOG_MAX) return;
+  uint32_t key = catalogKeyOf(name, ts);
+  i = catalogLowerBound(key, name);
+  memmove(&g_catalog[i + 1], &g_catalog[i], (g_catalogCount - i) * sizeof(CatalogEntry));
+  g_catalogCount++;
+  CatalogEntry &e = g_catalog[i];
+  strlcpy(e.name, name, sizeof(e.name));
+  e.size = size;
+  e.ts = ts;
+  e.order = key;
+  e.kind = kind;
+  e.flash = flash;
+  e.thumb = false;
+  g_catalogBytes += size;
+}
+
+static inline bool catalogIsThumb(const char *name) {
+  size_t n = strlen(name), x = sizeof(CATALOG_THUMB_EXT) - 1;
+  return n > x && !strcasecmp(name + n - x, CATALOG_THUMB_EXT);
+}
+
+// caller holds the lock; false if the capture is not (yet) catalogued
+static bool catalogMarkThumbLocked(const char *thumbName) {
+  char parent[CATALOG_NAME];
+  size_t n = strlen(thumbName) - (sizeof(CATALOG_THUMB_EXT) - 1);
+  if (n >= sizeof(parent)) return false;
+  memcpy(parent, thumbName, n);
+  parent[n] = '\0';
+  size_t i = catalogFindLocked(parent);
+  if (i < g_catalogCount) {
+    g_catalog[i].thumb = true;
+    return true;
+  }
+  return false;
+}
+
+static bool catalogLoad(const char *dirPath) {
+  if (!g_catalogMux) g_catalogMux = xSemaphoreCreateMutex();
+  if (!g_catalog) {
+    g_catalog = (CatalogEntry *)heap_caps_malloc(CATALOG_MAX * sizeof(CatalogEntry),
+                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!g_catalog) return false;
+  }
+
+  catalogLock();
+  g_catalogCount = 0;
+  g_catalogBytes = 0;
+  // LittleFS lists names in order, so a thumbnail normally follows its
+  // capture; a second pass only runs if one turned up first
+  bool orphans = false;
+  File dir = LittleFS.open(dirPath, "r");
+  while (dir && dir.isDirectory()) {
+    File f = dir.openNextFile();
+    if (!f) break;
+    const char *name = catalogBase(f.name());
+    uint8_t kind = f.isDirectory() ? 0 : catalogKindOf(name);
+    if (kind && strlen(name) < CATALOG_NAME) {
+      catalogInsertLocked(name, f.size(), (uint32_t)f.getLastWrite(), kind, false);
+    }
+    if (!kind && catalogIsThumb(name)) orphans |= !catalogMarkThumbLocked(name);
+    f.close();
+  }
+  if (dir) dir.close();
+
+  if (orphans) {
+    dir = LittleFS.open(dirPath, "r");
+    while (dir && dir.isDirectory()) {
+      File f = dir.openNextFile();
+      if (!f) break;
+      const char *name = catalogBase(f.name());
+      if (catalogIsThumb(name)) catalogMarkThumbLocked(name);
+      f.close();
+    }
+    if (dir) dir.close();
+  }
+  catalogUnlock();
+  return true;
+}
+
+// path may be a full path or a basename
+static void catalogAdd(const char *path, uint32_t size, bool flash) {
+  if (!g_catalog) return;
+  const char *name = catalogBase(path);
+  uint8_t kind = catalogKindOf(name);
+  if (!kind || strlen(name) >= CATALOG_NAME) return;
+  catalogLock();
+  catalogInsertLocked(name, size, (uint32_t)time(nullptr), kind, flash);
+  catalogUnlock();
+}
+
+// Records that "<path>.thm" now exists
+static void catalogSetThumb(const char *path) {
+  if (!g_catalog) return;
+  char thumbName[CATALOG_NAME + sizeof(CATALOG_THUMB_EXT)];
+  snprintf(thumbName, sizeof(thumbName), "%s" CATALOG_THUMB_EXT, catalogBase(path));
+  catalogLock();
+  catalogMarkThumbLocked(thumbName);
+  catalogUnlock();
+}
+
+static void catalogRemove(const char *path) {
+  if (!g_catalog) return;
+  const char *name = catalogBase(path);
+  catalogLock();
+  size_t i = catalogFindLocked(name);
+  if (i < g_catalogCount) catalogEraseLocked(i);
+  catalogUnlock();
+}
+
+static size_t catalogCount(uint8_t kinds = CAPTURE_ANY) {
+  if (!g_catalog) return 0;
+  size_t n = 0;
+  catalogLock();
+  if (kinds == CAPTURE_ANY) {
+    n = g_catalogCount;
+  } else {
+    for (size_t i = 0; i < g_catalogCount; i++) n += (g_catalog[i].kind & kinds) != 0;
+  }
+  catalogUnlock();
+  return n;
+}
+
+// offset/limit query argument (String::toInt() result) clamped to lo..hi, so
+// a negative or huge value can't wrap offset + limit arithmetic
+static size_t catalogArg(long v, size_t lo, size_t hi) {
+  if (v < (long)lo) return lo;
+  return (unsigned long)v > hi ? hi : (size_t)v;
+}
+
+// Copies up to limit entries of the given kinds, skipping the first offset
+// matches; newest first unless oldestFirst. Returns the number copied.
+static size_t catalogPage(size_t offset, size_t limit, uint8_t kinds, CatalogEntry *out,
+                          bool oldestFirst = false) {
+  if (!g_catalog || !limit) return 0;
+  size_t got = 0;
+  catalogLock();
+  for (size_t k = 0; k < g_catalogCount && got < limit; k++) {
+    const CatalogEntry &e = g_catalog[oldestFirst ? k : g_catalogCount - 1 - k];
+    if (!(e.kind & kinds)) continue;
+    if (offset) {
+      offset--;
+      continue;
+    }
+    out[got++] = e;
+  }
+  catalogUnlock();
+  return got;
+}
+
+// Oldest entry of the given kinds, false if none.
+static bool catalogOldest(uint8_t kinds, CatalogEntry &out) {
+  return catalogPage(0, 1, kinds, &out, /*oldestFirst=*/true) == 1;
+}
+
+// Calls fn(const CatalogEntry &) for up to limit entries of the given kinds
+// after skipping offset. Entries are copied out in small batches, so fn runs
+// without the lock held and may print or yield (but should not add/remove).
+template <typename Fn>
+static void catalogForEach(uint8_t kinds, Fn fn, bool oldestFirst = false,
+                           size_t offset = 0, size_t limit = CATALOG_MAX) {
+  CatalogEntry batch[16];
+  if (offset > CATALOG_MAX) return;
+  if (limit > CATALOG_MAX) limit = CATALOG_MAX;
+  while (limit) {
+    size_t got = catalogPage(offset, limit < 16 ? limit : 16, kinds, batch, oldestFirst);
+    for (size_t k = 0; k < got; k++) fn(batch[k]);
+    if (got < 16) break;
+    offset += got;
+    limit -= got;
+  }
+}
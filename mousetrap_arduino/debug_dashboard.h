@@ -308,6 +308,40 @@ const char DEBUG_DASHBOARD_HTML[] PROGMEM = R"rawliteral(
           <span class="stat-label">Free Heap (min)</span>
           <span class="stat-value" id="min-heap">--</span>
         </div>
+        <div class="stat-row">
+          <span class="stat-label">HTTP (req / fail / retry)</span>
+          <span class="stat-value" id="http-counts">--</span>
+        </div>
+        <div class="stat-row">
+          <span class="stat-label">HTTP latency (avg / max)</span>
+          <span class="stat-value" id="http-latency">--</span>
+        </div>
+        <div class="stat-row">
+          <span class="stat-label">NVS (written / unchanged)</span>
+          <span class="stat-value" id="nvs-writes">--</span>
+        </div>
+      </div>
+
+      <!-- Latency probes (perf_probes.h) -->
+      <div class="metric">
+        <h2>⏱️ Latency (p50 / p99 / max)</h2>
+        <div id="perf-probes">
+          <div class="stat-row">
+            <span class="stat-label">No samples yet</span>
+            <span class="stat-value">--</span>
+          </div>
+        </div>
+      </div>
+
+      <!-- Per-task CPU share -->
+      <div class="metric">
+        <h2>🧮 CPU Share</h2>
+        <div id="perf-cpu">
+          <div class="stat-row">
+            <span class="stat-label">Sampling...</span>
+            <span class="stat-value">--</span>
+          </div>
+        </div>
       </div>
 
       <!-- Last Crash Info -->
@@ -372,6 +406,40 @@ const char DEBUG_DASHBOARD_HTML[] PROGMEM = R"rawliteral(
       indicator.className = 'status-indicator ' + (isOnline ? 'online' : 'offline');
     }
 
+    function formatUs(us) {
+      if (us >= 1000000) return (us / 1000000).toFixed(2) + ' s';
+      if (us >= 1000) return (us / 1000).toFixed(1) + ' ms';
+      return us + ' µs';
+    }
+
+    function statRow(label, value, cls) {
+      return `<div class="stat-row"><span class="stat-label">${label}</span>` +
+             `<span class="stat-value ${cls || ''}">${value}</span></div>`;
+    }
+
+    // Latency histograms and per-task CPU share (data.perf)
+    function renderPerf(perf) {
+      if (!perf) return;
+      document.getElementById('perf-probes').innerHTML = perf.probes.map(p =>
+        statRow(`${p.name} <small>(${p.n})</small>`,
+                p.n ? formatUs(p.p50Us) + ' / ' + formatUs(p.p99Us) + ' / ' + formatUs(p.maxUs) : '--')
+      ).join('');
+
+      let cpuHtml;
+      if (!perf.cpu.available) {
+        cpuHtml = statRow('Run-time stats', 'not enabled in this build', 'warn');
+      } else if (!perf.cpu.tasks.length) {
+        cpuHtml = statRow('Sampling...', '--');
+      } else {
+        cpuHtml = perf.cpu.tasks.map(t => {
+          const pct = t.permille / 10;
+          const cls = t.name.startsWith('IDLE') ? '' : getColorClass(pct * 2);
+          return statRow(t.name, pct.toFixed(1) + '%', cls);
+        }).join('') + statRow('Window', (perf.cpu.windowMs / 1000).toFixed(0) + ' s');
+      }
+      document.getElementById('perf-cpu').innerHTML = cpuHtml;
+    }
+
     function updateDashboard() {
       fetch('/api/debug-stats')
         .then(response => response.json())
@@ -406,6 +474,17 @@ const char DEBUG_DASHBOARD_HTML[] PROGMEM = R"rawliteral(
           document.getElementById('cpu-freq').textContent = data.cpuFreq + ' MHz';
           document.getElementById('flash-size').textContent = formatBytes(data.flashSize);
           document.getElementById('min-heap').textContent = formatBytes(data.minFreeHeap);
+          if (data.http) {
+            document.getElementById('http-counts').textContent =
+              data.http.requests + ' / ' + data.http.failures + ' / ' + data.http.retries;
+            document.getElementById('http-latency').textContent =
+              data.http.avgMs + ' / ' + data.http.maxMs + ' ms';
+          }
+          renderPerf(data.perf);
+          if (data.nvs) {
+            document.getElementById('nvs-writes').textContent =
+              data.nvs.writes + ' / ' + data.nvs.unchanged + (data.nvs.failures ? ' (' + data.nvs.failures + ' failed)' : '');
+          }
 
           // Update page title with device name
           const deviceName = data.deviceName || 'MouseTrap';
@@ -582,6 +661,17 @@ ${JSON.stringify(latestData, null, 2)}
           document.getElementById('cpu-freq').textContent = data.cpuFreq + ' MHz';
           document.getElementById('flash-size').textContent = formatBytes(data.flashSize);
           document.getElementById('min-heap').textContent = formatBytes(data.minFreeHeap);
+          if (data.http) {
+            document.getElementById('http-counts').textContent =
+              data.http.requests + ' / ' + data.http.failures + ' / ' + data.http.retries;
+            document.getElementById('http-latency').textContent =
+              data.http.avgMs + ' / ' + data.http.maxMs + ' ms';
+          }
+          renderPerf(data.perf);
+          if (data.nvs) {
+            document.getElementById('nvs-writes').textContent =
+              data.nvs.writes + ' / ' + data.nvs.unchanged + (data.nvs.failures ? ' (' + data.nvs.failures + ' failed)' : '');
+          }
 
           // Update page title with device name
           const deviceName = data.deviceName || 'MouseTrap';
@@ -714,6 +804,37 @@ void handleDebugStatsAPI(AsyncWebServerRequest *request) {
     crash["last_biggest"] = g_crashStamp.last_biggest;
   }
 
+  // Shared HTTP client (http_service.h); copied under its lock so the
+  // 64-bit total and the counters come from the same moment
+  portENTER_CRITICAL(&g_httpStatsMux);
+  HttpStats hs = g_httpStats;
+  portEXIT_CRITICAL(&g_httpStatsMux);
+  JsonObject http = doc["http"].to<JsonObject>();
+  http["requests"] = hs.requests;
+  http["failures"] = hs.failures;
+  http["retries"] = hs.retries;
+  http["reused"] = hs.reused;
+  http["dropped"] = hs.dropped;
+  http["lastCode"] = hs.lastCode;
+  http["lastMs"] = hs.lastMs;
+  http["maxMs"] = hs.maxMs;
+  http["avgMs"] = hs.requests ? (uint32_t)(hs.totalMs / hs.requests) : 0;
+
+  // Coalesced NVS writes (nvs_store.h)
+  JsonObject nvs = doc["nvs"].to<JsonObject>();
+  nvs["puts"] = g_nvsStats.puts;
+  nvs["coalesced"] = g_nvsStats.coalesced;
+  nvs["writes"] = g_nvsStats.writes;
+  nvs["unchanged"] = g_nvsStats.unchanged;
+  nvs["commits"] = g_nvsStats.commits;
+  nvs["failures"] = g_nvsStats.failures;
+  nvs["pending"] = g_nvsCount;
+  nvs["maxPending"] = g_nvsStats.maxPending;
+  nvs["shutdownHook"] = g_nvsStats.shutdownHook;
+
+  // Latency probes and per-task CPU share (perf_probes.h)
+  perfToJson(doc["perf"].to<JsonObject>(), false);
+
   // Serialize and send
   String response;
   serializeJson(doc, response);
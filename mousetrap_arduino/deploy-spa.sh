@@ -40,6 +40,12 @@ echo ""
 echo -e "${BLUE}[2/5]${NC} Copying files to data/app..."
 rm -rf "$APP_DIR"/*
 cp -r "$SPA_DIR/dist"/* "$APP_DIR/"
+# served with Content-Encoding: gzip; keep the .gz only when it is smaller
+find "$APP_DIR" -type f \( -name '*.js' -o -name '*.css' -o -name '*.html' -o -name '*.svg' \) |
+while read -r f; do
+  gzip -9 -n -k -f "$f"
+  if [ "$(wc -c < "$f.gz")" -ge "$(wc -c < "$f")" ]; then rm -f "$f.gz"; fi
+done
 echo -e "${GREEN}✓ Files copied${NC}"
 echo ""
 
@@ -0,0 +1,67 @@
+// http_range.h
+#pragma once
+#include <Arduino.h>
+#include <stdlib.h>
+
+/*  Single-range "Range: bytes=..." parsing for file downloads.
+
+    Pure so the host bench can check it; beginFileRange() in the sketch
+    turns the result into a 206, a 416 or a plain 200.
+
+      size_t start, end;
+      switch (httpParseRange(req->header("Range").c_str(), size, start, end)) {
+        case HTTP_RANGE_NONE: ...   // whole file, 200
+        case HTTP_RANGE_OK:   ...   // bytes start..end (inclusive), 206
+        case HTTP_RANGE_BAD:  ...   // 416 with the size in Content-Range
+      }
+
+    Accepted forms: "bytes=a-b", "bytes=a-" and the suffix "bytes=-n" (last
+    n bytes). Anything else, including multi-range lists, is ignored and the
+    whole file is sent, which RFC 9110 allows.                              */
+
+enum HttpRangeResult : uint8_t { HTTP_RANGE_NONE, HTTP_RANGE_OK, HTTP_RANGE_BAD };
+
+// digits only, no sign or spaces; false on empty or overflow
+static bool httpRangeNum(const char *s, const char *end, size_t &out) {
+  if (s == end) return false;
+  size_t v = 0;
+  for (; s < end; s++) {
+    if (*s < '0' || *s > '9') return false;
+    size_t d = *s - '0';
+    if (v > (SIZE_MAX - d) / 10) return false;
+    v = v * 10 + d;
+  }
+  out = v;
+  return true;
+}
+
+static HttpRangeResult httpParseRange(const char *hdr, size_t size, size_t &start, size_t &end) {
+  start = 0;
+  end = size ? size - 1 : 0;
+  if (!hdr || strncmp(hdr, "bytes=", 6) != 0 || strchr(hdr, ',')) return HTTP_RANGE_NONE;
+
+  const char *spec = hdr + 6;
+  const char *dash = strchr(spec, '-');
+  if (!dash) return HTTP_RANGE_NONE;
+  const char *stop = spec + strlen(spec);
+
+  size_t a = 0, b = 0;
+  bool haveA = httpRangeNum(spec, dash, a);
+  bool haveB = httpRangeNum(dash + 1, stop, b);
+  if ((dash > spec && !haveA) || (dash + 1 < stop && !haveB)) return HTTP_RANGE_NONE;
+
+  if (haveA) {
+    if (a >= size) return HTTP_RANGE_BAD;
+    start = a;
+    if (haveB) {
+      if (b < a) return HTTP_RANGE_NONE;  // invalid syntax, not unsatisfiable
+      end = b < size - 1 ? b : size - 1;
+    }
+  } else if (haveB) {  // suffix range: last b bytes
+    if (b == 0 || size == 0) return HTTP_RANGE_BAD;
+    start = b < size ? size - b : 0;
+  } else {
+    return HTTP_RANGE_NONE;  // "bytes=-"
+  }
+  return HTTP_RANGE_OK;
+}
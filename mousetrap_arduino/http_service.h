@@ -0,0 +1,221 @@
+// http_service.h
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/*  Shared HTTP client.
+
+    Keeps one keep-alive connection per origin (HTTP_POOL_SLOTS; the least
+    recently used one is closed when a new origin needs a slot), so repeated
+    calls to the relay skip the TCP - and for https the TLS - handshake for
+    as long as the server keeps the socket open.
+
+      httpSvcInit();                                                // setup(), once
+      int rc = httpSvcRequest("GET", url, nullptr, &reply, 10000);  // caller's task
+      httpSvcPostAsync(url, payload, onDone);                       // returns at once
+      rc = httpSvcRequestUrgent("POST", url, body, nullptr, 1500);  // alerts
+
+    httpSvcRequest() runs on the calling task under the pool lock and retries
+    once when a reused socket turns out to be dead. httpSvcPostAsync() copies
+    the request onto a queue; the HttpSvc worker sends it, retries with
+    backoff and then calls done(code) on its own task.
+    httpSvcRequestUrgent() works the same on a slot and lock of its own, so
+    an alert never queues behind a pooled or async request. Latency, retries
+    and reuse are counted in g_httpStats for the debug dashboard.           */
+
+#define HTTP_POOL_SLOTS 2
+#define HTTP_QUEUE_LEN 8
+#define HTTP_ORIGIN_MAX 64
+#define HTTP_RETRY_BASE_MS 500  // async retries wait 0.5 s, 1 s, 2 s ...
+
+typedef void (*HttpDoneFn)(int code);
+
+struct HttpSlot {
+  char origin[HTTP_ORIGIN_MAX];  // "http://host:port", "" = free
+  HTTPClient http;               // owns the socket between requests
+  uint32_t lastUse;
+};
+
+struct HttpStats {
+  uint32_t requests = 0;
+  uint32_t failures = 0;  // final result <= 0 or >= 400
+  uint32_t retries = 0;
+  uint32_t reused = 0;    // sent on an already-open connection
+  uint32_t dropped = 0;   // async requests lost to a full queue
+  uint32_t lastMs = 0;
+  uint32_t maxMs = 0;
+  uint64_t totalMs = 0;
+  int lastCode = 0;
+};
+
+struct HttpJob {
+  char *url;   // malloc'd; the worker frees both
+  char *body;
+  uint16_t timeoutMs;
+  uint8_t retries;
+  HttpDoneFn done;
+};
+
+static HttpSlot g_httpSlots[HTTP_POOL_SLOTS];
+static HttpSlot g_httpUrgentSlot;
+static SemaphoreHandle_t g_httpMux = nullptr;
+static SemaphoreHandle_t g_httpUrgentMux = nullptr;
+static QueueHandle_t g_httpQueue = nullptr;
+static HttpStats g_httpStats;
+static portMUX_TYPE g_httpStatsMux = portMUX_INITIALIZER_UNLOCKED;  // guards every g_httpStats field
+
+// "scheme://host[:port]" part of url
+static void httpOrigin(const char *url, char *out, size_t outLen) {
+  const char *p = strstr(url, "://");
+  p = p ? p + 3 : url;
+  const char *end = strchr(p, '/');
+  size_t n = end ? (size_t)(end - url) : strlen(url);
+  if (n >= outLen) n = outLen - 1;
+  memcpy(out, url, n);
+  out[n] = '\0';
+}
+
+// caller holds g_httpMux
+static HttpSlot &httpSlotFor(const char *url) {
+  char origin[HTTP_ORIGIN_MAX];
+  httpOrigin(url, origin, sizeof(origin));
+  HttpSlot *victim = &g_httpSlots[0];
+  for (HttpSlot &s : g_httpSlots) {
+    if (!strcmp(s.origin, origin)) return s;
+    if (!s.origin[0] || (victim->origin[0] && s.lastUse < victim->lastUse)) victim = &s;
+  }
+  if (victim->origin[0]) {  // close the old origin's socket
+    victim->http.setReuse(false);
+    victim->http.end();
+  }
+  strlcpy(victim->origin, origin, sizeof(victim->origin));
+  return *victim;
+}
+
+static int httpSendOnce(HttpSlot &slot, const char *method, const char *url, const char *body,
+                        String *response, uint16_t timeoutMs, bool &reused) {
+  HTTPClient &http = slot.http;
+  reused = http.connected();
+  if (!http.begin(url)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  http.setReuse(true);
+  http.setTimeout(timeoutMs);
+  http.setConnectTimeout(timeoutMs);
+  if (body) http.addHeader("Content-Type", "application/json");
+  int code = http.sendRequest(method, (uint8_t *)body, body ? strlen(body) : 0);
+  if (response) *response = code > 0 ? http.getString() : String();
+  http.end();  // keeps the socket when the server allows keep-alive
+  slot.lastUse = millis();
+  return code;
+}
+
+static void httpRecord(int code, uint32_t ms, bool reused) {
+  portENTER_CRITICAL(&g_httpStatsMux);
+  g_httpStats.requests++;
+  if (code <= 0 || code >= 400) g_httpStats.failures++;
+  if (reused) g_httpStats.reused++;
+  g_httpStats.lastCode = code;
+  g_httpStats.lastMs = ms;
+  g_httpStats.totalMs += ms;
+  if (ms > g_httpStats.maxMs) g_httpStats.maxMs = ms;
+  portEXIT_CRITICAL(&g_httpStatsMux);
+}
+
+// one of g_httpStats' counters, e.g. httpCount(g_httpStats.retries)
+static void httpCount(uint32_t &counter) {
+  portENTER_CRITICAL(&g_httpStatsMux);
+  counter++;
+  portEXIT_CRITICAL(&g_httpStatsMux);
+}
+
+// caller holds the slot's lock
+static int httpSendRetry(HttpSlot &slot, const char *method, const char *url, const char *body,
+                         String *response, uint16_t timeoutMs) {
+  uint32_t t0 = millis();
+  bool reused;
+  int code = httpSendOnce(slot, method, url, body, response, timeoutMs, reused);
+  if (code < 0 && reused) {  // server dropped the idle socket; one fresh try
+    httpCount(g_httpStats.retries);
+    slot.http.setReuse(false);
+    slot.http.end();
+    code = httpSendOnce(slot, method, url, body, response, timeoutMs, reused);
+  }
+  httpRecord(code, millis() - t0, reused);
+  return code;
+}
+
+// Blocking request on the pooled connection. body (JSON) may be null;
+// response, if given, receives the reply body. Returns the HTTP status or a
+// negative HTTPC_ERROR_* code.
+static int httpSvcRequest(const char *method, const char *url, const char *body, String *response,
+                          uint16_t timeoutMs = 3000) {
+  if (WiFi.status() != WL_CONNECTED || !g_httpMux) return HTTPC_ERROR_NOT_CONNECTED;
+  xSemaphoreTake(g_httpMux, portMAX_DELAY);
+  int code = httpSendRetry(httpSlotFor(url), method, url, body, response, timeoutMs);
+  xSemaphoreGive(g_httpMux);
+  return code;
+}
+
+// Same, on the dedicated alert slot; its keep-alive socket follows whichever
+// origin the last alert went to.
+static int httpSvcRequestUrgent(const char *method, const char *url, const char *body, String *response,
+                                uint16_t timeoutMs = 3000) {
+  if (WiFi.status() != WL_CONNECTED || !g_httpUrgentMux) return HTTPC_ERROR_NOT_CONNECTED;
+  xSemaphoreTake(g_httpUrgentMux, portMAX_DELAY);
+  HttpSlot &slot = g_httpUrgentSlot;
+  char origin[HTTP_ORIGIN_MAX];
+  httpOrigin(url, origin, sizeof(origin));
+  if (strcmp(slot.origin, origin)) {
+    if (slot.origin[0]) {
+      slot.http.setReuse(false);
+      slot.http.end();
+    }
+    strlcpy(slot.origin, origin, sizeof(slot.origin));
+  }
+  int code = httpSendRetry(slot, method, url, body, response, timeoutMs);
+  xSemaphoreGive(g_httpUrgentMux);
+  return code;
+}
+
+static void httpWorkerTask(void *) {
+  HttpJob job;
+  for (;;) {
+    if (xQueueReceive(g_httpQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+    int code = httpSvcRequest("POST", job.url, job.body, nullptr, job.timeoutMs);
+    for (uint8_t i = 0; i < job.retries && (code <= 0 || code >= 500); i++) {
+      vTaskDelay(pdMS_TO_TICKS(HTTP_RETRY_BASE_MS << i));
+      httpCount(g_httpStats.retries);
+      code = httpSvcRequest("POST", job.url, job.body, nullptr, job.timeoutMs);
+    }
+    if (job.done) job.done(code);
+    free(job.url);
+    free(job.body);
+  }
+}
+
+// Call once from setup(), before any task can issue a request.
+static void httpSvcInit() {
+  if (g_httpMux) return;
+  g_httpMux = xSemaphoreCreateMutex();
+  g_httpUrgentMux = xSemaphoreCreateMutex();
+  g_httpQueue = xQueueCreate(HTTP_QUEUE_LEN, sizeof(HttpJob));
+  xTaskCreatePinnedToCore(httpWorkerTask, "HttpSvc", 6144, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
+}
+
+// Queues a JSON POST and returns at once; false if the queue is full.
+// done (optional) runs on the worker with the final status.
+static bool httpSvcPostAsync(const char *url, const String &body, HttpDoneFn done = nullptr,
+                             uint8_t retries = 2, uint16_t timeoutMs = 3000) {
+  if (!g_httpQueue) return false;
+  HttpJob job = { strdup(url), strdup(body.c_str()), timeoutMs, retries, done };
+  if (!job.url || !job.body || xQueueSend(g_httpQueue, &job, 0) != pdTRUE) {
+    free(job.url);
+    free(job.body);
+    httpCount(g_httpStats.dropped);
+    return false;
+  }
+  return true;
+}
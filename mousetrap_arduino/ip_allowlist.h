@@ -0,0 +1,150 @@
+// ip_allowlist.h
+#pragma once
+#include <Arduino.h>
+#include <stdlib.h>
+
+/*  Compiled IP allowlist.
+
+    ipAllowlistCompile() parses the comma-separated whitelist setting
+    ("*", "192.168.1.0/24, 10.0.0.7", ...) once, when it is loaded or saved,
+    into (network, mask) pairs grouped by prefix length and sorted by
+    network. ipAllowlistMatch() then costs one binary search per distinct
+    prefix length, with no allocation and no string work, so it can run on
+    every request.
+
+      ipAllowlistCompile(ipWhitelist.c_str());
+      if (!ipAllowlistMatch(ipToUint(remoteIP))) -> 403
+
+    A bare address is a /32. Entries that do not parse are skipped and
+    counted (they never matched anything before either).                     */
+
+#define IPLIST_MAX 32
+
+struct IpRule {
+  uint32_t net;   // already masked
+  uint32_t mask;
+};
+
+struct IpAllowlist {
+  bool allowAll = true;       // until the setting is first compiled
+  uint8_t count = 0;
+  uint8_t rejected = 0;       // entries that did not parse
+  uint8_t groups = 0;         // distinct prefix lengths
+  uint8_t groupStart[33];     // first rule of group g; rules are sorted by (mask desc, net)
+  IpRule rules[IPLIST_MAX];
+};
+
+// Two copies: one in use, one to compile into; a save swaps the pointer so a
+// lookup on another task never sees a half-built list.
+static IpAllowlist g_allowlists[2];
+static IpAllowlist *volatile g_allowlist = &g_allowlists[0];
+
+// "a.b.c.d" → host-order uint32; false on anything else. Stops at end.
+static bool ipParseV4(const char *s, const char *end, uint32_t &out) {
+  uint32_t ip = 0;
+  for (int part = 0; part < 4; part++) {
+    if (s >= end || *s < '0' || *s > '9') return false;
+    uint32_t v = 0;
+    int digits = 0;
+    while (s < end && *s >= '0' && *s <= '9' && digits < 4) {
+      v = v * 10 + (*s++ - '0');
+      digits++;
+    }
+    if (v > 255 || digits > 3) return false;
+    ip = (ip << 8) | v;
+    if (part < 3) {
+      if (s >= end || *s != '.') return false;
+      s++;
+    }
+  }
+  if (s != end) return false;
+  out = ip;
+  return true;
+}
+
+// "a.b.c.d" or "a.b.c.d/n", already trimmed
+static bool ipParseRule(const char *s, const char *end, IpRule &out) {
+  const char *slash = (const char *)memchr(s, '/', end - s);
+  uint32_t ip;
+  if (!ipParseV4(s, slash ? slash : end, ip)) return false;
+  int bits = 32;
+  if (slash) {
+    char *stop;
+    if (slash + 1 >= end) return false;
+    long n = strtol(slash + 1, &stop, 10);
+    if (stop != end || n < 0 || n > 32) return false;
+    bits = (int)n;
+  }
+  out.mask = bits == 0 ? 0 : 0xFFFFFFFFUL << (32 - bits);
+  out.net = ip & out.mask;
+  return true;
+}
+
+static int ipRuleCmp(const void *a, const void *b) {
+  const IpRule *x = (const IpRule *)a, *y = (const IpRule *)b;
+  if (x->mask != y->mask) return x->mask > y->mask ? -1 : 1;  // longest prefix first
+  if (x->net != y->net) return x->net < y->net ? -1 : 1;
+  return 0;
+}
+
+// Compiles spec and makes it the active list. Returns the number of entries
+// that were skipped (unparseable or over IPLIST_MAX).
+static int ipAllowlistCompile(const char *spec) {
+  IpAllowlist &l = g_allowlist == &g_allowlists[0] ? g_allowlists[1] : g_allowlists[0];
+  l = IpAllowlist{};
+
+  const char *p = spec ? spec : "";
+  while (isspace((unsigned char)*p)) p++;
+  l.allowAll = *p == '\0' || (p[0] == '*' && p[1 + strspn(p + 1, " \t")] == '\0');
+
+  while (!l.allowAll && *p) {
+    const char *comma = strchr(p, ',');
+    const char *end = comma ? comma : p + strlen(p);
+    const char *s = p, *e = end;
+    while (s < e && isspace((unsigned char)*s)) s++;
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    if (s < e) {
+      IpRule r;
+      if (l.count < IPLIST_MAX && ipParseRule(s, e, r)) l.rules[l.count++] = r;
+      else l.rejected++;
+    }
+    p = comma ? comma + 1 : end;
+  }
+
+  qsort(l.rules, l.count, sizeof(IpRule), ipRuleCmp);
+  // drop duplicates, then index the prefix-length groups
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < l.count; i++) {
+    if (n && l.rules[n - 1].mask == l.rules[i].mask && l.rules[n - 1].net == l.rules[i].net) continue;
+    l.rules[n++] = l.rules[i];
+  }
+  l.count = n;
+  for (uint8_t i = 0; i < l.count; i++) {
+    if (i == 0 || l.rules[i].mask != l.rules[i - 1].mask) l.groupStart[l.groups++] = i;
+  }
+
+  g_allowlist = &l;
+  return l.rejected;
+}
+
+// ip in host order (see ipToUint)
+static bool ipAllowlistMatch(uint32_t ip) {
+  const IpAllowlist &l = *g_allowlist;
+  if (l.allowAll) return true;
+  for (uint8_t g = 0; g < l.groups; g++) {
+    uint8_t lo = l.groupStart[g];
+    const uint8_t end = g + 1 < l.groups ? l.groupStart[g + 1] : l.count;
+    uint8_t hi = end;
+    uint32_t want = ip & l.rules[lo].mask;
+    while (lo < hi) {
+      uint8_t mid = (lo + hi) / 2;
+      if (l.rules[mid].net < want) lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo < end && l.rules[lo].net == want) return true;
+  }
+  return false;
+}
+
+static inline size_t ipAllowlistSize() { return g_allowlist->count; }
+static inline bool ipAllowlistAllowsAll() { return g_allowlist->allowAll; }
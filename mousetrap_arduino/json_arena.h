@@ -0,0 +1,80 @@
+// json_arena.h
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "esp_heap_caps.h"
+
+/*  Bump allocator for short-lived ArduinoJson documents.
+
+    A JsonDocument built on a JsonArena takes its memory from one PSRAM
+    block allocated on first use instead of a string of heap calls, and
+    reset() between messages frees the whole block at once. A request that
+    does not fit falls back to malloc, so an oversized payload still parses.
+
+      static JsonArena arena(16 * 1024);
+      arena.reset();                        // no document may still use it
+      JsonDocument doc(&arena);
+      deserializeJson(doc, payload, length);
+
+    Not thread-safe; one owner at a time.                                   */
+
+class JsonArena : public ArduinoJson::Allocator {
+public:
+  explicit JsonArena(size_t capacity) : cap_(capacity) {}
+
+  void reset() { used_ = 0; }
+  size_t highWater() const { return high_; }
+  uint32_t overflows() const { return overflows_; }
+
+  void *allocate(size_t n) override {
+    if (!buf_) buf_ = (uint8_t *)heap_caps_malloc(cap_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    size_t need = HDR + align(n);
+    if (buf_ && used_ + need <= cap_) {
+      uint8_t *b = buf_ + used_;
+      *(size_t *)b = n;
+      used_ += need;
+      bump(used_);
+      return b + HDR;
+    }
+    overflows_++;
+    return malloc(n);
+  }
+
+  void deallocate(void *p) override {
+    if (p && !mine(p)) free(p);  // arena blocks come back on reset()
+  }
+
+  void *reallocate(void *p, size_t n) override {
+    if (!p) return allocate(n);
+    if (!mine(p)) return realloc(p, n);
+    uint8_t *b = (uint8_t *)p - HDR;
+    size_t old = *(size_t *)b;
+    size_t off = b - buf_;
+    if (off + HDR + align(old) == used_ && off + HDR + align(n) <= cap_) {
+      *(size_t *)b = n;  // newest block: grow or shrink in place
+      used_ = off + HDR + align(n);
+      bump(used_);
+      return p;
+    }
+    if (n <= old) return p;
+    void *q = allocate(n);
+    if (q) memcpy(q, p, old);
+    return q;
+  }
+
+private:
+  static constexpr size_t HDR = 8;  // block size, keeps payloads 8-aligned
+  static size_t align(size_t n) { return (n + 7) & ~(size_t)7; }
+  bool mine(const void *p) const {
+    return buf_ && (const uint8_t *)p >= buf_ && (const uint8_t *)p < buf_ + cap_;
+  }
+  void bump(size_t u) {
+    if (u > high_) high_ = u;
+  }
+
+  uint8_t *buf_ = nullptr;
+  size_t cap_;
+  size_t used_ = 0;
+  size_t high_ = 0;
+  uint32_t overflows_ = 0;
+};
@@ -0,0 +1,29 @@
+// light_heuristics.h
+#pragma once
+#include <Arduino.h>
+
+/*  Flash / no-flash decision from the size of a no-flash test JPEG.
+
+    Pure functions so the decision can be replayed on the host (bench/) over
+    recorded size sequences; the cached light model that decides when to
+    take a test shot stays in the sketch.                                   */
+
+#define LIGHT_HYST_PCT 15  // a probe flips the decision only past threshold ± 15 %
+
+// ---- Size-based darkness heuristic ----------------------------------------
+// For JPEG @ quality≈12, bright scenes are bigger; dark scenes compress small.
+// Threshold ≈ (pixels / 12), clamped to practical min/max.
+static size_t jpegDarkThreshold(size_t w, size_t h) {
+  size_t px = w * h;
+  size_t th = px / 12;              // empirical for Q~12
+  if (th < 16000)  th = 16000;      // floor for tiny frames
+  if (th > 120000) th = 120000;     // cap for very large frames
+  return th;
+}
+
+// true → flash. haveDecision/wasDark: the current cached decision, if any.
+static inline bool lightProbeIsDark(size_t jpegLen, size_t threshold, bool haveDecision, bool wasDark) {
+  if (!haveDecision) return jpegLen < threshold;
+  if (wasDark) return jpegLen < threshold + threshold * LIGHT_HYST_PCT / 100;
+  return jpegLen < threshold - threshold * LIGHT_HYST_PCT / 100;
+}
@@ -0,0 +1,92 @@
+// log_format.h
+#pragma once
+#include <Arduino.h>
+#include <stdarg.h>
+
+/*  Allocation-free system log formatting.
+
+      addSystemLog("Heartbeat POST rc=", rc);              // pieces, like "a" + x
+      addSystemLogf("Frame %u write failed", (unsigned)i); // printf style
+
+    Pieces are formatted straight into a fixed stack buffer; each value prints
+    the way String(value) would, so converted call sites log the same text.
+    The one-argument addSystemLog(const char*) / (const String&) are unchanged
+    for callers that already have the text.                                   */
+
+#define LOG_MSG_MAX 200  // message bytes incl. NUL (timestamp is added later)
+
+struct LogLine {
+  char buf[LOG_MSG_MAX];
+  size_t n = 0;
+
+  void put(const char *s, size_t len) {
+    if (!s) return;
+    size_t room = sizeof(buf) - 1 - n;
+    if (len > room) len = room;
+    memcpy(buf + n, s, len);
+    n += len;
+    buf[n] = '\0';
+  }
+  void vputf(const char *fmt, va_list ap) {
+    size_t room = sizeof(buf) - n;
+    int w = vsnprintf(buf + n, room, fmt, ap);
+    if (w > 0) n += ((size_t)w < room) ? (size_t)w : room - 1;
+  }
+  __attribute__((format(printf, 2, 3))) void putf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vputf(fmt, ap);
+    va_end(ap);
+  }
+};
+
+// String(x, HEX) / String(x, decimals) equivalents
+struct LogHex   { unsigned long v; };
+struct LogFixed { double v; int digits; };
+static inline LogHex   logHex(unsigned long v)           { return LogHex{ v }; }
+static inline LogFixed logFixed(double v, int digits)    { return LogFixed{ v, digits }; }
+
+static inline void logPut(LogLine &l, const char *s)                 { if (s) l.put(s, strlen(s)); }
+static inline void logPut(LogLine &l, const __FlashStringHelper *s)  { logPut(l, reinterpret_cast<const char *>(s)); }
+static inline void logPut(LogLine &l, const String &s)               { l.put(s.c_str(), s.length()); }
+static inline void logPut(LogLine &l, char c)                        { l.put(&c, 1); }
+static inline void logPut(LogLine &l, bool v)                        { l.putf("%u", v ? 1u : 0u); }
+static inline void logPut(LogLine &l, unsigned char v)               { l.putf("%u", (unsigned)v); }
+static inline void logPut(LogLine &l, int v)                         { l.putf("%d", v); }
+static inline void logPut(LogLine &l, unsigned int v)                { l.putf("%u", v); }
+static inline void logPut(LogLine &l, long v)                        { l.putf("%ld", v); }
+static inline void logPut(LogLine &l, unsigned long v)               { l.putf("%lu", v); }
+static inline void logPut(LogLine &l, long long v)                   { l.putf("%lld", v); }
+static inline void logPut(LogLine &l, unsigned long long v)          { l.putf("%llu", v); }
+static inline void logPut(LogLine &l, float v)                       { l.putf("%.2f", (double)v); }
+static inline void logPut(LogLine &l, double v)                      { l.putf("%.2f", v); }
+static inline void logPut(LogLine &l, const LogHex &h)               { l.putf("%lx", h.v); }
+static inline void logPut(LogLine &l, const LogFixed &f)             { l.putf("%.*f", f.digits, f.v); }
+
+static inline void logPutAll(LogLine &) {}
+template <typename T, typename... Rest>
+static inline void logPutAll(LogLine &l, const T &v, const Rest &...rest) {
+  logPut(l, v);
+  logPutAll(l, rest...);
+}
+
+void addSystemLogLine(const char *msg, size_t len);  // mousetrap_arduino.ino
+void addSystemLog(const char *msg);
+void addSystemLog(const String &msg);
+
+template <typename A, typename B, typename... Rest>
+static inline void addSystemLog(const A &a, const B &b, const Rest &...rest) {
+  LogLine l;
+  logPutAll(l, a, b, rest...);
+  addSystemLogLine(l.buf, l.n);
+}
+
+static inline void addSystemLogf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static inline void addSystemLogf(const char *fmt, ...) {
+  LogLine l;
+  va_list ap;
+  va_start(ap, fmt);
+  l.vputf(fmt, ap);
+  va_end(ap);
+  addSystemLogLine(l.buf, l.n);
+}
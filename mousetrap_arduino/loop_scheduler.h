@@ -0,0 +1,113 @@
+// loop_scheduler.h
+#pragma once
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*  Deadline scheduler for loop().
+
+    Each subsystem registers a job with a period (0 = only when kicked).
+    loopSchedRun() runs every job whose deadline has passed or that was
+    kicked, then blocks on the loop task's notification until the earliest
+    remaining deadline - so an idle trap wakes only as often as its fastest
+    job needs, and an ISR or another task can wake it early with a kick.
+
+      static int jobMqtt = loopJobAdd("mqtt", mqttLoop, 50);
+      loopJobAdd("nvsVerify", jobNvsVerify, 300000, 300000);  // first run 5 min in
+      loopJobKick(jobMqtt);                        // any task
+      void loop() { loopSchedRun(1000); }          // never sleep longer than 1 s
+
+    Jobs run on the loop task only, one after another, so they need no
+    locking among themselves.                                               */
+
+#define LOOP_MAX_JOBS 16
+
+typedef void (*LoopJobFn)();
+
+struct LoopJob {
+  const char *name;
+  LoopJobFn fn;
+  uint32_t periodMs;       // 0 = event-only
+  uint32_t dueMs;
+  volatile bool kicked;
+  uint32_t runs;
+  uint32_t busyUs;         // total time spent in fn
+};
+
+static LoopJob g_loopJobs[LOOP_MAX_JOBS];
+static int g_loopJobCount = 0;
+static TaskHandle_t g_loopTask = nullptr;
+static uint32_t g_loopWakeups = 0;
+
+// Returns the job id, or -1 when the table is full. A periodic job first
+// runs after firstMs (default: immediately), so slow or chatty jobs can stay
+// out of the boot rush.
+static int loopJobAdd(const char *name, LoopJobFn fn, uint32_t periodMs, uint32_t firstMs = 0) {
+  if (g_loopJobCount >= LOOP_MAX_JOBS) return -1;
+  LoopJob &j = g_loopJobs[g_loopJobCount];
+  j.name = name;
+  j.fn = fn;
+  j.periodMs = periodMs;
+  j.dueMs = millis() + firstMs;
+  j.kicked = periodMs != 0 && firstMs == 0;
+  j.runs = 0;
+  j.busyUs = 0;
+  return g_loopJobCount++;
+}
+
+// New period; from inside the job it applies to the deadline set after this run.
+static inline void loopJobPeriod(int id, uint32_t periodMs) {
+  if (id < 0) return;
+  g_loopJobs[id].periodMs = periodMs;
+  g_loopJobs[id].dueMs = millis() + periodMs;
+}
+
+static inline void loopJobKick(int id) {
+  if (id < 0) return;
+  g_loopJobs[id].kicked = true;
+  if (g_loopTask) xTaskNotifyGive(g_loopTask);
+}
+
+static inline void IRAM_ATTR loopJobKickFromISR(int id) {
+  if (id < 0) return;
+  g_loopJobs[id].kicked = true;
+  if (g_loopTask) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(g_loopTask, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+}
+
+// One scheduler pass: run what's due, then sleep until the next deadline
+// (at most maxSleepMs) or a kick.
+static void loopSchedRun(uint32_t maxSleepMs) {
+  if (!g_loopTask) g_loopTask = xTaskGetCurrentTaskHandle();
+
+  uint32_t now = millis();
+  for (int i = 0; i < g_loopJobCount; i++) {
+    LoopJob &j = g_loopJobs[i];
+    bool due = j.periodMs && (int32_t)(now - j.dueMs) >= 0;
+    if (!due && !j.kicked) continue;
+    j.kicked = false;
+    uint32_t period = j.periodMs;
+    uint32_t t0 = micros();
+    j.fn();
+    j.busyUs += micros() - t0;
+    j.runs++;
+    now = millis();
+    // the job may have changed its own period; otherwise step the deadline
+    if (j.periodMs && j.periodMs == period) j.dueMs = now + j.periodMs;
+  }
+
+  uint32_t sleepMs = maxSleepMs;
+  for (int i = 0; i < g_loopJobCount; i++) {
+    const LoopJob &j = g_loopJobs[i];
+    if (j.kicked) return;  // kicked while we were running - go again
+    if (!j.periodMs) continue;
+    int32_t left = (int32_t)(j.dueMs - now);
+    if (left <= 0) return;
+    if ((uint32_t)left < sleepMs) sleepMs = left;
+  }
+  g_loopWakeups++;
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs) ? pdMS_TO_TICKS(sleepMs) : 1);
+}
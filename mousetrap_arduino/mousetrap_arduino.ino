@@ -40,10 +40,19 @@
 #endif
 //#define SERVO_PIN 48          // this device has NO servo; use 48 on servo units
 #define TOF_XSHUT_PIN -1  // set to your XSHUT GPIO if wired; else leave -1
+#define TOF_INT_PIN -1    // VL6180X GPIO1 (interrupt out) if wired; -1 = poll every 100 ms
 #define TOF_FORCE 0       // 0=AUTO, 1=VL6180X, 2=VL53L0X, 3=VL53L1X (optional)
 
 #include "servo_optional.h"
 #include "tof_autodetect.h"
+#include "range_stats.h"
+#include "loop_scheduler.h"
+#include "ip_allowlist.h"
+#include "http_service.h"
+#include "http_range.h"
+#include "nvs_store.h"
+#include "json_arena.h"
+#include "page_template.h"
 
 
 
@@ -64,6 +73,7 @@
 
 #define CAPTURE_DIR "/captures"
 constexpr int CAPTURE_DIR_LEN = sizeof(CAPTURE_DIR) - 1;
+#include "capture_catalog.h"
 
 
 
@@ -91,12 +101,16 @@ constexpr int CAPTURE_DIR_LEN = sizeof(CAPTURE_DIR) - 1;
 #include <Preferences.h>
 #include <functional>
 #include "esp_camera.h"
+#include "img_converters.h"  // thumbnails: jpg2rgb888 / fmt2jpg
 #include <stdlib.h>
 #include <vector>
 #include <algorithm>  // for std::sort in WiFi scan
+#include <atomic>     // SPSC video ring indices
 #include "esp_heap_caps.h"  // for PSRAM alloc
 #include <FS.h>
 #define MAX_SAVED_IMAGES 20  // keep the newest N pictures
+#define GALLERY_PAGE 60       // /gallery entries per page
+#define GALLERY_PAGE_MAX 200
 #include <LittleFS.h>
 #define FS LittleFS  // handy alias ‑ you can still call it "SPIFFS"
 #include <ESP32Servo.h>
@@ -123,6 +137,7 @@ constexpr int CAPTURE_DIR_LEN = sizeof(CAPTURE_DIR) - 1;
 
 // HMAC-SHA256 for secure device claim tokens
 #include <mbedtls/md.h>
+#include "rom/miniz.h"  // tinfl: gzip OTA images
 
 // Debug instrumentation for PANIC crash debugging
 #include "debug_framebuffer.h"
@@ -130,6 +145,7 @@ constexpr int CAPTURE_DIR_LEN = sizeof(CAPTURE_DIR) - 1;
 #include "debug_tasks.h"
 #include "debug_crashkit.h"
 #include "debug_context.h"
+#include "perf_probes.h"
 #include "debug_dashboard.h"
 
 // Device Claim Server Configuration
@@ -198,7 +214,23 @@ enum ClaimVerificationResult {
 #define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
 #endif
 
-void addSystemLog(const String &msg);  // Forward declaration
+// Battery traps: let the chip light-sleep between loop deadlines. Needs a core
+// built with CONFIG_PM_ENABLE + tickless idle; otherwise it only logs why not.
+#ifndef TRAP_LIGHT_SLEEP
+#define TRAP_LIGHT_SLEEP 0
+#endif
+
+#include "log_format.h"  // addSystemLog(a, b, ...) / addSystemLogf(): no heap
+
+// Boot-time benchmark of the hot kernels, printed over Serial in the same
+// format as `make bench` on the host (bench_kernels.h).
+#ifndef TRAP_BENCH
+#define TRAP_BENCH 0
+#endif
+#if TRAP_BENCH
+#include "bench_kernels.h"
+#endif
+void flushSystemLogs();                // drains the log pipeline to /logs.txt
 
 #ifdef LOG
 #undef LOG
@@ -217,10 +249,12 @@ static const char* BUILD_COMMIT = "local";
 static unsigned long BOOT_MILLIS = 0;
 static bool VERBOSE_HTTP = true; // set false to quiet logs
 
-static void addStdHeaders(AsyncWebServerResponse* res) {
+static const char* NO_STORE = "no-store, no-cache, must-revalidate, max-age=0";
+
+static void addStdHeaders(AsyncWebServerResponse* res, const char* cacheControl = NO_STORE) {
   res->addHeader("X-Build", BUILD_SEMVER);
   res->addHeader("X-Commit", BUILD_COMMIT);
-  res->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+  res->addHeader("Cache-Control", cacheControl);
 }
 
 static String fmtUptime() {
@@ -267,11 +301,12 @@ static void logHit(const char* method, const String& url, const char* handler, i
 static void sendWith(AsyncWebServerRequest* req,
                      AsyncWebServerResponse* res,
                      const char* handlerTag,
-                     int statusCode)
+                     int statusCode,
+                     const char* cacheControl = NO_STORE)
 {
   res->setCode(statusCode);               // ensure status
   res->addHeader("X-Handler", handlerTag);
-  addStdHeaders(res);
+  addStdHeaders(res, cacheControl);
   logHit(req->methodToString(), req->url(), handlerTag, statusCode);
   req->send(res);
 }
@@ -307,13 +342,8 @@ bool g_context_initialized = false;
 static String g_macUpper;
 
 // Keep base64 helpers (still used by some legacy code)
-#include "mbedtls/base64.h"
-static String b64Enc(const uint8_t* data,size_t n){ size_t cap=4*((n+2)/3)+1, out=0; std::unique_ptr<unsigned char[]>buf(new unsigned char[cap]); if(mbedtls_base64_encode(buf.get(),cap,&out,data,n)!=0)return String(); buf[ out ]=0; return String((char*)buf.get());}
-static bool   b64Dec(const String&s,std::unique_ptr<uint8_t[]>&out,size_t&n){ size_t cap=(s.length()*3)/4+3; out.reset(new uint8_t[cap]); size_t got=0; int rc=mbedtls_base64_decode(out.get(),cap,&got,(const unsigned char*)s.c_str(),s.length()); if(rc!=0)return false; n=got; return true; }
-
-// If your project already has b64Enc / b64Dec, provide aliases used by newer code
-static inline String b64Encode(const uint8_t* p, size_t n) { return b64Enc(p, n); }
-static inline bool   b64Decode(const String& in, std::unique_ptr<uint8_t[]>& out, size_t& outLen) { return b64Dec(in, out, outLen); }
+#include "b64_util.h"
+#include "esp_rom_crc.h"  // zlib-compatible CRC32 for binary snapshots
 // --- END PATCH: ChatGPT.ino (helpers) ---
 
 // Keep MIME type helper (used by file serving)
@@ -325,9 +355,11 @@ static String guessContentType(const String& path) {
   if (p.endsWith(".json")) return F("application/json; charset=utf-8");
   if (p.endsWith(".svg"))  return F("image/svg+xml");
   if (p.endsWith(".png"))  return F("image/png");
-  if (p.endsWith(".jpg") || p.endsWith(".jpeg")) return F("image/jpeg");
+  if (p.endsWith(".jpg") || p.endsWith(".jpeg") || p.endsWith(CATALOG_THUMB_EXT)) return F("image/jpeg");
   if (p.endsWith(".gif"))  return F("image/gif");
   if (p.endsWith(".ico"))  return F("image/x-icon");
+  if (p.endsWith(".woff2")) return F("font/woff2");
+  if (p.endsWith(".mjpg")) return F("video/x-motion-jpeg");
   if (p.endsWith(".txt") || p.endsWith(".log")) return F("text/plain; charset=utf-8");
   return F("application/octet-stream");
 }
@@ -697,7 +729,7 @@ void startWiFiScan() {
     std::sort(cachedNetworks.begin(), cachedNetworks.end(),
       [](const CachedNetwork& a, const CachedNetwork& b) { return a.rssi > b.rssi; });
     Serial.printf("[WIFI-SCAN] Cached %d unique networks\n", cachedNetworks.size());
-    addSystemLog("[WIFI-SCAN] Found " + String(cachedNetworks.size()) + " networks");
+    addSystemLog("[WIFI-SCAN] Found ", cachedNetworks.size(), " networks");
   } else {
     Serial.println("[WIFI-SCAN] All attempts failed");
     addSystemLog("[WIFI-SCAN] FAILED - no networks found");
@@ -970,7 +1002,7 @@ static void tunnel_handleHttpReqFromServer(const JsonDocument& m) {
   // Method not supported or unknown path
   if (!isGet && !isHead) {
     wsSendStart(id, 405, F("text/plain; charset=utf-8"), false);
-    wsSendChunkText(id, "method not allowed", 19);
+    wsSendChunkText(id, "method not allowed", 18);
     wsSendEnd(id);
     g_tunnelBusy = false;
     return;
@@ -984,37 +1016,33 @@ static void tunnel_handleHttpReqFromServer(const JsonDocument& m) {
   g_tunnelBusy = false;
 }
 
+// GET /api/captures[?offset=&limit=]  newest first, served from the catalog
 static void handleApiCaptures(AsyncWebServerRequest* req) {
+  size_t offset = req->hasParam("offset") ? catalogArg(req->getParam("offset")->value().toInt(), 0, CATALOG_MAX) : 0;
+  size_t limit = req->hasParam("limit") ? catalogArg(req->getParam("limit")->value().toInt(), 0, CATALOG_MAX) : CATALOG_MAX;
+
   AsyncResponseStream *res = req->beginResponseStream("application/json; charset=utf-8");
   res->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
-  res->print("{\"files\":[");
+  res->print("{\"total\":"); res->print(catalogCount());
+  res->print(",\"files\":[");
   bool first = true;
 
-  File dir = LittleFS.open("/captures", "r");
-  if (dir && dir.isDirectory()) {
-    while (true) {
-      File f = dir.openNextFile();
-      if (!f) break;
-      if (f.isDirectory()) { f.close(); continue; }
-      String full = String(f.name());
-      String name = full;
-      int slash = name.lastIndexOf('/'); if (slash >= 0) name = name.substring(slash + 1);
-      String kind = "other";
-      int dot = name.lastIndexOf('.'); if (dot >= 0) {
-        String ext = name.substring(dot + 1); ext.toLowerCase();
-        if (ext == "jpg" || ext == "jpeg" || ext == "png") kind = "image";
-        else if (ext == "mjpg" || ext == "mjpeg") kind = "video";
-      }
-      if (!first) res->print(",");
-      first = false;
-      res->print("{\"name\":\"");
-      for (size_t i = 0; i < name.length(); ++i) { char c = name[i]; if (c=='\\' || c=='\"') res->print('\\'); res->print(c); }
-      res->print("\",\"size\":"); res->print(f.size());
-      res->print(",\"kind\":\""); res->print(kind); res->print("\"}");
-      f.close();
+  catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &e) {
+    if (!first) res->print(",");
+    first = false;
+    res->print("{\"name\":\"");
+    for (const char *c = e.name; *c; ++c) { if (*c=='\\' || *c=='\"') res->print('\\'); res->print(*c); }
+    res->print("\",\"size\":"); res->print(e.size);
+    res->print(",\"kind\":\""); res->print(e.kind == CAPTURE_VIDEO ? "video" : "image");
+    res->print("\",\"ts\":"); res->print(e.ts);
+    res->print(",\"flash\":"); res->print(e.flash ? "true" : "false");
+    if (e.thumb) {
+      res->print(",\"thumb\":\"" CAPTURE_DIR "/");
+      for (const char *c = e.name; *c; ++c) { if (*c=='\\' || *c=='\"') res->print('\\'); res->print(*c); }
+      res->print(CATALOG_THUMB_EXT "\"");
     }
-    dir.close();
-  }
+    res->print("}");
+  }, false, offset, limit);
   res->print("]}");
   req->send(res);
 }
@@ -1091,15 +1119,27 @@ static void handleFsList(AsyncWebServerRequest* req) {
   if (p.isEmpty()) p = "/";
   while (p.length() > 1 && p.endsWith("/")) p.remove(p.length() - 1);
 
-  // Open directory (try with/without trailing slash)
-  File dir = LittleFS.open(p);
-  if (!dir || !dir.isDirectory()) {
-    dir = LittleFS.open(p + "/");
-  }
-
   JsonDocument doc;                // v7: no capacity template needed
   JsonArray files = doc["files"].to<JsonArray>();  // v7: nested array
 
+  // The capture folder is the big one; list it from the catalog (captures
+  // only - clip .idx sidecars are not shown)
+  File dir;
+  if (p == CAPTURE_DIR) {
+    catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &e) {
+      JsonObject o = files.add<JsonObject>();
+      o["name"] = e.name;
+      o["size"] = e.size;
+      o["kind"] = "file";
+    }, true);
+  } else {
+    // Open directory (try with/without trailing slash)
+    dir = LittleFS.open(p);
+    if (!dir || !dir.isDirectory()) {
+      dir = LittleFS.open(p + "/");
+    }
+  }
+
   if (dir && dir.isDirectory()) {
     for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
       JsonObject o = files.add<JsonObject>();      // v7: create object entry
@@ -1161,14 +1201,10 @@ static void handleFsGet(AsyncWebServerRequest *req) {
 #include <Preferences.h>   // (safe to include multiple times)
 
 static void handleApiCalib(AsyncWebServerRequest* req) {
-  Preferences prefs;                  // local instance (no global needed)
-  prefs.begin("settings", true);      // readOnly = true
-
-  const int calibOff      = prefs.getInt("calibOff", 0);
-  const int falseOff      = prefs.getInt("falseOff", 0);
-  const int overrideTh    = prefs.getInt("overrideTh", 0);
-
-  prefs.end();
+  // pending (not yet committed) values included
+  const int calibOff      = nvsGetInt("settings", "calibOff", 0);
+  const int falseOff      = nvsGetInt("settings", "falseOff", 0);
+  const int overrideTh    = nvsGetInt("settings", "overrideTh", 0);
 
   String j = "{";
   j += "\"threshold\":" + String(threshold) + ",";
@@ -1352,7 +1388,7 @@ void loadClaimedCredentials() {
     Serial.println("[CLAIM] Verifying claim status with server...");
 
     // Verify with server (need WiFi first, so we'll do this in setup after WiFi connects)
-    addSystemLog("[CLAIM] Device is claimed: " + claimedDeviceName);
+    addSystemLog("[CLAIM] Device is claimed: ", claimedDeviceName);
   } else {
     Serial.println("[CLAIM] Device not claimed - provisioning required");
     addSystemLog("[CLAIM] Device not claimed - awaiting provisioning");
@@ -1366,18 +1402,15 @@ void saveClaimedCredentials(const String& deviceId, const String& tenantId,
                             const String& mqttClientId, const String& mqttUsername,
                             const String& mqttPassword, const String& mqttBroker,
                             const String& deviceName) {
-  devicePrefs.begin("device", false);  // read-write
-
-  devicePrefs.putBool("claimed", true);
-  devicePrefs.putString("deviceId", deviceId);
-  devicePrefs.putString("tenantId", tenantId);
-  devicePrefs.putString("mqttClientId", mqttClientId);
-  devicePrefs.putString("mqttUsername", mqttUsername);
-  devicePrefs.putString("mqttPassword", mqttPassword);
-  devicePrefs.putString("mqttBroker", mqttBroker);
-  devicePrefs.putString("deviceName", deviceName);
-
-  devicePrefs.end();
+  nvsPutBool("device", "claimed", true);
+  nvsPutString("device", "deviceId", deviceId);
+  nvsPutString("device", "tenantId", tenantId);
+  nvsPutString("device", "mqttClientId", mqttClientId);
+  nvsPutString("device", "mqttUsername", mqttUsername);
+  nvsPutString("device", "mqttPassword", mqttPassword);
+  nvsPutString("device", "mqttBroker", mqttBroker);
+  nvsPutString("device", "deviceName", deviceName);
+  nvsCommit("device");  // one session; unchanged keys are not rewritten
 
   loadClaimedCredentials();  // Reload into memory
 
@@ -1391,7 +1424,7 @@ void saveClaimedCredentials(const String& deviceId, const String& tenantId,
   mqttSetup();
 
   Serial.println("[CLAIM] Credentials saved to Preferences");
-  addSystemLog("[CLAIM] Device claimed successfully: " + deviceName);
+  addSystemLog("[CLAIM] Device claimed successfully: ", deviceName);
 }
 
 // Clear claimed credentials (for re-provisioning)
@@ -1407,14 +1440,8 @@ void clearClaimedCredentials() {
   Serial.printf("[CLAIM]   - claimedMqttUsername: %s\n", claimedMqttUsername.c_str());
   Serial.printf("[CLAIM]   - claimedMqttBroker: %s\n", claimedMqttBroker.c_str());
 
-  Serial.println("[CLAIM] Opening NVS 'device' namespace for clearing...");
-  devicePrefs.begin("device", false);
-
-  Serial.println("[CLAIM] Calling devicePrefs.clear() to erase all keys...");
-  devicePrefs.clear();
-
-  Serial.println("[CLAIM] Closing NVS namespace...");
-  devicePrefs.end();
+  Serial.println("[CLAIM] Clearing NVS 'device' namespace (and pending writes)...");
+  nvsClear("device");
 
   Serial.println("[CLAIM] Resetting in-memory credential variables...");
   deviceClaimed = false;
@@ -1497,7 +1524,7 @@ bool claimDevice(const String& claimCode) {
                             mqttPassword, mqttBroker, deviceName);
 
       Serial.println("[CLAIM] Device claimed successfully!");
-      addSystemLog("[CLAIM] Device claimed: " + deviceName);
+      addSystemLog("[CLAIM] Device claimed: ", deviceName);
 
       http.end();
       return true;
@@ -1508,7 +1535,7 @@ bool claimDevice(const String& claimCode) {
     }
   } else {
     Serial.printf("[CLAIM] HTTP error %d: %s\n", httpCode, http.getString().c_str());
-    addSystemLog("[CLAIM] Claim failed - HTTP " + String(httpCode));
+    addSystemLog("[CLAIM] Claim failed - HTTP ", httpCode);
     http.end();
     return false;
   }
@@ -1607,20 +1634,17 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     return NETWORK_ERROR;
   }
 
-  HTTPClient http;
   String url = String(CLAIM_SERVER_URL) + "/api/device/claim-status?mac=" + g_macUpper;
 
   Serial.printf("[CLAIM-VERIFY] Request URL: %s\n", url.c_str());
   Serial.printf("[CLAIM-VERIFY] MAC Address: %s\n", g_macUpper.c_str());
 
-  http.begin(url);
-  http.setTimeout(10000);  // 10 second timeout (increased for network stability)
-
-  int httpCode = http.GET();
+  String response;
+  int httpCode = httpSvcRequest("GET", url.c_str(), nullptr, &response,
+                                10000);  // 10 second timeout (increased for network stability)
   Serial.printf("[CLAIM-VERIFY] HTTP Response Code: %d\n", httpCode);
 
   if (httpCode == 200) {
-    String response = http.getString();
     Serial.printf("[CLAIM-VERIFY] Response payload: %s\n", response.c_str());
 
     JsonDocument responseDoc;
@@ -1629,7 +1653,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     if (error) {
       Serial.printf("[CLAIM-VERIFY] JSON parse error: %s\n", error.c_str());
       Serial.println("[CLAIM-VERIFY] Treating parse error as network issue");
-      http.end();
       return NETWORK_ERROR;
     }
 
@@ -1640,7 +1663,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
       Serial.println("[CLAIM-VERIFY] SUCCESS: Server confirms device is claimed");
       Serial.println("[CLAIM-VERIFY] Result: CLAIM_VERIFIED");
       Serial.println("[CLAIM-VERIFY] ========================================");
-      http.end();
       return CLAIM_VERIFIED;
     } else {
       Serial.println("[CLAIM-VERIFY] ========================================");
@@ -1648,7 +1670,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
       Serial.println("[CLAIM-VERIFY] Server returned: {\"claimed\": false}");
       Serial.println("[CLAIM-VERIFY] Result: EXPLICITLY_REVOKED");
       Serial.println("[CLAIM-VERIFY] ========================================");
-      http.end();
       return EXPLICITLY_REVOKED;
     }
   } else if (httpCode == 410) {
@@ -1658,7 +1679,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     Serial.println("[CLAIM-VERIFY] Device has been revoked by server");
     Serial.println("[CLAIM-VERIFY] Result: EXPLICITLY_REVOKED");
     Serial.println("[CLAIM-VERIFY] ========================================");
-    http.end();
     return EXPLICITLY_REVOKED;
   } else if (httpCode == 404 || httpCode < 0) {
     // Network error or device not found - treat as network issue
@@ -1667,7 +1687,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     Serial.println("[CLAIM-VERIFY] Device will STAY CLAIMED and retry later");
     Serial.println("[CLAIM-VERIFY] Result: NETWORK_ERROR");
     Serial.println("[CLAIM-VERIFY] ========================================");
-    http.end();
     return NETWORK_ERROR;
   } else if (httpCode >= 500 && httpCode < 600) {
     // Server error - don't unclaim on server issues
@@ -1676,7 +1695,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     Serial.println("[CLAIM-VERIFY] Device will STAY CLAIMED and retry later");
     Serial.println("[CLAIM-VERIFY] Result: SERVER_ERROR");
     Serial.println("[CLAIM-VERIFY] ========================================");
-    http.end();
     return SERVER_ERROR;
   } else {
     // Other HTTP errors - treat as network issue to be safe
@@ -1684,7 +1702,6 @@ ClaimVerificationResult checkClaimStatusWithServer() {
     Serial.println("[CLAIM-VERIFY] Treating as network issue to be safe");
     Serial.println("[CLAIM-VERIFY] Result: NETWORK_ERROR");
     Serial.println("[CLAIM-VERIFY] ========================================");
-    http.end();
     return NETWORK_ERROR;
   }
 }
@@ -1711,8 +1728,8 @@ void unclaimDeviceWithSource(const char* source) {
   Serial.printf("[UNCLAIM]   - Free heap: %u bytes\n", ESP.getFreeHeap());
 
   // Add to system log for persistence
-  addSystemLog("[UNCLAIM] Device unclaim initiated - Source: " + String(source) + ", MAC: " + g_macUpper);
-  addSystemLog("[UNCLAIM] Device was: " + claimedDeviceName + " (ID: " + claimedDeviceId + ")");
+  addSystemLog("[UNCLAIM] Device unclaim initiated - Source: ", source, ", MAC: ", g_macUpper);
+  addSystemLog("[UNCLAIM] Device was: ", claimedDeviceName, " (ID: ", claimedDeviceId, ")");
 
   // Notify server if we're online (include source for audit logging)
   if (WiFi.status() == WL_CONNECTED) {
@@ -1741,7 +1758,7 @@ void unclaimDeviceWithSource(const char* source) {
       addSystemLog("[UNCLAIM] Server notified of unclaim");
     } else {
       Serial.printf("[UNCLAIM] Server notification failed (HTTP %d) - device will retry on next boot\n", httpCode);
-      addSystemLog("[UNCLAIM] Server notification failed - HTTP " + String(httpCode));
+      addSystemLog("[UNCLAIM] Server notification failed - HTTP ", httpCode);
     }
 
     http.end();
@@ -1933,7 +1950,7 @@ bool registerAndClaimDevice(const String& email, const String& password, const S
   Serial.printf("[REGISTER-CLAIM] Free heap before HTTP: %d bytes\n", ESP.getFreeHeap());
   Serial.println("[REGISTER-CLAIM] === END DEBUG ===");
 
-  addSystemLog("[REGISTER-CLAIM] Attempting HTTP to: " + url);
+  addSystemLog("[REGISTER-CLAIM] Attempting HTTP to: ", url);
 
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
@@ -1992,7 +2009,7 @@ bool registerAndClaimDevice(const String& email, const String& password, const S
     }
     Serial.printf("[REGISTER-CLAIM] WiFi still connected: %s\n", WiFi.status() == WL_CONNECTED ? "YES" : "NO");
     Serial.printf("[REGISTER-CLAIM] Free heap after error: %d bytes\n", ESP.getFreeHeap());
-    addSystemLog("[REGISTER-CLAIM] HTTP error code: " + String(httpCode));
+    addSystemLog("[REGISTER-CLAIM] HTTP error code: ", httpCode);
     Serial.println("[REGISTER-CLAIM] === END ERROR DETAILS ===");
   }
 
@@ -2041,14 +2058,14 @@ bool registerAndClaimDevice(const String& email, const String& password, const S
       Serial.printf("[REGISTER-CLAIM]   Tenant ID: %s\n", tenantId.c_str());
       Serial.printf("[REGISTER-CLAIM]   MQTT Broker: %s\n", mqttBroker.c_str());
 
-      addSystemLog("[REGISTER-CLAIM] Device registered and claimed: " + respDeviceName);
+      addSystemLog("[REGISTER-CLAIM] Device registered and claimed: ", respDeviceName);
 
       http.end();
       return true;
     } else {
       String errorMsg = responseDoc["error"].as<String>();
       Serial.printf("[REGISTER-CLAIM] Server returned success=false: %s\n", errorMsg.c_str());
-      addSystemLog("[REGISTER-CLAIM] Failed: " + errorMsg);
+      addSystemLog("[REGISTER-CLAIM] Failed: ", errorMsg);
       http.end();
       return false;
     }
@@ -2072,7 +2089,7 @@ bool registerAndClaimDevice(const String& email, const String& password, const S
     return false;
   } else {
     Serial.printf("[REGISTER-CLAIM] HTTP error %d: %s\n", httpCode, http.getString().c_str());
-    addSystemLog("[REGISTER-CLAIM] Failed - HTTP " + String(httpCode));
+    addSystemLog("[REGISTER-CLAIM] Failed - HTTP ", httpCode);
     http.end();
     return false;
   }
@@ -2102,16 +2119,14 @@ void loadWiFiCredentials() {
 
 // Save WiFi credentials to Preferences
 void saveWiFiCredentials(const String& newSSID, const String& newPassword) {
-  devicePrefs.begin("wifi", false);  // read-write
-  devicePrefs.putString("ssid", newSSID);
-  devicePrefs.putString("password", newPassword);
-  devicePrefs.end();
+  nvsPutString("wifi", "ssid", newSSID);
+  nvsPutString("wifi", "password", newPassword, NVS_SOON);
 
   savedSSID = newSSID;
   savedPassword = newPassword;
 
   Serial.println("[WIFI] WiFi credentials saved");
-  addSystemLog("[WIFI] WiFi credentials saved: " + newSSID);
+  addSystemLog("[WIFI] WiFi credentials saved: ", newSSID);
 }
 
 // ============================================================================
@@ -2121,11 +2136,197 @@ void saveWiFiCredentials(const String& newSSID, const String& newPassword) {
 // Publish MQTT message helper
 void mqttPublish(const char* topic, const char* payload, bool retained = false) {
   if (mqttClient.connected()) {
+    PERF_SCOPE(PERF_MQTT_PUB);
     mqttClient.publish(topic, payload, retained);
     Serial.printf("[MQTT] Published to %s: %s\n", topic, payload);
   }
 }
 
+// ----------------------------------------------------------------------------
+// Streaming image publish
+// Sends {<meta fields>,"image":"<base64 jpeg>"} via beginPublish/write/
+// endPublish. The JPEG is base64-encoded one small chunk at a time, straight
+// from RAM (camera framebuffer) or from a LittleFS file, so extra heap is the
+// metadata JSON plus ~2 KB scratch regardless of image size.
+// ----------------------------------------------------------------------------
+#define MQTT_IMG_RAW_CHUNK 768  // multiple of 3: no '=' padding mid-stream
+#define MQTT_IMG_B64_CHUNK ((MQTT_IMG_RAW_CHUNK / 3) * 4)
+
+static bool mqttStreamImageJson(const char* topic, JsonDocument& meta,
+                                const uint8_t* mem, File* file, size_t len) {
+  if (!mqttClient.connected() || len == 0) return false;
+  PERF_SCOPE(PERF_MQTT_IMAGE);
+
+  String head;
+  serializeJson(meta, head);
+  if (head.length() < 2 || head[head.length() - 1] != '}') return false;
+  head.remove(head.length() - 1);
+  head += (head.length() > 1) ? ",\"image\":\"" : "\"image\":\"";
+  static const char tail[] = "\"}";
+
+  // MQTT needs the full length up front; base64 length is known exactly
+  size_t b64Len = 4 * ((len + 2) / 3);
+  size_t total = head.length() + b64Len + (sizeof(tail) - 1);
+
+  uint8_t* scratch = (uint8_t*)heap_caps_malloc(MQTT_IMG_RAW_CHUNK + MQTT_IMG_B64_CHUNK + 1,
+                                                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (!scratch) return false;
+  uint8_t* raw = scratch;
+  unsigned char* enc = scratch + MQTT_IMG_RAW_CHUNK;
+
+  if (!mqttClient.beginPublish(topic, total, false)) {
+    heap_caps_free(scratch);
+    return false;
+  }
+
+  bool ok = mqttClient.write((const uint8_t*)head.c_str(), head.length()) == head.length();
+  size_t off = 0;
+  while (ok && off < len) {
+    size_t n = min((size_t)MQTT_IMG_RAW_CHUNK, len - off);
+    const uint8_t* src = mem ? (mem + off) : raw;
+    if (!mem && file->read(raw, n) != n) {
+      ok = false;
+      break;
+    }
+    size_t olen = 0;
+    if (mbedtls_base64_encode(enc, MQTT_IMG_B64_CHUNK + 1, &olen, src, n) != 0) {
+      ok = false;
+      break;
+    }
+    ok = mqttClient.write(enc, olen) == olen;
+    off += n;
+  }
+  if (ok) ok = mqttClient.write((const uint8_t*)tail, sizeof(tail) - 1) == sizeof(tail) - 1;
+  heap_caps_free(scratch);
+
+  if (!ok) {
+    // The announced length can no longer be honoured - drop the socket so
+    // the broker doesn't treat the next packet as payload; mqttLoop reconnects.
+    Serial.printf("[MQTT] Image stream aborted at %u/%u bytes\n", (unsigned)off, (unsigned)len);
+    getMqttWifiClient().stop();
+    return false;
+  }
+  return mqttClient.endPublish();
+}
+
+bool mqttPublishImageJson(const char* topic, JsonDocument& meta, const uint8_t* jpg, size_t len) {
+  return mqttStreamImageJson(topic, meta, jpg, nullptr, len);
+}
+
+bool mqttPublishImageJsonFile(const char* topic, JsonDocument& meta, File& file) {
+  return mqttStreamImageJson(topic, meta, nullptr, &file, file.size());
+}
+
+// ----------------------------------------------------------------------------
+// Binary snapshot transport (setting "snapBin")
+// Avoids the 33% base64 overhead. Metadata goes to <base>/meta as small JSON:
+//   {<meta fields>,"id","chunks","chunk_size","crc32","format":"jpeg"}
+// then the raw JPEG goes to <base>/bin in chunks of MQTT_SNAP_BIN_CHUNK bytes,
+// each prefixed with a 16-byte little-endian header:
+//   "SNP1" | id u32 | seq u16 | total u16 | crc32(chunk) u32
+// CRCs are zlib CRC-32 so the server can check them with a stock table.
+// ----------------------------------------------------------------------------
+bool snapshotBinary = false;  // false = legacy base64 JSON on <base>, true = <base>/meta + <base>/bin
+
+#define MQTT_SNAP_BIN_CHUNK 4096
+#define MQTT_SNAP_BIN_HDR   16
+
+static void snapPutU16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void snapPutU32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+static bool mqttStreamImageBinary(const String& baseTopic, JsonDocument& meta,
+                                  const uint8_t* mem, File* file, size_t len) {
+  if (!mqttClient.connected() || len == 0) return false;
+  PERF_SCOPE(PERF_MQTT_IMAGE);
+  size_t chunks = (len + MQTT_SNAP_BIN_CHUNK - 1) / MQTT_SNAP_BIN_CHUNK;
+  if (chunks > 0xFFFF) return false;
+
+  uint8_t* buf = nullptr;
+  if (!mem) {
+    buf = (uint8_t*)heap_caps_malloc(MQTT_SNAP_BIN_CHUNK, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) buf = (uint8_t*)heap_caps_malloc(MQTT_SNAP_BIN_CHUNK, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!buf) return false;
+  }
+
+  // Whole-image CRC goes in the metadata, which is sent first
+  uint32_t crc = 0;
+  if (mem) {
+    crc = esp_rom_crc32_le(0, mem, len);
+  } else {
+    size_t off = 0;
+    while (off < len) {
+      size_t n = min((size_t)MQTT_SNAP_BIN_CHUNK, len - off);
+      if (file->read(buf, n) != n) {
+        heap_caps_free(buf);
+        return false;
+      }
+      crc = esp_rom_crc32_le(crc, buf, n);
+      off += n;
+    }
+    file->seek(0);
+  }
+
+  uint32_t id = esp_random();
+  meta["id"] = id;
+  meta["chunks"] = chunks;
+  meta["chunk_size"] = MQTT_SNAP_BIN_CHUNK;
+  meta["crc32"] = crc;
+  meta["format"] = "jpeg";
+
+  String metaJson;
+  serializeJson(meta, metaJson);
+  String metaTopic = baseTopic + "/meta";
+  String binTopic = baseTopic + "/bin";
+  if (!mqttClient.publish(metaTopic.c_str(), metaJson.c_str(), false)) {
+    heap_caps_free(buf);
+    return false;
+  }
+
+  uint8_t hdr[MQTT_SNAP_BIN_HDR];
+  memcpy(hdr, "SNP1", 4);
+  snapPutU32(hdr + 4, id);
+  snapPutU16(hdr + 10, (uint16_t)chunks);
+
+  bool ok = true;
+  size_t off = 0;
+  for (size_t seq = 0; ok && seq < chunks; seq++) {
+    size_t n = min((size_t)MQTT_SNAP_BIN_CHUNK, len - off);
+    const uint8_t* src = mem ? (mem + off) : buf;
+    if (!mem && file->read(buf, n) != n) {
+      ok = false;
+      break;
+    }
+    snapPutU16(hdr + 8, (uint16_t)seq);
+    snapPutU32(hdr + 12, esp_rom_crc32_le(0, src, n));
+
+    if (!mqttClient.beginPublish(binTopic.c_str(), MQTT_SNAP_BIN_HDR + n, false)) {
+      ok = false;
+      break;
+    }
+    if (mqttClient.write(hdr, MQTT_SNAP_BIN_HDR) != MQTT_SNAP_BIN_HDR ||
+        mqttClient.write(src, n) != n) {
+      // Half-written packet - same recovery as the JSON stream
+      Serial.printf("[MQTT] Binary snapshot aborted at chunk %u/%u\n", (unsigned)seq, (unsigned)chunks);
+      getMqttWifiClient().stop();
+      heap_caps_free(buf);
+      return false;
+    }
+    ok = mqttClient.endPublish();
+    off += n;
+  }
+  heap_caps_free(buf);
+  return ok;
+}
+
+// Publishes a stored snapshot in whichever format the device is configured for.
+// baseTopic is tenant/{tenantId}/device/{MAC}/camera/snapshot.
+bool mqttPublishSnapshotFile(const String& baseTopic, JsonDocument& meta, File& file) {
+  if (snapshotBinary) {
+    return mqttStreamImageBinary(baseTopic, meta, nullptr, &file, file.size());
+  }
+  return mqttStreamImageJson(baseTopic.c_str(), meta, nullptr, &file, file.size());
+}
+
 // Load persisted versions from Preferences
 void loadVersions() {
   versionPrefs.begin("versions", false);  // Read-write to allow updates
@@ -2170,23 +2371,22 @@ void loadVersions() {
 
 // Save version after successful OTA
 void saveVersion(const char* type, const char* version) {
-  versionPrefs.begin("versions", false);  // Read-write
   unsigned long now = time(nullptr);
 
+  // written by the NVS task right away; a restart flushes it in any case
   if (strcmp(type, "firmware") == 0) {
-    versionPrefs.putString("firmware", version);
-    versionPrefs.putULong("fwTime", now);
+    nvsPutString("versions", "firmware", version);
+    nvsPutUInt("versions", "fwTime", now, NVS_SOON);
     currentFirmwareVersion = String(version);
     firmwareUpdateTimestamp = now;
     Serial.printf("[Versions] Saved firmware version: %s (timestamp: %lu)\n", version, now);
   } else if (strcmp(type, "filesystem") == 0) {
-    versionPrefs.putString("filesystem", version);
-    versionPrefs.putULong("fsTime", now);
+    nvsPutString("versions", "filesystem", version);
+    nvsPutUInt("versions", "fsTime", now, NVS_SOON);
     currentFilesystemVersion = String(version);
     filesystemUpdateTimestamp = now;
     Serial.printf("[Versions] Saved filesystem version: %s (timestamp: %lu)\n", version, now);
   }
-  versionPrefs.end();
 }
 
 // Publish OTA progress to cloud
@@ -2246,119 +2446,349 @@ void publishDeviceStatus() {
   mqttPublish(topic, payload.c_str(), true);  // Retained
 }
 
-// HTTP download and flash binary
-bool downloadAndFlash(const char* url, size_t expectedSize, const char* sha256, int updateType) {
-  HTTPClient http;
-  http.begin(url);
-  http.setTimeout(30000);  // 30 second timeout
+// Publish latency histograms and CPU share (perf_probes.h). The histograms
+// run since boot and carry their raw bucket counts, so the server can merge
+// them across devices on the same firmware.
+void publishPerfStats() {
+  if (!mqttClient.connected() || !deviceClaimed) return;
 
-  Serial.printf("[OTA] Downloading from: %s\n", url);
-  addSystemLog(String("[OTA] Starting download: ") + url);
+  char topic[256];
+  snprintf(topic, sizeof(topic), "tenant/%s/device/%s/perf",
+           claimedTenantId.c_str(), claimedMqttClientId.c_str());
 
-  int httpCode = http.GET();
-  if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("[OTA] HTTP GET failed: %d\n", httpCode);
-    addSystemLog(String("[OTA] Download failed: HTTP ") + httpCode);
-    http.end();
-    return false;
-  }
+  JsonDocument doc;
+  perfToJson(doc.to<JsonObject>(), true);
+  doc["firmware_version"] = currentFirmwareVersion;
 
-  size_t contentLength = http.getSize();
-  if (contentLength == 0 || (expectedSize > 0 && contentLength != expectedSize)) {
-    Serial.printf("[OTA] Size mismatch. Expected: %u, Got: %u\n", expectedSize, contentLength);
-    addSystemLog("[OTA] Size mismatch");
-    http.end();
-    return false;
+  String payload;
+  serializeJson(doc, payload);
+  mqttPublish(topic, payload.c_str());
+}
+
+/* ---------------- streaming OTA ----------------
+   The downloader (caller) fills PSRAM chunks while otaWriterTask hashes the
+   previous one and feeds it to Update.write(), so flash erase/write overlaps
+   the next network read. A dropped or stalled connection resumes with an
+   HTTP Range request from the last byte received; the SHA-256 from the
+   update message is checked before Update.end(). Images that start with the
+   gzip magic are inflated on the fly (ROM miniz), so filesystem images can be
+   shipped compressed - size/sha256 then describe the .gz as served. */
+#define OTA_CHUNK_BYTES   (16 * 1024)
+#define OTA_CHUNKS        2            // double buffer
+#define OTA_MAX_RESUMES   6
+#define OTA_STALL_MS      15000        // no bytes for this long → reconnect
+
+struct OtaChunk {
+  uint8_t *data;
+  size_t len;
+};
+
+struct OtaStream {
+  int type;                    // U_FLASH / U_SPIFFS
+  size_t total;                // bytes to download
+  OtaChunk chunks[OTA_CHUNKS];
+  QueueHandle_t freeQ, fullQ;  // OtaChunk* ; nullptr on fullQ = end of stream
+  SemaphoreHandle_t done;
+  mbedtls_md_context_t sha;
+  bool begun;
+  volatile bool failed;
+  // gzip
+  bool gz;
+  bool gzDone;
+  tinfl_decompressor *inf;
+  uint8_t *dict;               // TINFL_LZ_DICT_SIZE ring, also the inflate output
+  size_t dictOfs;
+};
+
+static bool otaFlash(OtaStream *o, const uint8_t *p, size_t n) {
+  if (Update.write((uint8_t *)p, n) == n) return true;
+  addSystemLog("[OTA] Flash write failed: ", Update.errorString());
+  return false;
+}
+
+// Length of the gzip member header at p, 0 if it isn't complete within n
+static size_t otaGzipHeaderLen(const uint8_t *p, size_t n) {
+  if (n < 10 || p[2] != 8) return 0;  // deflate only
+  uint8_t flg = p[3];
+  size_t i = 10;
+  if (flg & 0x04) {                   // FEXTRA
+    if (i + 2 > n) return 0;
+    i += 2 + (p[i] | (p[i + 1] << 8));
+  }
+  if (flg & 0x08) { while (i < n && p[i]) i++; i++; }  // FNAME
+  if (flg & 0x10) { while (i < n && p[i]) i++; i++; }  // FCOMMENT
+  if (flg & 0x02) i += 2;                              // FHCRC
+  return i <= n ? i : 0;
+}
+
+static bool otaInflate(OtaStream *o, const uint8_t *in, size_t n) {
+  while (n && !o->gzDone) {
+    size_t inLen = n, outLen = TINFL_LZ_DICT_SIZE - o->dictOfs;
+    tinfl_status st = tinfl_decompress(o->inf, in, &inLen, o->dict, o->dict + o->dictOfs, &outLen,
+                                       TINFL_FLAG_HAS_MORE_INPUT);
+    in += inLen;
+    n -= inLen;
+    if (outLen && !otaFlash(o, o->dict + o->dictOfs, outLen)) return false;
+    o->dictOfs = (o->dictOfs + outLen) & (TINFL_LZ_DICT_SIZE - 1);
+    if (st == TINFL_STATUS_DONE) o->gzDone = true;  // trailer bytes are ignored
+    else if (st < 0) {
+      addSystemLog("[OTA] gzip inflate error ", (int)st);
+      return false;
+    } else if (st == TINFL_STATUS_NEEDS_MORE_INPUT && !n) break;
   }
+  return true;
+}
 
-  // Unmount filesystem if doing filesystem update
-  if (updateType == U_SPIFFS) {
-    Serial.println("[OTA] Unmounting LittleFS before update...");
-    addSystemLog("[OTA] Unmounting filesystem");
-    LittleFS.end();
+// First chunk decides plain vs gzip, then Update.begin() can be sized
+static bool otaBegin(OtaStream *o, const uint8_t *p, size_t n, size_t &skip) {
+  skip = 0;
+  o->gz = n >= 2 && p[0] == 0x1F && p[1] == 0x8B;
+  if (o->gz) {
+    skip = otaGzipHeaderLen(p, n);
+    o->inf = (tinfl_decompressor *)heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    o->dict = (uint8_t *)heap_caps_malloc(TINFL_LZ_DICT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!skip || !o->inf || !o->dict) {
+      addSystemLog("[OTA] gzip image unusable (header or memory)");
+      return false;
+    }
+    tinfl_init(o->inf);
+    addSystemLog("[OTA] gzip image, inflating while flashing");
   }
 
-  // Begin Update
   DEBUG_SNAPSHOT("ota_update_begin");
-  bool beginOk = Update.begin(contentLength, updateType);
-  if (!beginOk) {
+  if (!Update.begin(o->gz ? UPDATE_SIZE_UNKNOWN : o->total, o->type)) {
     Serial.printf("[OTA] Update.begin failed: %s\n", Update.errorString());
-    addSystemLog(String("[OTA] Update.begin failed: ") + Update.errorString());
-    http.end();
+    addSystemLog("[OTA] Update.begin failed: ", Update.errorString());
     return false;
   }
+  o->begun = true;
+  return true;
+}
 
-  WiFiClient* stream = http.getStreamPtr();
-  mqttOtaTotalBytes = contentLength;
-  mqttOtaWrittenBytes = 0;
+static void otaWriterTask(void *pv) {
+  auto *o = static_cast<OtaStream *>(pv);
+  OtaChunk *c;
+  while (xQueueReceive(o->fullQ, &c, portMAX_DELAY) == pdTRUE && c) {
+    if (!o->failed) {
+      mbedtls_md_update(&o->sha, c->data, c->len);
+      size_t skip = 0;
+      bool ok = o->begun || otaBegin(o, c->data, c->len, skip);
+      if (ok) ok = o->gz ? otaInflate(o, c->data + skip, c->len - skip)
+                         : otaFlash(o, c->data, c->len);
+      if (!ok) o->failed = true;
+    }
+    xQueueSend(o->freeQ, &c, portMAX_DELAY);
+  }
+  xSemaphoreGive(o->done);
+  vTaskDelete(nullptr);
+}
+
+static bool otaVerifySha(OtaStream *o, const char *want) {
+  uint8_t digest[32];
+  mbedtls_md_finish(&o->sha, digest);
+  if (!want || !*want) {
+    addSystemLog("[OTA] No sha256 given - image not verified");
+    return true;
+  }
+  char hex[65];
+  for (int i = 0; i < 32; i++) snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  if (strcasecmp(hex, want) == 0) return true;
+  Serial.printf("[OTA] SHA-256 mismatch: got %s want %s\n", hex, want);
+  addSystemLog("[OTA] SHA-256 mismatch - update rejected");
+  return false;
+}
 
-  uint8_t buf[1024];
+// HTTP download and flash binary
+bool downloadAndFlash(const char* url, size_t expectedSize, const char* sha256, int updateType) {
+  Serial.printf("[OTA] Downloading from: %s\n", url);
+  addSystemLog("[OTA] Starting download: ", url);
+
+  OtaStream o = {};
+  o.type = updateType;
+  o.freeQ = xQueueCreate(OTA_CHUNKS, sizeof(OtaChunk *));
+  o.fullQ = xQueueCreate(OTA_CHUNKS + 1, sizeof(OtaChunk *));
+  o.done = xSemaphoreCreateBinary();
+  bool ok = o.freeQ && o.fullQ && o.done;
+  for (auto &c : o.chunks) {
+    c.data = ok ? (uint8_t *)heap_caps_malloc(OTA_CHUNK_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : nullptr;
+    ok = ok && c.data;
+    OtaChunk *cp = &c;
+    if (ok) xQueueSend(o.freeQ, &cp, 0);
+  }
+  mbedtls_md_init(&o.sha);
+  ok = ok && mbedtls_md_setup(&o.sha, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) == 0
+          && mbedtls_md_starts(&o.sha) == 0;
+
+  size_t received = 0;
+  bool writerRunning = false;
+  OtaChunk *cur = nullptr;
   int lastProgress = -1;
 
-  while (http.connected() && mqttOtaWrittenBytes < contentLength) {
-    size_t available = stream->available();
-    if (available) {
-      size_t toRead = min(available, sizeof(buf));
-      size_t bytesRead = stream->readBytes(buf, toRead);
-      size_t written = Update.write(buf, bytesRead);
-
-      if (written != bytesRead) {
-        Serial.println("[OTA] Write failed");
-        addSystemLog("[OTA] Flash write failed");
-        Update.abort();
+  // attempt 0 is the first GET; every later one (including a retried first
+  // GET) backs off and, once bytes have arrived, resumes with a Range request
+  for (int attempt = 0; ok && attempt <= OTA_MAX_RESUMES; attempt++) {
+    if (attempt) {
+      if (writerRunning) {
+        addSystemLog("[OTA] Link lost at ", received, " / ", o.total, " bytes, resuming (", attempt, "/", OTA_MAX_RESUMES, ")");
+      } else {
+        addSystemLog("[OTA] Retrying download (", attempt, "/", OTA_MAX_RESUMES, ")");
+      }
+      vTaskDelay(pdMS_TO_TICKS(1000 * attempt));
+    }
+
+    HTTPClient http;
+    http.begin(url);
+    http.setTimeout(OTA_STALL_MS);
+    if (received) http.addHeader("Range", "bytes=" + String(received) + "-");
+    const char *hdrs[] = { "Content-Range" };
+    http.collectHeaders(hdrs, 1);
+
+    int httpCode = http.GET();
+    size_t discard = 0;  // server ignored the Range header: skip what we have
+    if (httpCode == HTTP_CODE_OK && writerRunning) {
+      // restarted from byte 0 (Range ignored, or nothing received yet):
+      // must still be the image we started on
+      size_t contentLength = http.getSize();
+      if (contentLength != o.total) {
+        Serial.printf("[OTA] Restarted download changed size: %u -> %u\n", (unsigned)o.total,
+                      (unsigned)contentLength);
+        addSystemLog("[OTA] Size changed on restart - aborting");
         http.end();
-        return false;
+        ok = false;
+        break;
+      }
+      discard = received;
+    } else if (httpCode == HTTP_CODE_PARTIAL_CONTENT && received) {
+      // must resume exactly where we left off, in an image of the same size
+      String cr = http.header("Content-Range");
+      int slash = cr.lastIndexOf('/');
+      if (!cr.startsWith("bytes " + String(received) + "-") || slash < 0
+          || (cr.substring(slash + 1) != "*" && (size_t)cr.substring(slash + 1).toInt() != o.total)) {
+        addSystemLog("[OTA] Unexpected Content-Range: ", cr);
+        http.end();
+        ok = false;
+        break;
+      }
+    } else if (httpCode == HTTP_CODE_OK) {
+      size_t contentLength = http.getSize();
+      if (contentLength == 0 || contentLength == (size_t)-1 || (expectedSize > 0 && contentLength != expectedSize)) {
+        Serial.printf("[OTA] Size mismatch. Expected: %u, Got: %u\n", expectedSize, contentLength);
+        addSystemLog("[OTA] Size mismatch");
+        http.end();
+        ok = false;
+        break;
       }
+      o.total = contentLength;
+      mqttOtaTotalBytes = contentLength;
+      mqttOtaWrittenBytes = 0;
 
-      mqttOtaWrittenBytes += written;
+      // Unmount filesystem if doing filesystem update
+      if (updateType == U_SPIFFS) {
+        Serial.println("[OTA] Unmounting LittleFS before update...");
+        addSystemLog("[OTA] Unmounting filesystem");
+        LittleFS.end();
+      }
+      writerRunning = xTaskCreatePinnedToCore(otaWriterTask, "OtaWrite", 6144, &o, 2, nullptr, 1) == pdPASS;
+      if (!writerRunning) { http.end(); ok = false; break; }
+    } else {
+      Serial.printf("[OTA] HTTP GET failed: %d\n", httpCode);
+      addSystemLog("[OTA] Download failed: HTTP ", httpCode);
+      http.end();
+      // connection errors, timeouts and 5xx are worth another try; other 4xx won't change
+      bool transient = httpCode < 0 || httpCode >= 500 || httpCode == 408 || httpCode == 429;
+      if (!transient) { ok = false; break; }
+      continue;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    uint32_t lastData = millis();
+    while (received < o.total && !o.failed) {
+      if (!cur) {
+        xQueueReceive(o.freeQ, &cur, portMAX_DELAY);
+        cur->len = 0;
+      }
+      size_t want = discard ? min(discard, (size_t)OTA_CHUNK_BYTES - cur->len)
+                            : min(o.total - received, (size_t)OTA_CHUNK_BYTES - cur->len);
+      int n = stream->available() ? stream->read(cur->data + cur->len, want) : 0;
+      if (n <= 0) {
+        if (!http.connected() || millis() - lastData > OTA_STALL_MS) break;
+        vTaskDelay(1);
+        continue;
+      }
+      lastData = millis();
+      if (discard) {  // bytes land in the free tail of cur and are overwritten
+        discard -= n;
+        continue;
+      }
+
+      cur->len += n;
+      received += n;
+      mqttOtaWrittenBytes = received;
+      if (cur->len == OTA_CHUNK_BYTES || received == o.total) {
+        xQueueSend(o.fullQ, &cur, portMAX_DELAY);
+        cur = nullptr;
+      }
 
       // Publish progress every 10%
-      int progress = (mqttOtaWrittenBytes * 100) / contentLength;
+      int progress = (received * 100) / o.total;
       if (progress >= lastProgress + 10 || progress == 100) {
         publishOtaProgress("downloading", progress);
         lastProgress = progress;
       }
-    } else {
-      delay(10);
     }
+    http.end();
+    if (received == o.total || o.failed) break;
   }
 
-  http.end();
+  // drain the writer
+  if (writerRunning) {
+    OtaChunk *end = nullptr;
+    if (cur && cur->len && !o.failed) xQueueSend(o.fullQ, &cur, portMAX_DELAY);
+    xQueueSend(o.fullQ, &end, portMAX_DELAY);
+    xSemaphoreTake(o.done, portMAX_DELAY);
+  }
 
-  // Verify and finish
-  if (mqttOtaWrittenBytes != contentLength) {
-    Serial.printf("[OTA] Incomplete download: %u / %u bytes\n", mqttOtaWrittenBytes, contentLength);
+  ok = ok && writerRunning && !o.failed;
+  if (ok && received != o.total) {
+    Serial.printf("[OTA] Incomplete download: %u / %u bytes\n", received, o.total);
     addSystemLog("[OTA] Incomplete download");
+    ok = false;
+  }
+  if (ok && o.gz && !o.gzDone) {
+    addSystemLog("[OTA] gzip stream truncated");
+    ok = false;
+  }
+  if (ok) {
+    publishOtaProgress("verifying", 100);
+    ok = otaVerifySha(&o, sha256);
+  }
+  if (ok && !Update.end(true)) {
+    Serial.printf("[OTA] Update.end failed: %s\n", Update.errorString());
+    addSystemLog("[OTA] Update.end failed: ", Update.errorString());
+    ok = false;
+  } else if (!ok && o.begun) {
     Update.abort();
-    return false;
   }
 
-  publishOtaProgress("verifying", 100);
+  mbedtls_md_free(&o.sha);
+  for (auto &c : o.chunks) if (c.data) heap_caps_free(c.data);
+  if (o.inf) heap_caps_free(o.inf);
+  if (o.dict) heap_caps_free(o.dict);
+  if (o.freeQ) vQueueDelete(o.freeQ);
+  if (o.fullQ) vQueueDelete(o.fullQ);
+  if (o.done) vSemaphoreDelete(o.done);
 
-  if (!Update.end(true)) {
-    Serial.printf("[OTA] Update.end failed: %s\n", Update.errorString());
-    addSystemLog(String("[OTA] Update.end failed: ") + Update.errorString());
-    return false;
+  if (ok) {
+    Serial.println("[OTA] Update complete!");
+    addSystemLog("[OTA] Update successful, rebooting...");
   }
-
-  Serial.println("[OTA] Update complete!");
-  addSystemLog("[OTA] Update successful, rebooting...");
-  return true;
+  return ok;
 }
 
 // Handle firmware/filesystem update notification
-void handleOtaNotification(const JsonDocument& doc) {
-  const char* version = doc["version"];
-  const char* url = doc["url"];
-  size_t size = doc["size"] | 0;
-  const char* sha256 = doc["sha256"] | "";
-
-  Serial.printf("[OTA] MQTT payload - version: '%s', url: '%s'\n", version ? version : "NULL", url ? url : "NULL");
-
-  if (!version || !url) {
-    Serial.println("[OTA] Invalid update message");
-    return;
-  }
+// Runs an announced update (queued by mqttQueueOta); mqttOtaType says which
+void handleOtaNotification(const char* version, const char* url, size_t size, const char* sha256) {
+  if (mqttOtaInProgress) return;
 
   // Compare versions
   const char* currentVersion = (mqttOtaType == "firmware") ? currentFirmwareVersion.c_str() : currentFilesystemVersion.c_str();
@@ -2368,7 +2798,7 @@ void handleOtaNotification(const JsonDocument& doc) {
   }
 
   Serial.printf("[OTA] New %s available: %s -> %s\n", mqttOtaType.c_str(), currentVersion, version);
-  addSystemLog(String("[OTA] Updating ") + mqttOtaType + " to " + version);
+  addSystemLog("[OTA] Updating ", mqttOtaType, " to ", version);
 
   mqttOtaInProgress = true;
   mqttOtaTotalBytes = size;
@@ -2399,7 +2829,7 @@ extern bool detectionState;
 extern time_t lastAlertTime;
 extern time_t lastEmailTime;
 void alertFunction();
-bool captureSingleFrame(const String &fullPath, bool flash);
+bool captureSingleFrame(const String &fullPath, bool flash, bool queueThumb);
 
 // Capture and upload a single snapshot via MQTT without triggering alarm
 void captureAndUploadSnapshot() {
@@ -2439,67 +2869,29 @@ void captureAndUploadSnapshot() {
   size_t fileSize = imgFile.size();
   Serial.printf("[Snapshot] Image size: %d bytes\n", fileSize);
 
-  // Limit to ~200KB to avoid memory issues
-  if (fileSize == 0 || fileSize > 200000) {
-    Serial.printf("[Snapshot] Invalid file size: %d\n", fileSize);
+  if (fileSize == 0) {
+    Serial.println("[Snapshot] Empty image file");
     addSystemLog("[Snapshot] Invalid file size");
     imgFile.close();
     return;
   }
 
-  // Allocate memory for image data
-  uint8_t* imgData = (uint8_t*)malloc(fileSize);
-  if (!imgData) {
-    Serial.println("[Snapshot] Memory allocation failed");
-    addSystemLog("[Snapshot] Out of memory");
-    imgFile.close();
-    return;
-  }
-
-  // Read image data
-  size_t bytesRead = imgFile.read(imgData, fileSize);
-  imgFile.close();
-
-  if (bytesRead != fileSize) {
-    Serial.printf("[Snapshot] Read error: %d / %d bytes\n", bytesRead, fileSize);
-    addSystemLog("[Snapshot] File read error");
-    free(imgData);
-    return;
-  }
-
-  Serial.println("[Snapshot] Encoding image to base64...");
-
-  // Base64 encode the image
-  String base64Image = b64Enc(imgData, fileSize);
-  free(imgData);  // Free memory immediately after encoding
-
-  if (base64Image.length() == 0) {
-    Serial.println("[Snapshot] Base64 encoding failed");
-    addSystemLog("[Snapshot] Encoding FAILED");
-    return;
-  }
-
-  Serial.printf("[Snapshot] Base64 encoded: %d bytes\n", base64Image.length());
-
   // Build MQTT topic: tenant/{tenantId}/device/{MAC}/camera/snapshot
   String snapshotTopic = "tenant/" + claimedTenantId + "/device/" +
                          claimedMqttClientId + "/camera/snapshot";
 
-  // Build JSON payload
+  // Metadata only - the image is streamed from the file into the payload
   JsonDocument snapshotDoc;
   snapshotDoc["timestamp"] = now;
   snapshotDoc["filename"] = filename.substring(filename.lastIndexOf('/') + 1);
   snapshotDoc["size"] = fileSize;
-  snapshotDoc["image"] = base64Image;
-
-  String snapshotPayload;
-  serializeJson(snapshotDoc, snapshotPayload);
 
   // Publish to MQTT broker
   Serial.printf("[Snapshot] Publishing to: %s\n", snapshotTopic.c_str());
   addSystemLog("[Snapshot] Uploading via MQTT");
 
-  bool published = mqttClient.publish(snapshotTopic.c_str(), snapshotPayload.c_str());
+  bool published = mqttPublishSnapshotFile(snapshotTopic, snapshotDoc, imgFile);
+  imgFile.close();
 
   if (published) {
     Serial.println("[Snapshot] Successfully uploaded to broker");
@@ -2515,255 +2907,400 @@ void captureAndUploadSnapshot() {
 }
 
 // MQTT message callback
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.printf("[MQTT] Message on %s\n", topic);
+// ---- MQTT dispatch ---------------------------------------------------------
+// mqttCallback() strips the subscribed prefix (device, tenant or global),
+// looks the rest of the topic up in kMqttRoutes and parses JSON only for
+// routes that want it, into a document on a reusable arena. Retained clears
+// ("" / null) and unrouted topics never reach the parser. OTA announcements
+// are only recorded here; the "mqttOta" loop job runs the download after
+// the callback has returned, so mqttClient.loop() is never held up by it.
+
+struct MqttMsg {
+  const char *topic;
+  const byte *payload;
+  unsigned int length;
+  JsonDocument *doc;  // parsed payload for json routes, else nullptr
+};
 
-  // Update connection tracking - we received a message, so we're definitely connected
-  mqttReallyConnected = true;
-  lastMqttActivity = millis();
+typedef void (*MqttRouteFn)(const MqttMsg &m);
 
-  // Parse JSON payload
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, payload, length);
-  if (error) {
-    Serial.printf("[MQTT] JSON parse error: %s\n", error.c_str());
+enum : uint8_t { MQTT_SCOPE_DEVICE = 1, MQTT_SCOPE_TENANT = 2, MQTT_SCOPE_GLOBAL = 4 };
+
+struct MqttRoute {
+  const char *suffix;  // topic after the scope prefix; a trailing '/' matches any subtopic
+  uint8_t scopes;
+  bool json;
+  MqttRouteFn fn;
+};
+
+struct MqttCommand {
+  const char *name;
+  void (*fn)(JsonDocument &doc);
+};
+
+// "tenant/<t>/device/<c>/" and "tenant/<t>/", set before subscribing
+static char g_mqttDevicePrefix[160];
+static char g_mqttTenantPrefix[96];
+static size_t g_mqttDevicePrefixLen = 0, g_mqttTenantPrefixLen = 0;
+
+static JsonArena g_mqttArena(16 * 1024);  // > setBufferSize() worth of parsed JSON
+static bool g_mqttArenaBusy = false;      // a handler pumped mqttClient.loop() and re-entered us
+static uint32_t g_mqttCbLastUs = 0, g_mqttCbMaxUs = 0;
+
+// Latest OTA announcement per kind, run by jobMqttOta()
+struct PendingOta {
+  volatile bool pending;
+  char version[32];
+  char url[320];
+  size_t size;
+  char sha256[72];
+};
+static PendingOta g_pendingOta[2];  // [0] firmware, [1] filesystem
+static int g_jobMqttOta = -1;
+
+static void mqttSetTopicPrefixes() {
+  g_mqttDevicePrefixLen = snprintf(g_mqttDevicePrefix, sizeof(g_mqttDevicePrefix), "tenant/%s/device/%s/",
+                                   claimedTenantId.c_str(), claimedMqttClientId.c_str());
+  g_mqttTenantPrefixLen = snprintf(g_mqttTenantPrefix, sizeof(g_mqttTenantPrefix), "tenant/%s/",
+                                   claimedTenantId.c_str());
+  g_mqttDevicePrefixLen = min(g_mqttDevicePrefixLen, sizeof(g_mqttDevicePrefix) - 1);
+  g_mqttTenantPrefixLen = min(g_mqttTenantPrefixLen, sizeof(g_mqttTenantPrefix) - 1);
+}
+
+static void mqttQueueOta(int kind, const MqttMsg &m) {
+  JsonDocument &doc = *m.doc;
+  const char *version = doc["version"];
+  const char *url = doc["url"];
+  Serial.printf("[OTA] MQTT payload - version: '%s', url: '%s'\n", version ? version : "NULL", url ? url : "NULL");
+  if (!version || !url) {
+    Serial.println("[OTA] Invalid update message");
     return;
   }
+  PendingOta &p = g_pendingOta[kind];
+  strlcpy(p.version, version, sizeof(p.version));
+  strlcpy(p.url, url, sizeof(p.url));
+  p.size = doc["size"] | 0;
+  strlcpy(p.sha256, doc["sha256"] | "", sizeof(p.sha256));
+  p.pending = true;
+  loopJobKick(g_jobMqttOta);
+}
+
+static void mqttOnFirmwareLatest(const MqttMsg &m) { mqttQueueOta(0, m); }
+static void mqttOnFilesystemLatest(const MqttMsg &m) { mqttQueueOta(1, m); }
+
+static void jobMqttOta() {
+  for (int kind = 0; kind < 2; kind++) {
+    PendingOta &p = g_pendingOta[kind];
+    if (!p.pending) continue;
+    p.pending = false;
+    mqttOtaType = kind ? "filesystem" : "firmware";
+    handleOtaNotification(p.version, p.url, p.size, p.sha256);
+  }
+}
+
+// Handle device revocation - REQUIRES TOKEN VERIFICATION
+static void mqttOnRevoke(const MqttMsg &m) {
+  const char *topic = m.topic;
+  JsonDocument &doc = *m.doc;
+  // Empty retained "clear" messages never get here; a parsed null is the same thing
+  if (doc.isNull()) return;
 
-  // Handle firmware update
-  if (strstr(topic, "/firmware/latest")) {
-    mqttOtaType = "firmware";
-    handleOtaNotification(doc);
+  Serial.println("[MQTT-REVOKE] ========================================");
+  Serial.println("[MQTT-REVOKE] REVOCATION COMMAND RECEIVED FROM SERVER");
+  Serial.println("[MQTT-REVOKE] ========================================");
+  Serial.printf("[MQTT-REVOKE] Topic: %s\n", topic);
+
+  // Extract token from the revocation message
+  const char* token = doc["token"];
+  const char* action = doc["action"];
+
+  if (!token || strlen(token) == 0) {
+    Serial.println("[MQTT-REVOKE] REJECTED: No token in revocation message");
+    Serial.println("[MQTT-REVOKE] Device will NOT unclaim without valid token");
+    addSystemLog("[MQTT-REVOKE] Rejected revocation - missing token");
     return;
   }
 
-  // Handle filesystem update
-  if (strstr(topic, "/filesystem/latest")) {
-    mqttOtaType = "filesystem";
-    handleOtaNotification(doc);
+  if (!action || strcmp(action, "revoke") != 0) {
+    Serial.println("[MQTT-REVOKE] REJECTED: Invalid action in revocation message");
+    addSystemLog("[MQTT-REVOKE] Rejected revocation - invalid action");
     return;
   }
 
-  // Handle device revocation - REQUIRES TOKEN VERIFICATION
-  if (strstr(topic, "/revoke")) {
-    // Ignore empty retained "clear" messages (payload is null or empty)
-    // These are published when a device is claimed to clear old revoke messages
-    if (length == 0 || doc.isNull() || (length == 4 && memcmp(payload, "null", 4) == 0)) {
-      // Silently ignore - this is normal for claimed devices
-      return;
-    }
+  Serial.printf("[MQTT-REVOKE] Token received: %.16s...\n", token);
+  Serial.println("[MQTT-REVOKE] Verifying token with server...");
+  addSystemLog("[MQTT-REVOKE] Verifying revocation token with server...");
 
+  // Verify the token with the server before unclaiming
+  if (verifyRevocationToken(token)) {
     Serial.println("[MQTT-REVOKE] ========================================");
-    Serial.println("[MQTT-REVOKE] REVOCATION COMMAND RECEIVED FROM SERVER");
+    Serial.println("[MQTT-REVOKE] TOKEN VERIFIED - Proceeding with unclaim");
     Serial.println("[MQTT-REVOKE] ========================================");
-    Serial.printf("[MQTT-REVOKE] Topic: %s\n", topic);
+    addSystemLog("[MQTT-REVOKE] Token verified - unclaiming device");
+    unclaimDeviceWithSource("mqtt_revoke");
+  } else {
+    Serial.println("[MQTT-REVOKE] ========================================");
+    Serial.println("[MQTT-REVOKE] TOKEN VERIFICATION FAILED");
+    Serial.println("[MQTT-REVOKE] Device will STAY CLAIMED");
+    Serial.println("[MQTT-REVOKE] ========================================");
+    addSystemLog("[MQTT-REVOKE] Token verification failed - staying claimed");
+  }
+}
 
-    // Extract token from the revocation message
-    const char* token = doc["token"];
-    const char* action = doc["action"];
+static void mqttCmdReboot(JsonDocument &) {
+  flushSystemLogs();
+  ESP.restart();
+}
 
-    if (!token || strlen(token) == 0) {
-      Serial.println("[MQTT-REVOKE] REJECTED: No token in revocation message");
-      Serial.println("[MQTT-REVOKE] Device will NOT unclaim without valid token");
-      addSystemLog("[MQTT-REVOKE] Rejected revocation - missing token");
-      return;
-    }
+static void mqttCmdStatus(JsonDocument &) { publishDeviceStatus(); }
 
-    if (!action || strcmp(action, "revoke") != 0) {
-      Serial.println("[MQTT-REVOKE] REJECTED: Invalid action in revocation message");
-      addSystemLog("[MQTT-REVOKE] Rejected revocation - invalid action");
-      return;
-    }
+static void mqttCmdClearVersions(JsonDocument &) {
+  nvsClear("versions");
+  Serial.println("[MQTT] Cleared version preferences");
+  addSystemLog("[MQTT] Cleared version preferences, rebooting...");
+  delay(1000);
+  ESP.restart();
+}
 
-    Serial.printf("[MQTT-REVOKE] Token received: %.16s...\n", token);
-    Serial.println("[MQTT-REVOKE] Verifying token with server...");
-    addSystemLog("[MQTT-REVOKE] Verifying revocation token with server...");
+// Test trigger from server - start escalation without taking photos
+static void mqttCmdTestTrigger(JsonDocument &) { handleTestTriggerCommand(); }
 
-    // Verify the token with the server before unclaiming
-    if (verifyRevocationToken(token)) {
-      Serial.println("[MQTT-REVOKE] ========================================");
-      Serial.println("[MQTT-REVOKE] TOKEN VERIFIED - Proceeding with unclaim");
-      Serial.println("[MQTT-REVOKE] ========================================");
-      addSystemLog("[MQTT-REVOKE] Token verified - unclaiming device");
-      unclaimDeviceWithSource("mqtt_revoke");
-    } else {
-      Serial.println("[MQTT-REVOKE] ========================================");
-      Serial.println("[MQTT-REVOKE] TOKEN VERIFICATION FAILED");
-      Serial.println("[MQTT-REVOKE] Device will STAY CLAIMED");
-      Serial.println("[MQTT-REVOKE] ========================================");
-      addSystemLog("[MQTT-REVOKE] Token verification failed - staying claimed");
-    }
-    return;
+// Capture and send snapshot without triggering alarm
+static void mqttCmdCaptureSnapshot(JsonDocument &) {
+  Serial.println("[MQTT] Snapshot capture requested via server command");
+  addSystemLog("[MQTT] Capturing snapshot via server command");
+  captureAndUploadSnapshot();
+}
+
+// Update tenant credentials - used when moving device between tenants
+static void mqttCmdUpdateTenant(JsonDocument &doc) {
+  Serial.println("[MQTT-TENANT] ========================================");
+  Serial.println("[MQTT-TENANT] TENANT UPDATE COMMAND RECEIVED");
+  Serial.println("[MQTT-TENANT] ========================================");
+
+  const char* newTenantId = doc["tenantId"];
+  const char* newDeviceId = doc["deviceId"];
+  const char* newDeviceName = doc["deviceName"];
+  const char* moveId = doc["moveId"];  // Track the move operation
+
+  if (newTenantId && newDeviceId) {
+    Serial.printf("[MQTT-TENANT] Updating tenant from %s to %s\n",
+                  claimedTenantId.c_str(), newTenantId);
+    Serial.printf("[MQTT-TENANT] New device name: %s\n", newDeviceName ? newDeviceName : "(unchanged)");
+    addSystemLog("[MQTT-TENANT] Updating tenant credentials");
+
+    // Store old tenant for confirmation message
+    String oldTenantId = claimedTenantId;
+
+    // Update credentials in memory
+    claimedTenantId = String(newTenantId);
+    claimedDeviceId = String(newDeviceId);
+    if (newDeviceName) claimedDeviceName = String(newDeviceName);
+
+    // Persist to preferences using devicePrefs (same as saveClaimedCredentials)
+    nvsPutString("device", "tenantId", claimedTenantId);
+    nvsPutString("device", "deviceId", claimedDeviceId);
+    nvsPutString("device", "deviceName", claimedDeviceName);
+    nvsCommit("device");
+
+    Serial.println("[MQTT-TENANT] Credentials saved to NVS");
+    addSystemLog("[MQTT-TENANT] Tenant credentials saved, reconnecting...");
+
+    // Disconnect and reconnect with new tenant
+    mqttClient.disconnect();
+    mqttReallyConnected = false;
+    lastMqttReconnect = 0;  // Force immediate reconnect
+
+    // The device will automatically reconnect with new credentials
+    // and subscribe to new tenant's topics
+
+    Serial.println("[MQTT-TENANT] ========================================");
+    Serial.printf("[MQTT-TENANT] Tenant move complete: %s -> %s\n",
+                  oldTenantId.c_str(), claimedTenantId.c_str());
+    Serial.println("[MQTT-TENANT] Device will reconnect with new credentials");
+    Serial.println("[MQTT-TENANT] ========================================");
+
+    // Note: Confirmation will be sent after reconnecting to new tenant
+    // via the regular status publish mechanism
+  } else {
+    Serial.println("[MQTT-TENANT] ERROR: Missing required fields (tenantId, deviceId)");
+    addSystemLog("[MQTT-TENANT] ERROR: Invalid update_tenant command - missing fields");
   }
+}
 
-  // Handle commands
-  if (strstr(topic, "/command/")) {
-    const char* cmd = doc["command"];
-    if (cmd) {
-      Serial.printf("[MQTT] Command: %s\n", cmd);
-      addSystemLog(String("[MQTT] Command received: ") + cmd);
+// Rotate MQTT credentials - ACK-based rotation for Dynamic Security
+static void mqttCmdRotateCredentials(JsonDocument &doc) {
+  // CRITICAL: Must publish ACK BEFORE disconnecting so server knows to update broker
+  Serial.println("[MQTT-ROTATE] ========================================");
+  Serial.println("[MQTT-ROTATE] CREDENTIAL ROTATION COMMAND RECEIVED");
+  Serial.println("[MQTT-ROTATE] ========================================");
 
-      if (strcmp(cmd, "reboot") == 0) {
-        ESP.restart();
-      } else if (strcmp(cmd, "status") == 0) {
-        publishDeviceStatus();
-      } else if (strcmp(cmd, "clear_versions") == 0) {
-        versionPrefs.begin("versions", false);
-        versionPrefs.clear();
-        versionPrefs.end();
-        Serial.println("[MQTT] Cleared version preferences");
-        addSystemLog("[MQTT] Cleared version preferences, rebooting...");
-        delay(1000);
-        ESP.restart();
-      } else if (strcmp(cmd, "alert_reset") == 0 || strcmp(cmd, "alert_clear") == 0) {
-        // Clear alert state using new escalation system
-        handleAlertClearCommand(doc);
-      } else if (strcmp(cmd, "test_trigger") == 0) {
-        // Test trigger from server - start escalation without taking photos
-        handleTestTriggerCommand();
-      } else if (strcmp(cmd, "escalation") == 0) {
-        // Update escalation settings (preset, timing, force level)
-        handleEscalationCommand(doc);
-      } else if (strcmp(cmd, "capture_snapshot") == 0) {
-        // Capture and send snapshot without triggering alarm
-        Serial.println("[MQTT] Snapshot capture requested via server command");
-        addSystemLog("[MQTT] Capturing snapshot via server command");
-        captureAndUploadSnapshot();
-      } else if (strcmp(cmd, "update_tenant") == 0) {
-        // Update tenant credentials - used when moving device between tenants
-        Serial.println("[MQTT-TENANT] ========================================");
-        Serial.println("[MQTT-TENANT] TENANT UPDATE COMMAND RECEIVED");
-        Serial.println("[MQTT-TENANT] ========================================");
-
-        const char* newTenantId = doc["tenantId"];
-        const char* newDeviceId = doc["deviceId"];
-        const char* newDeviceName = doc["deviceName"];
-        const char* moveId = doc["moveId"];  // Track the move operation
-
-        if (newTenantId && newDeviceId) {
-          Serial.printf("[MQTT-TENANT] Updating tenant from %s to %s\n",
-                        claimedTenantId.c_str(), newTenantId);
-          Serial.printf("[MQTT-TENANT] New device name: %s\n", newDeviceName ? newDeviceName : "(unchanged)");
-          addSystemLog("[MQTT-TENANT] Updating tenant credentials");
-
-          // Store old tenant for confirmation message
-          String oldTenantId = claimedTenantId;
-
-          // Update credentials in memory
-          claimedTenantId = String(newTenantId);
-          claimedDeviceId = String(newDeviceId);
-          if (newDeviceName) claimedDeviceName = String(newDeviceName);
-
-          // Persist to preferences using devicePrefs (same as saveClaimedCredentials)
-          devicePrefs.begin("device", false);
-          devicePrefs.putString("tenantId", claimedTenantId);
-          devicePrefs.putString("deviceId", claimedDeviceId);
-          devicePrefs.putString("deviceName", claimedDeviceName);
-          devicePrefs.end();
-
-          Serial.println("[MQTT-TENANT] Credentials saved to NVS");
-          addSystemLog("[MQTT-TENANT] Tenant credentials saved, reconnecting...");
-
-          // Disconnect and reconnect with new tenant
-          mqttClient.disconnect();
-          mqttReallyConnected = false;
-          lastMqttReconnect = 0;  // Force immediate reconnect
-
-          // The device will automatically reconnect with new credentials
-          // and subscribe to new tenant's topics
-
-          Serial.println("[MQTT-TENANT] ========================================");
-          Serial.printf("[MQTT-TENANT] Tenant move complete: %s -> %s\n",
-                        oldTenantId.c_str(), claimedTenantId.c_str());
-          Serial.println("[MQTT-TENANT] Device will reconnect with new credentials");
-          Serial.println("[MQTT-TENANT] ========================================");
-
-          // Note: Confirmation will be sent after reconnecting to new tenant
-          // via the regular status publish mechanism
-        } else {
-          Serial.println("[MQTT-TENANT] ERROR: Missing required fields (tenantId, deviceId)");
-          addSystemLog("[MQTT-TENANT] ERROR: Invalid update_tenant command - missing fields");
-        }
-      } else if (strcmp(cmd, "rotate_credentials") == 0) {
-        // Rotate MQTT credentials - ACK-based rotation for Dynamic Security
-        // CRITICAL: Must publish ACK BEFORE disconnecting so server knows to update broker
-        Serial.println("[MQTT-ROTATE] ========================================");
-        Serial.println("[MQTT-ROTATE] CREDENTIAL ROTATION COMMAND RECEIVED");
-        Serial.println("[MQTT-ROTATE] ========================================");
-
-        const char* newPassword = doc["password"];
-        const char* rotationId = doc["rotationId"];  // Track the rotation operation
-
-        if (newPassword && strlen(newPassword) > 0) {
-          Serial.printf("[MQTT-ROTATE] Rotation ID: %s\n", rotationId ? rotationId : "none");
-          Serial.println("[MQTT-ROTATE] Updating MQTT password...");
-          addSystemLog("[MQTT-ROTATE] Updating MQTT credentials");
-
-          // Store old tenant/topic info for ACK
-          String oldTenantId = claimedTenantId;
-          String oldClientId = claimedMqttClientId;
-
-          // Update password in memory
-          claimedMqttPassword = String(newPassword);
-
-          // Persist to NVS FIRST - this is critical!
-          devicePrefs.begin("device", false);
-          devicePrefs.putString("mqttPassword", claimedMqttPassword);
-          devicePrefs.end();
-
-          Serial.println("[MQTT-ROTATE] New credentials saved to NVS");
-          addSystemLog("[MQTT-ROTATE] Credentials saved to NVS");
-
-          // CRITICAL: Publish ACK BEFORE disconnecting
-          // Server waits for this ACK before updating broker credentials
-          if (rotationId && strlen(rotationId) > 0) {
-            char ackTopic[256];
-            snprintf(ackTopic, sizeof(ackTopic), "tenant/%s/device/%s/rotation_ack",
-                     oldTenantId.c_str(), oldClientId.c_str());
-
-            StaticJsonDocument<256> ackDoc;
-            ackDoc["rotationId"] = rotationId;
-            ackDoc["success"] = true;
-            String ackPayload;
-            serializeJson(ackDoc, ackPayload);
-
-            Serial.printf("[MQTT-ROTATE] Publishing ACK to %s\n", ackTopic);
-            bool ackSent = mqttClient.publish(ackTopic, ackPayload.c_str());
-
-            // Process the MQTT client loop to ensure ACK is sent
-            mqttClient.loop();
-            delay(100);  // Small delay to ensure message is transmitted
-            mqttClient.loop();
-
-            if (ackSent) {
-              Serial.println("[MQTT-ROTATE] ACK published successfully");
-              addSystemLog("[MQTT-ROTATE] ACK sent, waiting for broker update...");
-            } else {
-              Serial.println("[MQTT-ROTATE] WARNING: Failed to publish ACK");
-              addSystemLog("[MQTT-ROTATE] WARNING: ACK publish failed");
-            }
-          } else {
-            Serial.println("[MQTT-ROTATE] WARNING: No rotationId - cannot send ACK");
-            addSystemLog("[MQTT-ROTATE] WARNING: No rotationId provided");
-          }
+  const char* newPassword = doc["password"];
+  const char* rotationId = doc["rotationId"];  // Track the rotation operation
 
-          // Now disconnect - server should have received ACK and updated broker
-          Serial.println("[MQTT-ROTATE] Disconnecting to reconnect with new credentials...");
-          mqttClient.disconnect();
-          mqttReallyConnected = false;
-          lastMqttReconnect = 0;  // Force immediate reconnect
+  if (newPassword && strlen(newPassword) > 0) {
+    Serial.printf("[MQTT-ROTATE] Rotation ID: %s\n", rotationId ? rotationId : "none");
+    Serial.println("[MQTT-ROTATE] Updating MQTT password...");
+    addSystemLog("[MQTT-ROTATE] Updating MQTT credentials");
 
-          Serial.println("[MQTT-ROTATE] ========================================");
-          Serial.println("[MQTT-ROTATE] Credential rotation complete");
-          Serial.println("[MQTT-ROTATE] Device will reconnect with new password");
-          Serial.println("[MQTT-ROTATE] ========================================");
-        } else {
-          Serial.println("[MQTT-ROTATE] ERROR: Missing password in rotation command");
-          addSystemLog("[MQTT-ROTATE] ERROR: Invalid rotate_credentials - missing password");
-        }
+    // Store old tenant/topic info for ACK
+    String oldTenantId = claimedTenantId;
+    String oldClientId = claimedMqttClientId;
+
+    // Update password in memory
+    claimedMqttPassword = String(newPassword);
+
+    // Persist to NVS FIRST - this is critical!
+    nvsPutString("device", "mqttPassword", claimedMqttPassword, NVS_SYNC);
+
+    Serial.println("[MQTT-ROTATE] New credentials saved to NVS");
+    addSystemLog("[MQTT-ROTATE] Credentials saved to NVS");
+
+    // CRITICAL: Publish ACK BEFORE disconnecting
+    // Server waits for this ACK before updating broker credentials
+    if (rotationId && strlen(rotationId) > 0) {
+      char ackTopic[256];
+      snprintf(ackTopic, sizeof(ackTopic), "tenant/%s/device/%s/rotation_ack",
+               oldTenantId.c_str(), oldClientId.c_str());
+
+      StaticJsonDocument<256> ackDoc;
+      ackDoc["rotationId"] = rotationId;
+      ackDoc["success"] = true;
+      String ackPayload;
+      serializeJson(ackDoc, ackPayload);
+
+      Serial.printf("[MQTT-ROTATE] Publishing ACK to %s\n", ackTopic);
+      bool ackSent = mqttClient.publish(ackTopic, ackPayload.c_str());
+
+      // Process the MQTT client loop to ensure ACK is sent
+      mqttClient.loop();
+      delay(100);  // Small delay to ensure message is transmitted
+      mqttClient.loop();
+
+      if (ackSent) {
+        Serial.println("[MQTT-ROTATE] ACK published successfully");
+        addSystemLog("[MQTT-ROTATE] ACK sent, waiting for broker update...");
+      } else {
+        Serial.println("[MQTT-ROTATE] WARNING: Failed to publish ACK");
+        addSystemLog("[MQTT-ROTATE] WARNING: ACK publish failed");
       }
+    } else {
+      Serial.println("[MQTT-ROTATE] WARNING: No rotationId - cannot send ACK");
+      addSystemLog("[MQTT-ROTATE] WARNING: No rotationId provided");
     }
+
+    // Now disconnect - server should have received ACK and updated broker
+    Serial.println("[MQTT-ROTATE] Disconnecting to reconnect with new credentials...");
+    mqttClient.disconnect();
+    mqttReallyConnected = false;
+    lastMqttReconnect = 0;  // Force immediate reconnect
+
+    Serial.println("[MQTT-ROTATE] ========================================");
+    Serial.println("[MQTT-ROTATE] Credential rotation complete");
+    Serial.println("[MQTT-ROTATE] Device will reconnect with new password");
+    Serial.println("[MQTT-ROTATE] ========================================");
+  } else {
+    Serial.println("[MQTT-ROTATE] ERROR: Missing password in rotation command");
+    addSystemLog("[MQTT-ROTATE] ERROR: Invalid rotate_credentials - missing password");
+  }
+}
+
+static const MqttCommand kMqttCommands[] = {
+  { "reboot", mqttCmdReboot },
+  { "status", mqttCmdStatus },
+  { "clear_versions", mqttCmdClearVersions },
+  { "alert_reset", handleAlertClearCommand },  // clear alert state (escalation system)
+  { "alert_clear", handleAlertClearCommand },
+  { "test_trigger", mqttCmdTestTrigger },
+  { "escalation", handleEscalationCommand },   // preset, timing, force level
+  { "capture_snapshot", mqttCmdCaptureSnapshot },
+  { "update_tenant", mqttCmdUpdateTenant },
+  { "rotate_credentials", mqttCmdRotateCredentials },
+};
+
+static void mqttOnCommand(const MqttMsg &m) {
+  const char *cmd = (*m.doc)["command"];
+  if (!cmd) return;
+  Serial.printf("[MQTT] Command: %s\n", cmd);
+  addSystemLog("[MQTT] Command received: ", cmd);
+  for (const MqttCommand &c : kMqttCommands) {
+    if (strcmp(cmd, c.name) == 0) return c.fn(*m.doc);
+  }
+}
+
+static const MqttRoute kMqttRoutes[] = {
+  { "revoke", MQTT_SCOPE_DEVICE, true, mqttOnRevoke },
+  { "command/", MQTT_SCOPE_DEVICE, true, mqttOnCommand },
+  { "firmware/latest", MQTT_SCOPE_TENANT | MQTT_SCOPE_GLOBAL, true, mqttOnFirmwareLatest },
+  { "filesystem/latest", MQTT_SCOPE_TENANT | MQTT_SCOPE_GLOBAL, true, mqttOnFilesystemLatest },
+};
+
+static const MqttRoute *mqttRouteFor(const char *topic) {
+  uint8_t scope;
+  const char *rest;
+  if (g_mqttDevicePrefixLen && !strncmp(topic, g_mqttDevicePrefix, g_mqttDevicePrefixLen)) {
+    scope = MQTT_SCOPE_DEVICE;
+    rest = topic + g_mqttDevicePrefixLen;
+  } else if (g_mqttTenantPrefixLen && !strncmp(topic, g_mqttTenantPrefix, g_mqttTenantPrefixLen)) {
+    scope = MQTT_SCOPE_TENANT;
+    rest = topic + g_mqttTenantPrefixLen;
+  } else if (!strncmp(topic, "global/", 7)) {
+    scope = MQTT_SCOPE_GLOBAL;
+    rest = topic + 7;
+  } else {
+    return nullptr;
+  }
+  for (const MqttRoute &r : kMqttRoutes) {
+    if (!(r.scopes & scope)) continue;
+    size_t n = strlen(r.suffix);
+    bool hit = r.suffix[n - 1] == '/' ? !strncmp(rest, r.suffix, n) : !strcmp(rest, r.suffix);
+    if (hit) return &r;
+  }
+  return nullptr;
+}
+
+static void mqttRunRoute(const MqttRoute &r, MqttMsg &m, JsonDocument &doc) {
+  DeserializationError error = deserializeJson(doc, m.payload, m.length);
+  if (error) {
+    Serial.printf("[MQTT] JSON parse error: %s\n", error.c_str());
+    return;
+  }
+  m.doc = &doc;
+  r.fn(m);
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  uint32_t t0 = micros();
+  Serial.printf("[MQTT] Message on %s\n", topic);
+
+  // Update connection tracking - we received a message, so we're definitely connected
+  mqttReallyConnected = true;
+  lastMqttActivity = millis();
+
+  const MqttRoute *route = mqttRouteFor(topic);
+  if (!route) return;
+  // Retained "clear" messages (empty or null) are published when a device
+  // is claimed; they carry nothing for any route
+  if (length == 0 || (length == 4 && memcmp(payload, "null", 4) == 0)) return;
+
+  MqttMsg m = { topic, payload, length, nullptr };
+  if (!route->json) {
+    route->fn(m);
+  } else if (!g_mqttArenaBusy) {
+    g_mqttArenaBusy = true;
+    g_mqttArena.reset();
+    {
+      JsonDocument doc(&g_mqttArena);
+      mqttRunRoute(*route, m, doc);
+    }
+    g_mqttArenaBusy = false;
+  } else {
+    JsonDocument doc;  // nested call; the arena belongs to the outer one
+    mqttRunRoute(*route, m, doc);
   }
+
+  g_mqttCbLastUs = micros() - t0;
+  if (g_mqttCbLastUs > g_mqttCbMaxUs) g_mqttCbMaxUs = g_mqttCbLastUs;
 }
 
 // Connect to MQTT broker
@@ -2786,10 +3323,10 @@ bool mqttConnect() {
 
   // DEBUG: Log credentials state
   addSystemLog("[MQTT] Attempting connection...");
-  addSystemLog("[MQTT] Broker: " + claimedMqttBroker);
-  addSystemLog("[MQTT] Username: " + claimedMqttUsername);
-  addSystemLog("[MQTT] Password: " + String(claimedMqttPassword.length() > 0 ? "SET" : "EMPTY"));
-  addSystemLog("[MQTT] ClientId: " + claimedMqttClientId);
+  addSystemLog("[MQTT] Broker: ", claimedMqttBroker);
+  addSystemLog("[MQTT] Username: ", claimedMqttUsername);
+  addSystemLog("[MQTT] Password: ", claimedMqttPassword.length() > 0 ? "SET" : "EMPTY");
+  addSystemLog("[MQTT] ClientId: ", claimedMqttClientId);
 
   // DEBUG: Test raw TCP connection first
   String broker = claimedMqttBroker;
@@ -2808,7 +3345,7 @@ bool mqttConnect() {
 
   // Don't pre-connect - let PubSubClient handle the connection
   // Just verify the broker string is clean
-  addSystemLog("[MQTT] Using broker: " + broker);
+  addSystemLog("[MQTT] Using broker: ", broker);
 
   Serial.printf("[MQTT] Connecting to %s:%d...\n", claimedMqttBroker.c_str(), MQTT_PORT);
 
@@ -2839,7 +3376,7 @@ bool mqttConnect() {
   if (!connected) {
     int rc = mqttClient.state();
     Serial.printf("[MQTT] Connect failed, rc=%d\n", rc);
-    addSystemLog("[MQTT] Connect FAILED, rc=" + String(rc));
+    addSystemLog("[MQTT] Connect FAILED, rc=", rc);
     // PubSubClient state codes:
     // -4: MQTT_CONNECTION_TIMEOUT
     // -3: MQTT_CONNECTION_LOST
@@ -2872,7 +3409,7 @@ bool mqttConnect() {
         Serial.printf("[MQTT-AUTH]   - Device Name: %s\n", claimedDeviceName.c_str());
         Serial.println("[MQTT-AUTH] Checking claim status with server...");
 
-        addSystemLog("[MQTT-AUTH] MQTT authentication failed (rc=" + String(rc) + ") - verifying claim status");
+        addSystemLog("[MQTT-AUTH] MQTT authentication failed (rc=", rc, ") - verifying claim status");
         lastClaimStatusCheck = millis();
 
         // Check with server, but don't unclaim on network errors
@@ -2925,13 +3462,14 @@ bool mqttConnect() {
 
   Serial.println("[MQTT] Connected with claimed credentials!");
   Serial.printf("[MQTT] Client ID: %s\n", clientId.c_str());
-  addSystemLog("[MQTT] Connected as " + claimedDeviceName);
+  addSystemLog("[MQTT] Connected as ", claimedDeviceName);
 
   // Mark as really connected
   mqttReallyConnected = true;
   lastMqttActivity = millis();
 
   // Subscribe to topics using claimed IDs
+  mqttSetTopicPrefixes();
   char topic[256];
 
   // Device revocation topic (highest priority - subscribe first)
@@ -3000,7 +3538,7 @@ void mqttSetup() {
 
   mqttClient.setServer(mqttBrokerDomain, MQTT_PORT);
   mqttClient.setCallback(mqttCallback);
-  mqttClient.setBufferSize(51200);  // 50KB buffer for snapshot images (~30KB base64 + JSON)
+  mqttClient.setBufferSize(8192);  // JSON commands/status only - images are streamed (mqttPublishImageJson)
 
   if (deviceClaimed) {
     Serial.printf("[MQTT] Configured for %s:%d (Claimed Device)\n", brokerStr.c_str(), MQTT_PORT);
@@ -3133,15 +3671,18 @@ inline String makeBootCrashReport() {
 }
 }
 
-// RAII: stamps entry/exit of a handler so baseline code can’t overwrite it
+// RAII: stamps entry/exit of a handler so baseline code can’t overwrite it;
+// also times the handler body into the "http" latency probe
 struct PageScope {
-  explicit PageScope(const char *n) {
+  explicit PageScope(const char *n) : t0(perfNow()) {
     CrashKit::s_pageActive = true;
     CrashKit::markPage(n);
   }
   ~PageScope() {
     CrashKit::s_pageActive = false; /* keep stamp */
+    perfRecord(PERF_HTTP, t0);
   }
+  PerfStamp t0;
 };
 
 // ---- Helper macros ----
@@ -3298,6 +3839,13 @@ constexpr bool SERVO_ENABLED = false;
  * ------------------------------------------------------------------*/
 #define RECAL_PERIOD_MS 3600000  // 5 minutes  (use 3600000 in production)
 
+/* Incremental recalibration: the sensor task re-derives the threshold from
+   the rolling baseline (range_stats.h) instead of a blocking 10 s burst. */
+#define RECAL_STEP_MS 60000        // how often the sensor task re-derives it
+#define RECAL_MIN_SAMPLES 120      // baseline samples before it's trusted (~2 min)
+#define THRESH_HYSTERESIS_MM 3     // smaller differences are left alone
+#define THRESH_MAX_STEP_MM 2       // per step, so the threshold glides
+
 
 /******************************************************************
  *  SERVO CONSTANTS  (top-of-file, right next to the attach helpers)
@@ -3325,10 +3873,12 @@ void alertFunction();           // defined later
 void setHighPowerLED(bool on);  // defined later
 bool recordVideo(const String &filePath,
                  uint32_t durationMs = 10000);                      // defined later
-bool captureSingleFrame(const String &fullPath, bool flash = true);  // defined later
+bool captureSingleFrame(const String &fullPath, bool flash = true,
+                        bool queueThumb = true);                    // defined later
 void dumpCaptures();
 String formatTime(time_t t);
 String getHamburgerMenuHTML();
+static bool pageCommonVar(const char *key, PageVar &v);  // {{menu}} etc.
 // Calibration & false‐alarm handlers
 void handleCalibrationPage(AsyncWebServerRequest *req);
 void handleSetCalibration(AsyncWebServerRequest *req);
@@ -3375,7 +3925,7 @@ void flushBootLog() {
     int nextBreak = preNTPLogBuffer.indexOf('\n', lineStart);
     if (nextBreak < 0) break;
     String rawLine = preNTPLogBuffer.substring(lineStart, nextBreak);
-    addSystemLog("[boot] " + rawLine);  // prefix or use formatTime()
+    addSystemLog("[boot] ", rawLine);  // prefix or use formatTime()
     lineStart = nextBreak + 1;
   }
 
@@ -3397,43 +3947,85 @@ static inline void cameraUnlock() {
   if (g_camMux) xSemaphoreGive(g_camMux);
 }
 
-// ---- Size-based darkness heuristic ----------------------------------------
-// For JPEG @ quality≈12, bright scenes are bigger; dark scenes compress small.
-// Threshold ≈ (pixels / 12), clamped to practical min/max.
-static size_t jpegDarkThreshold(size_t w, size_t h) {
-  size_t px = w * h;
-  size_t th = px / 12;              // empirical for Q~12
-  if (th < 16000)  th = 16000;      // floor for tiny frames
-  if (th > 120000) th = 120000;     // cap for very large frames
-  return th;
-}
-
-// ---- One shot that auto-decides to use LED, no pixformat switching ---------
-static camera_fb_t* grabAutoLitJpeg(bool *usedFlashOut) {
-  if (usedFlashOut) *usedFlashOut = false;
-
-  // 1) Test shot with LED OFF
-  camera_fb_t *fb = esp_camera_fb_get();
-  if (fb) debugFramebufferAllocated(fb);
-  if (!fb) return nullptr;
+#include "light_heuristics.h"  // jpegDarkThreshold(), lightProbeIsDark()
+
+// ---- Light-level model ------------------------------------------------------
+// The trap box is lit the same way for hours at a time, so the flash/no-flash
+// decision is cached instead of re-measured with a test shot every call. A
+// fresh test shot ("probe") is only taken when the decision is older than
+// LIGHT_REPROBE_MS, the hour of day moved to one last seen with the other
+// decision, or (OV2640) the sensor's own exposure × gain drifted by more than
+// LIGHT_AE_DRIFT from what it was at the last probe. Probe results flip the
+// decision only when they clear the threshold by LIGHT_HYST_PCT.
+#define LIGHT_REPROBE_MS  (15UL * 60UL * 1000UL)
+#define LIGHT_AE_DRIFT    2.0f
+
+struct LightModel {
+  bool     valid = false;
+  bool     dark = false;
+  uint32_t decidedMs = 0;
+  int8_t   hour = -1;
+  int8_t   hourDark[24];        // -1 unknown, 0 bright, 1 dark (last probe in that hour)
+  uint32_t ae = 0;              // exposure × gain at the last no-flash probe, 0 = n/a
+  uint32_t hits = 0, probes = 0;
+
+  LightModel() { memset(hourDark, -1, sizeof(hourDark)); }
+};
+static LightModel g_light;
 
-  size_t threshold = jpegDarkThreshold(fb->width, fb->height);
-  threshold = threshold - 12000;
-  bool tooDark = (fb->len < threshold);
-  addSystemLog("Checking light level...");
-  addSystemLog(String(fb->len));
-  addSystemLog(String("threshold = ") + threshold);
-  addSystemLog(String("Bool tooDark = ") + tooDark);
+static int lightHourNow() {
+  time_t now = time(nullptr);
+  if (now < 1700000000) return -1;  // no NTP yet
+  struct tm tmNow;
+  localtime_r(&now, &tmNow);
+  return tmNow.tm_hour;
+}
 
-  if (!tooDark) {
-    // Looks bright enough—use this frame
-    return fb;
+// OV2640 exposure lines × gain step, straight from the sensor bank registers;
+// 0 when the sensor can't report it. Caller holds cameraLock.
+static uint32_t lightSensorAe() {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || s->id.PID != OV2640_PID || !s->get_reg) return 0;
+  int hi = s->get_reg(s, 0x145, 0x3F);  // REG45[5:0] = AEC[15:10]
+  int mid = s->get_reg(s, 0x110, 0xFF); // AEC[9:2]
+  int lo = s->get_reg(s, 0x104, 0x03);  // REG04[1:0] = AEC[1:0]
+  int gain = s->get_reg(s, 0x100, 0xFF);
+  if (hi < 0 || mid < 0 || lo < 0 || gain < 0) return 0;
+  uint32_t aec = ((uint32_t)hi << 10) | ((uint32_t)mid << 2) | (uint32_t)lo;
+  // gain = (1 + [3:0]/16) × 2 per set bit of [7:4]; kept ×16 to stay integral
+  return aec * ((16u + (gain & 0x0F)) << __builtin_popcount((gain >> 4) & 0x0F));
+}
+
+// true → cached decision is usable as is
+static bool lightCacheFresh(int hour, uint32_t ae) {
+  if (!g_light.valid) return false;
+  if (millis() - g_light.decidedMs > LIGHT_REPROBE_MS) return false;
+  if (hour >= 0 && hour != g_light.hour && g_light.hourDark[hour] != (int8_t)g_light.dark) return false;
+  if (ae && g_light.ae) {
+    float r = (float)ae / g_light.ae;
+    if (r > LIGHT_AE_DRIFT || r < 1.0f / LIGHT_AE_DRIFT) return false;
   }
+  return true;
+}
 
-  // 2) Too dark: capture again with LED
-  debugFramebufferReleased(fb);
-  esp_camera_fb_return(fb);
+static void lightRecordProbe(size_t jpegLen, size_t threshold, int hour, uint32_t ae) {
+  bool dark = lightProbeIsDark(jpegLen, threshold, g_light.valid, g_light.dark);
+
+  bool flipped = g_light.valid && dark != g_light.dark;
+  g_light.valid = true;
+  g_light.dark = dark;
+  g_light.decidedMs = millis();
+  g_light.hour = hour;
+  if (hour >= 0) g_light.hourDark[hour] = dark;
+  g_light.ae = ae;
+  g_light.probes++;
+  addSystemLogf("Light probe: %u B vs %u → %s%s (ae=%u, %u cached / %u probes)",
+                (unsigned)jpegLen, (unsigned)threshold, dark ? "flash" : "no flash",
+                flipped ? " [changed]" : "", (unsigned)ae, (unsigned)g_light.hits, (unsigned)g_light.probes);
+}
 
+// LED-on capture: warm-up, one discarded frame so AE converges, the real frame
+static camera_fb_t* grabFlashJpeg() {
   setHighPowerLED(true);
   delay(preFlashMs);
 
@@ -3446,14 +4038,52 @@ static camera_fb_t* grabAutoLitJpeg(bool *usedFlashOut) {
   }
   delay(settleMs);
 
-  fb = esp_camera_fb_get();
+  camera_fb_t *fb = esp_camera_fb_get();
   if (fb) debugFramebufferAllocated(fb);
 
   delay(postOffMs);
   setHighPowerLED(false);
+  return fb;
+}
+
+// ---- One shot that auto-decides to use LED, no pixformat switching ---------
+static camera_fb_t* grabAutoLitJpeg(bool *usedFlashOut) {
+  if (usedFlashOut) *usedFlashOut = false;
+
+  int hour = lightHourNow();
+  uint32_t ae = lightSensorAe();  // LED is off here, so this tracks the ambient light
+
+  if (lightCacheFresh(hour, ae)) {
+    g_light.hits++;
+    if (g_light.dark) {
+      if (usedFlashOut) *usedFlashOut = true;
+      return grabFlashJpeg();
+    }
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (fb) debugFramebufferAllocated(fb);
+    return fb;
+  }
+
+  // 1) Test shot with LED OFF
+  camera_fb_t *fb = esp_camera_fb_get();
+  if (fb) debugFramebufferAllocated(fb);
+  if (!fb) return nullptr;
+
+  size_t threshold = jpegDarkThreshold(fb->width, fb->height);
+  threshold = threshold - 12000;
+  lightRecordProbe(fb->len, threshold, hour, ae);
+
+  if (!g_light.dark) {
+    // Looks bright enough—use this frame
+    return fb;
+  }
+
+  // 2) Too dark: capture again with LED
+  debugFramebufferReleased(fb);
+  esp_camera_fb_return(fb);
 
   if (usedFlashOut) *usedFlashOut = true;
-  return fb;  // may be nullptr if capture failed
+  return grabFlashJpeg();  // may be nullptr if capture failed
 }
 
 
@@ -3463,12 +4093,8 @@ volatile bool disableServo = true;
 // Single source of truth for changing the gate.
 static void setDisableServo(bool v, const char* src) {
   disableServo = v;
-  // persist
-  Preferences p;
-  if (p.begin("trap", /*readOnly=*/false)) {
-    p.putBool("disableServo", v);
-    p.end();
-  }
+  // persist (skipped when NVS already holds v, e.g. the boot-time call)
+  nvsPutBool("trap", "disableServo", v, NVS_SOON);
   applyServoDisableState(src);
   Serial.printf("[servo] setDisableServo(%d) by %s @%p\n", (int)v, &disableServo);
 }
@@ -3498,7 +4124,8 @@ void loadServoSettings() {
 
 /* ---------- globals & forward declarations ---------- */
 inline void logServo(const char *tag);  // fwd
-int computeThreshold(uint16_t avg);
+int computeThreshold(uint16_t avg, float stddev = 0);
+static void recalFromBaseline(bool jump);  // sensor task, see requestRecalibration()
 bool crashedWhileArming;
 
 //Servo trapServo;  // global instance
@@ -3516,7 +4143,7 @@ static void attachServoIfEnabled() {
       addSystemLog("⚠️ Servo attach FAILED (first attach)");
       return;
     }
-    addSystemLog(String("Servo attached on LEDC channel: ") + ch);
+    addSystemLog("Servo attached on LEDC channel: ", ch);
     // Optional: put the horn at a neutral position so it won’t “kick”
     // trapServo.writeMicroseconds(1500);
   }
@@ -3546,14 +4173,31 @@ volatile uint32_t calibDoneMillis = 0;
 
 /* hourly calibration */
 //TimerHandle_t reCalTimer = nullptr;
-volatile bool reCalBusy = false;  // prevents overlapping calibrations
+volatile bool g_recalNow = false;  // explicit request: apply the baseline threshold at once
 
 
 
 static volatile bool flushInProgress = false;
 //VideoJob   *currentJob      = nullptr;  // points to the active job, else null
 
-static const size_t PSRAM_LIMIT = 3 * 1024 * 1024UL;
+/* video pipeline: recorder fills PSRAM slots, writer drains them to LittleFS */
+#define VIDEO_RING_SLOTS      12           // frames in flight between the two tasks
+#define VIDEO_SLOT_MIN_BYTES  (64 * 1024)  // first allocation per slot; grows on demand
+#define VIDEO_FS_RESERVE      (64 * 1024)  // stop writing when LittleFS gets this full
+#define VIDEO_ROOM_BYTES      (2 * 1024 * 1024)  // old captures evicted to free this before a clip
+
+/* pre-trigger ring: low-rate JPEGs kept in PSRAM while armed in video mode */
+#define PREROLL_MAX_FRAMES    48
+#define PREROLL_INTERVAL_MS   250  // ~4 fps background grabs
+uint8_t  preRollSec = 0;     // seconds before the trip to keep, 0 = off
+uint16_t preRollKB  = 1024;  // PSRAM byte budget for the ring
+
+struct PreRollFrame {
+  uint8_t *data;
+  size_t cap;
+  size_t len;
+  uint32_t ms;  // millis() at capture
+};
 
 
 
@@ -3662,8 +4306,11 @@ static camera_fb_t* grabOneJpegWithOptionalFlash(bool flash) {
 
 //const char *CAPTURE_DIR = "/captures";
 
+static int g_jobButton = -1;  // loop job that polls the button while it is held
+
 void IRAM_ATTR buttonISR() {
   buttonPressed = true;
+  loopJobKickFromISR(g_jobButton);
 }
 
 void beepReady() {
@@ -3834,13 +4481,10 @@ void checkClaimCompletion() {
 
   Serial.println("[CLAIMING] Checking claim status: " + checkUrl);
 
-  HTTPClient http;
-  http.begin(checkUrl);
-
-  int httpCode = http.GET();
+  String payload;
+  int httpCode = httpSvcRequest("GET", checkUrl.c_str(), nullptr, &payload, 5000);  // polled: keep-alive
 
   if (httpCode == 200) {
-    String payload = http.getString();
     Serial.println("[CLAIMING] Server response: " + payload);
 
     // Parse JSON response
@@ -3849,7 +4493,6 @@ void checkClaimCompletion() {
 
     if (error) {
       Serial.println("[CLAIMING] JSON parse error: " + String(error.c_str()));
-      http.end();
       return;
     }
 
@@ -3938,7 +4581,7 @@ void checkClaimCompletion() {
         TASK_YIELD_MS(50);
       }
 
-      addSystemLog("[CLAIMING] Device claimed successfully to tenant: " + tenantId);
+      addSystemLog("[CLAIMING] Device claimed successfully to tenant: ", tenantId);
 
       // Restart mDNS with new hostname (e.g., kitchen.mousetrap.local)
       Serial.println("[CLAIMING] Restarting mDNS with device-specific hostname...");
@@ -3959,8 +4602,6 @@ void checkClaimCompletion() {
   } else {
     Serial.println("[CLAIMING] HTTP error checking claim status: " + String(httpCode));
   }
-
-  http.end();
 }
 
 void checkClaimingModeTimeout() {
@@ -3977,9 +4618,7 @@ void checkClaimingModeTimeout() {
 // Clear WiFi credentials from NVS for factory reset
 void clearWiFiCredentials() {
   Serial.println("[FACTORY-RESET] Clearing WiFi credentials from NVS");
-  devicePrefs.begin("wifi", false);  // read-write
-  devicePrefs.clear();
-  devicePrefs.end();
+  nvsClear("wifi");
 
   savedSSID = "";
   savedPassword = "";
@@ -4215,6 +4854,9 @@ TwoWire I2CSensors = TwoWire(0);
 #define WEEK_HOURS 168  // 7 days * 24 hours
 #define MAX_ANOMALIES 20
 #define ANOMALY_MIN_INTERVAL 10  // seconds
+#define ANOMALY_MIN_DELTA_MM 30  // never flag less than this from the baseline...
+#define ANOMALY_SIGMA 4.0f       // ...or less than this many baseline std devs
+#define BASELINE_ALPHA (1.0f / 600)  // ~10 min time constant at one sample per second
 
 //int threshold = 25;  // Sensor detection threshold (mm)
 uint8_t range = 200;
@@ -4222,19 +4864,89 @@ time_t lastAlertTime = 0;
 time_t lastEmailTime = 0;
 bool lastEmailSuccess = false;
 unsigned long lastLEDToggleTime = 0;
-float currentHourSum = 0;
-unsigned long currentHourCount = 0;
 time_t hourStartTime = 0;
-float weeklyAverages[WEEK_HOURS] = { 0 };
-int currentHourIndex = 0;
 
 struct Anomaly {
   time_t timestamp;
   uint8_t reading;
 };
-Anomaly anomalyEvents[MAX_ANOMALIES];
-int anomalyCount = 0;
-time_t lastAnomalyTime = 0;
+
+struct HourSummary {
+  float mean;
+  float stddev;
+  uint8_t p10, p50, p90;
+};
+
+// Written by the sensor task, read by handleData(); guarded by g_rangeStatsMux
+struct RangeStats {
+  Welford hour;              // current hour
+  RangeHistogram hourHist;   // current hour percentiles
+  Ewma baseline{ BASELINE_ALPHA };  // empty-trap reading, fed only above threshold
+  bool baselineSeeded = false;       // calibrateThreshold() measured it
+  RingLog<HourSummary, WEEK_HOURS> weekly;
+  RingLog<Anomaly, MAX_ANOMALIES> anomalies;
+  time_t lastAnomaly = 0;
+};
+static RangeStats g_rangeStats;
+static portMUX_TYPE g_rangeStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// one sample per second
+static void rangeStatsAdd(uint8_t mm, bool belowThreshold) {
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  g_rangeStats.hour.add(mm);
+  g_rangeStats.hourHist.add(mm);
+  if (!belowThreshold) g_rangeStats.baseline.add(mm);
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+}
+
+// Logs an anomaly when a below-threshold reading is well outside the
+// baseline's spread; returns true if one was recorded.
+static bool rangeStatsCheckAnomaly(uint8_t mm, time_t now) {
+  bool hit = false;
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  RangeStats &st = g_rangeStats;
+  if (st.baseline.primed && now - st.lastAnomaly >= ANOMALY_MIN_INTERVAL) {
+    float dev = fabsf((float)mm - st.baseline.mean);
+    hit = dev >= max((float)ANOMALY_MIN_DELTA_MM, ANOMALY_SIGMA * st.baseline.stddev());
+    if (hit) {
+      st.anomalies.push(Anomaly{ now, mm });
+      st.lastAnomaly = now;
+    }
+  }
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+  return hit;
+}
+
+// Closes the current hour into the weekly ring; returns its mean.
+static float rangeStatsCloseHour() {
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  RangeStats &st = g_rangeStats;
+  HourSummary h{ (float)st.hour.mean, (float)st.hour.stddev(),
+                 st.hourHist.percentile(10), st.hourHist.percentile(50), st.hourHist.percentile(90) };
+  st.weekly.push(h);
+  st.hour.reset();
+  st.hourHist.clear();
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+  return h.mean;
+}
+
+static void rangeStatsSeedBaseline(float mean, float stddev) {
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  g_rangeStats.baseline.seed(mean, stddev);
+  g_rangeStats.baselineSeeded = true;
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+}
+
+// false until the baseline has seen enough empty-trap samples
+static bool rangeStatsBaseline(float &mean, float &stddev) {
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  const RangeStats &st = g_rangeStats;
+  bool ok = st.baseline.primed && (st.baselineSeeded || st.baseline.n >= RECAL_MIN_SAMPLES);
+  mean = st.baseline.mean;
+  stddev = st.baseline.stddev();
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+  return ok;
+}
 
 // Persisted IP filtering settings
 String ipWhitelist = "*";  // Default: allow all
@@ -4251,19 +4963,196 @@ String ipBlacklist = "";   // Default: block none
 String accessLogs[MAX_ACCESS_LOGS];
 int accessLogCount = 0;
 
-String systemLogs[MAX_SYSTEM_LOGS];
+#define SYSLOG_SLOT_BYTES 160  // per RAM entry incl. timestamp; longer lines are cut (file keeps more)
+
+// RAM view for /systemLogs: fixed char slots in PSRAM, allocated on first log
+static char (*systemLogs)[SYSLOG_SLOT_BYTES] = nullptr;
 int systemLogCount = 0;  // counts total entries ever written
 
-// ======== Replacement addSystemLog with Heartbeat Aggregation ========
-void addSystemLog(const String &msg) {
-  String nowStr = formatTime(time(nullptr));
+// ======== Log file pipeline ========
+// addSystemLog() never touches flash: lines go into a lock-free ring of
+// fixed-size records (bounded MPMC queue, per-slot sequence numbers) and
+// syslogWriterTask appends them to /logs.txt in batches, rotating there.
+// If the ring is full the line is dropped from the file (it is still in
+// systemLogs[]) and counted; the next batch notes how many were lost.
+#define LOG_PIPE_SLOTS      128   // power of two
+#define LOG_PIPE_TEXT       220   // bytes per line incl. NUL, longer lines truncated
+#define LOG_PIPE_HIGH_WATER 96    // wake the writer early at this fill level
+#define LOG_PIPE_FLUSH_MS   3000  // otherwise flush this often
+
+struct LogPipeRec {
+  std::atomic<uint32_t> seq;
+  char text[LOG_PIPE_TEXT];
+};
 
-  // Identify heartbeats (same heuristic you already have)
-  String lower = msg; lower.toLowerCase();
-  bool isHeartbeat = (lower.indexOf("heartbeat") >= 0) || lower.startsWith("[hb]");
+static LogPipeRec *g_logPipe = nullptr;  // PSRAM, allocated on first use
+static std::atomic<uint32_t> g_logPipeHead{ 0 };
+static std::atomic<uint32_t> g_logPipeTail{ 0 };
+static std::atomic<uint32_t> g_logPipeDropped{ 0 };
+static TaskHandle_t g_logWriterTask = nullptr;
+
+static LogPipeRec *logPipeBuf() {
+  static std::atomic<LogPipeRec *> pipe{ nullptr };
+  LogPipeRec *p = pipe.load(std::memory_order_acquire);
+  if (p) return p;
+  p = (LogPipeRec *)heap_caps_calloc(LOG_PIPE_SLOTS, sizeof(LogPipeRec), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!p) p = (LogPipeRec *)heap_caps_calloc(LOG_PIPE_SLOTS, sizeof(LogPipeRec), MALLOC_CAP_8BIT);
+  if (!p) return nullptr;
+  for (uint32_t i = 0; i < LOG_PIPE_SLOTS; i++) p[i].seq.store(i, std::memory_order_relaxed);
+  LogPipeRec *expected = nullptr;
+  if (!pipe.compare_exchange_strong(expected, p, std::memory_order_acq_rel)) {
+    heap_caps_free(p);  // another task won the race
+    return expected;
+  }
+  g_logPipe = p;
+  return p;
+}
+
+// Non-blocking: claims a slot, copies the line, publishes it.
+static void logPipePush(const char *line, size_t len) {
+  LogPipeRec *buf = logPipeBuf();
+  if (!buf) return;
+
+  uint32_t pos = g_logPipeHead.load(std::memory_order_relaxed);
+  LogPipeRec *rec;
+  for (;;) {
+    rec = &buf[pos & (LOG_PIPE_SLOTS - 1)];
+    int32_t dif = (int32_t)(rec->seq.load(std::memory_order_acquire) - pos);
+    if (dif == 0) {
+      if (g_logPipeHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      g_logPipeDropped.fetch_add(1, std::memory_order_relaxed);  // full
+      return;
+    } else {
+      pos = g_logPipeHead.load(std::memory_order_relaxed);
+    }
+  }
+
+  size_t n = len < LOG_PIPE_TEXT - 1 ? len : LOG_PIPE_TEXT - 1;
+  memcpy(rec->text, line, n);
+  rec->text[n] = '\0';
+  rec->seq.store(pos + 1, std::memory_order_release);
+
+  if (g_logWriterTask && pos - g_logPipeTail.load(std::memory_order_relaxed) >= LOG_PIPE_HIGH_WATER) {
+    xTaskNotifyGive(g_logWriterTask);
+  }
+}
+
+// Writer side: appends everything queued to /logs.txt, then rotates if needed.
+// SysLogW and flushSystemLogs() can both get here; fsLock() makes them take
+// turns as the ring's single consumer, so tail is only read under it.
+static void logPipeDrain() {
+  LogPipeRec *buf = g_logPipe;
+  if (!buf) return;
+
+  uint32_t peek = g_logPipeTail.load(std::memory_order_relaxed);  // hint only
+  if (buf[peek & (LOG_PIPE_SLOTS - 1)].seq.load(std::memory_order_acquire) != peek + 1 &&
+      g_logPipeDropped.load(std::memory_order_relaxed) == 0) {
+    return;  // nothing to do - don't open the file
+  }
+
+  PERF_SCOPE(PERF_LOG_FLUSH);
+  fsLock();
+  uint32_t tail = g_logPipeTail.load(std::memory_order_relaxed);
+  File f = LittleFS.open("/logs.txt", FILE_APPEND);
+  if (f) {
+    uint32_t dropped = g_logPipeDropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) f.printf("%s [log] %u lines dropped (log writer behind)\n", formatTime(time(nullptr)).c_str(), (unsigned)dropped);
+    for (;;) {
+      LogPipeRec &rec = buf[tail & (LOG_PIPE_SLOTS - 1)];
+      if (rec.seq.load(std::memory_order_acquire) != tail + 1) break;
+      f.write((const uint8_t *)rec.text, strlen(rec.text));
+      f.write('\n');
+      rec.seq.store(tail + LOG_PIPE_SLOTS, std::memory_order_release);
+      tail++;
+    }
+    g_logPipeTail.store(tail, std::memory_order_relaxed);
+    size_t sz = f.size();
+    f.close();
+    if (sz > MAX_LOGFILE_BYTES) {
+      LittleFS.remove("/logs.older");
+      LittleFS.rename("/logs.txt", "/logs.old");
+      LittleFS.rename("/logs.old", "/logs.older");
+      File nf = LittleFS.open("/logs.txt", "w");
+      if (nf) nf.close();
+    }
+  }
+  fsUnlock();
+}
+
+static void syslogWriterTask(void *) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_PIPE_FLUSH_MS));
+    if (g_logsStreaming) continue;  // /systemLogs is reading; catch up next round
+    logPipeDrain();
+  }
+}
+
+static void startSyslogWriter() {
+  if (g_logWriterTask) return;
+  xTaskCreatePinnedToCore(syslogWriterTask, "SysLogW", 4096, nullptr, tskIDLE_PRIORITY + 1, &g_logWriterTask, 0);
+}
+
+// Synchronous drain for paths that are about to reboot
+void flushSystemLogs() {
+  logPipeDrain();
+}
+
+// "Mon DD HH:MM:SS" into buf (same format as formatTime), returns length
+static size_t formatTimeInto(char *buf, size_t cap, time_t t) {
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  return strftime(buf, cap, "%b %d %H:%M:%S", &timeinfo);
+}
+
+// snprintf at buf + n; returns the new length, clamped to cap - 1 so a
+// truncated piece can't push the next call's offset past the buffer
+static size_t appendf(char *buf, size_t cap, size_t n, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+static size_t appendf(char *buf, size_t cap, size_t n, const char *fmt, ...) {
+  if (!cap) return 0;
+  if (n >= cap) return cap - 1;
+  va_list ap;
+  va_start(ap, fmt);
+  int w = vsnprintf(buf + n, cap - n, fmt, ap);
+  va_end(ap);
+  if (w > 0) n += (size_t)w;
+  return n < cap ? n : cap - 1;
+}
+
+// Case-insensitive substring test without a lowered copy
+static bool logContainsNoCase(const char *hay, const char *needle) {
+  size_t nl = strlen(needle);
+  for (; *hay; ++hay) {
+    if (strncasecmp(hay, needle, nl) == 0) return true;
+  }
+  return false;
+}
+
+// caller holds syslogLock()
+static char *systemLogSlot(int idx) {
+  if (!systemLogs) {
+    systemLogs = (char (*)[SYSLOG_SLOT_BYTES])heap_caps_calloc(MAX_SYSTEM_LOGS, SYSLOG_SLOT_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!systemLogs) systemLogs = (char (*)[SYSLOG_SLOT_BYTES])heap_caps_calloc(MAX_SYSTEM_LOGS, SYSLOG_SLOT_BYTES, MALLOC_CAP_8BIT);
+    if (!systemLogs) return nullptr;
+  }
+  return systemLogs[idx];
+}
 
-  // Persistent rotation limit
-  //const size_t MAX_LOGFILE_BYTES = 256 * 1024;  // keep your value if different
+// Copies ring entry idx into out (empty if the ring isn't allocated yet)
+static void copySystemLog(int idx, char *out, size_t cap) {
+  syslogLock();
+  char *slot = systemLogs ? systemLogs[idx] : nullptr;
+  strlcpy(out, slot ? slot : "", cap);
+  syslogUnlock();
+}
+
+// ======== addSystemLog core with Heartbeat Aggregation (no heap use) ========
+void addSystemLogLine(const char *msg, size_t len) {
+  char line[LOG_PIPE_TEXT];
+  size_t ts = formatTimeInto(line, sizeof(line), time(nullptr));
+
+  // Identify heartbeats (same heuristic you already have)
+  bool isHeartbeat = logContainsNoCase(msg, "heartbeat") || strncasecmp(msg, "[hb]", 4) == 0;
 
   static int      hbSlotIdx   = -1;
   static uint32_t hbCount     = 0;
@@ -4271,17 +5160,16 @@ void addSystemLog(const String &msg) {
   static int      hbLastRC    = -32768;
 
   if (isHeartbeat) {
-    int rci = msg.indexOf("rc=");
-    if (rci >= 0 && rci + 3 < (int)msg.length()) {
-      hbLastRC = atoi(msg.c_str() + rci + 3);
-    }
+    const char *rc = strstr(msg, "rc=");
+    if (rc && rc[3]) hbLastRC = atoi(rc + 3);
     hbCount++;
 
-    // Build line text
-    String summary = String("Heartbeat × ") + hbCount + " (last " + nowStr;
-    if (hbLastRC != -32768) summary += String(", rc=") + hbLastRC;
-    summary += ")";
-    String line = nowStr + " " + summary;
+    // Build line text: "<now> Heartbeat × N (last <now>[, rc=X])"
+    size_t n = ts;
+    n = appendf(line, sizeof(line), n, " Heartbeat × %lu (last ", (unsigned long)hbCount);
+    n += formatTimeInto(line + n, sizeof(line) - n, time(nullptr));  // 0 if it doesn't fit
+    if (hbLastRC != -32768) n = appendf(line, sizeof(line), n, ", rc=%d", hbLastRC);
+    n = appendf(line, sizeof(line), n, ")");
 
     // Update ring under lock and decide if we need a new slot *inside* the lock
     syslogLock();
@@ -4289,62 +5177,42 @@ void addSystemLog(const String &msg) {
     if (needNewSlot) {
       hbSlotIdx   = systemLogCount % MAX_SYSTEM_LOGS;
       hbSlotEpoch = systemLogCount;
-      systemLogs[hbSlotIdx] = line;
       systemLogCount++;
-    } else {
-      systemLogs[hbSlotIdx] = line;
     }
+    char *slot = systemLogSlot(hbSlotIdx);
+    if (slot) strlcpy(slot, line, SYSLOG_SLOT_BYTES);
     syslogUnlock();
 
-    // Skip FS writes while the page is streaming to avoid contention
-    if (!g_logsStreaming) {
-      const uint32_t EVERY_N = 20;
-      if ((hbCount % EVERY_N) == 1) {
-        fsLock();
-        File f = LittleFS.open("/logs.txt", FILE_APPEND);
-        if (f) {
-          f.printf("%s\n", line.c_str());
-          size_t sz = f.size();
-          f.close();
-          if (sz > MAX_LOGFILE_BYTES) {
-            LittleFS.remove("/logs.older");
-            LittleFS.rename("/logs.txt", "/logs.old");
-            LittleFS.rename("/logs.old", "/logs.older");
-            File nf = LittleFS.open("/logs.txt", "w");
-            if (nf) nf.close();
-          }
-        }
-        fsUnlock();
-      }
-    }
+    // Only every Nth heartbeat reaches the log file
+    const uint32_t EVERY_N = 20;
+    if ((hbCount % EVERY_N) == 1) logPipePush(line, n);
     return;
   }
 
   // -------- Non-heartbeat messages --------
-  String line = nowStr + " " + msg;
+  size_t n = ts;
+  if (n < sizeof(line) - 1) line[n++] = ' ';
+  size_t take = (len < sizeof(line) - 1 - n) ? len : sizeof(line) - 1 - n;
+  memcpy(line + n, msg, take);
+  n += take;
+  line[n] = '\0';
 
   syslogLock();
-  systemLogs[systemLogCount % MAX_SYSTEM_LOGS] = line;
+  char *slot = systemLogSlot(systemLogCount % MAX_SYSTEM_LOGS);
+  if (slot) strlcpy(slot, line, SYSLOG_SLOT_BYTES);
   systemLogCount++;
   syslogUnlock();
 
-  if (!g_logsStreaming) {
-    fsLock();
-    File f = LittleFS.open("/logs.txt", FILE_APPEND);
-    if (f) {
-      f.printf("%s\n", line.c_str());
-      size_t sz = f.size();
-      f.close();
-      if (sz > MAX_LOGFILE_BYTES) {
-        LittleFS.remove("/logs.older");
-        LittleFS.rename("/logs.txt", "/logs.old");
-        LittleFS.rename("/logs.old", "/logs.older");
-        File nf = LittleFS.open("/logs.txt", "w");
-        if (nf) nf.close();
-      }
-    }
-    fsUnlock();
-  }
+  // File write happens later in syslogWriterTask
+  logPipePush(line, n);
+}
+
+void addSystemLog(const char *msg) {
+  if (msg) addSystemLogLine(msg, strlen(msg));
+}
+
+void addSystemLog(const String &msg) {
+  addSystemLogLine(msg.c_str(), msg.length());
 }
 
 
@@ -4468,7 +5336,7 @@ void addAccessLog(String logEntry) {
 // ----- quick helper so we don’t typo the same line ------------
 static inline void logPath(const char *tag, const String &p) {
   const bool exists = LittleFS.exists(p) && !LittleFS.open(p, "r").isDirectory();
-  addSystemLog(String("[PATH] ") + tag + " = \"" + p + "\"  (" + (exists ? "✔︎ exists" : "✘ MISSING") + ")");
+  addSystemLog("[PATH] ", tag, " = \"", p, "\"  (", (exists ? "✔︎ exists" : "✘ MISSING"), ")");
 }
 
 
@@ -4689,11 +5557,22 @@ void syncNTP() {
 //   addSystemLog("tm_.tmisdst = " + String(tm_.tm_isdst));
 // }
 
+// Recompiles ipWhitelist into the allowlist isAllowed() matches against;
+// call whenever the setting changes.
+void compileIpWhitelist() {
+  int skipped = ipAllowlistCompile(ipWhitelist.c_str());
+  if (skipped) addSystemLog("⚠️  IP whitelist: ignored ", skipped, " invalid entr", skipped == 1 ? "y" : "ies");
+}
+
 void loadSettings() {
   preferences.begin("settings", false);
   ipWhitelist = preferences.getString("whitelist", "*");
   ipBlacklist = preferences.getString("blacklist", "");
+  compileIpWhitelist();
   videoMode = preferences.getBool("videoMode", true);
+  snapshotBinary = preferences.getBool("snapBin", false);
+  preRollSec = preferences.getUChar("preRollS", 0);
+  preRollKB = preferences.getUShort("preRollKB", 1024);
   calibrationOffset = preferences.getInt("calibOff", 0);
   falseAlarmOffset = preferences.getInt("falseOff", 0);
   if (falseAlarmOffset < 0) falseAlarmOffset = -falseAlarmOffset;
@@ -4714,6 +5593,8 @@ void loadSettings() {
   addBootLog(String("whitelist=") + String(ipWhitelist));
   addBootLog(String("blacklist=") + String(ipBlacklist));
   addBootLog(String("videoMode=") + String(videoMode));
+  addBootLog(String("snapBin=") + String(snapshotBinary));
+  addBootLog(String("preRoll=") + String(preRollSec) + "s/" + String(preRollKB) + "KB");
   addBootLog(String("calibOff=") + String(calibrationOffset));
   addBootLog(String("falseOff=") + String(falseAlarmOffset));
   addBootLog(String("overrideThreshold=") + String(overrideThreshold));
@@ -4723,30 +5604,26 @@ void loadSettings() {
   if (disableServo) detachServo();
 }
 
+// Queued; the NVS task writes whichever of these changed a moment later.
 void saveSettings() {
-  preferences.begin("settings", false);
-  preferences.putString("whitelist", ipWhitelist);
-  preferences.putString("blacklist", ipBlacklist);
-  preferences.putBool("videoMode", videoMode);
-  preferences.putInt("calibOff", calibrationOffset);
-  preferences.putInt("falseOff", falseAlarmOffset);
-  preferences.end();
+  nvsPutString("settings", "whitelist", ipWhitelist);
+  nvsPutString("settings", "blacklist", ipBlacklist);
+  nvsPutBool("settings", "videoMode", videoMode);
+  nvsPutBool("settings", "snapBin", snapshotBinary);
+  nvsPutUChar("settings", "preRollS", preRollSec);
+  nvsPutUShort("settings", "preRollKB", preRollKB);
+  nvsPutInt("settings", "calibOff", calibrationOffset);
+  nvsPutInt("settings", "falseOff", falseAlarmOffset);
 }
 
 
 // Fetch public IPv4 (plain text). Returns "" if unavailable.
 String getPublicIP() {
-  HTTPClient http;
-  http.begin("http://api.ipify.org");  // simple HTTP avoids TLS weight
-  int rc = http.GET();
-  if (rc == 200) {
-    String ip = http.getString();
-    ip.trim();
-    http.end();
-    return ip;
-  }
-  http.end();
-  return String();
+  String ip;
+  // simple HTTP avoids TLS weight
+  if (httpSvcRequest("GET", "http://api.ipify.org", nullptr, &ip) != 200) return String();
+  ip.trim();
+  return ip;
 }
 
 // === Public IP cache (refresh no more than every 6 hours) ===
@@ -4758,27 +5635,22 @@ static String ensurePublicIp(uint32_t timeoutMs = 2000) {
     return PUBLIC_IP;  // cached is still fresh
   }
 
-  HTTPClient http;
-  http.setTimeout(timeoutMs);
   // Any plain-text service works; you can keep api.ipify.org
-  if (!http.begin("http://api.ipify.org")) return PUBLIC_IP; // keep old if fail
-
-  int rc = http.GET();
-  if (rc == 200) {
-    String ip = http.getString(); ip.trim();
+  String ip;
+  int rc = httpSvcRequest("GET", "http://api.ipify.org", nullptr, &ip, timeoutMs);
+  if (rc == 200) {  // keep the old one on failure
+    ip.trim();
     if (ip.length()) {
       PUBLIC_IP = ip;
       g_publicIpTs = now;
-      addSystemLog("Public IP refreshed: " + PUBLIC_IP);
+      addSystemLog("Public IP refreshed: ", PUBLIC_IP);
     }
   }
-  http.end();
   return PUBLIC_IP;
 }
 
 // heartbeat helper ()
 static void sendHeartbeat() {
-  addSystemLog(String("sendHeartbeat called"));
   if (WiFi.status() != WL_CONNECTED) return;
 
   // 1) Build JSON payload (same style as notifyBootIP, minus crash/trapId)
@@ -4793,23 +5665,13 @@ static void sendHeartbeat() {
   String payload;
   serializeJson(doc, payload);
 
-  // 2) POST to /api/heartbeat with JSON body
+  // 2) POST to /api/heartbeat with JSON body (queued; one log line when done)
   String url = String(emailServer) + "/api/heartbeat";
-  addSystemLog(url);
-
-  HTTPClient h;
-  h.setTimeout(3000);
-  h.begin(url);
-  h.addHeader("Content-Type", "application/json");
-
-  addSystemLog("Heartbeat JSON: " + payload);
-  int rc = h.POST(payload);
   Serial.print("[HB] POST /api/heartbeat body: ");
   Serial.println(payload);
-  Serial.printf("[HB] http rc=%d\n", rc);
-  addSystemLog(String("Heartbeat POST rc=") + rc);
-
-  h.end();  // always free sockets/heap
+  if (!httpSvcPostAsync(url.c_str(), payload, [](int rc) { addSystemLog("Heartbeat POST rc=", rc); })) {
+    addSystemLog("Heartbeat dropped (HTTP queue full)");
+  }
 }
 
 
@@ -4858,9 +5720,7 @@ void triggerServo() {
 
   // Crash window OPENS before rail power
   servoArming = true;
-  preferences.begin("settings", false);
-  preferences.putBool("srvArmFl", true);
-  preferences.end();
+  nvsPutBool("settings", "srvArmFl", true, NVS_SYNC);  // must be on flash before the rail powers
   addSystemLog("[debug] srvArmFl set → true");
 
   digitalWrite(SERVO_ENABLE_PIN, HIGH);  // power servo on
@@ -4878,9 +5738,7 @@ void triggerServo() {
   // ---------- SECOND MOVE (return to start) ----------
   // Re-open window (your logic mirrors original)
   servoArming = true;
-  preferences.begin("settings", false);
-  preferences.putBool("srvArmFl", true);
-  preferences.end();
+  nvsPutBool("settings", "srvArmFl", true, NVS_SYNC);  // still set: no flash write
 
   attachServoIfEnabled();
   // ch = trapServo.attach(SERVO_PIN, 500, 2500);
@@ -4903,9 +5761,7 @@ void triggerServo() {
   servoReleasePin(SERVO_PIN);
 
   // Crash window CLOSES on success
-  preferences.begin("settings", false);
-  preferences.putBool("srvArmFl", false);
-  preferences.end();
+  nvsPutBool("settings", "srvArmFl", false, NVS_SOON);
 
   logServo("After");
 }
@@ -4936,7 +5792,7 @@ inline void logServo(const char *tag) {
   char buf[64];
   snprintf(buf, sizeof(buf), "%s: %d µs (%d °)", tag, us, deg);
   Serial.println(buf);
-  addSystemLog(String(buf));
+  addSystemLog(buf);
 }
 
 // inline void logServo(const char *tag) {
@@ -4980,86 +5836,23 @@ void checkPhysicalButton() {
 // --------------------
 // CIDR Helper Functions
 // --------------------
-uint32_t ipStringToUint(const String &ipStr) {
-  uint32_t ip = 0;
-  int start = 0;
-  for (int i = 0; i < 4; i++) {
-    int dot = ipStr.indexOf('.', start);
-    String part = (dot == -1) ? ipStr.substring(start) : ipStr.substring(start, dot);
-    if (dot != -1) start = dot + 1;
-    ip = (ip << 8) | part.toInt();
-  }
-  return ip;
-}
-
 uint32_t ipToUint(const IPAddress &ip) {
   return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | (uint32_t)ip[3];
 }
 
-bool ipInCIDR(const String &cidr, const IPAddress &ip) {
-  int slashIndex = cidr.indexOf('/');
-  if (slashIndex == -1) return false;
-  String ipPart = cidr.substring(0, slashIndex);
-  String maskPart = cidr.substring(slashIndex + 1);
-  uint32_t cidrIP = ipStringToUint(ipPart);
-  int maskLength = maskPart.toInt();
-  if (maskLength < 0 || maskLength > 32) return false;
-  uint32_t mask = maskLength == 0 ? 0 : 0xFFFFFFFFUL << (32 - maskLength);
-  uint32_t remoteIP = ipToUint(ip);
-  return (cidrIP & mask) == (remoteIP & mask);
-}
-
 
 // --------------------
 // Access Control Functions
 // --------------------
 bool isAllowed(AsyncWebServerRequest *request) {
-  IPAddress remoteIP = request->client()->remoteIP();
-  String remote = remoteIP.toString();
-
-  // For debugging:
-  //Serial.println("==== [isAllowed] Checking IP: " + remote + " ====");
-  //Serial.println("Whitelist: '" + ipWhitelist + "'");
+  // Empty or "*" allows everyone; otherwise the IP must match an entry
+  // (direct IP or CIDR). Compiled by compileIpWhitelist(), so no parsing here.
+  return ipAllowlistMatch(ipToUint(request->client()->remoteIP()));
+}
 
-  // 1) If whitelist is empty or "*", allow everyone and skip further checks.
-  if (ipWhitelist == "" || ipWhitelist == "*") {
-    //Serial.println("[isAllowed] Whitelist is empty or '*'; ALLOW all, ignoring any blacklist.");
-    return true;
-  }
 
-  // 2) Otherwise, parse the whitelist. If the IP is listed (directly or by CIDR), allow; else block.
-  int start = 0;
-  while (start < ipWhitelist.length()) {
-    int comma = ipWhitelist.indexOf(',', start);
-    if (comma == -1) comma = ipWhitelist.length();
-    String entry = ipWhitelist.substring(start, comma);
-    entry.trim();
-    //Serial.println("[isAllowed] Checking whitelist entry: '" + entry + "'");
-
-    if (entry.indexOf('/') != -1) {
-      // Entry is a CIDR (e.g. "192.168.1.0/24")
-      if (ipInCIDR(entry, remoteIP)) {
-        //Serial.println("[isAllowed] IP matches CIDR: " + entry + " => ALLOW");
-        return true;
-      }
-    } else {
-      // Entry is a direct IP (e.g. "192.168.1.100")
-      if (entry == remote) {
-        //Serial.println("[isAllowed] IP matches direct whitelist entry: " + entry + " => ALLOW");
-        return true;
-      }
-    }
-    start = comma + 1;
-  }
-
-  // If we didn’t find any match in the whitelist, we block.
-  //Serial.println("[isAllowed] IP NOT found in whitelist => BLOCK");
-  return false;
-}
-
-
-// Use the exact alias used by ESPAsyncWebServer
-using ArRequestHandlerFunction = std::function<void(AsyncWebServerRequest*)>;
+// Use the exact alias used by ESPAsyncWebServer
+using ArRequestHandlerFunction = std::function<void(AsyncWebServerRequest*)>;
 
 // Replace your existing protectHandler with this:
 ArRequestHandlerFunction protectHandler(ArRequestHandlerFunction inner) {
@@ -5095,7 +5888,7 @@ void handleTriggerServo(AsyncWebServerRequest *req) {
   if (!isAllowed(req)) {
     return req->send(403, "text/plain", "forbidden");
   }
-  addSystemLog("🔄 /servo endpoint hit by " + req->client()->remoteIP().toString());
+  addSystemLog("🔄 /servo endpoint hit by ", req->client()->remoteIP().toString());
 
   if (!disableServo) {
     triggerServo();
@@ -5110,25 +5903,15 @@ void handleTriggerServo(AsyncWebServerRequest *req) {
 /* ----------------------------------------------------------
  *  /test  →  simple page with a “Test alert” button
  * --------------------------------------------------------*/
-void handleTestPage(AsyncWebServerRequest *request) {
-  PAGE_SCOPE("handleTestPage");
-  if (!isAllowed(request)) {  // IP whitelist / blacklist
-    request->send(403, "text/plain", "Forbidden");
-    return;
-  }
-  logRequest(request);
-
-  String html =
+static const char kTestPage[] PROGMEM =
     "<!DOCTYPE html><html><head><meta charset='utf-8'>"
     "<meta name='viewport' content='width=device-width,initial-scale=1'>"
     "<title>Test alert</title>"
     "<style>body{background:#222;color:#ddd;font-family:Arial;padding:10px}"
     "button{padding:10px 20px;font-size:18px;background:#444;color:#ddd;"
     "border:none;cursor:pointer}button:hover{background:#555}</style>"
-    "</head><body>";
-
-  html += getHamburgerMenuHTML();
-  html +=
+    "</head><body>"
+    "{{menu}}"
     "<h1>Test alert</h1>"
     "<p>Press a button to simulate an event or just fire the servo.</p>"
 
@@ -5155,8 +5938,14 @@ void handleTestPage(AsyncWebServerRequest *request) {
     "<br><br><a href='/'>Back</a>"
     "</body></html>";
 
-  request->send(200, "text/html", html);
-  //request->send(200, "text/plain", "✅ Test alert triggered – check /captures/");
+void handleTestPage(AsyncWebServerRequest *request) {
+  PAGE_SCOPE("handleTestPage");
+  if (!isAllowed(request)) {  // IP whitelist / blacklist
+    request->send(403, "text/plain", "Forbidden");
+    return;
+  }
+  logRequest(request);
+  pageSend(request, kTestPage, [](const char *key, PageVar &v) { pageCommonVar(key, v); });
 }
 
 
@@ -5197,11 +5986,9 @@ void handleTestAlert(AsyncWebServerRequest *request) {
 
 
 /* ----------------------------------------------------
- *  getHamburgerMenuHTML – builds the slide-out menu
+ *  kMenuHtml – the slide-out menu, {{menu}} in page templates
  * --------------------------------------------------*/
-String getHamburgerMenuHTML() {
-  String menu;
-  menu +=
+static const char kMenuHtml[] PROGMEM =
     // ──────────────────────────────────────────────────────────
     //  Top bar “hamburger” button
     // ──────────────────────────────────────────────────────────
@@ -5313,7 +6100,18 @@ String getHamburgerMenuHTML() {
     ".submenu{display:none;padding-left:20px}"
     "</style>";
 
-  return menu;
+// Copy for pages that are still built as a String
+String getHamburgerMenuHTML() {
+  return String(kMenuHtml);
+}
+
+// Placeholders every page template may use; true if key was one of them.
+static bool pageCommonVar(const char *key, PageVar &v) {
+  if (!strcmp(key, "menu")) {
+    v.raw(kMenuHtml);
+    return true;
+  }
+  return false;
 }
 
 
@@ -5376,13 +6174,13 @@ void initCamera() {
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x\n", err);
-    addSystemLog(String("Camera init failed with error 0x") + String(err, HEX));
+    addSystemLog("Camera init failed with error 0x", logHex(err));
     cameraInitialized = false;
     return;
   }
 
   Serial.println("Camera init succeeded.");
-  addSystemLog(String("Camera init succeeded."));
+  addSystemLog("Camera init succeeded.");
   cameraInitialized = true;
 
   sensor_t *s = esp_camera_sensor_get();
@@ -5396,7 +6194,7 @@ void initCamera() {
       s->set_saturation(s, -2);
     } else {
       Serial.println("Sensor PID does not match OV2640. Current PID: " + String(s->id.PID));
-      addSystemLog("Sensor PID does not match OV2640. Current PID: " + String(s->id.PID));
+      addSystemLog("Sensor PID does not match OV2640. Current PID: ", s->id.PID);
     }
     // For JPEG, force the sensor resolution to QVGA when PSRAM is available, else VGA.
     //s->set_framesize(s, psramFound() ? FRAMESIZE_QVGA : FRAMESIZE_VGA);
@@ -5410,9 +6208,233 @@ void initCamera() {
   }
 
   Serial.println("Camera initialized.");
-  addSystemLog(String("Camera initialized at ") + framesizeToString(config.frame_size) + " resolution");
+  addSystemLog("Camera initialized at ", framesizeToString(config.frame_size), " resolution");
+}
+
+/* ---- Live view hub ---------------------------------------------------------
+   One producer task owns the camera for live view. While anyone is watching
+   it grabs a frame under cameraLock() at most LIVE_MAX_FPS times a second,
+   copies it into a refcounted PSRAM LiveFrame and hands the DMA buffer
+   straight back. Every /live client streams whichever frame is newest when
+   its socket drains, so a slow client skips frames instead of holding a
+   camera buffer or slowing the others; /camera reuses a fresh hub frame.
+   Captures and recordings wrap themselves in liveHubHold() and the producer
+   stands aside until they finish.                                            */
+#define LIVE_MAX_FPS     10
+#define LIVE_MAX_CLIENTS 3
+#define LIVE_FRESH_MS    300   // /camera serves a hub frame at most this old
+#define LIVE_LINGER_MS   3000  // keep producing this long after the last /camera hit
+
+struct LiveFrame {
+  int refs;      // guarded by g_liveMux
+  uint32_t seq;
+  uint32_t ms;   // millis() at grab
+  size_t len;
+  uint8_t *data; // JPEG, same allocation
+};
+
+static portMUX_TYPE g_liveMux = portMUX_INITIALIZER_UNLOCKED;
+static LiveFrame *g_liveLatest = nullptr;  // hub holds one ref
+static TaskHandle_t g_liveTask = nullptr;
+static volatile int g_liveClients = 0;
+static volatile uint32_t g_liveDemandMs = 0;
+static std::atomic<int> g_liveHold{ 0 };
+static volatile uint32_t g_liveSeq = 0;
+static uint32_t g_liveSkipped = 0;        // frames clients never got to send
+
+static void liveFrameRelease(LiveFrame *f) {
+  if (!f) return;
+  portENTER_CRITICAL(&g_liveMux);
+  bool last = --f->refs == 0;
+  portEXIT_CRITICAL(&g_liveMux);
+  if (last) heap_caps_free(f);
+}
+
+// Newest frame with a reference taken, or nullptr
+static LiveFrame *liveFrameLatest() {
+  portENTER_CRITICAL(&g_liveMux);
+  LiveFrame *f = g_liveLatest;
+  if (f) f->refs++;
+  portEXIT_CRITICAL(&g_liveMux);
+  return f;
+}
+
+static void livePublish(LiveFrame *f) {
+  portENTER_CRITICAL(&g_liveMux);
+  LiveFrame *old = g_liveLatest;
+  g_liveLatest = f;
+  portEXIT_CRITICAL(&g_liveMux);
+  liveFrameRelease(old);
+}
+
+// Someone wants frames soon; wakes an idle producer
+static void liveHubDemand() {
+  g_liveDemandMs = millis();
+  if (g_liveTask) xTaskNotifyGive(g_liveTask);
+}
+
+// Capture paths bracket their camera use with these; the producer skips
+// grabs while any hold is active.
+static inline void liveHubHold() { g_liveHold.fetch_add(1); }
+static inline void liveHubRelease() { g_liveHold.fetch_sub(1); }
+
+// Hub held off for the lifetime of the scope
+struct LiveHubHoldScope {
+  LiveHubHoldScope() { liveHubHold(); }
+  ~LiveHubHoldScope() { liveHubRelease(); }
+};
+
+// esp_camera_fb_get() under cameraLock(); like handleCamera(), the buffer is
+// handed back later without the lock, so file writes never hold the camera
+static camera_fb_t *cameraGrab() {
+  cameraLock();
+  camera_fb_t *fb = esp_camera_fb_get();
+  cameraUnlock();
+  return fb;
+}
+
+static void liveHubTask(void *) {
+  for (;;) {
+    bool wanted = g_liveClients > 0 || millis() - g_liveDemandMs < LIVE_LINGER_MS;
+    if (!wanted) {
+      livePublish(nullptr);                     // give the PSRAM back while idle
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // first viewer wakes us
+      continue;
+    }
+    if (!cameraInitialized || g_liveHold.load() > 0) {
+      TASK_YIELD_MS(50);
+      continue;
+    }
+
+    uint32_t t0 = millis();
+    LiveFrame *f = nullptr;
+    cameraLock();
+    camera_fb_t *fb = g_liveHold.load() > 0 ? nullptr : esp_camera_fb_get();
+    if (fb) {
+      debugFramebufferAllocated(fb);
+      f = (LiveFrame *)heap_caps_malloc(sizeof(LiveFrame) + fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (f) {
+        f->data = (uint8_t *)(f + 1);
+        memcpy(f->data, fb->buf, fb->len);
+        f->len = fb->len;
+      }
+      debugFramebufferReleased(fb);
+      esp_camera_fb_return(fb);
+    }
+    cameraUnlock();
+
+    if (f) {
+      f->refs = 1;
+      f->seq = g_liveSeq + 1;
+      f->ms = millis();
+      livePublish(f);
+      g_liveSeq = f->seq;
+    }
+    int32_t wait = (int32_t)(t0 + 1000 / LIVE_MAX_FPS - millis());
+    TASK_YIELD_MS(wait > 0 ? wait : 1);
+  }
+}
+
+static void startLiveHub() {
+  if (g_liveTask) return;
+  // below the capture task (4), same core as the camera DMA
+  xTaskCreatePinnedToCore(liveHubTask, "LiveHub", 4096, nullptr, 2, &g_liveTask, 1);
+}
+
+// One /live viewer. The filler runs on the async_tcp task whenever the socket
+// can take more, so each client is paced by its own connection. It never
+// waits: that task serves every socket, so a caught-up client gets
+// RESPONSE_TRY_AGAIN and is filled again on its next ack or poll.
+struct LiveClient {
+  LiveFrame *frame;  // part being sent (holds a ref)
+  size_t off;        // bytes of the part already sent
+  uint32_t lastSeq;
+  size_t hdrLen;
+  char hdr[80];
+};
+
+static size_t liveFill(LiveClient *c, uint8_t *buf, size_t maxLen) {
+  if (!c->frame) {
+    LiveFrame *f = liveFrameLatest();
+    if (!f || f->seq == c->lastSeq) {  // caught up
+      liveFrameRelease(f);
+      return RESPONSE_TRY_AGAIN;
+    }
+    if (c->lastSeq && f->seq > c->lastSeq + 1) g_liveSkipped += f->seq - c->lastSeq - 1;
+    c->frame = f;
+    c->lastSeq = f->seq;
+    c->off = 0;
+    c->hdrLen = snprintf(c->hdr, sizeof(c->hdr),
+                         "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                         (unsigned)f->len);
+  }
+
+  const size_t jpegEnd = c->hdrLen + c->frame->len;
+  const size_t partLen = jpegEnd + 2;  // trailing CRLF
+  size_t sent = 0;
+  while (sent < maxLen && c->off < partLen) {
+    const uint8_t *src;
+    size_t avail;
+    if (c->off < c->hdrLen) {
+      src = (const uint8_t *)c->hdr + c->off;
+      avail = c->hdrLen - c->off;
+    } else if (c->off < jpegEnd) {
+      src = c->frame->data + (c->off - c->hdrLen);
+      avail = jpegEnd - c->off;
+    } else {
+      src = (const uint8_t *)"\r\n" + (c->off - jpegEnd);
+      avail = partLen - c->off;
+    }
+    size_t n = min(avail, maxLen - sent);
+    memcpy(buf + sent, src, n);
+    sent += n;
+    c->off += n;
+  }
+  if (c->off >= partLen) {
+    liveFrameRelease(c->frame);
+    c->frame = nullptr;
+  }
+  return sent;
+}
+
+void handleLive(AsyncWebServerRequest *request) {
+  PAGE_SCOPE("handleLive");
+  if (!isAllowed(request)) {
+    request->send(403, "text/plain", "Forbidden");
+    return;
+  }
+  if (!cameraInitialized) {
+    request->send(500, "text/plain", "Camera not initialized");
+    return;
+  }
+  if (g_liveClients >= LIVE_MAX_CLIENTS) {
+    AsyncWebServerResponse *busy = request->beginResponse(503, "text/plain", "Too many viewers");
+    busy->addHeader("Retry-After", "5");
+    request->send(busy);
+    return;
+  }
+
+  LiveClient *c = new LiveClient{};
+  g_liveClients++;
+  liveHubDemand();
+  request->onDisconnect([c]() {
+    liveFrameRelease(c->frame);
+    delete c;
+    g_liveClients--;
+  });
+
+  AsyncWebServerResponse *res = request->beginChunkedResponse(
+    "multipart/x-mixed-replace; boundary=frame",
+    [c](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+      return liveFill(c, buf, maxLen);
+    });
+  res->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+  request->send(res);
 }
 
+// Still frame. Served from the hub when it has a recent one (no camera
+// access at all); otherwise grabbed directly. Either way the hub is told
+// someone is looking, so a polling page is fed from it on the next request.
 void handleCamera(AsyncWebServerRequest *request) {
   PAGE_SCOPE("handleCamera");
   if (!isAllowed(request)) {
@@ -5423,8 +6445,49 @@ void handleCamera(AsyncWebServerRequest *request) {
     request->send(500, "text/plain", "Camera not initialized");
     return;
   }
+  liveHubDemand();
+
+  LiveFrame *lf = liveFrameLatest();
+  if (lf && millis() - lf->ms <= LIVE_FRESH_MS) {
+    struct LfHolder {
+      LiveFrame *f;
+    };
+    LfHolder *lh = new LfHolder{ lf };
+    request->onDisconnect([lh]() {
+      liveFrameRelease(lh->f);
+      delete lh;
+    });
+    AsyncWebServerResponse *res = request->beginResponse(
+      "image/jpeg", lf->len,
+      [lh](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if (!lh->f) return 0;
+        size_t remaining = lh->f->len - index;
+        size_t toSend = remaining > maxLen ? maxLen : remaining;
+        memcpy(buffer, lh->f->data + index, toSend);
+        if (index + toSend >= lh->f->len) {
+          liveFrameRelease(lh->f);
+          lh->f = nullptr;
+        }
+        return toSend;
+      });
+    res->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+    res->addHeader("Content-Disposition", "inline; filename=capture.jpg");
+    request->send(res);
+    return;
+  }
+  liveFrameRelease(lf);
 
+  // a capture has the camera; don't stall the web server behind it
+  if (g_liveHold.load() > 0) {
+    AsyncWebServerResponse *busy = request->beginResponse(503, "text/plain", "Camera busy");
+    busy->addHeader("Retry-After", "1");
+    request->send(busy);
+    return;
+  }
+
+  cameraLock();
   camera_fb_t *fb = esp_camera_fb_get();
+  cameraUnlock();
   if (fb) debugFramebufferAllocated(fb);
   if (!fb) {
     request->send(500, "text/plain", "Camera capture failed");
@@ -5845,9 +6908,85 @@ void initSensor() {
 
 static uint8_t g_lastToFStatus = 0;
 
+/* --------------------------------------------------------------------------
+   VL6180X continuous ranging + threshold interrupt (TOF_INT_PIN wired)
+   The sensor ranges on its own every TOF_CONT_PERIOD_MS and pulls GPIO1 low
+   when a sample is under SYSRANGE__THRESH_LOW. The ISR wakes the sensor task,
+   so the bus is idle until something is in the trap; the task still samples
+   every TOF_IDLE_POLL_MS to keep the hourly averages fed.
+   -------------------------------------------------------------------------- */
+#define VL6180_SYSTEM_MODE_GPIO1        0x0011
+#define VL6180_SYSTEM_INTERRUPT_CONFIG  0x0014
+#define VL6180_SYSTEM_INTERRUPT_CLEAR   0x0015
+#define VL6180_SYSRANGE_START           0x0018
+#define VL6180_SYSRANGE_THRESH_LOW      0x001A
+#define VL6180_SYSRANGE_INTERMEASURE    0x001B
+#define VL6180_SYSRANGE_MAX_CONVERGENCE 0x001C
+#define VL6180_RESULT_RANGE_STATUS      0x004D
+#define VL6180_RESULT_RANGE_VAL         0x0062
+
+#define TOF_CONT_PERIOD_MS   20    // inter-measurement period (10 ms steps)
+#define TOF_CONT_MAX_CONV_MS 12    // must stay below the period
+#define TOF_IDLE_POLL_MS     1000  // wake without an interrupt (averages, charts)
+#define TOF_ACTIVE_POLL_MS   100   // while triggered, same cadence as polling
+
+static volatile bool g_tofContinuous = false;
+static TaskHandle_t g_sensorTask = nullptr;
+static uint8_t g_tofIrqThresh = 0;
+static volatile uint32_t g_tofIrqCount = 0;
+
+static void IRAM_ATTR tofIrqISR() {
+  g_tofIrqCount++;
+  BaseType_t woke = pdFALSE;
+  if (g_sensorTask) vTaskNotifyGiveFromISR(g_sensorTask, &woke);
+  if (woke) portYIELD_FROM_ISR();
+}
+
+static bool tofSetIrqThreshold(uint8_t mm) {
+  if (!I2C_LOCK(50)) return false;
+  bool ok = i2cWrite8(I2CSensors, 0x29, VL6180_SYSRANGE_THRESH_LOW, mm);
+  I2C_UNLOCK();
+  if (ok) g_tofIrqThresh = mm;
+  return ok;
+}
+
+// Switches the VL6180X from single-shot to continuous ranging with a
+// "range below threshold" interrupt on GPIO1. false = keep polling.
+static bool tofStartContinuous(uint8_t thresholdMm) {
+#if TOF_INT_PIN >= 0
+  if (!sensorFound || useVL53) return false;
+  if (!I2C_LOCK(200)) return false;
+
+  bool ok = i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_MODE_GPIO1, 0x10)            // GPIO1 = IRQ out, active low
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_INTERRUPT_CONFIG, 0x01)    // range: level low
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSRANGE_THRESH_LOW, thresholdMm)
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSRANGE_INTERMEASURE, TOF_CONT_PERIOD_MS / 10 - 1)
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSRANGE_MAX_CONVERGENCE, TOF_CONT_MAX_CONV_MS)
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_INTERRUPT_CLEAR, 0x07)
+            && i2cWrite8(I2CSensors, 0x29, VL6180_SYSRANGE_START, 0x03);              // start, continuous
+  if (!ok) {
+    // put back what Adafruit_VL6180X::readRange() expects
+    i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_INTERRUPT_CONFIG, 0x24);
+    i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_INTERRUPT_CLEAR, 0x07);
+  }
+  I2C_UNLOCK();
+  if (!ok) return false;
+
+  g_tofIrqThresh = thresholdMm;
+  g_tofContinuous = true;
+  pinMode(TOF_INT_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(TOF_INT_PIN), tofIrqISR, FALLING);
+  return true;
+#else
+  (void)thresholdMm;
+  return false;
+#endif
+}
+
 // Returns one measurement in mm; 0 means error/out-of-range.
 // Also stashes the last driver-specific status code.
 static inline uint16_t readToF_mm_once() {
+  PERF_SCOPE(PERF_SENSOR);
   if (!sensorFound) {
     g_lastToFStatus = 0xFF;
     return 0;
@@ -5859,6 +6998,16 @@ static inline uint16_t readToF_mm_once() {
   }
 
   uint16_t out = 0;
+  if (g_tofContinuous) {
+    // latest result from the free-running sensor; clearing re-arms GPIO1
+    uint8_t st = 0, r = 0;
+    bool ok = i2cRead8(I2CSensors, 0x29, VL6180_RESULT_RANGE_STATUS, st)
+              && i2cRead8(I2CSensors, 0x29, VL6180_RESULT_RANGE_VAL, r);
+    i2cWrite8(I2CSensors, 0x29, VL6180_SYSTEM_INTERRUPT_CLEAR, 0x07);
+    I2C_UNLOCK();
+    g_lastToFStatus = ok ? (st >> 4) : 0xFE;
+    return (ok && g_lastToFStatus == VL6180X_ERROR_NONE) ? (uint16_t)r : 0;
+  }
   // if (useVL53) {
   //   VL53L0X_RangingMeasurementData_t m;
   //   l53.rangingTest(&m, false);       // Adafruit call (multiple I2C ops)
@@ -5908,17 +7057,112 @@ static inline uint8_t readToFStatus() {
 //   }
 // }
 
+static String clipIndexPath(const String &clip);  // defined below
+
+/* ------- thumbnails: sidecar "<capture>.thm", a ~160x120 JPEG
+   The capture is decoded at 1/4 scale and re-encoded small, so gallery and
+   SPA tiles fetch a few KB instead of the whole frame. */
+#define THUMB_SCALE_SHIFT 2  // 1/4 → VGA gives 160x120
+#define THUMB_QUALITY     60
+
+static String thumbPath(const String &capture) {
+  return capture + CATALOG_THUMB_EXT;
+}
+
+// Width/height from the JPEG's start-of-frame marker.
+static bool jpegDimensions(const uint8_t *jpg, size_t len, uint16_t &w, uint16_t &h) {
+  if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) return false;
+  size_t i = 2;
+  while (i + 9 < len) {
+    if (jpg[i] != 0xFF) return false;
+    uint8_t m = jpg[i + 1];
+    if (m == 0xFF) { i++; continue; }  // fill byte
+    if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+      h = (jpg[i + 5] << 8) | jpg[i + 6];
+      w = (jpg[i + 7] << 8) | jpg[i + 8];
+      return w && h;
+    }
+    i += 2 + ((jpg[i + 2] << 8) | jpg[i + 3]);
+  }
+  return false;
+}
+
+static bool writeThumbnail(const String &capture, const uint8_t *jpg, size_t len) {
+  uint16_t w, h;
+  if (!jpegDimensions(jpg, len, w, h)) return false;
+  uint16_t tw = w >> THUMB_SCALE_SHIFT, th = h >> THUMB_SCALE_SHIFT;
+  size_t rgbLen = (size_t)tw * th * 3;
+
+  uint8_t *rgb = (uint8_t *)heap_caps_malloc(rgbLen, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!rgb) return false;
+  uint8_t *out = nullptr;
+  size_t outLen = 0;
+  bool ok = jpg2rgb888(jpg, len, rgb, (jpg_scale_t)THUMB_SCALE_SHIFT)
+            && fmt2jpg(rgb, rgbLen, tw, th, PIXFORMAT_RGB888, THUMB_QUALITY, &out, &outLen);
+  heap_caps_free(rgb);
+
+  if (ok) {
+    File f = LittleFS.open(thumbPath(capture), FILE_WRITE);
+    ok = f && f.write(out, outLen) == outLen;
+    if (f) f.close();
+    if (!ok) LittleFS.remove(thumbPath(capture));
+  }
+  if (out) free(out);
+  if (ok) catalogSetThumb(capture.c_str());
+  return ok;
+}
+
+// Reads a saved capture back and thumbnails it. Runs on the alert worker so
+// the decode/encode never happens while a frame buffer or the camera is held.
+static bool writeThumbnailFromFile(const char *capture) {
+  File rd = LittleFS.open(capture, "r");
+  size_t len = rd ? rd.size() : 0;
+  uint8_t *jpg = len ? (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : nullptr;
+  bool ok = jpg && rd.read(jpg, len) == len;
+  if (rd) rd.close();
+  ok = ok && writeThumbnail(capture, jpg, len);
+  if (jpg) heap_caps_free(jpg);
+  return ok;
+}
+
+static void thumbEnqueue(const char *capture);  // alert worker, defined below
+
+/* ------- capture housekeeping (all bookkeeping via the catalog) -------- */
+// Removes one capture, its sidecars and its catalog entry.
+static void captureDelete(const char *name, uint8_t kind) {
+  String path = String(CAPTURE_DIR) + "/" + name;
+  LittleFS.remove(path);
+  LittleFS.remove(thumbPath(path));                                  // may not exist
+  if (kind == CAPTURE_VIDEO) LittleFS.remove(clipIndexPath(path));  // may not exist
+  catalogRemove(name);
+}
+
+// FIFO eviction: drops the oldest captures until `need` more bytes fit with
+// VIDEO_FS_RESERVE to spare. False if it still does not fit.
+static bool captureMakeRoom(size_t need) {
+  size_t total = LittleFS.totalBytes();
+  size_t used = LittleFS.usedBytes();
+  CatalogEntry old;
+  while (used + need + VIDEO_FS_RESERVE > total && catalogOldest(CAPTURE_ANY, old)) {
+    captureDelete(old.name, old.kind);
+    used = used > old.size ? used - old.size : 0;  // estimate; avoids re-walking the FS
+    addSystemLog("🗑️  Evicted oldest capture ", old.name, " (", old.size, " bytes)");
+  }
+  return used + need + VIDEO_FS_RESERVE <= total;
+}
+
 /* ----------------------------------------------------
  *  captureSingleFrame  –  grab ONE bright JPEG
  *  fullPath must include “/captures/…jpg”
  *  flash==true  → use the 1 W LED
  * ----------------------------------------------------*/
-bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
+bool captureSingleFrame(const String &fullPath, bool flash /*= true*/, bool queueThumb /*= true*/) {
   /* --- tweakable timings (ms) ----------------------- */
   constexpr uint16_t PRE_FLASH_MS = 150;  // light‑up before dummy frame (was 250)
   constexpr uint16_t SETTLE_MS = 40;      // tiny pause before real frame
   constexpr uint16_t POST_LED_OFF = 10;   // let rail recover
 
+  LiveHubHoldScope hold;  // live view stands aside until we return
   camera_fb_t *fb = nullptr;
 
   /* ---------- 1) “pre‑flash” to train auto‑exposure --- */
@@ -5928,7 +7172,7 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
     TASK_YIELD_MS(PRE_FLASH_MS);
 
     /* discard one dummy frame */
-    fb = esp_camera_fb_get();
+    fb = cameraGrab();
     if (fb) {
       debugFramebufferAllocated(fb);
       debugFramebufferReleased(fb);
@@ -5939,7 +7183,9 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
   }
 
   /* ---------- 2) real capture ------------------------ */
-  fb = esp_camera_fb_get();
+  PerfStamp t0 = perfNow();
+  fb = cameraGrab();
+  perfRecord(PERF_CAPTURE, t0);
   if (fb) debugFramebufferAllocated(fb);
 
   if (flash) {
@@ -5962,7 +7208,7 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
       TASK_YIELD_MS(PRE_FLASH_MS);
     }
 
-    fb = esp_camera_fb_get();
+    fb = cameraGrab();
     if (fb) debugFramebufferAllocated(fb);
 
     if (flash) {
@@ -5972,7 +7218,7 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
     }
 
     if (!fb || fb->len == 0) {
-      addSystemLog("⚠️  empty frame for " + fullPath);
+      addSystemLog("⚠️  empty frame for ", fullPath);
       if (fb) {
         debugFramebufferReleased(fb);
         esp_camera_fb_return(fb);
@@ -5982,9 +7228,12 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
   }
 
   /* ---------- 4) write to LittleFS ------------------ */
+  bool isCapture = fullPath.startsWith(CAPTURE_DIR "/");
+  if (isCapture) captureMakeRoom(fb->len);
+  t0 = perfNow();
   File f = LittleFS.open(fullPath, FILE_WRITE);
   if (!f) {
-    addSystemLog("⚠️  open failed for " + fullPath);
+    addSystemLog("⚠️  open failed for ", fullPath);
     debugFramebufferReleased(fb);
     esp_camera_fb_return(fb);
     return false;
@@ -5993,11 +7242,18 @@ bool captureSingleFrame(const String &fullPath, bool flash /*= true*/) {
   size_t wr = f.write(fb->buf, fb->len);
   size_t expected = fb->len;  // Save before releasing fb
   f.close();
+  perfRecord(PERF_JPEG_WRITE, t0);
+  if (wr == expected && isCapture) catalogAdd(fullPath.c_str(), wr, flash);
   debugFramebufferReleased(fb);
   esp_camera_fb_return(fb);
 
-  addSystemLog(String("📸 ") + fullPath + " : " + String(wr) + " / " + String(expected) + " bytes");
-  return wr == expected;
+  addSystemLog("📸 ", fullPath, " : ", wr, " / ", expected, " bytes");
+  if (wr != expected) {
+    LittleFS.remove(fullPath);
+    return false;
+  }
+  if (isCapture && queueThumb) thumbEnqueue(fullPath.c_str());
+  return true;
 }
 
 /* ------- helper: write little-endian word -------- */
@@ -6005,15 +7261,178 @@ static void le32(File &f, uint32_t v) {
   f.write((uint8_t *)&v, 4);
 }
 
+static uint32_t rd32(File &f) {
+  uint32_t v = 0;
+  if (f.read((uint8_t *)&v, 4) != 4) return 0;
+  return v;
+}
+
+/* ------- clip frame index: sidecar "<clip>.idx" written by the flush writer
+   "MJX1" | u32 frames | frames x { u32 jpegOffset, u32 jpegLen }  (LE)
+   Lets /clip/frame seek straight to one JPEG instead of reading the clip. */
+#define CLIP_INDEX_MAGIC 0x31584A4DUL  // "MJX1"
+
+static String clipIndexPath(const String &clip) {
+  return clip + ".idx";
+}
+
+static bool writeClipIndex(const String &clip, const std::vector<uint32_t> &idx) {
+  File f = LittleFS.open(clipIndexPath(clip), FILE_WRITE);
+  if (!f) return false;
+  le32(f, CLIP_INDEX_MAGIC);
+  le32(f, idx.size() / 2);
+  size_t want = idx.size() * sizeof(uint32_t);
+  bool ok = f.write((const uint8_t *)idx.data(), want) == want;
+  f.close();
+  if (!ok) LittleFS.remove(clipIndexPath(clip));
+  return ok;
+}
+
+// Finds frame n of a clip. Uses the index when present; older clips fall back
+// to hopping from header to header (reads headers only, seeks over JPEG data).
+// *count is set when the total is known (index present), else 0.
+static bool clipFrameLookup(const String &clip, uint32_t n, uint32_t &off, uint32_t &len, uint32_t *count) {
+  if (count) *count = 0;
+
+  File ix = LittleFS.open(clipIndexPath(clip), "r");
+  if (ix) {
+    bool ok = false;
+    if (rd32(ix) == CLIP_INDEX_MAGIC) {
+      uint32_t frames = rd32(ix);
+      if (count) *count = frames;
+      if (n < frames && ix.seek(8 + n * 8)) {
+        off = rd32(ix);
+        len = rd32(ix);
+        ok = len > 0;
+      }
+    }
+    ix.close();
+    return ok;
+  }
+
+  File f = LittleFS.open(clip, "r");
+  if (!f) return false;
+  uint32_t frame = 0;
+  uint32_t clen = 0;
+  while (f.available()) {
+    String line = f.readStringUntil('\n');
+    line.trim();
+    if (line.startsWith("Content-Length:")) {
+      clen = line.substring(15).toInt();
+    } else if (line.isEmpty() && clen) {
+      // blank line ends the part header; JPEG data starts here
+      if (frame == n) {
+        off = f.position();
+        len = clen;
+        f.close();
+        return true;
+      }
+      if (!f.seek(f.position() + clen + 2)) break;
+      clen = 0;
+      frame++;
+    }
+  }
+  f.close();
+  return false;
+}
+
+// Builds a response for size bytes of an open LittleFS file, honouring a
+// single "Range: bytes=a-b". base is the absolute file offset of byte 0 of
+// the resource. The response takes over file. Returns nullptr if an error
+// response was already sent. An empty resource gets an empty 200 (a Range
+// on it is a 416): a callback response can't have a zero length.
+static AsyncWebServerResponse *beginFileRange(AsyncWebServerRequest *req, File file,
+                                              const char *contentType, size_t base, size_t size,
+                                              bool ranges = true) {
+  size_t start = 0, end = size ? size - 1 : 0;
+  bool partial = false;
+
+  if (ranges && req->hasHeader("Range")) {
+    switch (httpParseRange(req->header("Range").c_str(), size, start, end)) {
+      case HTTP_RANGE_BAD: {
+        AsyncWebServerResponse *bad = req->beginResponse(416, "text/plain", "Range Not Satisfiable");
+        bad->addHeader("Content-Range", "bytes */" + String(size));
+        req->send(bad);
+        return nullptr;
+      }
+      case HTTP_RANGE_OK:
+        partial = true;
+        break;
+      case HTTP_RANGE_NONE:
+        break;
+    }
+  }
+
+  if (!file || !file.seek(base + start)) {
+    if (file) file.close();
+    req->send(404, "text/plain", "File not found");
+    return nullptr;
+  }
+
+  if (size == 0) {
+    file.close();
+    AsyncWebServerResponse *empty = req->beginResponse(200, contentType, "");
+    if (ranges) empty->addHeader("Accept-Ranges", "bytes");
+    return empty;
+  }
+
+  size_t len = end - start + 1;
+  AsyncWebServerResponse *resp = req->beginResponse(
+    contentType, len,
+    [file, len](uint8_t *buf, size_t maxLen, size_t index) mutable -> size_t {
+      if (!file || index >= len) {
+        if (file) file.close();
+        return 0;
+      }
+      size_t n = file.read(buf, min(maxLen, len - index));
+      if (index + n >= len) file.close();
+      return n;
+    });
+
+  if (ranges) resp->addHeader("Accept-Ranges", "bytes");
+  if (partial) {
+    resp->setCode(206);
+    resp->addHeader("Content-Range", "bytes " + String(start) + "-" + String(end) + "/" + String(size));
+  }
+  return resp;
+}
+
+static AsyncWebServerResponse *beginFileRange(AsyncWebServerRequest *req, const String &path,
+                                              const char *contentType, size_t base, size_t size,
+                                              bool ranges = true) {
+  return beginFileRange(req, LittleFS.open(path, "r"), contentType, base, size, ranges);
+}
+
 struct FrameBuf {
   uint8_t *data;
   size_t len;
 };
 
-struct VideoJob  // flushed by videoFlushTask()
+struct VideoSlot {
+  uint8_t *data;  // PSRAM, allocated on first use and reused for the whole clip
+  size_t cap;
+  size_t len;
+};
+
+/* Single-producer/single-consumer ring shared by videoRecordTask() (producer)
+   and videoFlushTask() (consumer). head/tail are free-running counters; only
+   the owner writes each one, so no lock is needed. The writer owns the job
+   and frees it once capture is done and the ring is empty. */
+struct VideoJob
 {
   char path[64];  // <<-- fixed buffer, plenty for "/captures/vid_YYYYMMDD_HHMM.mjpg"
-  std::vector<FrameBuf> frames;
+  VideoSlot slots[VIDEO_RING_SLOTS];
+  std::atomic<uint32_t> head;  // next slot to fill  (recorder only)
+  std::atomic<uint32_t> tail;  // next slot to drain (writer only)
+  std::atomic<bool> captureDone;
+  std::atomic<bool> writeFailed;  // writer gave up - recorder stops early
+  TaskHandle_t writer;
+  uint32_t framesWritten;
+  uint32_t framesDropped;  // ring full when the camera delivered a frame
+  PreRollFrame pre[PREROLL_MAX_FRAMES];  // spliced in front of the live frames
+  uint16_t preCount;
+
+  uint32_t queued() const { return head.load() - tail.load(); }
 };
 
 
@@ -6076,7 +7495,7 @@ bool recordVideoBuffered(const String &filePath, uint32_t durationMs) {
   }
 
   setHighPowerLED(false);
-  addSystemLog("🎞️  Buffered " + String(frames) + " frames (" + String(psramUsed / 1024) + " KB)");
+  addSystemLog("🎞️  Buffered ", frames, " frames (", psramUsed / 1024, " KB)");
 
   /* --------- FLUSH in BG TASK --------- */
   flushInProgress = true;
@@ -6090,7 +7509,7 @@ bool recordVideoBuffered(const String &filePath, uint32_t durationMs) {
 
       File f = LittleFS.open(path, FILE_WRITE);
       if (!f) {
-        addSystemLog("⚠️  open " + path + " failed");
+        addSystemLog("⚠️  open ", path, " failed");
         goto done;
       }
 
@@ -6106,7 +7525,7 @@ bool recordVideoBuffered(const String &filePath, uint32_t durationMs) {
       }
       f.print("--frame--\r\n");
       f.close();
-      addSystemLog("🎞️  Saved video → " + path);
+      addSystemLog("🎞️  Saved video → ", path);
 
   done:
       flushInProgress = false;
@@ -6133,13 +7552,13 @@ void handleStream(AsyncWebServerRequest *req) {
 
   String fn = req->getParam("f")->value();
   if (fn.indexOf("..") >= 0 || !fn.endsWith(".mjpg")) {
-    addSystemLog("🚫 /stream blocked (bad file name: " + fn + ")");
+    addSystemLog("🚫 /stream blocked (bad file name: ", fn, ")");
     return req->send(400, "text/plain", "Bad file name");
   }
 
   File f = LittleFS.open(fn, "r");
   if (!f || f.isDirectory()) {
-    addSystemLog("⚠️  /stream → file not found: " + fn);
+    addSystemLog("⚠️  /stream → file not found: ", fn);
     return req->send(404, "text/plain", "Video not found");
   }
 
@@ -6147,118 +7566,290 @@ void handleStream(AsyncWebServerRequest *req) {
   f.close();
 
   if (sz < 100) {
-    addSystemLog("⚠️  /stream → file too small: " + fn + " (" + String(sz) + " bytes)");
+    addSystemLog("⚠️  /stream → file too small: ", fn, " (", sz, " bytes)");
     return req->send(503, "text/plain", "Video file too small or invalid");
   }
 
-  addSystemLog("📽️  /stream sending " + fn + " (" + String(sz) + " bytes)");
-  AsyncWebServerResponse *resp = req->beginResponse(LittleFS, fn,
-                                                    "multipart/x-mixed-replace; boundary=frame");
-  req->send(resp);
+  addSystemLog("📽️  /stream sending ", fn, " (", sz, " bytes)");
+  AsyncWebServerResponse *resp = beginFileRange(req, fn, "multipart/x-mixed-replace; boundary=frame", 0, sz);
+  if (resp) req->send(resp);
 }
 
 
 void startVideoRecording(const String &filePath, uint32_t durationMs) {
   auto *p = new RecParams{ filePath, durationMs };
-  xTaskCreate(
+  xTaskCreatePinnedToCore(
     videoRecordTask,
     "VidRec",
     32 * 1024,
     p,
     tskIDLE_PRIORITY + 2,  // slightly higher so it actually runs
-    nullptr);
+    nullptr,
+    1);  // VidFlush goes on core 0, so file writes don't take camera time
+}
+
+
+/* --------------------------------------------------------------------------
+   Pre-trigger ring ("pre-roll")
+   While armed in video mode, a low-priority task keeps the last preRollSec
+   seconds of low-rate JPEGs in PSRAM. videoRecordTask() takes them on
+   trigger and the writer puts them at the front of the clip. Total slot
+   memory stays under preRollKB; grabs go through cameraLock().
+   -------------------------------------------------------------------------- */
+static PreRollFrame g_preRoll[PREROLL_MAX_FRAMES];
+static uint16_t g_preStart = 0;  // oldest frame
+static uint16_t g_preCount = 0;
+static size_t g_preAlloc = 0;    // sum of slot capacities (occupied or not)
+static SemaphoreHandle_t g_preMux = nullptr;
+
+static void preRollFreeSlot(PreRollFrame &f) {
+  if (f.data) heap_caps_free(f.data);
+  g_preAlloc -= f.cap;
+  f = PreRollFrame{};
+}
+
+// caller holds g_preMux
+static void preRollEvictOldest(bool freeBuf) {
+  PreRollFrame &old = g_preRoll[g_preStart];
+  if (freeBuf) preRollFreeSlot(old);
+  g_preStart = (g_preStart + 1) % PREROLL_MAX_FRAMES;
+  g_preCount--;
+}
+
+// caller holds g_preMux. Frees capacity until need more bytes fit in the
+// budget: spare buffers in empty slots first, then the oldest frames.
+static bool preRollMakeRoom(size_t need, size_t budget) {
+  for (uint16_t i = g_preCount; i < PREROLL_MAX_FRAMES && g_preAlloc + need > budget; ++i) {
+    PreRollFrame &spare = g_preRoll[(g_preStart + i) % PREROLL_MAX_FRAMES];
+    if (spare.data) preRollFreeSlot(spare);
+  }
+  while (g_preCount && g_preAlloc + need > budget) preRollEvictOldest(true);
+  return g_preAlloc + need <= budget;
+}
+
+static void preRollClear() {
+  xSemaphoreTake(g_preMux, portMAX_DELAY);
+  for (auto &f : g_preRoll) preRollFreeSlot(f);
+  g_preStart = g_preCount = 0;
+  g_preAlloc = 0;
+  xSemaphoreGive(g_preMux);
+}
+
+static void preRollPush(const camera_fb_t *fb) {
+  const size_t budget = (size_t)preRollKB * 1024;
+  const uint32_t nowMs = millis();
+
+  xSemaphoreTake(g_preMux, portMAX_DELAY);
+
+  // age out, then make room in the ring (the freed slot is reused as-is)
+  while (g_preCount && nowMs - g_preRoll[g_preStart].ms > (uint32_t)preRollSec * 1000) preRollEvictOldest(false);
+  if (g_preCount == PREROLL_MAX_FRAMES) preRollEvictOldest(false);
+  if (g_preAlloc > budget) preRollMakeRoom(0, budget);  // budget was lowered
+
+  uint16_t w = (g_preStart + g_preCount) % PREROLL_MAX_FRAMES;
+  PreRollFrame &slot = g_preRoll[w];
+  bool ok = true;
+
+  if (fb->len > slot.cap) {
+    // Evict first, then admit: the old buffer is freed rather than realloc'd
+    // (its contents are overwritten anyway, and realloc may hold old + new),
+    // so slot memory never goes over the budget, not even for one frame.
+    size_t want = fb->len + fb->len / 4;
+    preRollFreeSlot(slot);
+    ok = preRollMakeRoom(want, budget);
+    if (ok) {
+      slot.data = (uint8_t *)heap_caps_malloc(want, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      ok = slot.data != nullptr;
+      if (ok) {
+        slot.cap = want;
+        g_preAlloc += want;
+      }
+    }
+  }
+
+  if (ok) {
+    memcpy(slot.data, fb->buf, fb->len);
+    slot.len = fb->len;
+    slot.ms = nowMs;
+    g_preCount++;
+  }
+  xSemaphoreGive(g_preMux);
+}
+
+// Moves the buffered frames (oldest first) into job->pre; the writer frees them.
+static void preRollTake(VideoJob *job) {
+  if (!g_preMux) return;
+  const uint32_t nowMs = millis();
+
+  xSemaphoreTake(g_preMux, portMAX_DELAY);
+  while (g_preCount && nowMs - g_preRoll[g_preStart].ms > (uint32_t)preRollSec * 1000) preRollEvictOldest(false);
+  job->preCount = 0;
+  while (g_preCount) {
+    PreRollFrame &f = g_preRoll[g_preStart];
+    job->pre[job->preCount++] = f;
+    g_preAlloc -= f.cap;
+    f = PreRollFrame{};
+    g_preStart = (g_preStart + 1) % PREROLL_MAX_FRAMES;
+    g_preCount--;
+  }
+  xSemaphoreGive(g_preMux);
+}
+
+static void preRollTask(void *) {
+  bool wasActive = false;
+  for (;;) {
+    bool active = cameraInitialized && videoMode && preRollSec > 0 && eventArmed && !flushInProgress;
+    if (!active) {
+      // recording took the frames already; anything left is stale
+      if (wasActive && !flushInProgress) preRollClear();
+      wasActive = false;
+      TASK_YIELD_MS(500);
+      continue;
+    }
+    wasActive = true;
+
+    cameraLock();
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (fb) {
+      debugFramebufferAllocated(fb);
+      preRollPush(fb);
+      debugFramebufferReleased(fb);
+      esp_camera_fb_return(fb);
+    }
+    cameraUnlock();
+
+    TASK_YIELD_MS(PREROLL_INTERVAL_MS);
+  }
+}
+
+void startPreRollTask() {
+  if (!g_preMux) g_preMux = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(preRollTask, "PreRoll", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr, 1);
 }
 
 
 /* --------------------------------------------------------------------------
-   Task that copies buffered frames from PSRAM to LittleFS  (runs in background)
+   Writer task: drains the frame ring into the .mjpg while recording runs
    -------------------------------------------------------------------------- */
 /*********************************************************************
- *  Background flusher – runs in its own FreeRTOS task
- *  - job  : pointer created in startVideoRecording()
+ *  Background writer – runs in its own FreeRTOS task (core 0, for
+ *  throughput only; the ring's atomics are the synchronization)
+ *  - job  : created by videoRecordTask(), freed here
  ********************************************************************/
 static void videoFlushTask(void *pv) {
-  addSystemLog("VidFlush started on core " + String(xPortGetCoreID()));
+  addSystemLog("VidFlush started on core ", xPortGetCoreID());
   auto *job = static_cast<VideoJob *>(pv);
 
   // 1) create the lock
   const char *LOCK = "/.flush.lock";
   File lock = LittleFS.open(LOCK, FILE_WRITE);
   if (!lock) {
-    addSystemLog("⚠️  Could not create " + String(LOCK));
+    addSystemLog("⚠️  Could not create ", LOCK);
   } else {
     lock.close();
   }
 
-  // ── NEW: check for enough FS space ──────────────────────────
-  {
-    size_t fsFree = LittleFS.totalBytes() - LittleFS.usedBytes();
-    size_t need = 0;
-    // sum up raw JPEG data
-    for (auto &f : job->frames) need += f.len;
-    // add a modest per-frame overhead for headers & boundaries
-    need += job->frames.size() * 64 + 64;
-    if (fsFree < need) {
-      addSystemLog("⚠️  Not enough FS space: need " + String(need) + " bytes, have " + String(fsFree));
-      // clean up and bail
-      LittleFS.remove(LOCK);
-      flushInProgress = false;
-      delete job;
-      vTaskDelete(nullptr);
-      return;
-    }
-  }
-  // ─────────────────────────────────────────────────────────────
-
-  // 2) open the MJPEG file
+  // 2) open the MJPEG file; free space is sampled once (usedBytes() walks the FS)
+  captureMakeRoom(VIDEO_ROOM_BYTES);
+  size_t fsFree = LittleFS.totalBytes() - LittleFS.usedBytes();
   File vid = LittleFS.open(job->path, FILE_WRITE);
   size_t bytesWritten = 0;
-  int framesWritten = 0;
   bool abortFlush = false;
 
   if (!vid) {
-    addSystemLog("⚠️  Cannot open " + String(job->path));
+    addSystemLog("⚠️  Cannot open ", job->path);
     abortFlush = true;
-  } else {
-    // 3) write each buffered frame
-    for (size_t i = 0; i < job->frames.size(); ++i) {
-      FrameBuf &f = job->frames[i];
-
-      String header = "--frame\r\n"
-                      "Content-Type: image/jpeg\r\n"
-                      "Content-Length: "
-                      + String(f.len) + "\r\n\r\n";
-      size_t hlen = vid.print(header);
-      size_t plen = vid.write(f.data, f.len);
-      size_t tlen = vid.print("\r\n");
-
-      if (hlen < header.length() || plen < f.len || tlen < 2) {
-        addSystemLog("⚠️  Frame " + String(i) + " write failed, aborting flush");
-        abortFlush = true;
-        break;
-      }
+    job->writeFailed.store(true);
+  }
+
+  // 3) write frames as the recorder hands them over; keep draining after an
+  //    error so the recorder never blocks, until it says it's done
+  char header[80];
+  bool fsFull = false;
+  std::vector<uint32_t> frameIndex;  // {jpegOffset, jpegLen} pairs for the .idx sidecar
+  frameIndex.reserve(2 * 256);
+  auto writeFrame = [&](const uint8_t *data, size_t len) {
+    if (abortFlush || fsFull) return;
+    int hl = snprintf(header, sizeof(header),
+                      "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                      (unsigned)len);
+    if (bytesWritten + hl + len + 2 + VIDEO_FS_RESERVE > fsFree) {
+      addSystemLog("⚠️  FS nearly full after ", job->framesWritten, " frames, ending clip");
+      fsFull = true;
+      job->writeFailed.store(true);  // stop the recorder, keep what we have
+      return;
+    }
+    size_t hlen = vid.write((const uint8_t *)header, hl);
+    size_t plen = vid.write(data, len);
+    size_t tlen = vid.print("\r\n");
 
-      framesWritten++;
+    if (hlen < (size_t)hl || plen < len || tlen < 2) {
+      addSystemLog("⚠️  Frame ", job->framesWritten, " write failed, aborting flush");
+      abortFlush = true;
+      job->writeFailed.store(true);
+    } else {
+      frameIndex.push_back(bytesWritten + hlen);
+      frameIndex.push_back(len);
+      job->framesWritten++;
       bytesWritten += hlen + plen + tlen;
+    }
+  };
+
+  // pre-trigger frames first (already owned by the job)
+  for (uint16_t i = 0; i < job->preCount; ++i) {
+    writeFrame(job->pre[i].data, job->pre[i].len);
+    heap_caps_free(job->pre[i].data);
+    job->pre[i].data = nullptr;
+  }
+  if (job->preCount) addSystemLog("Pre-roll: ", job->preCount, " frames spliced");
 
-      heap_caps_free(f.data);
-      //vTaskDelay(pdMS_TO_TICKS(5));
-      TASK_YIELD_MS(5);
+  for (;;) {
+    uint32_t t = job->tail.load(std::memory_order_relaxed);
+    uint32_t h = job->head.load(std::memory_order_acquire);
+    if (t == h) {
+      if (job->captureDone.load(std::memory_order_acquire)) {
+        if (job->head.load(std::memory_order_acquire) == t) break;
+        continue;
+      }
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
     }
+
+    VideoSlot &f = job->slots[t % VIDEO_RING_SLOTS];
+    writeFrame(f.data, f.len);
+    job->tail.store(t + 1, std::memory_order_release);
   }
 
   // 4) finalize or clean up on error
-  if (!abortFlush) {
+  if (!abortFlush && job->framesWritten > 0) {
     bytesWritten += vid.print("--frame--\r\n");
     vid.close();
-    addSystemLog("🎞️  Saved video → " + String(job->path));
-    addSystemLog("Flushed " + String(framesWritten) + " frames (" + String(bytesWritten) + " bytes)");
+    if (!writeClipIndex(job->path, frameIndex)) {
+      addSystemLog("⚠️  Could not write frame index for ", job->path);
+    }
+    catalogAdd(job->path, bytesWritten, true);  // listed only once complete
+
+    // thumbnail from the trigger frame (first one after the pre-roll)
+    size_t frames = frameIndex.size() / 2;
+    if (frames) {
+      size_t n = job->preCount < frames ? job->preCount : 0;
+      uint32_t off = frameIndex[2 * n], len = frameIndex[2 * n + 1];
+      uint8_t *jpg = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      File rd = jpg ? LittleFS.open(job->path, "r") : File();
+      bool ok = rd && rd.seek(off) && rd.read(jpg, len) == len && writeThumbnail(job->path, jpg, len);
+      if (rd) rd.close();
+      if (jpg) heap_caps_free(jpg);
+      if (!ok) addSystemLog("⚠️  Could not write thumbnail for ", job->path);
+    }
+    addSystemLog("🎞️  Saved video → ", job->path);
+    addSystemLog("Flushed ", job->framesWritten, " frames (", bytesWritten, " bytes), dropped ", job->framesDropped);
   } else {
+    abortFlush = true;
     if (vid) vid.close();
     if (LittleFS.remove(job->path)) {
-      addSystemLog("🗑️  Incomplete file removed: " + String(job->path));
+      addSystemLog("🗑️  Incomplete file removed: ", job->path);
     } else {
-      addSystemLog("⚠️  Failed to remove incomplete " + String(job->path));
+      addSystemLog("⚠️  Failed to remove incomplete ", job->path);
     }
   }
 
@@ -6266,21 +7857,25 @@ static void videoFlushTask(void *pv) {
   if (LittleFS.remove(LOCK)) {
     addSystemLog("Flush lock removed");
   } else {
-    addSystemLog("⚠️  Could not remove " + String(LOCK));
+    addSystemLog("⚠️  Could not remove ", LOCK);
   }
 
-  flushInProgress = false;
-
   if (!abortFlush) {
     File chk = LittleFS.open(job->path, FILE_READ);
     if (chk) {
-      addSystemLog("Final file size: " + String(chk.size()) + " bytes");
+      addSystemLog("Final file size: ", chk.size(), " bytes");
       chk.close();
     }
   }
 
-  addSystemLog("VidFlush finished " + String(abortFlush ? "with errors" : "OK") + " (" + String(framesWritten) + " good frames)");
+  addSystemLog("VidFlush finished ", abortFlush ? "with errors" : "OK", " (", job->framesWritten, " good frames)");
+
+  currentJob = nullptr;
+  for (auto &slot : job->slots) {
+    if (slot.data) heap_caps_free(slot.data);
+  }
   delete job;
+  flushInProgress = false;
   vTaskDelete(nullptr);
 }
 
@@ -6294,68 +7889,107 @@ static void videoRecordTask(void *pv) {
   strlcpy(pathBuf, params->path.c_str(), sizeof(pathBuf));
   const uint32_t dur = params->durationMs;  // local copy
 
-  /* ---- allocate the job descriptor that will be passed
-            to the flush-to-LittleFS task ----                */
-  auto *job = new VideoJob;
-  strlcpy(job->path, pathBuf, sizeof(job->path));
-  // job->frames is the empty vector already
-  currentJob = job;  // <-- NEW
-
   /* we can delete params now, all data copied */
   delete params;
 
+  if (flushInProgress) {
+    addSystemLog("⚠️  Video already recording, skipped ", pathBuf);
+    vTaskDelete(nullptr);
+    return;
+  }
+
+  /* ---- job shared with the writer task ---- */
+  auto *job = new VideoJob{};
+  strlcpy(job->path, pathBuf, sizeof(job->path));
+
+  flushInProgress = true;  // also pauses the pre-roll task
+  preRollTake(job);
+  currentJob = job;
+  if (xTaskCreatePinnedToCore(
+        videoFlushTask,        // task entry
+        "VidFlush",            // name
+        16 * 1024,             // stack
+        job,                   // parameter
+        tskIDLE_PRIORITY + 1,  // priority
+        &job->writer,          // handle (recorder notifies it per frame)
+        0)                     // core 0: flash I/O away from the recorder
+      != pdPASS) {
+    addSystemLog("⚠️  Could not start VidFlush task");
+    currentJob = nullptr;
+    for (uint16_t i = 0; i < job->preCount; ++i) heap_caps_free(job->pre[i].data);
+    delete job;
+    flushInProgress = false;
+    vTaskDelete(nullptr);
+    return;
+  }
+
   /* ---- capture loop ---- */
   const uint32_t t0 = millis();
-  size_t usedPS = 0;
+  uint32_t captured = 0;
+  uint32_t dropped = 0;
 
   setHighPowerLED(true);
+  liveHubHold();  // the recording gets every frame
 
-  while (millis() - t0 < dur) {
+  while (millis() - t0 < dur && !job->writeFailed.load()) {
+    cameraLock();
     camera_fb_t *fb = esp_camera_fb_get();
     if (fb) debugFramebufferAllocated(fb);
     if (!fb) {
+      cameraUnlock();
       //vTaskDelay(pdMS_TO_TICKS(15));
       TASK_YIELD_MS(15);
       continue;
     }
-    if (usedPS + fb->len > PSRAM_LIMIT) {
-      debugFramebufferReleased(fb);
-      esp_camera_fb_return(fb);
-      break;
-    }
 
-    uint8_t *copy = (uint8_t *)heap_caps_malloc(
-      fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!copy) {
-      debugFramebufferReleased(fb);
-      esp_camera_fb_return(fb);
-      break;
+    uint32_t h = job->head.load(std::memory_order_relaxed);
+    uint32_t t = job->tail.load(std::memory_order_acquire);
+    VideoSlot &slot = job->slots[h % VIDEO_RING_SLOTS];
+    bool ok = (h - t) < VIDEO_RING_SLOTS;  // writer still owns the slot when full
+
+    if (ok && fb->len > slot.cap) {
+      size_t want = max((size_t)VIDEO_SLOT_MIN_BYTES, fb->len + fb->len / 4);
+      uint8_t *grown = (uint8_t *)heap_caps_realloc(slot.data, want,
+                                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (grown) {
+        slot.data = grown;
+        slot.cap = want;
+      } else {
+        ok = false;
+      }
     }
 
-    memcpy(copy, fb->buf, fb->len);
+    if (ok) {
+      memcpy(slot.data, fb->buf, fb->len);
+      slot.len = fb->len;
+      job->head.store(h + 1, std::memory_order_release);
+      xTaskNotifyGive(job->writer);
+      captured++;
+    } else {
+      dropped++;
+    }
     debugFramebufferReleased(fb);
     esp_camera_fb_return(fb);
-
-    /* ---------- push frame into the job ---------- */
-    job->frames.push_back({ copy, fb->len });
-    usedPS += fb->len;
+    cameraUnlock();
 
     //vTaskDelay(1);
     TASK_YIELD_MS(1);
   }
 
+  liveHubRelease();
   setHighPowerLED(false);
-  addSystemLog("PSRAM free: " + String(heap_caps_get_free_size(MALLOC_CAP_SPIRAM)));
-
-  /* ---- hand the job to the flusher ---- */
-  flushInProgress = true;
-  xTaskCreate(
-    videoFlushTask,        // task entry
-    "VidFlush",            // name
-    16 * 1024,             // stack
-    job,                   // parameter
-    tskIDLE_PRIORITY + 1,  // priority
-    nullptr);              // handle
+  addSystemLog("VidRec captured ", captured, " frames, dropped ", dropped, ", PSRAM free: ", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+  /* ---- hand off: the writer finishes the file and frees the job ---- */
+  // Once captureDone is visible the writer may finish, free the job and
+  // delete itself at any moment, so nothing may touch job or the writer
+  // after the store. The handle is copied and the wake-up sent first; a
+  // writer that checked captureDone just before the store sleeps at most
+  // its 100 ms notify timeout before it sees it.
+  job->framesDropped = dropped;
+  TaskHandle_t writer = job->writer;
+  xTaskNotifyGive(writer);
+  job->captureDone.store(true, std::memory_order_release);
 
   vTaskDelete(nullptr);  // recording task ends here
 }
@@ -6374,39 +8008,29 @@ void handleDownloadRaw(AsyncWebServerRequest *req) {
   }
 
   if (path.indexOf("..") >= 0 || !path.endsWith(".mjpg")) {
-    addSystemLog("🚫 /download bad file name: " + path);
+    addSystemLog("🚫 /download bad file name: ", path);
     return req->send(400, "text/plain", "Bad filename");
   }
 
   File src = LittleFS.open(path, "r");
   if (!src || src.isDirectory()) {
-    addSystemLog("⚠️  /download not found: " + path);
+    addSystemLog("⚠️  /download not found: ", path);
     return req->send(404, "text/plain", "File not found");
   }
 
   size_t sz = src.size();
   if (sz < 100) {
-    addSystemLog("⚠️  /download file too small: " + path + " (" + String(sz) + " bytes)");
+    addSystemLog("⚠️  /download file too small: ", path, " (", sz, " bytes)");
     src.close();
     return req->send(503, "text/plain", "File is invalid or incomplete");
   }
 
-  addSystemLog("⬇️  Downloading " + path + " (" + String(sz) + " bytes)");
-
-  // Reopen to stream properly from the beginning
+  addSystemLog("⬇️  Downloading ", path, " (", sz, " bytes)");
   src.close();
-  File file = LittleFS.open(path, "r");
-
-  AsyncWebServerResponse *resp = req->beginChunkedResponse(
-    "video/x-motion-jpeg",
-    [file](uint8_t *buf, size_t maxLen, size_t index) mutable -> size_t {
-      if (!file || !file.available()) {
-        if (file) file.close();
-        return 0;
-      }
-      return file.read(buf, maxLen);
-    });
 
+  // Range-aware: resumable downloads and byte seeking in players
+  AsyncWebServerResponse *resp = beginFileRange(req, path, "video/x-motion-jpeg", 0, sz);
+  if (!resp) return;
   String base = path.substring(path.lastIndexOf('/') + 1);
   resp->addHeader("Content-Disposition", "attachment; filename=\"" + base + "\"");
   req->send(resp);
@@ -6445,20 +8069,20 @@ void handleViewClip(AsyncWebServerRequest *req) {
 
   String fn = req->getParam("f")->value();
   if (fn.indexOf("..") >= 0 || !fn.endsWith(".mjpg")) {
-    addSystemLog("🚫 /view bad file name: " + fn);
+    addSystemLog("🚫 /view bad file name: ", fn);
     return req->send(400, "text/plain", "Bad file name");
   }
 
   String path = fn.startsWith("/") ? fn : ("/captures/" + fn);
   File test = LittleFS.open(path, "r");
   if (!test || test.isDirectory()) {
-    addSystemLog("⚠️  /view missing file: " + path);
+    addSystemLog("⚠️  /view missing file: ", path);
     return req->send(404, "text/plain", "Video not found");
   }
   size_t sz = test.size();
   test.close();
 
-  addSystemLog("🎬 Viewing " + path + " (" + String(sz) + " bytes)");
+  addSystemLog("🎬 Viewing ", path, " (", sz, " bytes)");
 
   String html =
     "<!DOCTYPE html><html><head><meta charset='utf-8'><title>" + fn + "</title>"
@@ -6497,74 +8121,69 @@ void handleStreamClip(AsyncWebServerRequest *req) {
     return;
   }
   String path = String(CAPTURE_DIR) + "/" + fn;
+  File f = LittleFS.open(path, "r");
+  if (!f || f.isDirectory()) {
+    req->send(404, "text/plain", "Video not found");
+    return;
+  }
+  size_t sz = f.size();
+  f.close();
   // Stream it as multipart MJPEG
-  AsyncWebServerResponse *response = req->beginResponse(LittleFS, path,
-                                                        "multipart/x-mixed-replace; boundary=frame");
+  AsyncWebServerResponse *response = beginFileRange(req, path, "multipart/x-mixed-replace; boundary=frame", 0, sz);
+  if (!response) return;
   response->addHeader("Connection", "close");
   req->send(response);
 }
 
-// --- Servo Settings Page Handlers (with Hamburger Menu preserved) ---
-
-// Ensure these globals exist somewhere in your main sketch:
-// uint16_t servoStartUS;
-// uint16_t servoEndUS;
-// bool disableServo = false;    // global flag to gate servo movement
-
-// --- Global Definitions (add to the top of your main .ino file) ---
-// Default start/end values and disable flag for the servo
-//uint16_t servoStartUS = 2046;
-//uint16_t servoEndUS = 1058;
-
-
-// --- Servo Settings Page Handlers (with Hamburger Menu preserved) ---
-void handleServoSettingsPage(AsyncWebServerRequest *req) {
-  PAGE_SCOPE("handleServoSettingsPage");
-  if (!isAllowed(req)) {
+// ---------------------------------------------------------------------------
+// GET /clip/frame?f=<clip>&n=<frame>  – one JPEG out of an .mjpg via its index
+void handleClipFrame(AsyncWebServerRequest *req) {
+  PAGE_SCOPE("handleClipFrame");
+  if (!isAllowed(req) || !req->hasParam("f")) {
     req->send(403, "text/plain", "Forbidden");
     return;
   }
+  String fn = req->getParam("f")->value();
+  if (fn.indexOf("..") >= 0 || !fn.endsWith(".mjpg")) {
+    req->send(400, "text/plain", "Bad name");
+    return;
+  }
+  String path = fn.startsWith("/") ? fn : (String(CAPTURE_DIR) + "/" + fn);
+  if (flushInProgress && currentJob && path == currentJob->path) {
+    req->send(503, "text/plain", "Clip is still recording");
+    return;
+  }
 
-  // Load persisted values
-  preferences.begin("settings", false);
-  int currentStart = preferences.getUInt("servoStart", servoStartUS);
-  int currentEnd = preferences.getUInt("servoEnd", servoEndUS);
-  bool currentDisable = preferences.getBool("disableServo", false);
-  preferences.end();
+  long n = req->hasParam("n") ? req->getParam("n")->value().toInt() : 0;
+  uint32_t off = 0, len = 0, count = 0;
+  if (n < 0 || !clipFrameLookup(path, (uint32_t)n, off, len, &count)) {
+    req->send(404, "text/plain", "Frame not found");
+    return;
+  }
 
-  // Build the page
-  String html =
-    "<!DOCTYPE html><html><head><meta charset='utf-8'>"
-    "<title>Servo Settings</title>"
-    "<style>"
-    "body{background:#222;color:#ddd;font-family:Arial;padding:10px}"
-    "label{display:block;margin-top:10px}"
-    "input{margin-left:10px;width:100px}"
-    "button{margin-top:20px;padding:6px 12px;margin-left:10px}"
-    "#servoSlider{width:300px;}"
-    "</style></head><body>";
+  AsyncWebServerResponse *resp = beginFileRange(req, path, "image/jpeg", off, len, false);
+  if (!resp) return;
+  if (count) resp->addHeader("X-Frame-Count", String(count));
+  resp->addHeader("Cache-Control", "private, max-age=86400");  // finalized clips never change
+  req->send(resp);
+}
 
-  html += getHamburgerMenuHTML();
-  html += "<h1>Servo Settings</h1>";
-
-  // Settings form
-  html += "<form id='servoForm'>";
-  html += "<label>Start Position (&micro;s):"
-          "<input type='number' name='start' id='startInput' value='"
-          + String(currentStart) + "' oninput='syncSlider(this.value)'>"
-                                   "<button type='button' onclick='setFromSlider(\"startInput\", true)'>Set</button></label>";
-  html += "<label>End Position (&micro;s):"
-          "<input type='number' name='end' id='endInput' value='"
-          + String(currentEnd) + "' oninput='syncSlider(this.value)'>"
-                                 "<button type='button' onclick='setFromSlider(\"endInput\", true)'>Set</button></label>";
-
-  html += "<label><input type='checkbox' name='disableServo'";
-  if (currentDisable) html += " checked";
-  html += "> Disable Servo</label>";
-  html += "</form>";
-
-  // Live-control slider, Save/Test buttons, script
-  html += R"rawliteral(
+// --- Servo Settings Page Handlers (with Hamburger Menu preserved) ---
+static const char kServoSettingsPage[] PROGMEM = R"rawliteral(<!DOCTYPE html><html><head><meta charset='utf-8'>
+<title>Servo Settings</title>
+<style>
+body{background:#222;color:#ddd;font-family:Arial;padding:10px}
+label{display:block;margin-top:10px}
+input{margin-left:10px;width:100px}
+button{margin-top:20px;padding:6px 12px;margin-left:10px}
+#servoSlider{width:300px;}
+</style></head><body>{{menu}}
+<h1>Servo Settings</h1>
+<form id='servoForm'>
+<label>Start Position (&micro;s):<input type='number' name='start' id='startInput' value='{{start}}' oninput='syncSlider(this.value)'><button type='button' onclick='setFromSlider("startInput", true)'>Set</button></label>
+<label>End Position (&micro;s):<input type='number' name='end' id='endInput' value='{{end}}' oninput='syncSlider(this.value)'><button type='button' onclick='setFromSlider("endInput", true)'>Set</button></label>
+<label><input type='checkbox' name='disableServo'{{checked}}> Disable Servo</label>
+</form>
 <h2>Live Control</h2>
 <input type="range" id="servoSlider" min="500" max="2500" value="1500"
        oninput="updateServo(this.value)">
@@ -6599,11 +8218,26 @@ function saveSettings(){
     .then(resp => resp.ok ? location.reload() : alert('Save failed'));
 }
 </script>
-)rawliteral";
+</body></html>)rawliteral";
 
-  html += "</body></html>";
+void handleServoSettingsPage(AsyncWebServerRequest *req) {
+  PAGE_SCOPE("handleServoSettingsPage");
+  if (!isAllowed(req)) {
+    req->send(403, "text/plain", "Forbidden");
+    return;
+  }
 
-  req->send(200, "text/html", html);
+  // Load persisted values (including ones still waiting to be written)
+  int currentStart = nvsGetUInt("settings", "servoStart", servoStartUS);
+  int currentEnd = nvsGetUInt("settings", "servoEnd", servoEndUS);
+  bool currentDisable = nvsGetBool("settings", "disableServo", false);
+
+  pageSend(req, kServoSettingsPage, [=](const char *key, PageVar &v) {
+    if (pageCommonVar(key, v)) return;
+    if (!strcmp(key, "start")) v.printf("%d", currentStart);
+    else if (!strcmp(key, "end")) v.printf("%d", currentEnd);
+    else if (!strcmp(key, "checked") && currentDisable) v.raw(" checked");
+  });
 }
 
 
@@ -6627,30 +8261,24 @@ void handleServoSettingsSave(AsyncWebServerRequest *req) {
   bool newDisable = (req->hasParam("disableServo", true) && req->getParam("disableServo", true)->value() == "on");
 
   /* ───── persist & log only when values change ───────────────────────── */
-  preferences.begin("settings", false);
-
   if (newStart != servoStartUS) {
     servoStartUS = newStart;
-    preferences.putUInt("servoStart", newStart);
-    addSystemLog("🛠️ servoStartUS → " + String(newStart) + " µs");
+    nvsPutUInt("settings", "servoStart", newStart);
+    addSystemLog("🛠️ servoStartUS → ", newStart, " µs");
   }
 
   if (newEnd != servoEndUS) {
     servoEndUS = newEnd;
-    preferences.putUInt("servoEnd", newEnd);
-    addSystemLog("🛠️ servoEndUS   → " + String(newEnd) + " µs");
+    nvsPutUInt("settings", "servoEnd", newEnd);
+    addSystemLog("🛠️ servoEndUS   → ", newEnd, " µs");
   }
 
   if (newDisable != disableServo) {
     disableServo = newDisable;
-    preferences.putBool("disableServo", newDisable);
-    addSystemLog(String("🛠️ disableServo → ") + (newDisable ? "true" : "false"));
-  } else {
-    /* still persist so the flag survives reboot */
-    preferences.putBool("disableServo", newDisable);
+    addSystemLog("🛠️ disableServo → ", (newDisable ? "true" : "false"));
   }
-
-  preferences.end();
+  /* always queued so the flag survives reboot; a no-op when NVS already has it */
+  nvsPutBool("settings", "disableServo", newDisable, NVS_SOON);
   req->send(200, "text/plain", "OK");
 }
 
@@ -6758,25 +8386,16 @@ void handleSystemStatus(AsyncWebServerRequest *req) {
   }
 
 
-  // ── scan captures ─────────────────────────────────────────────
+  // ── captures, newest first (catalog, no directory walk) ───────
   struct FileInfo {
     String name;
     size_t size;
   };
   std::vector<FileInfo> entries;
-  File dir = LittleFS.open(CAPTURE_DIR, "r");
-  if (dir) {
-    while (File f = dir.openNextFile()) {
-      if (!f.isDirectory()) {
-        entries.push_back({ String(f.name()), f.size() });
-      }
-    }
-    dir.close();
-    std::sort(entries.begin(), entries.end(),
-              [](const FileInfo &a, const FileInfo &b) {
-                return a.name > b.name;
-              });
-  }
+  entries.reserve(catalogCount());
+  catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &e) {
+    entries.push_back({ String(e.name), e.size });
+  });
 
   // ── build page ────────────────────────────────────────────────
   String page = R"rawliteral(
@@ -6838,6 +8457,260 @@ void handleSystemStatus(AsyncWebServerRequest *req) {
 
 
 
+/*************************************************
+ *  Trip pipeline
+ *  alertFunction (sensor task) only stamps the trip, hands the photo burst
+ *  to the capture task, queues the notifications and moves the servo, so
+ *  the first frame is grabbed while the servo is still travelling and no
+ *  network I/O runs on the sensor task.
+ *************************************************/
+#define BURST_GAP_MS        1000  // photo 2 is taken this long after photo 1 started
+#define ALERT_QUEUE_LEN     8     // notify + snapshot + two burst thumbnails, with room
+
+#define ALERT_TL_SLOTS      4     // trips in flight; >= 90 s apart before a slot is reused
+
+// ms since the trip for each stage of one event (0 = not reached)
+struct AlertTimeline {
+  uint32_t tripMs;      // millis() at the trip
+  uint32_t photo1;
+  uint32_t photo2;
+  uint32_t servo;       // both servo moves done
+  uint32_t alerted;     // MQTT alert published
+  uint32_t snapshot;    // MQTT snapshot upload done
+  uint32_t emailed;     // e-mail POST returned
+  bool video;
+};
+// Each trip stamps its own slot, so a new trip never resets one the alert
+// worker is still writing. A slot is held by alertFunction (servo stamp) and
+// by the trip's last worker job; whichever lets go second logs it and copies
+// it to g_alertTlLast.
+static AlertTimeline g_alertTl[ALERT_TL_SLOTS];
+static std::atomic<uint8_t> g_alertTlRefs[ALERT_TL_SLOTS];
+static uint32_t g_alertTrips = 0;
+static AlertTimeline g_alertTlLast = {};
+
+static inline void alertStamp(AlertTimeline *tl, uint32_t &field) {
+  field = millis() - tl->tripMs;
+}
+
+static void alertTimelineRelease(AlertTimeline *tl) {
+  if (g_alertTlRefs[tl - g_alertTl].fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+  g_alertTlLast = *tl;
+  addSystemLogf("⏱️  Trip timeline ms (%s): photo1=%u photo2=%u servo=%u alert=%u snapshot=%u email=%u",
+                tl->video ? "video" : "photo", (unsigned)tl->photo1, (unsigned)tl->photo2, (unsigned)tl->servo,
+                (unsigned)tl->alerted, (unsigned)tl->snapshot, (unsigned)tl->emailed);
+}
+
+enum AlertJobKind : uint8_t { ALERT_JOB_NOTIFY, ALERT_JOB_SNAPSHOT, ALERT_JOB_THUMB };
+struct AlertJob {
+  AlertJobKind kind;
+  bool last;          // releases tl after this job
+  time_t when;
+  AlertTimeline *tl;  // null for thumbnails
+  char path[64];      // snapshot to upload / capture to thumbnail / capture linked in the e-mail
+};
+
+struct BurstJob {
+  char path1[64];
+  char path2[64];
+  time_t when;
+  AlertTimeline *tl;
+};
+
+static TaskHandle_t g_captureTask = nullptr;
+static QueueHandle_t g_alertQueue = nullptr;
+static BurstJob g_burst;
+static volatile bool g_burstBusy = false;
+
+static void alertEnqueue(AlertJobKind kind, AlertTimeline *tl, bool last, time_t when, const char *path) {
+  AlertJob job = {};
+  job.kind = kind;
+  job.last = last;
+  job.when = when;
+  job.tl = tl;
+  strlcpy(job.path, path ? path : "", sizeof(job.path));
+  if (!g_alertQueue || xQueueSend(g_alertQueue, &job, 0) != pdTRUE) {
+    addSystemLog("⚠️  Alert queue full - notification dropped");
+    if (last) alertTimelineRelease(tl);
+  }
+}
+
+// Thumbnails are made off the capture path; inline only before the worker exists
+static void thumbEnqueue(const char *capture) {
+  AlertJob job = {};
+  job.kind = ALERT_JOB_THUMB;
+  strlcpy(job.path, capture, sizeof(job.path));
+  bool ok = g_alertQueue ? xQueueSend(g_alertQueue, &job, 0) == pdTRUE : writeThumbnailFromFile(capture);
+  if (!ok) addSystemLog("⚠️  Thumbnail skipped for ", capture);
+}
+
+// High-priority photo burst; woken by alertFunction with g_burst filled in
+static void captureTask(void *) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    liveHubHold();  // no live-view grabs between the two shots either
+    uint32_t start = millis();
+    AlertTimeline *tl = g_burst.tl;
+    bool ok1 = captureSingleFrame(g_burst.path1, true, /*queueThumb=*/false);
+    alertStamp(tl, tl->photo1);
+
+    int32_t wait = (int32_t)(start + BURST_GAP_MS - millis());
+    if (wait > 0) TASK_YIELD_MS(wait);
+    bool ok2 = captureSingleFrame(g_burst.path2, true, /*queueThumb=*/false);
+    alertStamp(tl, tl->photo2);
+    liveHubRelease();
+    homePreview = g_burst.path2;  // show on dashboard
+
+    // thumbnails queue behind the snapshot so they never delay the upload
+    alertEnqueue(ALERT_JOB_SNAPSHOT, tl, /*last=*/true, g_burst.when, g_burst.path2);
+    if (ok1) thumbEnqueue(g_burst.path1);
+    if (ok2) thumbEnqueue(g_burst.path2);
+    g_burstBusy = false;
+  }
+}
+
+static void alertSendEmail(time_t now, const char *image) {
+  // Same base you use for notifyBootIP()
+  String url = String(emailServer) + "/mouse-trap";
+
+  // Build JSON like notifyBootIP(), but NO crash object and NO boot trapId.
+  JsonDocument doc;
+  doc["event"] = "trigger";                          // <-- lets server mark ALERT
+  doc["status"] = "Trap triggered";                  // free text for email body
+  doc["mac"]    = WiFi.macAddress();
+  doc["lan"]    = WiFi.localIP().toString();
+  if (PUBLIC_IP.length()) doc["wan"] = PUBLIC_IP;
+
+  // link the capture this trip saves (photo 2 or the clip); none if the burst was skipped
+  if (*image) doc["imageUrl"] = String("http://") + WiFi.localIP().toString() + image;
+
+  String body; serializeJson(doc, body);
+  Serial.print("[ALERT] POST /mouse-trap body: ");
+  Serial.println(body);
+  addSystemLog("[ALERT] POST /mouse-trap body: ");
+  addSystemLog(body);
+
+  // already on the alert worker, so wait for the result; the alert slot
+  // never queues behind heartbeats or other pooled requests
+  int code = httpSvcRequestUrgent("POST", url.c_str(), body.c_str(), nullptr, 1500);
+  Serial.printf("[ALERT] http rc=%d\n", code);
+
+  if (code > 0 && code < 400) {
+    addSystemLog("Alert POST OK (HTTP ", code, ")");
+    lastEmailSuccess = true;
+  } else {
+    addSystemLog("Alert POST FAIL (HTTP ", code, ")");
+    lastEmailSuccess = false;
+  }
+  lastEmailTime = now;
+}
+
+static void alertPublishMqtt(time_t now) {
+  if (!mqttClient.connected()) {
+    Serial.println("[MQTT] Cannot publish alert - not connected");
+    addSystemLog("[MQTT] Alert NOT published - disconnected");
+    return;
+  }
+  String alertTopic = "tenant/" + claimedTenantId + "/device/" + claimedMqttClientId + "/alert";
+
+  JsonDocument alertDoc;
+  alertDoc["alert_type"] = "trap_triggered";
+  alertDoc["message"] = "Motion detected";
+  alertDoc["severity"] = "high";
+  alertDoc["timestamp"] = now;
+
+  String alertPayload;
+  serializeJson(alertDoc, alertPayload);
+
+  mqttClient.publish(alertTopic.c_str(), alertPayload.c_str());
+  Serial.println("[MQTT] Published alert: " + alertPayload);
+  addSystemLog("[MQTT] Alert published to broker");
+}
+
+static void alertUploadSnapshot(time_t now, const char *path) {
+  if (!mqttClient.connected()) {
+    addSystemLog("[MQTT] Snapshot NOT uploaded - disconnected");
+    return;
+  }
+  Serial.printf("[MQTT] Uploading snapshot: %s\n", path);
+  addSystemLog("[MQTT] Uploading snapshot via MQTT");
+
+  File imgFile = LittleFS.open(path, "r");
+  if (!imgFile) {
+    Serial.printf("[MQTT] Failed to open image file: %s\n", path);
+    addSystemLog("[MQTT] Snapshot upload FAILED - file not found");
+    return;
+  }
+  size_t fileSize = imgFile.size();
+  Serial.printf("[MQTT] Image size: %d bytes\n", fileSize);
+
+  if (fileSize > 0) {
+    String snapshotTopic = "tenant/" + claimedTenantId + "/device/" + claimedMqttClientId + "/camera/snapshot";
+
+    // Metadata only - the image is base64-streamed from the file
+    JsonDocument snapshotDoc;
+    snapshotDoc["timestamp"] = now;
+    snapshotDoc["filename"] = catalogBase(path);
+    snapshotDoc["size"] = fileSize;
+
+    bool published = mqttPublishSnapshotFile(snapshotTopic, snapshotDoc, imgFile);
+    if (published) {
+      Serial.println("[MQTT] Snapshot uploaded successfully");
+      addSystemLog("[MQTT] Snapshot uploaded to broker");
+    } else {
+      Serial.println("[MQTT] Failed to publish snapshot");
+      addSystemLog("[MQTT] Snapshot upload FAILED");
+    }
+  } else {
+    Serial.printf("[MQTT] Image size invalid: %d bytes\n", fileSize);
+    addSystemLog("[MQTT] Snapshot upload FAILED - invalid size");
+  }
+  imgFile.close();
+}
+
+// Low-priority worker: everything that talks to the network or the buzzer
+static void alertWorkerTask(void *) {
+  AlertJob job;
+  for (;;) {
+    if (xQueueReceive(g_alertQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+
+    if (job.kind == ALERT_JOB_NOTIFY) {
+      alertPublishMqtt(job.when);
+      alertStamp(job.tl, job.tl->alerted);
+
+      /*  ----------  e-mail notification (rate-limited like before)  ----------  */
+      if ((job.when - lastEmailTime > 3600) || !lastEmailSuccess) {
+        alertSendEmail(job.when, job.path);
+        alertStamp(job.tl, job.tl->emailed);
+      }
+
+      /*  ----------  audible “chirp”  ----------  */
+      for (int i = 0; i < 3; ++i) {
+        tone(BUZZER_PIN, 300);
+        TASK_YIELD_MS(100);
+        noTone(BUZZER_PIN);
+        TASK_YIELD_MS(100);
+      }
+    } else if (job.kind == ALERT_JOB_THUMB) {
+      if (!writeThumbnailFromFile(job.path)) addSystemLog("⚠️  thumbnail failed for ", job.path);
+    } else {
+      alertUploadSnapshot(job.when, job.path);
+      alertStamp(job.tl, job.tl->snapshot);
+    }
+    if (job.last) alertTimelineRelease(job.tl);
+  }
+}
+
+void startAlertTasks() {
+  if (g_alertQueue) return;
+  g_alertQueue = xQueueCreate(ALERT_QUEUE_LEN, sizeof(AlertJob));
+  // capture above the sensor task (1) so the burst preempts it; same core as the camera DMA
+  xTaskCreatePinnedToCore(captureTask, "Capture", 12288, nullptr, 4, &g_captureTask, 1);
+  xTaskCreatePinnedToCore(alertWorkerTask, "AlertW", 8192, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
+  startLiveHub();
+}
+
 /*************************************************
  *  alertFunction – called when the trap trips
  *************************************************/
@@ -6852,160 +8725,52 @@ void alertFunction() {
   }
   lastAlertTime = now;
 
+  size_t slot = g_alertTrips++ % ALERT_TL_SLOTS;
+  if (g_alertTlRefs[slot].load()) addSystemLog("⚠️  Trip timeline slot reused while still open");
+  AlertTimeline *tl = &g_alertTl[slot];
+  *tl = {};
+  tl->tripMs = millis();
+  tl->video = videoMode;
+  g_alertTlRefs[slot].store(2);  // this function + the trip's last job
+  char clipPath[64] = "";
+  const char *image = "";  // capture the e-mail links to
+  bool burst = false;      // the snapshot job is the last one
+
   /*  ----------  build filename & save to LittleFS  ----------  */
   char ts[20];
   struct tm tmNow;
   localtime_r(&now, &tmNow);
   strftime(ts, sizeof(ts), "%Y%m%d_%H%M", &tmNow);
 
-  if (!videoMode) {  // ← still-photo branch unchanged
-    if (!disableServo) {
-      triggerServo();
-      TASK_YIELD_MS(500);
-    }
-    String path1 = String(CAPTURE_DIR) + "/img_" + ts + "_a.jpg";
-    captureSingleFrame(path1);
-
-    //vTaskDelay(pdMS_TO_TICKS(1000));
-    TASK_YIELD_MS(1000);
-    String path2 = String(CAPTURE_DIR) + "/img_" + ts + "_b.jpg";
-    captureSingleFrame(path2);
-    homePreview = path2;  // show on dashboard
-  } else {                // ← video branch
-    String vPath = String(CAPTURE_DIR) + "/vid_" + ts + ".mjpg";
-    if (!disableServo) {
-      triggerServo();
-      TASK_YIELD_MS(500);
-    }
-    startVideoRecording(vPath, 10 * 1000);  // 10-s clip
-    addSystemLog("Video recording task started → " + vPath);
-  }
-
-  /*  ----------  e-mail notification (rate-limited like before)  ----------  */
-  if ((now - lastEmailTime > 3600) || !lastEmailSuccess) {
-    HTTPClient http;
-    // Same base you use for notifyBootIP()
-    String url = String(emailServer) + "/mouse-trap";
-
-    if (http.begin(url)) {
-      http.addHeader("Content-Type", "application/json");
-
-      // Build JSON like notifyBootIP(), but NO crash object and NO boot trapId.
-      JsonDocument doc;
-      doc["event"] = "trigger";                          // <-- lets server mark ALERT
-      doc["status"] = "Trap triggered";                  // free text for email body
-      doc["mac"]    = WiFi.macAddress();
-      doc["lan"]    = WiFi.localIP().toString();
-      if (PUBLIC_IP.length()) doc["wan"] = PUBLIC_IP;
-
-      // Keep your image link if you want it in the email/logs
-      doc["imageUrl"] = String("http://") + WiFi.localIP().toString()
-                        + String("/captures/img_") + String(ts) + String(".jpg");
-
-      String body; serializeJson(doc, body);
-      http.setTimeout(1500);
-      Serial.print("[ALERT] POST /mouse-trap body: ");
-      Serial.println(body);
-      addSystemLog("[ALERT] POST /mouse-trap body: ");
-      addSystemLog(body);
-
-      int code = http.POST(body);
-      Serial.printf("[ALERT] http rc=%d\n", code);
-      
-      if (code > 0 && code < 400) {
-        addSystemLog("Alert POST OK (HTTP " + String(code) + ")");
-        lastEmailSuccess = true;
-      } else {
-        addSystemLog("Alert POST FAIL (HTTP " + String(code) + ")");
-        lastEmailSuccess = false;
-      }
-      http.end();
-    } else {
-      addSystemLog("Alert POST FAIL (begin error)");
-      lastEmailSuccess = false;
-    }
-    lastEmailTime = now;
-  }
-
-  /*  ----------  MQTT alert notification  ----------  */
-  if (mqttClient.connected()) {
-    String alertTopic = "tenant/" + claimedTenantId + "/device/" + claimedMqttClientId + "/alert";
-
-    JsonDocument alertDoc;
-    alertDoc["alert_type"] = "trap_triggered";
-    alertDoc["message"] = "Motion detected";
-    alertDoc["severity"] = "high";
-    alertDoc["timestamp"] = now;
-
-    String alertPayload;
-    serializeJson(alertDoc, alertPayload);
-
-    mqttClient.publish(alertTopic.c_str(), alertPayload.c_str());
-    Serial.println("[MQTT] Published alert: " + alertPayload);
-    addSystemLog("[MQTT] Alert published to broker");
-
-    // Upload captured image via MQTT
-    if (!videoMode && homePreview.length() > 0) {
-      Serial.println("[MQTT] Uploading snapshot: " + homePreview);
-      addSystemLog("[MQTT] Uploading snapshot via MQTT");
-
-      File imgFile = LittleFS.open(homePreview, "r");
-      if (imgFile) {
-        size_t fileSize = imgFile.size();
-        Serial.printf("[MQTT] Image size: %d bytes\n", fileSize);
-
-        if (fileSize > 0 && fileSize < 200000) {  // Max ~200KB
-          uint8_t* imgData = (uint8_t*)malloc(fileSize);
-          if (imgData) {
-            size_t bytesRead = imgFile.read(imgData, fileSize);
-            imgFile.close();
-
-            if (bytesRead == fileSize) {
-              // Publish image via MQTT
-              String snapshotTopic = "tenant/" + claimedTenantId + "/device/" + claimedMqttClientId + "/camera/snapshot";
-
-              // Create JSON with metadata and base64 image
-              JsonDocument snapshotDoc;
-              snapshotDoc["timestamp"] = now;
-              snapshotDoc["filename"] = homePreview.substring(homePreview.lastIndexOf('/') + 1);
-              snapshotDoc["size"] = fileSize;
-
-              // Base64 encode image
-              String base64Image = b64Enc(imgData, fileSize);
-              snapshotDoc["image"] = base64Image;
-
-              String snapshotPayload;
-              serializeJson(snapshotDoc, snapshotPayload);
-
-              bool published = mqttClient.publish(snapshotTopic.c_str(), snapshotPayload.c_str());
-              if (published) {
-                Serial.println("[MQTT] Snapshot uploaded successfully");
-                addSystemLog("[MQTT] Snapshot uploaded to broker");
-              } else {
-                Serial.println("[MQTT] Failed to publish snapshot");
-                addSystemLog("[MQTT] Snapshot upload FAILED");
-              }
-            }
-            free(imgData);
-          } else {
-            Serial.println("[MQTT] Failed to allocate memory for image");
-            addSystemLog("[MQTT] Snapshot upload FAILED - no memory");
-            imgFile.close();
-          }
-        } else {
-          Serial.printf("[MQTT] Image size invalid: %d bytes\n", fileSize);
-          addSystemLog("[MQTT] Snapshot upload FAILED - invalid size");
-          imgFile.close();
-        }
-      } else {
-        Serial.println("[MQTT] Failed to open image file: " + homePreview);
-        addSystemLog("[MQTT] Snapshot upload FAILED - file not found");
-      }
-    }
-  } else {
-    Serial.println("[MQTT] Cannot publish alert - not connected");
-    addSystemLog("[MQTT] Alert NOT published - disconnected");
+  if (!videoMode) {  // ← still-photo burst, on the capture task
+    if (g_captureTask && !g_burstBusy) {
+      snprintf(g_burst.path1, sizeof(g_burst.path1), CAPTURE_DIR "/img_%s_a.jpg", ts);
+      snprintf(g_burst.path2, sizeof(g_burst.path2), CAPTURE_DIR "/img_%s_b.jpg", ts);
+      g_burst.when = now;
+      g_burst.tl = tl;
+      g_burstBusy = true;
+      image = g_burst.path2;
+      burst = true;
+      xTaskNotifyGive(g_captureTask);
+    } else {
+      addSystemLog("⚠️  Photo burst skipped (capture task busy or missing)");
+    }
+  } else {                // ← video branch
+    String vPath = String(CAPTURE_DIR) + "/vid_" + ts + ".mjpg";
+    startVideoRecording(vPath, 10 * 1000);  // 10-s clip
+    addSystemLog("Video recording task started → ", vPath);
+    strlcpy(clipPath, vPath.c_str(), sizeof(clipPath));
+    image = clipPath;
+  }
+
+  alertEnqueue(ALERT_JOB_NOTIFY, tl, /*last=*/!burst, now, image);
+
+  // the servo moves while the camera works
+  if (!disableServo) {
+    triggerServo();
+    alertStamp(tl, tl->servo);
   }
+  alertTimelineRelease(tl);
 
   /*  ----------  e-mail notification (rate-limited like before)  ----------  */
   // if ((now - lastEmailTime > 3600) || !lastEmailSuccess) {
@@ -7053,16 +8818,6 @@ void alertFunction() {
   //   lastEmailTime = now;
   // }
 
-  /*  ----------  audible “chirp”  ----------  */
-  for (int i = 0; i < 3; ++i) {
-    tone(BUZZER_PIN, 300);
-    //vTaskDelay(pdMS_TO_TICKS(100));
-    TASK_YIELD_MS(100);
-    noTone(BUZZER_PIN);
-    //vTaskDelay(pdMS_TO_TICKS(100));
-    TASK_YIELD_MS(100);
-  }
-
   /*  ----------  clean-up  ----------  */
   // esp_camera_fb_return(fb);
 
@@ -7085,14 +8840,19 @@ void alertFunction() {
 // ALERT ESCALATION SYSTEM IMPLEMENTATION
 // ============================================================================
 
-// Save alert state to NVS for power loss recovery
+static bool g_alertSavedTriggered = false;  // "triggered" as last handed to NVS
+
+// Save alert state to NVS for power loss recovery. Nothing here waits for
+// flash: a trigger (or clear) is written by the NVS task at once, while a
+// level change waits for the debounce - the restore recomputes the level
+// from triggerAt anyway.
 void saveAlertStateToNVS() {
-  alertPrefs.begin("alertState", false);
-  alertPrefs.putBool("triggered", alertEscalation.isTriggered);
-  alertPrefs.putUInt("triggerAt", alertEscalation.triggeredAtEpoch);
-  alertPrefs.putUChar("level", (uint8_t)alertEscalation.currentLevel);
-  alertPrefs.putBool("serverAck", alertEscalation.serverAcknowledged);
-  alertPrefs.end();
+  NvsWhen when = alertEscalation.isTriggered != g_alertSavedTriggered ? NVS_SOON : NVS_LAZY;
+  g_alertSavedTriggered = alertEscalation.isTriggered;
+  nvsPutUInt("alertState", "triggerAt", alertEscalation.triggeredAtEpoch);
+  nvsPutUChar("alertState", "level", (uint8_t)alertEscalation.currentLevel);
+  nvsPutBool("alertState", "serverAck", alertEscalation.serverAcknowledged);
+  nvsPutBool("alertState", "triggered", alertEscalation.isTriggered, when);
   Serial.println("[ESCALATION] Alert state saved to NVS");
 }
 
@@ -7104,6 +8864,7 @@ void loadAlertStateFromNVS() {
   alertEscalation.currentLevel = (AlertLevel)alertPrefs.getUChar("level", 0);
   alertEscalation.serverAcknowledged = alertPrefs.getBool("serverAck", false);
   alertPrefs.end();
+  g_alertSavedTriggered = alertEscalation.isTriggered;
 
   if (alertEscalation.isTriggered) {
     alertEscalation.lastBuzzerTime = millis();
@@ -7117,7 +8878,7 @@ void loadAlertStateFromNVS() {
     Serial.printf("[ESCALATION] Triggered at: %u\n", alertEscalation.triggeredAtEpoch);
     Serial.printf("[ESCALATION] Current level: %d\n", alertEscalation.currentLevel);
     Serial.println("[ESCALATION] ========================================");
-    addSystemLog("[ESCALATION] Alert state restored from NVS, Level " + String(alertEscalation.currentLevel));
+    addSystemLog("[ESCALATION] Alert state restored from NVS, Level ", alertEscalation.currentLevel);
 
     // Recalculate level based on current time
     updateAlertEscalation();
@@ -7126,9 +8887,8 @@ void loadAlertStateFromNVS() {
 
 // Clear alert state from NVS
 void clearAlertStateFromNVS() {
-  alertPrefs.begin("alertState", false);
-  alertPrefs.clear();
-  alertPrefs.end();
+  nvsClear("alertState");
+  g_alertSavedTriggered = false;
   Serial.println("[ESCALATION] Alert state cleared from NVS");
 }
 
@@ -7299,7 +9059,7 @@ void updateAlertEscalation() {
 
     Serial.printf("[ESCALATION] Level changed: %d -> %d (elapsed: %d min)\n",
                   oldLevel, newLevel, elapsedMinutes);
-    addSystemLog("[ESCALATION] Level " + String(oldLevel) + " -> " + String(newLevel));
+    addSystemLog("[ESCALATION] Level ", oldLevel, " -> ", newLevel);
 
     // Notify server of level change via MQTT
     if (mqttClient.connected()) {
@@ -7350,7 +9110,7 @@ void handleEscalationCommand(JsonDocument& doc) {
                       activePreset.level4, activePreset.level5);
       }
     }
-    addSystemLog("[ESCALATION] Preset updated: " + String(preset));
+    addSystemLog("[ESCALATION] Preset updated: ", preset);
 
     // Recalculate current level with new timing
     if (alertEscalation.isTriggered) {
@@ -7364,7 +9124,7 @@ void handleEscalationCommand(JsonDocument& doc) {
     if (level >= 0 && level <= 5) {
       alertEscalation.currentLevel = (AlertLevel)level;
       Serial.printf("[ESCALATION] Level forced to %d by server\n", level);
-      addSystemLog("[ESCALATION] Level forced to " + String(level));
+      addSystemLog("[ESCALATION] Level forced to ", level);
     }
   }
 }
@@ -7400,7 +9160,7 @@ void handleAlertClearCommand(JsonDocument& doc) {
   eventArmed = true;  // Re-arm so next test alert can take photos
 
   Serial.println("[ESCALATION] Alert cleared successfully");
-  addSystemLog("[ESCALATION] Alert cleared by server: " + String(reason ? reason : "acknowledged"));
+  addSystemLog("[ESCALATION] Alert cleared by server: ", reason ? reason : "acknowledged");
 
   // Publish confirmation back to server
   if (mqttClient.connected()) {
@@ -7539,11 +9299,21 @@ void sensorTaskFunction(void *pvParameters) {
   }
   unsigned long lastHeartbeat = millis();
   hourStartTime = time(nullptr);
-  currentHourSum = 0;
-  currentHourCount = 0;
+
+  g_sensorTask = xTaskGetCurrentTaskHandle();
+  if (tofStartContinuous((uint8_t)constrain(threshold, 0, 255))) {
+    addSystemLog("ToF continuous ranging, interrupt on GPIO", TOF_INT_PIN, " (", TOF_CONT_PERIOD_MS, " ms)");
+  }
 
   for (;;) {
     NET_YIELD();  // Allow background tasks to run
+    if (g_tofContinuous) {
+      int irqTh = (overrideThreshold > 0) ? overrideThreshold : threshold;
+      uint8_t want = (uint8_t)constrain(irqTh, 0, 255);
+      if (want != g_tofIrqThresh) tofSetIrqThreshold(want);
+      // sleep until the sensor reports something under the threshold
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(detectionState ? TOF_ACTIVE_POLL_MS : TOF_IDLE_POLL_MS));
+    }
     //uint8_t currentRange = vl.readRange();
     debugI2CTransactionStart(I2C_SENSOR_VL6180X);
     uint16_t currentRange16 = readToF_mm_once();
@@ -7569,6 +9339,16 @@ void sensorTaskFunction(void *pvParameters) {
       }
     }
 
+    // incremental recalibration; never while something is in the trap
+    static uint32_t lastRecalMs = millis();
+    if (!detectionState && (g_recalNow || reCalFlag || millis() - lastRecalMs >= RECAL_STEP_MS)) {
+      bool jump = g_recalNow;
+      g_recalNow = false;
+      reCalFlag = false;
+      recalFromBaseline(jump);
+      lastRecalMs = millis();
+    }
+
     // ---------- NEW: trigger photo on first detection ----------
     sensorState = (range < threshold);
     time_t now = time(nullptr);
@@ -7576,49 +9356,33 @@ void sensorTaskFunction(void *pvParameters) {
 
     if (!detectionState && sensorState) {
       detectionState = true;
-      addSystemLog(String("🐁 Trap triggered! Range: ") + range + " mm (threshold: " + threshold + " mm)");
+      addSystemLog("🐁 Trap triggered! Range: ", range, " mm (threshold: ", threshold, " mm)");
       alertFunction();
       //captureAndStorePhoto();            // <‑‑ flash & save
       lastAlertTime = 0;  // reset alert timing
     }
     if (now - lastSecondUpdate >= 1) {
-      currentHourSum += range;
-      currentHourCount++;
+      rangeStatsAdd(range, range < threshold);
       lastSecondUpdate = now;
     }
     if (now - hourStartTime >= ONE_HOUR) {
-      float hourAvg = (currentHourCount > 0) ? (currentHourSum / currentHourCount) : 0;
-      weeklyAverages[currentHourIndex] = hourAvg;
-      currentHourIndex = (currentHourIndex + 1) % WEEK_HOURS;
-      currentHourSum = 0;
-      currentHourCount = 0;
+      float hourAvg = rangeStatsCloseHour();
       hourStartTime = now;
       Serial.println("Hourly average updated: " + String(hourAvg));
     }
 
     //Heartbeat log every 5 seconds.
     if (millis() - lastHeartbeat >= 5000) {
-      Serial.println("Sensor task heartbeat");
+      if (g_tofContinuous) {
+        Serial.printf("Sensor task heartbeat (ToF irq %u)\n", (unsigned)g_tofIrqCount);
+      } else {
+        Serial.println("Sensor task heartbeat");
+      }
       lastHeartbeat = millis();
     }
 
-    if (currentHourCount > 0) {
-      float runningAvg = currentHourSum / currentHourCount;
-      if ((range < threshold) && (now - lastAnomalyTime >= ANOMALY_MIN_INTERVAL) && (abs((int)range - (int)runningAvg) >= 30)) {
-        if (anomalyCount < MAX_ANOMALIES) {
-          anomalyEvents[anomalyCount].timestamp = now;
-          anomalyEvents[anomalyCount].reading = range;
-          anomalyCount++;
-        } else {
-          for (int i = 1; i < MAX_ANOMALIES; i++) {
-            anomalyEvents[i - 1] = anomalyEvents[i];
-          }
-          anomalyEvents[MAX_ANOMALIES - 1].timestamp = now;
-          anomalyEvents[MAX_ANOMALIES - 1].reading = range;
-        }
-        lastAnomalyTime = now;
-        Serial.println("Anomaly logged: " + String(range) + " mm at " + String(now));
-      }
+    if (range < threshold && rangeStatsCheckAnomaly(range, now)) {
+      Serial.println("Anomaly logged: " + String(range) + " mm at " + String(now));
     }
     static unsigned long lastLogTime = 0;
     static uint8_t lastLoggedRange = 0;
@@ -7634,7 +9398,7 @@ void sensorTaskFunction(void *pvParameters) {
 
       // Add to system log every 5 minutes (not every minute to avoid log spam)
       if (millis() - lastSystemLogTime > 300000) {  // 5 minutes
-        addSystemLog(String("Sensor reading: ") + range + " mm (threshold: " + threshold + " mm)");
+        addSystemLog("Sensor reading: ", range, " mm (threshold: ", threshold, " mm)");
         lastSystemLogTime = millis();
       }
 
@@ -7667,7 +9431,7 @@ void sensorTaskFunction(void *pvParameters) {
     }
     NET_YIELD();
     //vTaskDelay(pdMS_TO_TICKS(100));
-    TASK_YIELD_MS(100);
+    if (!g_tofContinuous) TASK_YIELD_MS(100);  // continuous mode waits on the ISR above
   }
 }
 
@@ -7675,6 +9439,151 @@ void sensorTaskFunction(void *pvParameters) {
 // --------------------
 // Web Request Handlers
 // --------------------
+static const char kRootPage[] PROGMEM =
+    "<!DOCTYPE html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width, initial-scale=1'>"
+    "<title>{{name}}</title>"
+    "<style>"
+    "body { background-color: #222; color: #ddd; font-family: Arial, sans-serif; margin: 0; padding: 10px; }"
+    ".container { display: flex; flex-direction: column; align-items: center; }"
+    ".chart-container { width: 100%; max-width: 600px; height: 200px; }"
+    ".camera-container { margin-bottom: 20px; }"
+    ".button-container { text-align: center; margin-top: 10px; }"
+    ".camera-button { background-color: #444; color: #ddd; border: none; padding: 10px 20px; margin: 5px; cursor: pointer; font-size: 16px; width: 150px; }"
+    ".camera-button:hover { background-color: #555; }"
+    "#triggerIndicator { display: none; font-size: 24px; color: red; animation: flash 1s infinite; margin: 10px; }"
+    "@keyframes flash { 0% { opacity: 1; } 50% { opacity: 0; } 100% { opacity: 1; } }"
+    "</style></head><body>"
+    "{{menu}}"
+    "<div class='container'>"
+    "<div class='camera-container'>"
+    "  <img id='cameraImage' src='{{preview}}' "
+    "style='width:100%; max-width:600px; height:auto; display:block; margin:0 auto;' "
+    "onerror='retryPreview();'><br>"
+    "  <div class='button-container'>"
+    "    <button class='camera-button' onclick='refreshCamera()'>Refresh</button>"
+    "    <button class='camera-button' id='liveButton' onclick='toggleLive()'>Live Off</button>"
+    "    <button class='camera-button' id='toggleLEDButton' onclick='toggleLED()'>Toggle LED</button>"
+    "  </div>"
+    "</div>"
+    "<div id='triggerIndicator'>TRAP TRIGGERED!</div>"
+    "<h1>{{name}}</h1>"
+    "<div class='chart-container'><canvas id='rangeChart'></canvas></div>"
+    "<h2>Anomalous Events</h2>"
+    "<ul id='anomalyList'></ul>"
+    // "<button onclick='fetch(\"/reset\")'>Reset Alarm</button>"
+    "<div class='button-container'>"
+    "  <button class='camera-button' onclick='fetch(\"/reset\")'>Reset Alarm</button>"
+    "<button class='camera-button' onclick=\"fetch('/falseAlarm')"
+    ".then(r=>r.json())"
+    ".then(j=>{"
+    "document.getElementById('falseOffDisplay').innerText=j.falseOff;"
+    "document.getElementById('thresholdDisplay').innerText=j.threshold;"
+    "initThresh=j.threshold;"
+    "});\">False Alarm</button>"
+    "</div>"
+    "<div class='button-container'>"
+    "  <button class='camera-button' onclick='sendHeartbeat()'>Send Heartbeat</button>"
+    "</div>"
+
+    // claim link while the device is unclaimed
+    "{{claim}}"
+
+    "</div>"
+    "<script src='https://cdn.jsdelivr.net/npm/chart.js'></script>"
+    "<script>"
+    "var liveMode = false; var liveTimer = null;"
+    "function refreshCamera() {"
+    "  console.log('Refresh button clicked');"
+    "  var url = (typeof liveMode !== 'undefined' && liveMode) ? '/camera' : '/auto.jpg';"
+    "  document.getElementById('cameraImage').src = url + '?t=' + new Date().getTime();"
+    "}"
+    "function sendHeartbeat(){"
+    "  fetch('/sendHeartbeat?t=' + Date.now())"
+    "    .then(r => r.json())"
+    "    .then(_ => console.log('Heartbeat triggered'))"
+    "    .catch(err => console.error('sendHeartbeat failed', err));"
+    "}"
+    "function retryPreview(){"
+    "  setTimeout(refreshCamera, 500);"  // retry after 0.5 s
+    "}"
+    "function toggleLive() {"
+    "  console.log('Toggle Live button clicked');"
+    "  liveMode = !liveMode;"
+    "  var btn = document.getElementById('liveButton');"
+    "  if (liveMode) {"
+    "    btn.textContent = 'Live On';"
+    "    liveTimer = setInterval(refreshCamera, 100);"
+    "  } else {"
+    "    btn.textContent = 'Live Off';"
+    "    clearInterval(liveTimer);"
+    "  }"
+    "}"
+    "function toggleLED() {"
+    "  console.log('Toggle LED button clicked');"
+    "  fetch('/toggleLED?t=' + new Date().getTime())"
+    "    .then(response => response.text())"
+    "    .then(result => {"
+    "      console.log('ToggleLED response: ' + result);"
+    "      document.getElementById('toggleLEDButton').innerText = 'LED is ' + result;"
+    "    })"
+    "    .catch(err => console.error(err));"
+    "}"
+    "function updateLEDStatus() {"
+    "  fetch('/ledStatus?t=' + new Date().getTime())"
+    "    .then(response => response.text())"
+    "    .then(result => {"
+    "      document.getElementById('toggleLEDButton').innerText = 'LED is ' + result;"
+    "    })"
+    "    .catch(err => console.error(err));"
+    "}"
+    "setInterval(updateLEDStatus, 5000);"
+    "function updateTrapStatus() {"
+    "  fetch('/data?t=' + new Date().getTime())"
+    "    .then(response => response.json())"
+    "    .then(data => {"
+    "      var indicator = document.getElementById('triggerIndicator');"
+    "      if(data.triggered) {"
+    "        indicator.style.display = 'block';"
+    "      } else {"
+    "        indicator.style.display = 'none';"
+    "      }"
+    "    })"
+    "    .catch(err => console.error(err));"
+    "}"
+    "setInterval(updateTrapStatus, 2000);"
+    "var ctx = document.getElementById('rangeChart').getContext('2d');"
+    "var rangeChart = new Chart(ctx, { type: 'line', data: { labels: [], datasets: [{ label: 'Hourly Average (mm)', data: [], borderColor: '#90EE90', backgroundColor: 'rgba(144,238,144,0.2)', tension: 0.1, fill: true }] }, options: { responsive: true, maintainAspectRatio: false, scales: { x: { title: { display: true, text: 'Hour (oldest to newest)' }, ticks: { color: '#ddd' } }, y: { title: { display: true, text: 'Range (mm)' }, ticks: { color: '#ddd' } } }, plugins: { legend: { labels: { color: '#ddd' } } } } });"
+    "function fetchData() { fetch('/data').then(response => response.json()).then(data => {"
+    "    var labels = []; var averages = [];"
+    "    if(data.weekly && data.weekly.length > 0 && data.weekly.some(val => val != 0)) {"
+    "      labels = data.weekly.map((val, index) => index);"
+    "      averages = data.weekly;"
+    "    } else {"
+    "      labels = [0]; averages = [data.currentHourAverage];"
+    "    }"
+    "    rangeChart.data.labels = labels;"
+    "    rangeChart.data.datasets[0].data = averages;"
+    "    rangeChart.options.scales.x.min = 0;"
+    "    rangeChart.options.scales.x.max = labels.length - 1;"
+    "    rangeChart.update();"
+    "    var list = document.getElementById('anomalyList');"
+    "    list.innerHTML = '';"
+    "    data.anomalies.forEach(event => {"
+    "      var li = document.createElement('li');"
+    "      li.textContent = 'Time: ' + new Date(event.timestamp * 1000).toLocaleString() + ' , Reading: ' + event.reading + ' mm';"
+    "      list.appendChild(li);"
+    "    });"
+    "  }).catch(err => console.error(err));"
+    "}"
+    "setInterval(fetchData, 2000); fetchData();"
+    "</script></body></html>";
+
+static const char kRootClaimBanner[] PROGMEM =
+    "<div style='margin-top: 20px; padding: 15px; background: #fff3cd; color: #856404; border-radius: 5px; text-align: center;'>"
+    "⚠️ <strong>Device Not Claimed</strong><br>"
+    "<a href='/claim' style='color: #007bff; text-decoration: none; font-weight: bold;'>Click here to claim this device</a>"
+    "</div>";
+
 void handleRoot(AsyncWebServerRequest *request) {
   PAGE_SCOPE("handleRoot");
 
@@ -7694,152 +9603,15 @@ void handleRoot(AsyncWebServerRequest *request) {
   }
   logRequest(request);
 
-  String displayName = (claimedDeviceName.length() > 0) ? claimedDeviceName : "MouseTrap";
-  String html = "<!DOCTYPE html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width, initial-scale=1'>";
-  html += "<title>" + displayName + "</title>";
-  html += "<style>";
-  html += "body { background-color: #222; color: #ddd; font-family: Arial, sans-serif; margin: 0; padding: 10px; }";
-  html += ".container { display: flex; flex-direction: column; align-items: center; }";
-  html += ".chart-container { width: 100%; max-width: 600px; height: 200px; }";
-  html += ".camera-container { margin-bottom: 20px; }";
-  html += ".button-container { text-align: center; margin-top: 10px; }";
-  html += ".camera-button { background-color: #444; color: #ddd; border: none; padding: 10px 20px; margin: 5px; cursor: pointer; font-size: 16px; width: 150px; }";
-  html += ".camera-button:hover { background-color: #555; }";
-  html += "#triggerIndicator { display: none; font-size: 24px; color: red; animation: flash 1s infinite; margin: 10px; }";
-  html += "@keyframes flash { 0% { opacity: 1; } 50% { opacity: 0; } 100% { opacity: 1; } }";
-  html += "</style></head><body>";
-  html += getHamburgerMenuHTML();
-  html += "<div class='container'>";
-  html += "<div class='camera-container'>";
-  String imgSrc = homePreview.length() ? homePreview : "/auto.jpg";
-  html += "  <img id='cameraImage' src='" + imgSrc + "' "
-                                                     "style='width:100%; max-width:600px; height:auto; display:block; margin:0 auto;' "
-                                                     "onerror='retryPreview();'><br>";
-  html += "  <div class='button-container'>";
-  html += "    <button class='camera-button' onclick='refreshCamera()'>Refresh</button>";
-  html += "    <button class='camera-button' id='liveButton' onclick='toggleLive()'>Live Off</button>";
-  html += "    <button class='camera-button' id='toggleLEDButton' onclick='toggleLED()'>Toggle LED</button>";
-  html += "  </div>";
-  html += "</div>";
-  html += "<div id='triggerIndicator'>TRAP TRIGGERED!</div>";
-  html += "<h1>" + displayName + "</h1>";
-  html += "<div class='chart-container'><canvas id='rangeChart'></canvas></div>";
-  html += "<h2>Anomalous Events</h2>";
-  html += "<ul id='anomalyList'></ul>";
-  // html += "<button onclick='fetch(\"/reset\")'>Reset Alarm</button>";
-  html += "<div class='button-container'>";
-  html += "  <button class='camera-button' onclick='fetch(\"/reset\")'>Reset Alarm</button>";
-  html +=   "<button class='camera-button' onclick=\"fetch('/falseAlarm')"
-            ".then(r=>r.json())"
-            ".then(j=>{"
-            "document.getElementById('falseOffDisplay').innerText=j.falseOff;"
-            "document.getElementById('thresholdDisplay').innerText=j.threshold;"
-            "initThresh=j.threshold;"
-            "});\">False Alarm</button>";
-  html += "</div>";
-  html += "<div class='button-container'>";
-  html += "  <button class='camera-button' onclick='sendHeartbeat()'>Send Heartbeat</button>";
-  html += "</div>";
-
-  // Add claim link if device is unclaimed
-  if (!deviceClaimed) {
-    html += "<div style='margin-top: 20px; padding: 15px; background: #fff3cd; color: #856404; border-radius: 5px; text-align: center;'>";
-    html += "⚠️ <strong>Device Not Claimed</strong><br>";
-    html += "<a href='/claim' style='color: #007bff; text-decoration: none; font-weight: bold;'>Click here to claim this device</a>";
-    html += "</div>";
-  }
-
-  html += "</div>";
-  html += "<script src='https://cdn.jsdelivr.net/npm/chart.js'></script>";
-  html += "<script>";
-  html += "var liveMode = false; var liveTimer = null;";
-  html += "function refreshCamera() {";
-  html += "  console.log('Refresh button clicked');";
-  html += "  var url = (typeof liveMode !== 'undefined' && liveMode) ? '/camera' : '/auto.jpg';";
-  html += "  document.getElementById('cameraImage').src = url + '?t=' + new Date().getTime();";
-  html += "}";
-  html += "function sendHeartbeat(){";
-  html += "  fetch('/sendHeartbeat?t=' + Date.now())";
-  html += "    .then(r => r.json())";
-  html += "    .then(_ => console.log('Heartbeat triggered'))";
-  html += "    .catch(err => console.error('sendHeartbeat failed', err));";
-  html += "}";
-  html += "function retryPreview(){";
-  html += "  setTimeout(refreshCamera, 500);";  // retry after 0.5 s
-  html += "}";
-  html += "function toggleLive() {";
-  html += "  console.log('Toggle Live button clicked');";
-  html += "  liveMode = !liveMode;";
-  html += "  var btn = document.getElementById('liveButton');";
-  html += "  if (liveMode) {";
-  html += "    btn.textContent = 'Live On';";
-  html += "    liveTimer = setInterval(refreshCamera, 100);";
-  html += "  } else {";
-  html += "    btn.textContent = 'Live Off';";
-  html += "    clearInterval(liveTimer);";
-  html += "  }";
-  html += "}";
-  html += "function toggleLED() {";
-  html += "  console.log('Toggle LED button clicked');";
-  html += "  fetch('/toggleLED?t=' + new Date().getTime())";
-  html += "    .then(response => response.text())";
-  html += "    .then(result => {";
-  html += "      console.log('ToggleLED response: ' + result);";
-  html += "      document.getElementById('toggleLEDButton').innerText = 'LED is ' + result;";
-  html += "    })";
-  html += "    .catch(err => console.error(err));";
-  html += "}";
-  html += "function updateLEDStatus() {";
-  html += "  fetch('/ledStatus?t=' + new Date().getTime())";
-  html += "    .then(response => response.text())";
-  html += "    .then(result => {";
-  html += "      document.getElementById('toggleLEDButton').innerText = 'LED is ' + result;";
-  html += "    })";
-  html += "    .catch(err => console.error(err));";
-  html += "}";
-  html += "setInterval(updateLEDStatus, 5000);";
-  html += "function updateTrapStatus() {";
-  html += "  fetch('/data?t=' + new Date().getTime())";
-  html += "    .then(response => response.json())";
-  html += "    .then(data => {";
-  html += "      var indicator = document.getElementById('triggerIndicator');";
-  html += "      if(data.triggered) {";
-  html += "        indicator.style.display = 'block';";
-  html += "      } else {";
-  html += "        indicator.style.display = 'none';";
-  html += "      }";
-  html += "    })";
-  html += "    .catch(err => console.error(err));";
-  html += "}";
-  html += "setInterval(updateTrapStatus, 2000);";
-  html += "var ctx = document.getElementById('rangeChart').getContext('2d');";
-  html += "var rangeChart = new Chart(ctx, { type: 'line', data: { labels: [], datasets: [{ label: 'Hourly Average (mm)', data: [], borderColor: '#90EE90', backgroundColor: 'rgba(144,238,144,0.2)', tension: 0.1, fill: true }] }, options: { responsive: true, maintainAspectRatio: false, scales: { x: { title: { display: true, text: 'Hour (oldest to newest)' }, ticks: { color: '#ddd' } }, y: { title: { display: true, text: 'Range (mm)' }, ticks: { color: '#ddd' } } }, plugins: { legend: { labels: { color: '#ddd' } } } } });";
-  html += "function fetchData() { fetch('/data').then(response => response.json()).then(data => {";
-  html += "    var labels = []; var averages = [];";
-  html += "    if(data.weekly && data.weekly.length > 0 && data.weekly.some(val => val != 0)) {";
-  html += "      labels = data.weekly.map((val, index) => index);";
-  html += "      averages = data.weekly;";
-  html += "    } else {";
-  html += "      labels = [0]; averages = [data.currentHourAverage];";
-  html += "    }";
-  html += "    rangeChart.data.labels = labels;";
-  html += "    rangeChart.data.datasets[0].data = averages;";
-  html += "    rangeChart.options.scales.x.min = 0;";
-  html += "    rangeChart.options.scales.x.max = labels.length - 1;";
-  html += "    rangeChart.update();";
-  html += "    var list = document.getElementById('anomalyList');";
-  html += "    list.innerHTML = '';";
-  html += "    data.anomalies.forEach(event => {";
-  html += "      var li = document.createElement('li');";
-  html += "      li.textContent = 'Time: ' + new Date(event.timestamp * 1000).toLocaleString() + ' , Reading: ' + event.reading + ' mm';";
-  html += "      list.appendChild(li);";
-  html += "    });";
-  html += "  }).catch(err => console.error(err));";
-  html += "}";
-  html += "setInterval(fetchData, 2000); fetchData();";
-  html += "</script></body></html>";
-
-  request->send(200, "text/html", html);
+  const String displayName = (claimedDeviceName.length() > 0) ? claimedDeviceName : "MouseTrap";
+  const String imgSrc = homePreview.length() ? homePreview : "/auto.jpg";
+  const bool claimed = deviceClaimed;
+  pageSend(request, kRootPage, [=](const char *key, PageVar &v) {
+    if (pageCommonVar(key, v)) return;
+    if (!strcmp(key, "name")) v.html(displayName);
+    else if (!strcmp(key, "preview")) v.html(imgSrc);
+    else if (!strcmp(key, "claim") && !claimed) v.raw(kRootClaimBanner);
+  });
 }
 
 void handleData(AsyncWebServerRequest *request) {
@@ -7850,27 +9622,32 @@ void handleData(AsyncWebServerRequest *request) {
     request->send(403, "text/plain", "Forbidden");
     return;
   }
+  // snapshot so the JSON is built outside the spinlock
+  std::unique_ptr<RangeStats> st(new (std::nothrow) RangeStats);
+  if (!st) {
+    request->send(503, "text/plain", "Out of memory");
+    return;
+  }
+  portENTER_CRITICAL(&g_rangeStatsMux);
+  *st = g_rangeStats;
+  portEXIT_CRITICAL(&g_rangeStatsMux);
+
   //JsonArray weekly = doc.createNestedArray("weekly");
   JsonArray weekly = doc["weekly"].to<JsonArray>();
-  int count = 0;
-  if (weeklyAverages[0] == 0 && currentHourIndex == 0) {
-    count = 0;
-  } else if (weeklyAverages[currentHourIndex] == 0) {
-    count = currentHourIndex;
-    for (int i = 0; i < count; i++) {
-      weekly.add(weeklyAverages[i]);
-    }
-  } else {
-    count = WEEK_HOURS;
-    for (int i = currentHourIndex; i < WEEK_HOURS; i++) {
-      weekly.add(weeklyAverages[i]);
-    }
-    for (int i = 0; i < currentHourIndex; i++) {
-      weekly.add(weeklyAverages[i]);
-    }
-  }
-  float currentHourAverage = (currentHourCount > 0) ? (currentHourSum / currentHourCount) : 0;
-  doc["currentHourAverage"] = currentHourAverage;
+  JsonArray weeklyP50 = doc["weeklyP50"].to<JsonArray>();
+  for (size_t i = 0; i < st->weekly.size(); i++) {
+    weekly.add(st->weekly.at(i).mean);
+    weeklyP50.add(st->weekly.at(i).p50);
+  }
+  doc["currentHourAverage"] = st->hour.n ? (float)st->hour.mean : 0.0f;
+  JsonObject stats = doc["stats"].to<JsonObject>();
+  stats["hourSamples"] = st->hour.n;
+  stats["hourStdDev"] = (float)st->hour.stddev();
+  stats["hourP10"] = st->hourHist.percentile(10);
+  stats["hourP50"] = st->hourHist.percentile(50);
+  stats["hourP90"] = st->hourHist.percentile(90);
+  stats["baseline"] = st->baseline.mean;
+  stats["baselineStdDev"] = st->baseline.stddev();
   doc["triggered"] = detectionState;
   doc["threshold"] = threshold;
   doc["calibrationOffset"] = calibrationOffset;
@@ -7878,10 +9655,10 @@ void handleData(AsyncWebServerRequest *request) {
   doc["overrideThreshold"] = overrideThreshold;
   //JsonArray anomalies = doc.createNestedArray("anomalies");
   JsonArray anomalies = doc["anomalies"].to<JsonArray>();
-  for (int i = 0; i < anomalyCount; i++) {
+  for (size_t i = 0; i < st->anomalies.size(); i++) {
     JsonObject event = anomalies.add<JsonObject>();
-    event["timestamp"] = anomalyEvents[i].timestamp;
-    event["reading"] = anomalyEvents[i].reading;
+    event["timestamp"] = st->anomalies.at(i).timestamp;
+    event["reading"] = st->anomalies.at(i).reading;
   }
   String output;
   serializeJson(doc, output);
@@ -7973,7 +9750,7 @@ void handleReset(AsyncWebServerRequest *request) {
   }
   logRequest(request);
   String ip = request->client()->remoteIP().toString();
-  addSystemLog("Reset command from " + ip);
+  addSystemLog("Reset command from ", ip);
   detectionState = false;
   addSystemLog("Detection state cleared via web reset.");
   lastAlertTime = 0;
@@ -8039,8 +9816,8 @@ void handleSetSettings(AsyncWebServerRequest *request) {
   if (request->hasParam("overrideTh")) {
     int v = request->getParam("overrideTh")->value().toInt();
     overrideThreshold = v;
-    preferences.putInt("overrideTh", v);
-    addSystemLog("🔧 Override threshold set to " + String(v) + " mm");
+    nvsPutInt("settings", "overrideTh", v);
+    addSystemLog("🔧 Override threshold set to ", v, " mm");
   }
   const AsyncWebParameter *pWhitelist = request->getParam("ipWhitelist", false);
   const AsyncWebParameter *pBlacklist = request->getParam("ipBlacklist", false);
@@ -8054,8 +9831,9 @@ void handleSetSettings(AsyncWebServerRequest *request) {
     } else {
       ipWhitelist = newWhitelist;
       ipBlacklist = newBlacklist;
-      addSystemLog("Settings updated by " + request->client()->remoteIP().toString());
+      addSystemLog("Settings updated by ", request->client()->remoteIP().toString());
     }
+    compileIpWhitelist();
     request->send(200, "text/plain", "Settings updated.");
     saveSettings();
   } else {
@@ -8125,7 +9903,7 @@ void handleSystemLogs(AsyncWebServerRequest *request) {
   res->print("<!DOCTYPE html><html><head><meta charset='utf-8'><title>System Logs</title>"
              "<style>body{background:#222;color:#ddd;font-family:Arial,sans-serif;padding:10px}"
              "pre{white-space:pre-wrap}</style></head><body>");
-  res->print(getHamburgerMenuHTML());
+  res->print(kMenuHtml);
   res->print("<h1>System Logs</h1>");
   if (busyNow) {
     res->print("<p>⚠️ Busy/low-memory mode: showing last ");
@@ -8140,10 +9918,8 @@ void handleSystemLogs(AsyncWebServerRequest *request) {
 
   for (int i = 0; i < show; ++i) {
     int ringPos = (startIdx + skip + i) % cap;
-    String line;
-    syslogLock();
-    line = systemLogs[ringPos];   // deep-copies String contents
-    syslogUnlock();
+    char line[SYSLOG_SLOT_BYTES];
+    copySystemLog(ringPos, line, sizeof(line));
 
     res->print(line);
     res->print("\n");
@@ -8193,6 +9969,7 @@ void handleReboot(AsyncWebServerRequest *request) {
   logEvent("Reboot command received from " + request->client()->remoteIP().toString(), true);
   request->send(200, "text/plain", "Rebooting...");
   TASK_YIELD_MS(1000);
+  flushSystemLogs();
   ESP.restart();
 }
 
@@ -8221,7 +9998,7 @@ void handleDeletePhotos(AsyncWebServerRequest* req,
   req->_tempObject = nullptr;
 
   if (err) {
-    addSystemLog(String("[gallery] delete: JSON parse error: ") + err.c_str());
+    addSystemLog("[gallery] delete: JSON parse error: ", err.c_str());
     return req->send(400, "text/plain", "Bad JSON");
   }
 
@@ -8252,7 +10029,9 @@ void handleDeletePhotos(AsyncWebServerRequest* req,
 
     if (!LittleFS.exists(path)) { missing.add(nm); continue; }
 
-    if (LittleFS.remove(path)) ++deleted; else errors.add(nm);
+    if (LittleFS.remove(path)) { ++deleted; catalogRemove(path.c_str()); } else errors.add(nm);
+    if (path.endsWith(".mjpg")) LittleFS.remove(clipIndexPath(path));  // sidecar, may not exist
+    LittleFS.remove(thumbPath(path));                                   // sidecar, may not exist
   }
   out["deleted"] = deleted;
 
@@ -8351,7 +10130,8 @@ void handleFlushStatus(AsyncWebServerRequest *req) {
   extern VideoJob *currentJob;  // defined globally
   if (flushInProgress && currentJob) {
     page += "<li>Flushing: " + String(currentJob->path) + "</li>";
-    page += "<li>Buffered frames: " + String(currentJob->frames.size()) + "</li>";
+    page += "<li>Queued frames: " + String(currentJob->queued()) + " / " + String(VIDEO_RING_SLOTS) + "</li>";
+    page += "<li>Written frames: " + String(currentJob->framesWritten) + "</li>";
   } else {
     page += "<li>No active VideoJob</li>";
   }
@@ -8407,18 +10187,20 @@ void handleSetOptions(AsyncWebServerRequest *request) {
   videoMode = request->hasParam("video");  // checked box → present
   saveSettings();
 
-  addSystemLog("Options changed: videoMode=" + String(videoMode));
+  addSystemLog("Options changed: videoMode=", videoMode);
 
   request->send(200, "text/plain",
                 String("✅ Options saved – video mode ")
                   + (videoMode ? "ON" : "OFF"));
 }
 
-int computeThreshold(uint16_t avg) {
+int computeThreshold(uint16_t avg, float stddev) {
   if (overrideThreshold > 0) {
     return overrideThreshold;
   }
-  const int baseOffset = 15;  // Detection margin: trigger when object is this many mm closer than baseline
+  // Detection margin: trigger when object is this many mm closer than baseline.
+  // A noisy baseline widens it (4 sigma) so sensor jitter alone can't trigger.
+  const int baseOffset = constrain((int)ceilf(4.0f * stddev), 15, 60);
   int t = int(avg)
           - baseOffset           // Baseline minus detection margin
           - falseAlarmOffset     // Additional margin to avoid false alarms
@@ -8444,31 +10226,15 @@ void handleGallery(AsyncWebServerRequest *request) {
     flushInProgress = false;
   }
 
-  if (flushInProgress) {
-    return request->send(503, "text/plain",
-                         "Gallery busy saving last video – try again in a moment");
-  }
-
-  // ---- collect latest captures ----
-  std::vector<String> files;
-  File dir = LittleFS.open(CAPTURE_DIR, "r");
-  while (dir && dir.isDirectory()) {
-    File f = dir.openNextFile();
-    if (!f) break;
-    String fn = String(f.name());  // "/captures/vid_…"
-    //if (fn.endsWith(".jpg") || fn.endsWith(".mjpg")) files.push_back(fn);
-    if (fn.endsWith(".jpg")) {
-      files.push_back(String(CAPTURE_DIR) + "/" + fn);
-    } else if (fn.endsWith(".mjpg")) {
-      files.push_back(fn);
-    }
-    NET_YIELD();
-  }
-  dir.close();
+  // ---- one page of captures from the catalog, newest first ----
+  // (the clip being recorded is only catalogued once it's finalized)
+  size_t offset = request->hasParam("offset") ? catalogArg(request->getParam("offset")->value().toInt(), 0, CATALOG_MAX) : 0;
+  size_t limit = request->hasParam("limit") ? catalogArg(request->getParam("limit")->value().toInt(), 1, GALLERY_PAGE_MAX) : GALLERY_PAGE;
+  size_t total = catalogCount();
 
-  std::sort(files.begin(), files.end());
-  //if (files.size() > 10) files.erase(files.begin(), files.end() - 10);
-  std::reverse(files.begin(), files.end());  // newest first
+  CatalogEntry *page = (CatalogEntry *)heap_caps_malloc(limit * sizeof(CatalogEntry),
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  size_t shown = page ? catalogPage(offset, limit, CAPTURE_ANY, page) : 0;
 
   // ---- HTML ----
   String html = R"rawliteral(
@@ -8484,13 +10250,14 @@ void handleGallery(AsyncWebServerRequest *request) {
  .btn{padding:6px 12px;background:#444;color:#ddd;border:none;cursor:pointer}
  .btn:hover{background:#555}
  input[type=checkbox]{transform:scale(1.2);margin-right:6px}
+ .th{width:160px;height:120px;object-fit:cover;vertical-align:middle;background:#000;margin-right:6px}
 </style></head><body>
 )rawliteral";
 
   html += getHamburgerMenuHTML();
   html += "<h1>Gallery</h1>";
 
-  if (files.empty()) {
+  if (!shown) {
     html += "<p>No captures found.</p>";
   } else {
     html += R"rawliteral(
@@ -8499,12 +10266,15 @@ void handleGallery(AsyncWebServerRequest *request) {
 <ul>
 )rawliteral";
 
-    size_t idx = 0;
-    for (const String &path : files) {
-      String name = path.substring(path.lastIndexOf('/') + 1);
-      bool isVid = path.endsWith(".mjpg");
+    for (size_t idx = 0; idx < shown; idx++) {
+      String name = page[idx].name;
+      bool isVid = page[idx].kind == CAPTURE_VIDEO;
+      String path = isVid ? name : String(CAPTURE_DIR) + "/" + name;
 
       html += "<li><label><input type='checkbox' name='pic' value='" + path + "'>";
+      if (page[idx].thumb) {
+        html += "<img class='th' loading='lazy' src='" CAPTURE_DIR "/" + name + CATALOG_THUMB_EXT "'> ";
+      }
 
       if (isVid) {
         html += "▶️ <a href='/view?f=" + path + "' target='_blank'>Play</a> | "
@@ -8518,10 +10288,25 @@ void handleGallery(AsyncWebServerRequest *request) {
         html += "<a href='" + path + "' target='_blank'>" + name + "</a>";
       }
       html += "</label></li>";
-      NET_YIELD_EVERY(idx++, 8);  // NEW: keep AsyncTCP fed
+      NET_YIELD_EVERY(idx, 8);  // NEW: keep AsyncTCP fed
     }
     html += "</ul>";
   }
+  if (page) heap_caps_free(page);
+
+  if (offset || offset + shown < total) {
+    html += "<p>";
+    if (offset) {
+      html += "<a class='btn' href='/gallery?offset=" + String(offset > limit ? offset - limit : 0)
+              + "&limit=" + String(limit) + "'>&laquo; Newer</a> ";
+    }
+    html += String(offset + 1) + "–" + String(offset + shown) + " of " + String(total);
+    if (offset + shown < total) {
+      html += " <a class='btn' href='/gallery?offset=" + String(offset + shown)
+              + "&limit=" + String(limit) + "'>Older &raquo;</a>";
+    }
+    html += "</p>";
+  }
 
   // ---------- JS ----------
   html += R"rawliteral(
@@ -8561,7 +10346,7 @@ AsyncWebServer& getServer() {
 static void handleJsLog(AsyncWebServerRequest* req) {
   if (!req->hasParam("m", true)) return req->send(400, "text/plain", "missing m");
   String msg = req->getParam("m", true)->value();
-  addSystemLog("[JS] " + msg);
+  addSystemLog("[JS] ", msg);
   req->send(204);
 }
 
@@ -8572,12 +10357,109 @@ static inline bool wantsHtml(AsyncWebServerRequest* r) {
   return h && h->value().indexOf("text/html") != -1;
 }
 
-// SPA shell: no-store
+/* ---------- cached LittleFS files (SPA, captures) ----------
+   build-littlefs.sh stores name.gz next to each compressible SPA file; it
+   is sent with Content-Encoding when the client takes gzip. Strong ETags
+   are a CRC32 of the stored bytes, computed once per file per boot. Vite
+   puts a content hash in every /app/assets/ name, so those are immutable;
+   the shell revalidates and gets a 304 while unchanged. */
+#define SPA_ASSET_CACHE "public, max-age=31536000, immutable"
+#define SPA_SHELL_CACHE "no-cache"
+#define CAPTURE_CACHE "private, no-cache"
+#define FS_ETAG_CACHE_MAX 32
+
+struct FsEtag {
+  String path;
+  size_t size;
+  time_t mtime;
+  uint32_t crc;
+};
+static std::vector<FsEtag> g_fsEtags;  // async_tcp task only
+
+// strong: content CRC (cached by path/size/mtime); weak: size + mtime only,
+// for large or still-growing files (captures, clips). f stays open; a CRC
+// pass leaves it at EOF, so the caller seeks before reading.
+static String fsEtag(File& f, const String& path, bool strong) {
+  if (!f) return String();
+  const size_t size = f.size();
+  const time_t mtime = f.getLastWrite();
+  char tag[40];
+
+  if (!strong) {
+    snprintf(tag, sizeof(tag), "W/\"%x-%lx\"", (unsigned)size, (unsigned long)mtime);
+    return String(tag);
+  }
+
+  FsEtag* hit = nullptr;
+  for (auto& e : g_fsEtags) {
+    if (e.path == path) { hit = &e; break; }
+  }
+  if (!hit || hit->size != size || hit->mtime != mtime) {
+    uint8_t buf[512];
+    uint32_t crc = 0;
+    size_t n;
+    while ((n = f.read(buf, sizeof(buf))) > 0) crc = esp_rom_crc32_le(crc, buf, n);
+    if (!hit) {
+      if (g_fsEtags.size() >= FS_ETAG_CACHE_MAX) g_fsEtags.erase(g_fsEtags.begin());
+      g_fsEtags.push_back(FsEtag{ path, size, mtime, crc });
+      hit = &g_fsEtags.back();
+    } else {
+      *hit = FsEtag{ path, size, mtime, crc };
+    }
+  }
+  snprintf(tag, sizeof(tag), "\"%08lx-%x\"", (unsigned long)hit->crc, (unsigned)size);
+  return String(tag);
+}
+
+static bool clientTakesGzip(AsyncWebServerRequest* req) {
+  return req->hasHeader("Accept-Encoding") && req->header("Accept-Encoding").indexOf("gzip") >= 0;
+}
+
+// Sends a LittleFS file (path.gz when present and accepted) with an ETag and
+// cacheControl; If-None-Match hits get an empty 304. false = no such file.
+static bool sendFsCached(AsyncWebServerRequest* req, const String& path, const char* cacheControl,
+                         const char* tag, bool strongEtag = true) {
+  // one open serves the ETag, the size and the body; probe first, since
+  // opening a missing file logs a VFS error on every SPA route miss
+  String file = path;
+  const bool gz = clientTakesGzip(req) && LittleFS.exists(path + ".gz");
+  if (gz) file += ".gz";
+  else if (!LittleFS.exists(path)) return false;
+  File f = LittleFS.open(file, "r");
+  if (!f || f.isDirectory()) return false;
+
+  const String etag = fsEtag(f, file, strongEtag);
+  AsyncWebServerResponse* res;
+  int code = 200;
+  if (etag.length() && req->hasHeader("If-None-Match") && req->header("If-None-Match") == etag) {
+    f.close();
+    res = req->beginResponse(304);
+    code = 304;
+  } else {
+    const size_t size = f.size();
+    const String ctype = guessContentType(path);
+    res = beginFileRange(req, f, ctype.c_str(), 0, size, !gz);  // no ranges on encoded bodies
+    if (!res) return true;  // error already sent
+    if (gz) res->addHeader("Content-Encoding", "gzip");
+    if (!gz && req->hasHeader("Range")) code = 206;  // beginFileRange set it
+  }
+  if (etag.length()) res->addHeader("ETag", etag);
+  res->addHeader("Vary", "Accept-Encoding");
+  res->addHeader("X-Handler", tag);
+  addStdHeaders(res, cacheControl);
+  logHit(req->methodToString(), req->url(), tag, code);
+  req->send(res);
+  return true;
+}
+
+// SPA shell: always revalidated
 static void sendIndex(AsyncWebServerRequest* req, const char* tag) {
-  AsyncWebServerResponse* r = req->beginResponse(LittleFS, "/app/index.html", "text/html");
-  r->addHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
-  r->addHeader("X-Handler", tag);
-  req->send(r);
+  if (sendFsCached(req, "/app/index.html", SPA_SHELL_CACHE, tag)) return;
+  auto* res = req->beginResponse(503, "text/html",
+    "<html><body><h1>503 Service Unavailable</h1>"
+    "<p>The web interface has not been uploaded to this device yet.</p>"
+    "<p>Please upload the filesystem via OTA or ElegantOTA.</p></body></html>");
+  sendWith(req, res, "nf-spa-missing", 503);
 }
 
 // static void sendIndex(AsyncWebServerRequest* req, const char* tag) {
@@ -8600,24 +10482,19 @@ static void send404(AsyncWebServerRequest* req, const char* tag) {
 // }
 
 void registerSpaRoutes() {
-  // 1) Static assets
-  server.serveStatic("/app/assets/", LittleFS, "/app/assets/")
-        .setCacheControl("no-store, no-cache, must-revalidate, max-age=0");
+  // 1) Static assets (content-hashed names: cache forever, gzip when stored)
+  server.on("/app/assets", HTTP_GET | HTTP_HEAD, protectHandler([](AsyncWebServerRequest* req) {
+    const String url = req->url();
+    if (url.indexOf("..") >= 0 || !sendFsCached(req, url, SPA_ASSET_CACHE, "spa-asset")) {
+      auto* res = req->beginResponse(404, "text/plain", "Not found");
+      sendWith(req, res, "nf-assets-404", 404);
+    }
+  }));
 
   // 2) SPA shell for /app and /app/ (serve directly; GET/HEAD allowed)
   server.on("/app", HTTP_ANY, protectHandler([](AsyncWebServerRequest* req) {
     if (req->method() == HTTP_GET || req->method() == HTTP_HEAD) {
-      // Check if filesystem is mounted and file exists
-      if (!LittleFS.exists("/app/index.html")) {
-        auto* res = req->beginResponse(503, "text/html",
-          "<html><body><h1>503 Service Unavailable</h1>"
-          "<p>The web interface has not been uploaded to this device yet.</p>"
-          "<p>Please upload the filesystem via OTA or ElegantOTA.</p></body></html>");
-        sendWith(req, res, "nf-spa-missing", 503);
-        return;
-      }
-      auto* res = req->beginResponse(LittleFS, "/app/index.html", "text/html");
-      sendWith(req, res, "nf-spa-root", 200);
+      sendIndex(req, "nf-spa-root");
     } else {
       auto* res = req->beginResponse(405, "text/plain", "Method Not Allowed");
       sendWith(req, res, "nf-405", 405);
@@ -8626,17 +10503,7 @@ void registerSpaRoutes() {
 
   server.on("/app/", HTTP_ANY, protectHandler([](AsyncWebServerRequest* req) {
     if (req->method() == HTTP_GET || req->method() == HTTP_HEAD) {
-      // Check if filesystem is mounted and file exists
-      if (!LittleFS.exists("/app/index.html")) {
-        auto* res = req->beginResponse(503, "text/html",
-          "<html><body><h1>503 Service Unavailable</h1>"
-          "<p>The web interface has not been uploaded to this device yet.</p>"
-          "<p>Please upload the filesystem via OTA or ElegantOTA.</p></body></html>");
-        sendWith(req, res, "nf-spa-missing", 503);
-        return;
-      }
-      auto* res = req->beginResponse(LittleFS, "/app/index.html", "text/html");
-      sendWith(req, res, "nf-spa-root", 200);
+      sendIndex(req, "nf-spa-root");
     } else {
       auto* res = req->beginResponse(405, "text/plain", "Method Not Allowed");
       sendWith(req, res, "nf-405", 405);
@@ -8728,8 +10595,7 @@ void registerSpaRoutes() {
       const int last = url.lastIndexOf('/');
       const int dot  = url.indexOf('.', (last >= 0 ? last + 1 : 0));
       if (dot < 0) {
-        auto* res = req->beginResponse(LittleFS, "/app/index.html", "text/html");
-        sendWith(req, res, "nf-spa", 200);
+        sendIndex(req, "nf-spa");
         return;
       }
       auto* res = req->beginResponse(404, "text/plain", "Not found");
@@ -9291,6 +11157,7 @@ void setupEndpoints() {
   // Reboot endpoint already registered at line 6297 - don't duplicate
   // server.on("/reboot", HTTP_GET, protectHandler(handleReboot));
   server.on("/camera", HTTP_GET, protectHandler(handleCamera));
+  server.on("/live", HTTP_GET, protectHandler(handleLive));
   server.on("/toggleLED", HTTP_GET, protectHandler(handleToggleLED));
   server.on("/ledStatus", HTTP_GET, protectHandler(handleLEDStatus));
   server.on("/test", HTTP_GET, protectHandler(handleTestPage));
@@ -9304,6 +11171,9 @@ void setupEndpoints() {
     JsonDocument doc;
 
     doc["videoMode"] = videoMode;
+    doc["snapshotBinary"] = snapshotBinary;
+    doc["preRollSec"] = preRollSec;
+    doc["preRollKB"] = preRollKB;
     doc["framesize"] = s ? s->status.framesize : 0;
     doc["quality"] = s ? s->status.quality : 12;
     doc["brightness"] = s ? s->status.brightness : 0;
@@ -9343,6 +11213,24 @@ void setupEndpoints() {
         videoMode = doc["videoMode"].as<bool>();
         changed = true;
       }
+      if (doc.containsKey("snapshotBinary")) {
+        snapshotBinary = doc["snapshotBinary"].as<bool>();
+        changed = true;
+      }
+      if (doc.containsKey("preRollSec")) {
+        int sec = doc["preRollSec"].as<int>();
+        if (sec >= 0 && sec <= 10) {
+          preRollSec = sec;
+          changed = true;
+        }
+      }
+      if (doc.containsKey("preRollKB")) {
+        int kb = doc["preRollKB"].as<int>();
+        if (kb >= 128 && kb <= 4096) {
+          preRollKB = kb;
+          changed = true;
+        }
+      }
       if (doc.containsKey("framesize")) {
         int fs = doc["framesize"].as<int>();
         if (fs >= 0 && fs <= 13) {
@@ -9440,23 +11328,45 @@ void setupEndpoints() {
     doc["ipAddress"] = WiFi.localIP().toString();
     doc["rssi"] = WiFi.RSSI();
 
+    // Last trip: ms from the trip to each stage (0 = not reached)
+    JsonObject trip = doc["lastTrip"].to<JsonObject>();
+    trip["video"] = g_alertTlLast.video;
+    trip["photo1"] = g_alertTlLast.photo1;
+    trip["photo2"] = g_alertTlLast.photo2;
+    trip["servo"] = g_alertTlLast.servo;
+    trip["alert"] = g_alertTlLast.alerted;
+    trip["snapshot"] = g_alertTlLast.snapshot;
+    trip["email"] = g_alertTlLast.emailed;
+
+    doc["loopWakeups"] = g_loopWakeups;
+    JsonObject mq = doc["mqttCallback"].to<JsonObject>();
+    mq["lastUs"] = g_mqttCbLastUs;
+    mq["maxUs"] = g_mqttCbMaxUs;
+    mq["arenaHigh"] = (uint32_t)g_mqttArena.highWater();
+    mq["arenaOverflows"] = g_mqttArena.overflows();
+    JsonObject live = doc["live"].to<JsonObject>();
+    live["clients"] = (int)g_liveClients;
+    live["frames"] = (uint32_t)g_liveSeq;
+    live["skipped"] = g_liveSkipped;
+
+    // Auto-flash light model
+    JsonObject light = doc["light"].to<JsonObject>();
+    light["dark"] = g_light.dark;
+    light["ageSec"] = g_light.valid ? (millis() - g_light.decidedMs) / 1000 : 0;
+    light["cacheHits"] = g_light.hits;
+    light["probes"] = g_light.probes;
+
     // Servo positions
     doc["servoStart"] = servoStartUS;
     doc["servoEnd"] = servoEndUS;
 
     // Capture files
     JsonArray captures = doc.createNestedArray("captures");
-    File dir = LittleFS.open(CAPTURE_DIR, "r");
-    if (dir) {
-      while (File f = dir.openNextFile()) {
-        if (!f.isDirectory()) {
-          JsonObject capture = captures.createNestedObject();
-          capture["name"] = String(f.name());
-          capture["size"] = f.size();
-        }
-      }
-      dir.close();
-    }
+    catalogForEach(CAPTURE_ANY, [&](const CatalogEntry &e) {
+      JsonObject capture = captures.createNestedObject();
+      capture["name"] = e.name;
+      capture["size"] = e.size;
+    }, true);
 
     String json;
     serializeJson(doc, json);
@@ -9484,10 +11394,8 @@ void setupEndpoints() {
 
     for (int i = 0; i < show; ++i) {
       int ringPos = (startIdx + skip + i) % cap;
-      String line;
-      syslogLock();
-      line = systemLogs[ringPos];
-      syslogUnlock();
+      char line[SYSLOG_SLOT_BYTES];
+      copySystemLog(ringPos, line, sizeof(line));
       logsArray.add(line);
     }
 
@@ -9555,6 +11463,7 @@ void setupEndpoints() {
   server.on("/download", HTTP_GET, protectHandler(handleDownloadRaw));
   server.on("/gallery", HTTP_GET, protectHandler(handleGallery));
   server.on("/view", HTTP_GET, protectHandler(handleViewClip));  // existing
+  server.on("/clip/frame", HTTP_GET, protectHandler(handleClipFrame));
   server.on("/servo", HTTP_GET, protectHandler(handleTriggerServo));
   server.on("/servoSettings", HTTP_GET, protectHandler(handleServoSettingsPage));
   server.on("/setServoSettings", HTTP_POST, protectHandler(handleServoSettingsSave));
@@ -9661,7 +11570,7 @@ void setupEndpoints() {
       doc["success"] = true;
       doc["filename"] = filename;
       doc["message"] = "Photo captured successfully";
-      addSystemLog(String("Photo captured: ") + filename);
+      addSystemLog("Photo captured: ", filename);
     } else {
       doc["success"] = false;
       doc["error"] = "Failed to capture photo";
@@ -9788,7 +11697,7 @@ void setupEndpoints() {
       addSystemLog("[WIFI-SCAN] Triggering scan...");
       startWiFiScan();  // This is synchronous, will block
       Serial.println("[WIFI-SCAN] Scan completed");
-      addSystemLog("[WIFI-SCAN] Scan done, found " + String(cachedNetworks.size()));
+      addSystemLog("[WIFI-SCAN] Scan done, found ", cachedNetworks.size());
     }
 
     // Build response
@@ -9855,7 +11764,7 @@ void setupEndpoints() {
       }
 
       Serial.printf("[WIFI-UPDATE] Updating WiFi to SSID: %s\n", newSSID.c_str());
-      addSystemLog("[WIFI-UPDATE] Updating WiFi to: " + newSSID);
+      addSystemLog("[WIFI-UPDATE] Updating WiFi to: ", newSSID);
 
       // Save WiFi credentials (does NOT affect claim status)
       saveWiFiCredentials(newSSID, newPassword);
@@ -9995,7 +11904,7 @@ void setupEndpoints() {
         String ssid = doc["ssid"] | "";
         String password = doc["password"] | "";
 
-        addSystemLog("[SETUP-WIFI] SSID: " + ssid);
+        addSystemLog("[SETUP-WIFI] SSID: ", ssid);
 
         if (ssid.isEmpty()) {
           addSystemLog("[SETUP-WIFI] ERROR: Missing SSID");
@@ -10067,10 +11976,10 @@ void setupEndpoints() {
         bool isNewAccount = doc["isNewAccount"] | true;
         String timezone = doc["timezone"] | "UTC";
 
-        addSystemLog("[SETUP-REG] Email: " + email);
-        addSystemLog("[SETUP-REG] Device: " + deviceName);
-        addSystemLog("[SETUP-REG] NewAccount: " + String(isNewAccount ? "true" : "false"));
-        addSystemLog("[SETUP-REG] Timezone: " + timezone);
+        addSystemLog("[SETUP-REG] Email: ", email);
+        addSystemLog("[SETUP-REG] Device: ", deviceName);
+        addSystemLog("[SETUP-REG] NewAccount: ", isNewAccount ? "true" : "false");
+        addSystemLog("[SETUP-REG] Timezone: ", timezone);
 
         if (email.isEmpty() || accountPassword.isEmpty() || deviceName.isEmpty()) {
           addSystemLog("[SETUP-REG] ERROR: Missing required fields");
@@ -10132,11 +12041,11 @@ void setupEndpoints() {
         bool isNewAccount = doc["isNewAccount"] | true;  // Default to create account
         String timezone = doc["timezone"] | "UTC";
 
-        addSystemLog("[SETUP-CONNECT] SSID: " + ssid);
-        addSystemLog("[SETUP-CONNECT] Email: " + email);
-        addSystemLog("[SETUP-CONNECT] Device: " + deviceName);
-        addSystemLog("[SETUP-CONNECT] NewAccount: " + String(isNewAccount ? "true" : "false"));
-        addSystemLog("[SETUP-CONNECT] Timezone: " + timezone);
+        addSystemLog("[SETUP-CONNECT] SSID: ", ssid);
+        addSystemLog("[SETUP-CONNECT] Email: ", email);
+        addSystemLog("[SETUP-CONNECT] Device: ", deviceName);
+        addSystemLog("[SETUP-CONNECT] NewAccount: ", isNewAccount ? "true" : "false");
+        addSystemLog("[SETUP-CONNECT] Timezone: ", timezone);
 
         if (ssid.isEmpty() || email.isEmpty() || accountPassword.isEmpty() || deviceName.isEmpty()) {
           addSystemLog("[SETUP-CONNECT] ERROR: Missing required fields");
@@ -10203,14 +12112,13 @@ void setupEndpoints() {
           return;
         }
 
-        addSystemLog("[STANDALONE] Saving WiFi: " + ssid);
+        addSystemLog("[STANDALONE] Saving WiFi: ", ssid);
 
         // Save WiFi credentials
-        devicePrefs.begin("wifi", false);
-        devicePrefs.putString("ssid", ssid);
-        devicePrefs.putString("password", password);
-        devicePrefs.putBool("standalone", true);  // Flag for standalone mode
-        devicePrefs.end();
+        nvsPutString("wifi", "ssid", ssid);
+        nvsPutString("wifi", "password", password);
+        nvsPutBool("wifi", "standalone", true);  // Flag for standalone mode
+        nvsCommit("wifi");
 
         addSystemLog("[STANDALONE] Credentials saved, rebooting...");
 
@@ -10255,9 +12163,9 @@ void setupEndpoints() {
         String deviceName = doc["deviceName"] | "";
         bool isNewAccount = doc["isNewAccount"] | false;  // Default to sign-in for debug
 
-        addSystemLog("[DEBUG-REGISTER] Email: " + email);
-        addSystemLog("[DEBUG-REGISTER] Device: " + deviceName);
-        addSystemLog("[DEBUG-REGISTER] isNewAccount: " + String(isNewAccount ? "true" : "false"));
+        addSystemLog("[DEBUG-REGISTER] Email: ", email);
+        addSystemLog("[DEBUG-REGISTER] Device: ", deviceName);
+        addSystemLog("[DEBUG-REGISTER] isNewAccount: ", isNewAccount ? "true" : "false");
 
         if (email.isEmpty() || deviceName.isEmpty()) {
           req->send(400, "application/json",
@@ -10492,11 +12400,15 @@ function unclaim() {
   }));
 
  
-  /* serve every /captures/… request straight from LittleFS */
-  server.serveStatic("/captures", LittleFS, CAPTURE_DIR "/")
-    .setFilter([](AsyncWebServerRequest *r) {
-      return isAllowed(r);
-    });
+  /* serve every /captures/… request straight from LittleFS; names can be
+     reused within a minute, so revalidate against a size+mtime ETag */
+  server.on("/captures", HTTP_GET | HTTP_HEAD, [](AsyncWebServerRequest *req) {
+    if (!isAllowed(req)) return req->send(403, "text/plain", "Forbidden");
+    const String url = req->url();
+    if (url.indexOf("..") >= 0 || !sendFsCached(req, url, CAPTURE_CACHE, "captures", false)) {
+      req->send(404, "text/plain", "File not found");
+    }
+  });
 
   server.on(
     "/deletePhotos",
@@ -10533,7 +12445,7 @@ function unclaim() {
       }
 
       Serial.printf("[uploadfs] fsUploadStarted=%d, Update.hasError()=%d\n", fsUploadStarted, Update.hasError());
-      addSystemLog(String("[uploadfs] fsUploadStarted=") + (fsUploadStarted?"true":"false") + " hasError=" + (Update.hasError()?"true":"false"));
+      addSystemLog("[uploadfs] fsUploadStarted=", (fsUploadStarted?"true":"false"), " hasError=", (Update.hasError()?"true":"false"));
 
       // Only check Update.hasError() if upload actually started
       bool success = fsUploadStarted && !Update.hasError();
@@ -10549,7 +12461,7 @@ function unclaim() {
         ESP.restart();
       } else {
         if (fsUploadStarted) {
-          addSystemLog("LittleFS OTA update failed: " + String(Update.errorString()));
+          addSystemLog("LittleFS OTA update failed: ", Update.errorString());
         } else {
           addSystemLog("LittleFS OTA update failed: No file uploaded");
         }
@@ -10571,7 +12483,7 @@ function unclaim() {
       if (index == 0) {
         fsUploadStarted = true;  // Mark upload as started
         Serial.printf("LittleFS Update Start: %s\n", filename.c_str());
-        addSystemLog("Starting LittleFS OTA update: " + filename);
+        addSystemLog("Starting LittleFS OTA update: ", filename);
 
         // Unmount filesystem before update
         Serial.println("[OTA] Unmounting LittleFS before update...");
@@ -10594,7 +12506,7 @@ function unclaim() {
       if (final) {
         if (Update.end(true)) {
           Serial.printf("LittleFS Update Success: %u bytes\n", index + len);
-          addSystemLog("LittleFS OTA complete: " + String(index + len) + " bytes");
+          addSystemLog("LittleFS OTA complete: ", index + len, " bytes");
         } else {
           Update.printError(Serial);
           addSystemLog("LittleFS OTA end failed");
@@ -10626,10 +12538,11 @@ function unclaim() {
 
       if (success) {
         addSystemLog("Firmware OTA update successful, rebooting...");
+        flushSystemLogs();
         delay(1000);
         ESP.restart();
       } else {
-        addSystemLog("Firmware OTA update failed: " + String(Update.errorString()));
+        addSystemLog("Firmware OTA update failed: ", Update.errorString());
       }
     },
     // onUpload (called for each chunk)
@@ -10641,7 +12554,7 @@ function unclaim() {
 
       if (index == 0) {
         Serial.printf("Firmware Update Start: %s\n", filename.c_str());
-        addSystemLog("Starting Firmware OTA update: " + filename);
+        addSystemLog("Starting Firmware OTA update: ", filename);
 
         // Begin update with firmware partition type
         DEBUG_SNAPSHOT("ota_firmware_update");
@@ -10659,7 +12572,7 @@ function unclaim() {
       if (final) {
         if (Update.end(true)) {
           Serial.printf("Firmware Update Success: %u bytes\n", index + len);
-          addSystemLog("Firmware OTA complete: " + String(index + len) + " bytes");
+          addSystemLog("Firmware OTA complete: ", index + len, " bytes");
         } else {
           Update.printError(Serial);
           addSystemLog("Firmware OTA end failed");
@@ -10691,7 +12604,7 @@ void calibrateThreshold() {
 
   if (overrideThreshold > 0) {
     threshold = overrideThreshold;
-    addSystemLog("Skipping calibration from calibrateThreshold(). Threshold override active: " + String(threshold) + " mm");
+    addSystemLog("Skipping calibration from calibrateThreshold(). Threshold override active: ", threshold, " mm");
     return;
   }
 
@@ -10702,6 +12615,7 @@ void calibrateThreshold() {
   // NEW: track valid-sample stats only
   uint32_t sum = 0;
   uint16_t cnt = 0;
+  Welford spread;
   uint16_t minv = 0xFFFF, maxv = 0;
 
   while (millis() - start < CALIB_MS) {
@@ -10722,6 +12636,7 @@ void calibrateThreshold() {
 
     sum += d;
     cnt++;
+    spread.add(d);
     if (d < minv) minv = d;
     if (d > maxv) maxv = d;
 
@@ -10739,38 +12654,59 @@ void calibrateThreshold() {
       cnt -= 2;
     }
     uint16_t avg = sum / cnt;
+    float sd = spread.stddev();
 
-    threshold = computeThreshold(avg);  // you already account for calibrationOffset & falseAlarmOffset
+    threshold = computeThreshold(avg, sd);  // you already account for calibrationOffset & falseAlarmOffset
+    rangeStatsSeedBaseline(avg, sd);
 
-    Serial.printf("Calib %u samples (trimmed), avg=%u → threshold=%u (calibOff=%d, falseOff=%d, defaultOffset=%d)\n",
-                  cnt, avg, threshold, calibrationOffset, falseAlarmOffset, defaultOffset);
-    addSystemLog(formatTime(time(nullptr)) + " Calibration done (" + String(cnt)
-                 + " samples). Average = " + String(avg) + "mm. calibrationOffset = "
-                 + String(calibrationOffset) + ". falseAlarmOffset = " + String(falseAlarmOffset)
-                 + ". Default offset = " + String(defaultOffset) + ". Threshold = " + String(threshold) + " mm.");
+    Serial.printf("Calib %u samples (trimmed), avg=%u sd=%.1f → threshold=%u (calibOff=%d, falseOff=%d, defaultOffset=%d)\n",
+                  cnt, avg, sd, threshold, calibrationOffset, falseAlarmOffset, defaultOffset);
+    addSystemLog(formatTime(time(nullptr)), " Calibration done (", cnt,
+                 " samples). Average = ", avg, "mm, sd = ", sd, "mm. calibrationOffset = ",
+                 calibrationOffset, ". falseAlarmOffset = ", falseAlarmOffset,
+                 ". Default offset = ", defaultOffset, ". Threshold = ", threshold, " mm.");
   } else {
     Serial.println("Calib failed: no valid samples");
-    addSystemLog(formatTime(time(nullptr)) + " Calibration failed. No samples collected.");
+    addSystemLog(formatTime(time(nullptr)), " Calibration failed. No samples collected.");
   }
 
   g_calibrating = false;
   CrashKit::markLine(200);
 }
 
-void recalibTask(void *p) {
-  reCalBusy = true;
+// Re-derives the threshold from the rolling baseline; runs in the sensor task.
+// jump (explicit request) applies the result at once. Otherwise differences
+// under THRESH_HYSTERESIS_MM are ignored and it moves THRESH_MAX_STEP_MM at most.
+static void recalFromBaseline(bool jump) {
   if (overrideThreshold > 0) {
     threshold = overrideThreshold;
-    addSystemLog("Early return from recalibTask(). Threshold override active: " + String(threshold) + " mm");
-    reCalBusy = false;
-    vTaskDelete(nullptr);  // <— make the task end cleanly
-    return;                // (never reached, but fine)
-  }
-  calibrateThreshold();  // ~10 s loop
-  calibDoneMillis = millis();
-  addSystemLog("Re-calibration finished. Threshold=" + String(threshold) + " mm");
-  reCalBusy = false;
-  vTaskDelete(nullptr);
+    return;
+  }
+  float mean, sd;
+  if (!rangeStatsBaseline(mean, sd)) {
+    if (jump) addSystemLog("Re-calibration deferred: baseline still settling");
+    return;
+  }
+
+  int target = computeThreshold((uint16_t)lroundf(mean), sd);
+  int diff = target - threshold;
+  if (diff == 0 || (!jump && abs(diff) < THRESH_HYSTERESIS_MM)) {
+    if (jump) addSystemLog("Re-calibration finished. Threshold=", threshold, " mm");
+    return;
+  }
+
+  int next = jump ? target : threshold + constrain(diff, -THRESH_MAX_STEP_MM, THRESH_MAX_STEP_MM);
+  addSystemLog(jump ? "Re-calibration finished. Threshold=" : "Threshold drift ", threshold, " → ", next,
+               " mm (baseline ", mean, " ± ", sd, " mm)");
+  threshold = next;
+}
+
+// Handlers call this instead of running a blocking calibration; the sensor
+// task picks it up on its next pass.
+static void requestRecalibration() {
+  g_recalNow = true;
+  if (g_sensorTask) xTaskNotifyGive(g_sensorTask);
+  addSystemLog("Re-calibration scheduled.");
 }
 
 void IRAM_ATTR reCalTimerCb(TimerHandle_t) {
@@ -10779,22 +12715,7 @@ void IRAM_ATTR reCalTimerCb(TimerHandle_t) {
   /* if overrideThreshold > 0 the timer is stopped anyway */
 }
 
-void handleCalibrationPage(AsyncWebServerRequest *req) {
-  PAGE_SCOPE("handleCalibrationPage");
-  if (!isAllowed(req)) {
-    req->send(403, "text/plain", "Forbidden");
-    return;
-  }
-
-  // reload from NVS so the UI always shows the last-saved values
-  calibrationOffset = preferences.getInt("calibOff", calibrationOffset);
-  overrideThreshold = preferences.getInt("overrideTh", overrideThreshold);
-  // if override is active, apply it immediately
-  if (overrideThreshold > 0) {
-    threshold = overrideThreshold;
-  }
-
-  String html = R"rawliteral(
+static const char kCalibrationPage[] PROGMEM = R"rawliteral(
 <!DOCTYPE html><html><head><meta charset="utf-8">
 <title>Calibration Settings</title>
 <style>
@@ -10803,37 +12724,25 @@ void handleCalibrationPage(AsyncWebServerRequest *req) {
   .btn:hover{background:#555}
   label{display:block;margin:8px 0}
 </style>
-</head><body>)rawliteral"
-                + getHamburgerMenuHTML() +
-                R"rawliteral(
+</head><body>{{menu}}
   <h1>Calibration Settings</h1>
 
   <p><strong>False-Alarm Offset:</strong>
-     <span id="falseOffDisplay">)rawliteral"
-                + String(falseAlarmOffset) +
-                R"rawliteral(</span> mm</p>
+     <span id="falseOffDisplay">{{falseOff}}</span> mm</p>
 
   <p><strong>Current Threshold:</strong>
-     <span id="thresholdDisplay">)rawliteral"
-                + String(threshold) +
-                R"rawliteral(</span> mm</p>
+     <span id="thresholdDisplay">{{threshold}}</span> mm</p>
 
   <label>
     Calibration Offset:
     <input id="calib" type="range" min="-1000" max="1000"
-           value=")rawliteral"
-                + String(calibrationOffset) +
-                R"rawliteral(" oninput="offChanged(this.value)">
-    <span id="offsetDisplay">)rawliteral"
-                + String(calibrationOffset) +
-                R"rawliteral(</span> mm
+           value="{{calibOff}}" oninput="offChanged(this.value)">
+    <span id="offsetDisplay">{{calibOff}}</span> mm
   </label>
 
   <label>
     Override Threshold (mm):
-    <input id="overrideTh" type="number" value=")rawliteral"
-                + String(overrideThreshold) +
-                R"rawliteral(">
+    <input id="overrideTh" type="number" value="{{overrideTh}}">
   </label>
 
   <button class="btn" onclick="saveCalibration()">💾 Save</button>
@@ -10885,7 +12794,30 @@ void handleCalibrationPage(AsyncWebServerRequest *req) {
 </body></html>
 )rawliteral";
 
-  req->send(200, "text/html", html);
+
+void handleCalibrationPage(AsyncWebServerRequest *req) {
+  PAGE_SCOPE("handleCalibrationPage");
+  if (!isAllowed(req)) {
+    req->send(403, "text/plain", "Forbidden");
+    return;
+  }
+
+  // reload from NVS so the UI always shows the last-saved values
+  calibrationOffset = nvsGetInt("settings", "calibOff", calibrationOffset);
+  overrideThreshold = nvsGetInt("settings", "overrideTh", overrideThreshold);
+  // if override is active, apply it immediately
+  if (overrideThreshold > 0) {
+    threshold = overrideThreshold;
+  }
+
+  const int falseOff = falseAlarmOffset, th = threshold, calibOff = calibrationOffset, ovr = overrideThreshold;
+  pageSend(req, kCalibrationPage, [=](const char *key, PageVar &v) {
+    if (pageCommonVar(key, v)) return;
+    if (!strcmp(key, "falseOff")) v.printf("%d", falseOff);
+    else if (!strcmp(key, "threshold")) v.printf("%d", th);
+    else if (!strcmp(key, "calibOff")) v.printf("%d", calibOff);
+    else if (!strcmp(key, "overrideTh")) v.printf("%d", ovr);
+  });
 }
 
 
@@ -11025,24 +12957,21 @@ void handleSetCalibration(AsyncWebServerRequest *req) {
     return req->send(400, "text/plain", "Missing calib or overrideTh");
   }
 
-  // ▲ Open NVS namespace for *all* writes in this function
-  preferences.begin("settings", false);
-
   // 1) Slider moved?
   if (req->hasArg("calib")) {
     int newOff = req->arg("calib").toInt();  // e.g. –100…+100
     int delta = newOff - calibrationOffset;
     if (delta != 0) {
       calibrationOffset = newOff;
-      preferences.putInt("calibOff", calibrationOffset);
-      addSystemLog(formatTime(time(nullptr))
-                   + " 🔧 Calibration offset set to "
-                   + String(calibrationOffset) + " mm");
+      nvsPutInt("settings", "calibOff", calibrationOffset);  // slider drags coalesce
+      addSystemLog(formatTime(time(nullptr)),
+                   " 🔧 Calibration offset set to ",
+                   calibrationOffset, " mm");
       // live-adjust
       threshold = max(0, int(threshold) + delta);
-      addSystemLog(formatTime(time(nullptr))
-                   + " ✅ Active threshold now "
-                   + String(threshold) + " mm");
+      addSystemLog(formatTime(time(nullptr)),
+                   " ✅ Active threshold now ",
+                   threshold, " mm");
     }
   }
 
@@ -11052,34 +12981,28 @@ void handleSetCalibration(AsyncWebServerRequest *req) {
     if (newOvr > 0) {
       // set override
       overrideThreshold = newOvr;
-      preferences.putInt("overrideTh", overrideThreshold);
-      addSystemLog(formatTime(time(nullptr))
-                   + " 🔧 Override threshold set to "
-                   + String(overrideThreshold) + " mm");
+      nvsPutInt("settings", "overrideTh", overrideThreshold);
+      addSystemLog(formatTime(time(nullptr)),
+                   " 🔧 Override threshold set to ",
+                   overrideThreshold, " mm");
       threshold = overrideThreshold;
-      addSystemLog(formatTime(time(nullptr))
-                   + " ✅ Active threshold now "
-                   + String(threshold) + " mm");
+      addSystemLog(formatTime(time(nullptr)),
+                   " ✅ Active threshold now ",
+                   threshold, " mm");
     } else {
       // clear override
       overrideThreshold = 0;
-      preferences.remove("overrideTh");
-      addSystemLog(formatTime(time(nullptr))
-                   + " 🔧 Override threshold cleared");
+      nvsPutInt("settings", "overrideTh", 0);  // same as absent for every reader
+      addSystemLog(formatTime(time(nullptr)),
+                   " 🔧 Override threshold cleared");
       g_lastSettingsSaveMs = millis();
 
       // recalc from sensor or offsets
       //calibrateThreshold();
       //xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-      if (!reCalBusy) {
-        xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-        addSystemLog("Re-calibration scheduled.");
-      } else {
-        addSystemLog("Re-calibration request skipped: already running.");
-      }
+      requestRecalibration();
       //addSystemLog(formatTime(time(nullptr)) + " ✅ Threshold recalculated to " + String(threshold) + " mm");
     }
-    preferences.end();
   }
 
   req->send(200, "text/plain", "OK");
@@ -11153,9 +13076,9 @@ void handleResetCalibration(AsyncWebServerRequest *req) {
   overrideThreshold = 0;
 
   // 2) persist to NVS
-  preferences.putInt("calibOff", calibrationOffset);
-  preferences.putInt("falseOff", falseAlarmOffset);
-  preferences.putInt("overrideTh", overrideThreshold);
+  nvsPutInt("settings", "calibOff", calibrationOffset);
+  nvsPutInt("settings", "falseOff", falseAlarmOffset);
+  nvsPutInt("settings", "overrideTh", overrideThreshold);
 
   // 3) log what happened here
   addSystemLog("Calibration offsets reset to 0");
@@ -11167,12 +13090,7 @@ void handleResetCalibration(AsyncWebServerRequest *req) {
   //threshold = /* either your default-recalc or simply zero */ overrideThreshold;
   //calibrateThreshold();
   //xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-  if (!reCalBusy) {
-    xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-    addSystemLog("Re-calibration scheduled.");
-  } else {
-    addSystemLog("Re-calibration request skipped: already running.");
-  }
+  requestRecalibration();
 
 
   // 5) reply to the client
@@ -11186,7 +13104,7 @@ void handleClearOverride(AsyncWebServerRequest *req) {
 
   // clear the override in RAM + NVS
   overrideThreshold = 0;
-  preferences.putInt("overrideTh", 0);
+  nvsPutInt("settings", "overrideTh", 0);
   addSystemLog("🔄 Override threshold cleared");
   g_lastSettingsSaveMs = millis();
 
@@ -11194,12 +13112,7 @@ void handleClearOverride(AsyncWebServerRequest *req) {
   // recompute a fresh threshold
   //calibrateThreshold();
   //xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-  if (!reCalBusy) {
-    xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
-    addSystemLog("Re-calibration scheduled.");
-  } else {
-    addSystemLog("Re-calibration request skipped: already running.");
-  }
+  requestRecalibration();
 
 
   req->send(200, "text/plain", "OK");
@@ -11243,13 +13156,11 @@ void handleRecalibrate(AsyncWebServerRequest *req) {
   }
   if (overrideThreshold > 0) {
     threshold = overrideThreshold;
-    addSystemLog("Can't recalibrate.  Threshold override active: " + String(threshold) + " mm");
+    addSystemLog("Can't recalibrate.  Threshold override active: ", threshold, " mm");
     return;
   }
 
-  // launch once, low priority, on core 1
-  xTaskCreatePinnedToCore(
-    recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 0);
+  requestRecalibration();
 
   //addSystemLog("Re-calibrated ⇒ threshold " + String(threshold) + " mm");
 
@@ -11265,7 +13176,7 @@ void handleFalseAlarm(AsyncWebServerRequest *req) {
   }
   if (overrideThreshold > 0) {
     threshold = overrideThreshold;
-    addSystemLog("Can't set false alarm offset. Threshold override active: " + String(threshold) + " mm");
+    addSystemLog("Can't set false alarm offset. Threshold override active: ", threshold, " mm");
     return;
   }
 
@@ -11274,7 +13185,7 @@ void handleFalseAlarm(AsyncWebServerRequest *req) {
   threshold -= STEP;         // apply immediately
 
   saveSettings();
-  addSystemLog("False alarm ⇒ threshold " + String(threshold) + " mm (falseOff=" + String(falseAlarmOffset) + ")");
+  addSystemLog("False alarm ⇒ threshold ", threshold, " mm (falseOff=", falseAlarmOffset, ")");
   String json = "{\"falseOff\":" + String(falseAlarmOffset) + ",\"threshold\":" + String(threshold) + "}";
   req->send(200, "application/json", json);
   //req->send(200, "text/plain", "False Alarm offset: " + String(falseAlarmOffset));
@@ -11285,16 +13196,11 @@ void notifyBootIP() {
   /* 1) Get public IP (you were already caching PUBLIC_IP) */
   String ip = PUBLIC_IP;
   ip.trim();
-  addSystemLog("Public IP: " + ip);
+  addSystemLog("Public IP: ", ip);
 
   /* 2) Build JSON for the relay -------------------------------------- */
   String url = String(emailServer) + "/mouse-trap";  // same route
 
-  HTTPClient relay;
-  relay.setTimeout(3000);
-  relay.begin(url);
-  relay.addHeader("Content-Type", "application/json");
-
   JsonDocument doc; // keep your ArduinoJson v6 usage
 
   // ---- REQUIRED fields your relay already renders ----
@@ -11328,16 +13234,17 @@ void notifyBootIP() {
   String payload;
   serializeJson(doc, payload);
 
-  addSystemLog("Boot email payload: " + payload);
+  addSystemLog("Boot email payload: ", payload);
 
-  /* 3) Send ----------------------------------------------------------- */
-  int code = relay.POST(payload);
-  if (code == 200) {
-    addSystemLog("Boot-up IP email queued");
-  } else {
-    addSystemLog("Relay POST failed: " + String(code));
-  }
-  relay.end();
+  /* 3) Send (queued; setup() doesn't wait on the relay) ------------- */
+  bool queued = httpSvcPostAsync(url.c_str(), payload, [](int code) {
+    if (code == 200) {
+      addSystemLog("Boot-up IP email queued");
+    } else {
+      addSystemLog("Relay POST failed: ", code);
+    }
+  });
+  if (!queued) addSystemLog("Relay POST dropped (HTTP queue full)");
 }
 
 void notifyAlarmCleared(const char *reason) {
@@ -11345,10 +13252,6 @@ void notifyAlarmCleared(const char *reason) {
   if (WiFi.status() != WL_CONNECTED) return;
 
   String url = String(emailServer) + "/mouse-trap";
-  HTTPClient http;
-  http.setTimeout(3000);
-  if (!http.begin(url)) return;
-  http.addHeader("Content-Type", "application/json");
 
   JsonDocument doc;  // same pattern you already use
   doc["event"]  = "cleared";
@@ -11359,10 +13262,9 @@ void notifyAlarmCleared(const char *reason) {
 
   String payload;
   serializeJson(doc, payload);
-  int rc = http.POST(payload);
-  http.end();
-
-  addSystemLog(String("[notify] alarm cleared (") + reason + "), rc=" + String(rc));
+  // queued: this runs from web handlers and the button job
+  bool queued = httpSvcPostAsync(url.c_str(), payload, [](int rc) { addSystemLog("[notify] alarm cleared, rc=", rc); });
+  if (!queued) addSystemLog("[notify] alarm cleared (", reason, ") dropped - HTTP queue full");
 
   // Also publish via MQTT to notify server dashboard
   if (deviceClaimed && mqttClient.connected()) {
@@ -11379,7 +13281,7 @@ void notifyAlarmCleared(const char *reason) {
     serializeJson(mqttDoc, mqttPayload);
 
     mqttClient.publish(topic, mqttPayload.c_str());
-    addSystemLog(String("[MQTT] Published alert_cleared (") + reason + ")");
+    addSystemLog("[MQTT] Published alert_cleared (", reason, ")");
   }
 }
 
@@ -11416,14 +13318,31 @@ void syncFwStampOnBoot() {
 void dumpFsPartition() {
   const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "littlefs");
   if (p) {
-    addSystemLog(String("[FS] Partition label=") + (p->label?p->label:"(none)") +
-                 " addr=0x" + String(p->address, HEX) +
-                 " size=" + String(p->size));
+    addSystemLog("[FS] Partition label=", (p->label[0] ? p->label : "(none)"),
+                 " addr=0x", logHex(p->address),
+                 " size=", p->size);
   } else {
     addSystemLog("[FS] LittleFS partition not found via ESP-IDF");
   }
 }
 
+#if TRAP_LIGHT_SLEEP
+#include "esp_pm.h"
+static void enableLightSleep() {
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pm = {};
+#else
+  esp_pm_config_esp32s3_t pm = {};
+#endif
+  pm.max_freq_mhz = ESP.getCpuFreqMHz();
+  pm.min_freq_mhz = 40;
+  pm.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&pm);
+  WiFi.setSleep(true);  // modem sleep; required for light sleep with Wi-Fi up
+  addSystemLog("[PM] light sleep ", err == ESP_OK ? "enabled" : "unavailable: ", err == ESP_OK ? "" : esp_err_to_name(err));
+}
+#endif
+
 void setup() {
   Serial.begin(115200);
   delay(1000);  // Match test sketch - give radio time to initialize
@@ -11469,7 +13388,7 @@ void setup() {
   // ========== END EARLY WIFI SCAN ==========
 
   CrashKit::snapshotOnBoot();                                          // 1) capture prior run
-  addSystemLog(String("[crash] ") + CrashKit::makeBootCrashReport());  // 2) log it
+  addSystemLog("[crash] ", CrashKit::makeBootCrashReport());  // 2) log it
                                                                        // (do NOT call markPage("boot"))
 
 
@@ -11488,6 +13407,7 @@ void setup() {
   debugI2CInit();
   debugTasksInit();
   debugCrashKitInit();
+  perfInit();
   debugContextInit();
   addSystemLog("[debug] All debug modules initialized");
 
@@ -11499,6 +13419,7 @@ void setup() {
   addBootLog("[boot] Reset reason: " + String((int)reason) + " (" + CrashKit::resetReasonToString(reason) + ")");
 
     // ---- EARLY: load the stored setting and immediately enforce it ----
+  nvsInit();                          // coalesced NVS writer (nvs_store.h)
   loadServoPrefEarly();               // READ from NVS -> sets disableServo
   applyServoDisableState("boot");     // detaches/tri-states if disabled
 
@@ -11595,7 +13516,7 @@ void setup() {
     preferences.putBool("disableServo", true);
     //disableServo = true;
     setDisableServo(true, "boot/…");
-    addSystemLog("[servo] Auto-disabled after reset reason " + String((int)reason));
+    addSystemLog("[servo] Auto-disabled after reset reason ", (int)reason);
   }
   preferences.end();
 
@@ -11685,14 +13606,21 @@ void setup() {
     if (!LittleFS.exists(CAPTURE_DIR)) {
       if (LittleFS.mkdir(CAPTURE_DIR)) {
         Serial.printf("Created capture directory %s\n", CAPTURE_DIR);
-        addSystemLog(String("Created capture directory ") + CAPTURE_DIR);
+        addSystemLog("Created capture directory ", CAPTURE_DIR);
       } else {
         Serial.printf("❌ Failed to create capture directory %s\n", CAPTURE_DIR);
-        addSystemLog(String("❌ Failed to create capture directory ") + CAPTURE_DIR);
+        addSystemLog("❌ Failed to create capture directory ", CAPTURE_DIR);
       }
     } else {
       addBootLog(String("✅ Capture directory already exists ") + String(CAPTURE_DIR));
     }
+
+    // One directory walk for the life of the boot; writers keep it current
+    if (catalogLoad(CAPTURE_DIR)) {
+      addSystemLog("Capture catalog: ", (unsigned)catalogCount(), " files, ", (unsigned long)(g_catalogBytes / 1024), " KB");
+    } else {
+      addSystemLog("⚠️  Capture catalog alloc failed - listings will be empty");
+    }
   }
 
 
@@ -11752,7 +13680,7 @@ void setup() {
     Serial.println(apIP);
     Serial.println("[AP MODE] Connect to this network and navigate to http://192.168.4.1/setup");
 
-    addSystemLog("[AP MODE] Started AP: " + apName + " @ " + apIP.toString());
+    addSystemLog("[AP MODE] Started AP: ", apName, " @ ", apIP.toString());
     addSystemLog("[AP MODE] Visit http://192.168.4.1/setup to configure");
 
     isAPMode = true;
@@ -11832,7 +13760,7 @@ void setup() {
       apChannel = cachedNetworks[0].channel;
       Serial.printf("[AP MODE] Using channel %d (strongest network: %s)\n",
                     apChannel, cachedNetworks[0].ssid.c_str());
-      addSystemLog("[AP MODE] Starting on ch " + String(apChannel) + " (" + cachedNetworks[0].ssid + ")");
+      addSystemLog("[AP MODE] Starting on ch ", apChannel, " (", cachedNetworks[0].ssid, ")");
     }
     WiFi.softAP(apName.c_str(), "", apChannel);
 
@@ -11844,7 +13772,7 @@ void setup() {
     Serial.printf("[AP MODE] Channel: %d\n", apChannel);
     Serial.println("[AP MODE] Connect to this network and navigate to http://192.168.4.1/setup");
 
-    addSystemLog("[AP MODE] Started AP: " + apName + " @ " + apIP.toString() + " ch " + String(apChannel));
+    addSystemLog("[AP MODE] Started AP: ", apName, " @ ", apIP.toString(), " ch ", apChannel);
     addSystemLog("[AP MODE] Visit http://192.168.4.1/setup to configure");
 
     isAPMode = true;
@@ -11881,6 +13809,8 @@ void setup() {
     startMdnsService();
   }
 
+  httpSvcInit();  // pooled HTTP client + worker, before the first server call
+
   // Verify claim status with server if device thinks it's claimed
   if (deviceClaimed) {
     Serial.println("[STARTUP-CLAIM] ========================================");
@@ -11949,7 +13879,7 @@ void setup() {
         Serial.println("[STARTUP-CLAIM] ========================================");
         Serial.printf("[STARTUP-CLAIM] Device Name: %s\n", claimedDeviceName.c_str());
         Serial.printf("[STARTUP-CLAIM] Tenant ID: %s\n", claimedTenantId.c_str());
-        addSystemLog("[STARTUP-CLAIM] Claim auto-recovered: " + claimedDeviceName);
+        addSystemLog("[STARTUP-CLAIM] Claim auto-recovered: ", claimedDeviceName);
       } else {
         Serial.println("[STARTUP-CLAIM] Device not found on server - needs manual registration");
         addSystemLog("[STARTUP-CLAIM] Not found on server - needs registration");
@@ -11964,11 +13894,17 @@ void setup() {
 
   loadSettings();
 
+#if TRAP_BENCH
+  benchTrapKernels([](const char *line) { Serial.println(line); }, ipWhitelist.c_str());
+  Serial.printf("bench done, %u check(s) failed\n", (unsigned)g_benchFailures);
+#endif
+
   applyTimeZone();
 
   syncNTP();
 
   initLocksOnce();
+  startSyslogWriter();
 
   //static String PUBLIC_IP;
   PUBLIC_IP = getPublicIP();  // cache once; refresh later if you want
@@ -12029,11 +13965,11 @@ void setup() {
   //overrideThreshold = preferences.getInt("overrideTh", 0);
   if (overrideThreshold > 0) {
     //threshold = overrideThreshold;
-    addSystemLog(String("overrideThreshold = ") + overrideThreshold);
-    addSystemLog(String("Skipping sensor calibration.  Override threshold > 0: ") + threshold);
+    addSystemLog("overrideThreshold = ", overrideThreshold);
+    addSystemLog("Skipping sensor calibration.  Override threshold > 0: ", threshold);
   } else {
     // fall back to a fresh calibration run
-    addSystemLog(String("overrideThreshold = ") + overrideThreshold);
+    addSystemLog("overrideThreshold = ", overrideThreshold);
     addSystemLog("Running calibrateThreshold() from setup().");
     calibrateThreshold();  // your existing function sets `threshold`
     //xTaskCreatePinnedToCore(recalibTask, "ReCal", 4096, nullptr, 1, nullptr, 1);
@@ -12108,6 +14044,10 @@ void setup() {
 
   digitalWrite(LED_PIN, LOW);
 
+  startAlertTasks();  // capture burst + notification worker, idle until a trip
+#if TRAP_LIGHT_SLEEP
+  enableLightSleep();
+#endif
   if (sensorFound) {
     xTaskCreatePinnedToCore(sensorTaskFunction, "SensorTask", 8192, NULL, 1, NULL, 0);
   } else {
@@ -12149,7 +14089,7 @@ void setup() {
                         (uint32_t)time(nullptr));
     preferences.end();  // ② CLOSE  (flushes to NVS)
 
-    addSystemLog("🔄 Firmware updated at " + String(formatTime(time(nullptr))));
+    addSystemLog("🔄 Firmware updated at ", formatTime(time(nullptr)));
   });
 
   // Startup indication: flash LED and buzzer.
@@ -12173,6 +14113,9 @@ void setup() {
   // add in setup() (any time after Wi-Fi is up)
   xTaskCreatePinnedToCore(heartbeatTask, "hb", 4096, nullptr, 2, nullptr, 0);
 
+  // pre-trigger video ring (idles unless video mode + preRollSec > 0)
+  startPreRollTask();
+
     // ---- LATE: re-apply in case any init code tried to attach the servo ----
   applyServoDisableState("end-setup");
 
@@ -12222,7 +14165,9 @@ bool captureAndStorePhoto() {
   TASK_YIELD_MS(60);      // ≈60–80 ms – tweak if needed
 
   /* ---------- 2) Capture ---------- */
+  PerfStamp t0 = perfNow();
   camera_fb_t *fb = esp_camera_fb_get();
+  perfRecord(PERF_CAPTURE, t0);
   if (fb) debugFramebufferAllocated(fb);
   setHighPowerLED(false);  // always turn it off again
   if (!fb) {
@@ -12239,49 +14184,33 @@ bool captureAndStorePhoto() {
 
   String fileName = String(CAPTURE_DIR) + "/img_" + ts + ".jpg";
 
+  captureMakeRoom(fb->len);
+  t0 = perfNow();
   File f = LittleFS.open(fileName, FILE_WRITE);
   if (!f) {
-    addSystemLog("⚠️  captureAndStorePhoto: failed to open " + fileName);
+    addSystemLog("⚠️  captureAndStorePhoto: failed to open ", fileName);
     debugFramebufferReleased(fb);
     esp_camera_fb_return(fb);
     return false;
   }
-  f.write(fb->buf, fb->len);
+  size_t wr = f.write(fb->buf, fb->len);
   f.close();
+  perfRecord(PERF_JPEG_WRITE, t0);
+  catalogAdd(fileName.c_str(), wr, true);
   debugFramebufferReleased(fb);
   esp_camera_fb_return(fb);
+  thumbEnqueue(fileName.c_str());
 
   lastImagePath = fileName;
   photoQueued = true;
 
-  addSystemLog("📸 Saved picture " + fileName + " (" + String(fb->len) + " bytes)");
+  addSystemLog("📸 Saved picture ", fileName, " (", wr, " bytes)");
 
   /* ---------- 4) House‑keep: keep at most MAX_SAVED_IMAGES ---------- */
-  File root = LittleFS.open(CAPTURE_DIR);
-  if (!root) {
-    addSystemLog("⚠️  Could not open " + String(CAPTURE_DIR) + " for clean‑up");
-    return true;  // picture is safe; just continue
-  }
-
-  /* collect all jpg names so we can sort chronologically (name already
-     encodes the timestamp) */
-  std::vector<String> jpgNames;
-  File file = root.openNextFile();
-  while (file) {
-    String n = String(file.name());
-    if (!file.isDirectory() && n.endsWith(".jpg"))
-      jpgNames.push_back(n);
-    file = root.openNextFile();
-  }
-  root.close();
-
-  if (jpgNames.size() > MAX_SAVED_IMAGES) {
-    std::sort(jpgNames.begin(), jpgNames.end());  // oldest → newest
-    size_t toDelete = jpgNames.size() - MAX_SAVED_IMAGES;
-    for (size_t i = 0; i < toDelete; ++i) {
-      LittleFS.remove(jpgNames[i]);
-      addSystemLog("🗑️  Deleted old photo " + jpgNames[i]);
-    }
+  CatalogEntry old;
+  while (catalogCount(CAPTURE_IMAGE) > MAX_SAVED_IMAGES && catalogOldest(CAPTURE_IMAGE, old)) {
+    captureDelete(old.name, old.kind);
+    addSystemLog("🗑️  Deleted old photo ", old.name);
   }
 
   return true;
@@ -12298,7 +14227,7 @@ void saveSetupResult(bool success, const String& errorCode, const String& errorM
   prefs.putString("errorCode", errorCode);
   prefs.putString("errorMsg", errorMessage);
   prefs.end();
-  addSystemLog("[SETUP] Saved result: success=" + String(success ? "true" : "false") + ", error=" + errorCode);
+  addSystemLog("[SETUP] Saved result: success=", success ? "true" : "false", ", error=", errorCode);
 }
 
 SetupResult loadSetupResult() {
@@ -12328,11 +14257,11 @@ void clearSetupResult() {
 bool tryRecoverClaim() {
   String mac = g_macUpper;  // XX:XX:XX:XX:XX:XX format
 
-  addSystemLog("[RECOVER] Attempting claim recovery for MAC: " + mac);
+  addSystemLog("[RECOVER] Attempting claim recovery for MAC: ", mac);
 
   // Call server recover-claim endpoint
   String serverUrl = String(CLAIM_SERVER_URL) + "/api/setup/recover-claim";
-  addSystemLog("[RECOVER] Calling server: " + serverUrl);
+  addSystemLog("[RECOVER] Calling server: ", serverUrl);
 
   HTTPClient http;
   http.begin(serverUrl);
@@ -12347,12 +14276,12 @@ bool tryRecoverClaim() {
   serializeJson(reqDoc, reqBody);
 
   int httpCode = http.POST(reqBody);
-  addSystemLog("[RECOVER] HTTP response code: " + String(httpCode));
+  addSystemLog("[RECOVER] HTTP response code: ", httpCode);
 
   if (httpCode != 200) {
     // Device not claimed or error - need full registration
     String response = http.getString();
-    addSystemLog("[RECOVER] Not claimed or error: " + response);
+    addSystemLog("[RECOVER] Not claimed or error: ", response);
     http.end();
     return false;
   }
@@ -12364,7 +14293,7 @@ bool tryRecoverClaim() {
   JsonDocument respDoc;
   DeserializationError err = deserializeJson(respDoc, response);
   if (err) {
-    addSystemLog("[RECOVER] JSON parse error: " + String(err.c_str()));
+    addSystemLog("[RECOVER] JSON parse error: ", err.c_str());
     return false;
   }
 
@@ -12382,8 +14311,8 @@ bool tryRecoverClaim() {
   String mqttPassword = respDoc["mqttCredentials"]["password"].as<String>();
   String deviceName = respDoc["deviceName"].as<String>();
 
-  addSystemLog("[RECOVER] Claim recovered! Device: " + deviceName);
-  addSystemLog("[RECOVER] Tenant: " + tenantId);
+  addSystemLog("[RECOVER] Claim recovered! Device: ", deviceName);
+  addSystemLog("[RECOVER] Tenant: ", tenantId);
 
   // Save credentials to NVS (same format as processPendingRegistration)
   currentSetupStep = "Saving recovered credentials...";
@@ -12461,7 +14390,7 @@ void processPendingWiFiTest() {
   currentSetupErrorCode = "";
 
   addSystemLog("[WIFI-TEST] ====== STARTING WIFI TEST ======");
-  addSystemLog("[WIFI-TEST] SSID: " + pendingWiFiTestSSID);
+  addSystemLog("[WIFI-TEST] SSID: ", pendingWiFiTestSSID);
 
   // ===== STEP 0: Disconnect any previous WiFi connection =====
   addSystemLog("[WIFI-TEST] Disconnecting any previous connection...");
@@ -12471,7 +14400,7 @@ void processPendingWiFiTest() {
   // AP is already on the correct channel (started on strongest network's channel at boot)
   // No need to scan or change channels - this keeps the phone connected!
   currentSetupStep = "Connecting to WiFi...";
-  addSystemLog("[WIFI-TEST] AP channel: " + String(WiFi.channel()) + " (set at boot from strongest network)");
+  addSystemLog("[WIFI-TEST] AP channel: ", WiFi.channel(), " (set at boot from strongest network)");
 
   // Ensure we're in AP+STA mode (should already be, but be safe)
   if (WiFi.getMode() != WIFI_AP_STA) {
@@ -12480,7 +14409,7 @@ void processPendingWiFiTest() {
   }
 
   // ===== STEP 1: Connect to WiFi (STA) =====
-  addSystemLog("[WIFI-TEST] Connecting to WiFi: " + pendingWiFiTestSSID);
+  addSystemLog("[WIFI-TEST] Connecting to WiFi: ", pendingWiFiTestSSID);
   WiFi.begin(pendingWiFiTestSSID.c_str(), pendingWiFiTestPassword.c_str());
 
   int attempts = 0;
@@ -12493,8 +14422,8 @@ void processPendingWiFiTest() {
   }
 
   if (WiFi.status() != WL_CONNECTED) {
-    addSystemLog("[WIFI-TEST] WiFi connection failed after " + String(attempts * 500 / 1000) + " seconds");
-    addSystemLog("[WIFI-TEST] WiFi status code: " + String(WiFi.status()));
+    addSystemLog("[WIFI-TEST] WiFi connection failed after ", attempts * 500 / 1000, " seconds");
+    addSystemLog("[WIFI-TEST] WiFi status code: ", WiFi.status());
     currentSetupState = SETUP_FAILED;
     currentSetupError = "Could not connect to WiFi network. Check password and try again.";
     currentSetupErrorCode = "wifi_failed";
@@ -12503,7 +14432,7 @@ void processPendingWiFiTest() {
     return;
   }
 
-  addSystemLog("[WIFI-TEST] WiFi connected, IP: " + WiFi.localIP().toString());
+  addSystemLog("[WIFI-TEST] WiFi connected, IP: ", WiFi.localIP().toString());
 
   // Store the working credentials for registration phase
   pendingSetupSSID = pendingWiFiTestSSID;
@@ -12542,8 +14471,8 @@ void processPendingRegistration() {
   pendingRegistration = false;  // Clear flag first to prevent re-entry
 
   addSystemLog("[REGISTER] ====== STARTING REGISTRATION ======");
-  addSystemLog("[REGISTER] Email: " + pendingSetupEmail);
-  addSystemLog("[REGISTER] Device: " + pendingSetupDeviceName);
+  addSystemLog("[REGISTER] Email: ", pendingSetupEmail);
+  addSystemLog("[REGISTER] Device: ", pendingSetupDeviceName);
 
   // WiFi should already be connected from test-wifi phase
   if (WiFi.status() != WL_CONNECTED) {
@@ -12574,7 +14503,7 @@ void processPendingRegistration() {
   }
 
   if (now < MIN_VALID_TIME) {
-    addSystemLog("[REGISTER] NTP sync timeout, epoch=" + String((unsigned long)now));
+    addSystemLog("[REGISTER] NTP sync timeout, epoch=", (unsigned long)now);
     currentSetupState = SETUP_FAILED;
     currentSetupError = "Could not sync time with internet. Check your network connection.";
     currentSetupErrorCode = "ntp_failed";
@@ -12582,18 +14511,18 @@ void processPendingRegistration() {
     return;
   }
 
-  addSystemLog("[REGISTER] Time synced, epoch: " + String((unsigned long)now));
+  addSystemLog("[REGISTER] Time synced, epoch: ", (unsigned long)now);
 
   // ===== STEP 2: Generate claim token =====
   currentSetupState = SETUP_REGISTERING;
   currentSetupStep = "Registering device...";
   addSystemLog("[REGISTER] Generating claim credentials...");
   ClaimCredentials creds = generateClaimCredentials();
-  addSystemLog("[REGISTER] MAC=" + String(creds.mac) + ", timestamp=" + String(creds.timestamp));
+  addSystemLog("[REGISTER] MAC=", creds.mac, ", timestamp=", creds.timestamp);
 
   // ===== STEP 3: Call server =====
   String url = String(CLAIM_SERVER_URL) + "/api/setup/register-and-claim";
-  addSystemLog("[REGISTER] Calling server: " + url);
+  addSystemLog("[REGISTER] Calling server: ", url);
 
   HTTPClient http;
   http.begin(url);
@@ -12614,7 +14543,7 @@ void processPendingRegistration() {
   serializeJson(reqDoc, reqBody);
 
   int httpCode = http.POST(reqBody);
-  addSystemLog("[REGISTER] HTTP response code: " + String(httpCode));
+  addSystemLog("[REGISTER] HTTP response code: ", httpCode);
 
   if (httpCode == 200 || httpCode == 201) {
     String response = http.getString();
@@ -12644,7 +14573,7 @@ void processPendingRegistration() {
     String brokerHost = resDoc["brokerHost"] | MQTT_BROKER;
     int brokerPort = resDoc["brokerPort"] | MQTT_PORT;
 
-    addSystemLog("[REGISTER] Saving claim data: tenant=" + tenantId + ", device=" + deviceId);
+    addSystemLog("[REGISTER] Saving claim data: tenant=", tenantId, ", device=", deviceId);
 
     Preferences prefs;
     prefs.begin("claim", false);
@@ -12697,7 +14626,7 @@ void processPendingRegistration() {
   } else {
     // Handle error response
     String response = http.getString();
-    addSystemLog("[REGISTER] HTTP error: " + String(httpCode) + " - " + response);
+    addSystemLog("[REGISTER] HTTP error: ", httpCode, " - ", response);
 
     JsonDocument resDoc;
     deserializeJson(resDoc, response);
@@ -12720,7 +14649,7 @@ void processPendingRegistration() {
       currentSetupErrorCode = "server_error";
     }
 
-    addSystemLog("[REGISTER] Setup failed: " + currentSetupError);
+    addSystemLog("[REGISTER] Setup failed: ", currentSetupError);
     saveSetupResult(false, currentSetupErrorCode, currentSetupError);
   }
 
@@ -12750,9 +14679,9 @@ void processPendingSetup() {
 
   // ===== STEP 1: Log setup start =====
   addSystemLog("[SETUP] ====== STARTING SETUP PROCESS (APSTA MODE) ======");
-  addSystemLog("[SETUP] SSID: " + pendingSetupSSID);
-  addSystemLog("[SETUP] Email: " + pendingSetupEmail);
-  addSystemLog("[SETUP] Device: " + pendingSetupDeviceName);
+  addSystemLog("[SETUP] SSID: ", pendingSetupSSID);
+  addSystemLog("[SETUP] Email: ", pendingSetupEmail);
+  addSystemLog("[SETUP] Device: ", pendingSetupDeviceName);
 
   // ===== STEP 2: Scan for target network to find its channel =====
   // In AP+STA mode, both interfaces MUST be on the same channel
@@ -12765,12 +14694,12 @@ void processPendingSetup() {
 
   int targetChannel = 1;  // Default fallback
   int n = WiFi.scanNetworks();
-  addSystemLog("[SETUP] Found " + String(n) + " networks");
+  addSystemLog("[SETUP] Found ", n, " networks");
 
   for (int i = 0; i < n; i++) {
     if (WiFi.SSID(i) == pendingSetupSSID) {
       targetChannel = WiFi.channel(i);
-      addSystemLog("[SETUP] Target network '" + pendingSetupSSID + "' found on channel " + String(targetChannel));
+      addSystemLog("[SETUP] Target network '", pendingSetupSSID, "' found on channel ", targetChannel);
       break;
     }
   }
@@ -12782,7 +14711,7 @@ void processPendingSetup() {
 
   // ===== STEP 3: Switch to AP+STA mode with correct channel =====
   currentSetupStep = "Connecting to WiFi...";
-  addSystemLog("[SETUP] Switching to AP+STA mode on channel " + String(targetChannel) + "...");
+  addSystemLog("[SETUP] Switching to AP+STA mode on channel ", targetChannel, "...");
   WiFi.mode(WIFI_AP_STA);
   delay(100);
 
@@ -12792,10 +14721,10 @@ void processPendingSetup() {
   String apName = "MouseTrap-" + macSuffix;
   WiFi.softAP(apName.c_str(), "", targetChannel);  // Empty password for open AP
   delay(500);  // Allow mode switch to settle
-  addSystemLog("[SETUP] AP restarted on channel " + String(targetChannel) + ", IP: " + WiFi.softAPIP().toString());
+  addSystemLog("[SETUP] AP restarted on channel ", targetChannel, ", IP: ", WiFi.softAPIP().toString());
 
   // ===== STEP 4: Connect to WiFi (STA) =====
-  addSystemLog("[SETUP] Connecting to WiFi: " + pendingSetupSSID);
+  addSystemLog("[SETUP] Connecting to WiFi: ", pendingSetupSSID);
   WiFi.begin(pendingSetupSSID.c_str(), pendingSetupPassword.c_str());
 
   int attempts = 0;
@@ -12808,8 +14737,8 @@ void processPendingSetup() {
   }
 
   if (WiFi.status() != WL_CONNECTED) {
-    addSystemLog("[SETUP] WiFi connection failed after " + String(attempts) + " attempts");
-    addSystemLog("[SETUP] WiFi status code: " + String(WiFi.status()));
+    addSystemLog("[SETUP] WiFi connection failed after ", attempts, " attempts");
+    addSystemLog("[SETUP] WiFi status code: ", WiFi.status());
     currentSetupState = SETUP_FAILED;
     currentSetupError = "Could not connect to WiFi network. Check password and try again.";
     currentSetupErrorCode = "wifi_failed";
@@ -12818,7 +14747,7 @@ void processPendingSetup() {
     return;
   }
 
-  addSystemLog("[SETUP] WiFi connected, IP: " + WiFi.localIP().toString());
+  addSystemLog("[SETUP] WiFi connected, IP: ", WiFi.localIP().toString());
   currentSetupStep = "WiFi connected, syncing time...";
 
   // Give WiFi stack time to fully initialize
@@ -12842,7 +14771,7 @@ void processPendingSetup() {
   }
 
   if (now < MIN_VALID_TIME) {
-    addSystemLog("[SETUP] NTP sync timeout, epoch=" + String((unsigned long)now));
+    addSystemLog("[SETUP] NTP sync timeout, epoch=", (unsigned long)now);
     currentSetupState = SETUP_FAILED;
     currentSetupError = "Could not sync time with internet. Check your network connection.";
     currentSetupErrorCode = "ntp_failed";
@@ -12850,18 +14779,18 @@ void processPendingSetup() {
     return;
   }
 
-  addSystemLog("[SETUP] Time synced, epoch: " + String((unsigned long)now));
+  addSystemLog("[SETUP] Time synced, epoch: ", (unsigned long)now);
 
   // ===== STEP 6: Generate claim token =====
   currentSetupState = SETUP_REGISTERING;
   currentSetupStep = "Registering device...";
   addSystemLog("[SETUP] Generating claim credentials...");
   ClaimCredentials creds = generateClaimCredentials();
-  addSystemLog("[SETUP] MAC=" + String(creds.mac) + ", timestamp=" + String(creds.timestamp));
+  addSystemLog("[SETUP] MAC=", creds.mac, ", timestamp=", creds.timestamp);
 
   // ===== STEP 7: Call server =====
   String url = String(CLAIM_SERVER_URL) + "/api/setup/register-and-claim";
-  addSystemLog("[SETUP] Calling server: " + url);
+  addSystemLog("[SETUP] Calling server: ", url);
 
   HTTPClient http;
   http.begin(url);
@@ -12881,7 +14810,7 @@ void processPendingSetup() {
   serializeJson(reqDoc, reqBody);
 
   int httpCode = http.POST(reqBody);
-  addSystemLog("[SETUP] HTTP response code: " + String(httpCode));
+  addSystemLog("[SETUP] HTTP response code: ", httpCode);
 
   if (httpCode == 200 || httpCode == 201) {
     String response = http.getString();
@@ -12891,7 +14820,7 @@ void processPendingSetup() {
     DeserializationError jsonErr = deserializeJson(respDoc, response);
 
     if (jsonErr) {
-      addSystemLog("[SETUP] JSON parse error: " + String(jsonErr.c_str()));
+      addSystemLog("[SETUP] JSON parse error: ", jsonErr.c_str());
       currentSetupState = SETUP_FAILED;
       currentSetupError = "Server returned invalid response. Please try again.";
       currentSetupErrorCode = "server_error";
@@ -12930,7 +14859,7 @@ void processPendingSetup() {
       devicePrefs.end();
 
       addSystemLog("[SETUP] Credentials saved");
-      addSystemLog("[SETUP] DeviceID: " + claimedDeviceId);
+      addSystemLog("[SETUP] DeviceID: ", claimedDeviceId);
       clearSetupResult();  // Clear any previous error on success
 
       // ===== SUCCESS! =====
@@ -12941,21 +14870,21 @@ void processPendingSetup() {
 
     } else {
       String error = respDoc["error"].as<String>();
-      addSystemLog("[SETUP] Server rejected: " + error);
+      addSystemLog("[SETUP] Server rejected: ", error);
       currentSetupState = SETUP_FAILED;
       currentSetupError = error;
       currentSetupErrorCode = "server_rejected";
       currentSetupStep = "Registration failed";
     }
   } else if (httpCode < 0) {
-    addSystemLog("[SETUP] HTTP connection error: " + String(httpCode) + " - " + http.errorToString(httpCode));
+    addSystemLog("[SETUP] HTTP connection error: ", httpCode, " - ", http.errorToString(httpCode));
     currentSetupState = SETUP_FAILED;
     currentSetupError = "Could not connect to server. Check internet connection.";
     currentSetupErrorCode = "connection_error";
     currentSetupStep = "Connection error";
   } else if (httpCode == 401) {
     String errorBody = http.getString();
-    addSystemLog("[SETUP] Authentication error (401): " + errorBody.substring(0, 200));
+    addSystemLog("[SETUP] Authentication error (401): ", errorBody.substring(0, 200));
 
     JsonDocument errDoc;
     String errorMsg = "Invalid email or password";
@@ -12970,7 +14899,7 @@ void processPendingSetup() {
     currentSetupStep = "Authentication failed";
   } else {
     String errorBody = http.getString();
-    addSystemLog("[SETUP] HTTP " + String(httpCode) + ": " + errorBody.substring(0, 200));
+    addSystemLog("[SETUP] HTTP ", httpCode, ": ", errorBody.substring(0, 200));
 
     JsonDocument errDoc;
     String errorMsg = "Registration failed (HTTP " + String(httpCode) + ")";
@@ -12988,134 +14917,158 @@ void processPendingSetup() {
   http.end();
 }
 
-void loop() {
+/* ================================================================
+ *  Main loop: deadline-scheduled jobs (loop_scheduler.h)
+ *  Each former loop() poller runs at the rate it actually needs; between
+ *  deadlines the loop task blocks instead of spinning every 10 ms.
+ * ================================================================ */
+#define MQTT_LOOP_MS      50    // PubSubClient poll; bounds command latency
+#define AP_DNS_LOOP_MS    10    // captive portal DNS while in AP mode
+#define LOOP_MAX_SLEEP_MS 1000
+#define PERF_PUBLISH_MS   300000  // latency histograms + CPU share to MQTT
 
+static int g_jobDns = -1;
+
+static void jobDns() {
   // Process DNS requests for captive portal when in AP mode
   if (isAPMode) {
     dnsServer.processNextRequest();
     performWiFiScan();  // Check if async scan completed and cache results
   }
+  loopJobPeriod(g_jobDns, isAPMode ? AP_DNS_LOOP_MS : 500);
+}
 
+static void jobPendingSetup() {
   // Process pending setup from captive portal (deferred to allow HTTP response to send)
   processPendingWiFiTest();    // Phase 1: Test WiFi connection only
   processPendingRegistration(); // Phase 2: Register (after WiFi confirmed)
   processPendingSetup();       // Legacy: Combined flow (for backward compatibility)
+}
 
-  static uint32_t lastStamp = 0;
-  if (!CrashKit::pageActive() && millis() - lastStamp >= 500) {
+static void jobHousekeeping() {
+  if (!CrashKit::pageActive()) {
     CrashKit::markPage("loop");
     CrashKit::markLine(__LINE__);
-    lastStamp = millis();
   }
 
-  /* ── Heap low-water-mark monitor ───────────────────────────── */
-  static uint32_t lowHeap = ESP.getFreeHeap();  // start at current value
-  static uint32_t lastMinute = 0;               // time of last 1-min check
-  static uint32_t lastReport = 0;               // time of last 1-h log
-
-  uint32_t now = millis();
-
-  /* every 60 s update the running minimum */
-  if (now - lastMinute >= 60000) {
-    lastMinute = now;
-    lowHeap = min(lowHeap, ESP.getFreeHeap());
+  // If the high-power LED is on and has been on for 10 seconds, turn it off.
+  if (highPowerLedState && (millis() - highPowerLedOnTimestamp >= 10000)) {
+    Serial.println("Safety override: High-power LED turned off after 10 seconds.");
+    addSystemLog("Safety override: High-power LED turned off after 10 seconds.");
+    setHighPowerLED(false);
   }
+}
+
+/* ── Heap low-water-mark monitor: sampled every minute, logged hourly ── */
+static void jobHeapMonitor() {
+  static uint32_t lowHeap = ESP.getFreeHeap();  // start at current value
+  static uint8_t minutes = 0;
 
-  /* every 60 min write one line to the system log */
-  if (now - lastReport >= 3600000) {
-    lastReport = now;
-    addSystemLog("[heap] low-water mark: " + String(lowHeap) + " bytes");
+  lowHeap = min(lowHeap, ESP.getFreeHeap());
+  if (++minutes >= 60) {
+    minutes = 0;
+    addSystemLog("[heap] low-water mark: ", lowHeap, " bytes");
     lowHeap = ESP.getFreeHeap();  // reset for next hour
   }
-  /* ─────────────────────────────────────────────────────────── */
+}
 
-  /* ── NVS Claim Status Verification (every 5 minutes) ─────── */
-  if (now - lastNvsVerification >= 300000) {  // Every 5 minutes (300000 ms)
-    lastNvsVerification = now;
+/* ── NVS Claim Status Verification (every 5 minutes) ─────── */
+static void jobNvsVerify() {
+  uint32_t now = millis();
+  lastNvsVerification = now;
 
-    // Verify NVS claim credentials are still present
-    Serial.println("[NVS-VERIFY] ========================================");
-    Serial.println("[NVS-VERIFY] PERIODIC CLAIM STATUS CHECK");
-    Serial.println("[NVS-VERIFY] ========================================");
-    Serial.printf("[NVS-VERIFY] Timestamp: %lu ms (uptime: %.1f hours)\n", now, now / 3600000.0);
-    Serial.printf("[NVS-VERIFY] Claim Status:\n");
-    Serial.printf("[NVS-VERIFY]   - deviceClaimed: %s\n", deviceClaimed ? "TRUE" : "FALSE");
+  // Verify NVS claim credentials are still present
+  Serial.println("[NVS-VERIFY] ========================================");
+  Serial.println("[NVS-VERIFY] PERIODIC CLAIM STATUS CHECK");
+  Serial.println("[NVS-VERIFY] ========================================");
+  Serial.printf("[NVS-VERIFY] Timestamp: %lu ms (uptime: %.1f hours)\n", now, now / 3600000.0);
+  Serial.printf("[NVS-VERIFY] Claim Status:\n");
+  Serial.printf("[NVS-VERIFY]   - deviceClaimed: %s\n", deviceClaimed ? "TRUE" : "FALSE");
 
-    if (deviceClaimed) {
-      Serial.printf("[NVS-VERIFY]   - claimedDeviceId: %s\n",
-                    claimedDeviceId.length() > 0 ? "PRESENT" : "MISSING");
-      Serial.printf("[NVS-VERIFY]   - claimedDeviceName: %s\n",
-                    claimedDeviceName.length() > 0 ? claimedDeviceName.c_str() : "MISSING");
-      Serial.printf("[NVS-VERIFY]   - claimedMqttClientId: %s\n",
-                    claimedMqttClientId.length() > 0 ? "PRESENT" : "MISSING");
-      Serial.printf("[NVS-VERIFY]   - claimedMqttUsername: %s\n",
-                    claimedMqttUsername.length() > 0 ? "PRESENT" : "MISSING");
-      Serial.printf("[NVS-VERIFY]   - claimedMqttPassword: %s\n",
-                    claimedMqttPassword.length() > 0 ? "PRESENT" : "MISSING");
-      Serial.printf("[NVS-VERIFY]   - MQTT Connected: %s\n",
-                    mqttReallyConnected ? "YES" : "NO");
-
-      // Check for credential integrity
-      bool credentialsIntact = (claimedDeviceId.length() > 0 &&
-                                claimedMqttClientId.length() > 0 &&
-                                claimedMqttUsername.length() > 0 &&
-                                claimedMqttPassword.length() > 0);
-
-      if (credentialsIntact) {
-        Serial.println("[NVS-VERIFY] ✓ All claim credentials present and intact");
-      } else {
-        Serial.println("[NVS-VERIFY] ⚠️ WARNING: Claim credentials are INCOMPLETE!");
-        Serial.println("[NVS-VERIFY] This may indicate NVS corruption or partial clear");
-        addSystemLog("[NVS-VERIFY] WARNING: Incomplete claim credentials detected!");
-      }
+  if (deviceClaimed) {
+    Serial.printf("[NVS-VERIFY]   - claimedDeviceId: %s\n",
+                  claimedDeviceId.length() > 0 ? "PRESENT" : "MISSING");
+    Serial.printf("[NVS-VERIFY]   - claimedDeviceName: %s\n",
+                  claimedDeviceName.length() > 0 ? claimedDeviceName.c_str() : "MISSING");
+    Serial.printf("[NVS-VERIFY]   - claimedMqttClientId: %s\n",
+                  claimedMqttClientId.length() > 0 ? "PRESENT" : "MISSING");
+    Serial.printf("[NVS-VERIFY]   - claimedMqttUsername: %s\n",
+                  claimedMqttUsername.length() > 0 ? "PRESENT" : "MISSING");
+    Serial.printf("[NVS-VERIFY]   - claimedMqttPassword: %s\n",
+                  claimedMqttPassword.length() > 0 ? "PRESENT" : "MISSING");
+    Serial.printf("[NVS-VERIFY]   - MQTT Connected: %s\n",
+                  mqttReallyConnected ? "YES" : "NO");
+
+    // Check for credential integrity
+    bool credentialsIntact = (claimedDeviceId.length() > 0 &&
+                              claimedMqttClientId.length() > 0 &&
+                              claimedMqttUsername.length() > 0 &&
+                              claimedMqttPassword.length() > 0);
+
+    if (credentialsIntact) {
+      Serial.println("[NVS-VERIFY] ✓ All claim credentials present and intact");
     } else {
-      Serial.println("[NVS-VERIFY]   - Device is UNCLAIMED");
-      Serial.printf("[NVS-VERIFY]   - WiFi: %s\n", WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
-      Serial.printf("[NVS-VERIFY]   - AP Mode: %s\n", isAPMode ? "Active" : "Inactive");
+      Serial.println("[NVS-VERIFY] ⚠️ WARNING: Claim credentials are INCOMPLETE!");
+      Serial.println("[NVS-VERIFY] This may indicate NVS corruption or partial clear");
+      addSystemLog("[NVS-VERIFY] WARNING: Incomplete claim credentials detected!");
     }
-
-    Serial.println("[NVS-VERIFY] ========================================");
+  } else {
+    Serial.println("[NVS-VERIFY]   - Device is UNCLAIMED");
+    Serial.printf("[NVS-VERIFY]   - WiFi: %s\n", WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
+    Serial.printf("[NVS-VERIFY]   - AP Mode: %s\n", isAPMode ? "Active" : "Inactive");
   }
-  /* ─────────────────────────────────────────────────────────── */
 
-  /* ── Debug instrumentation periodic monitoring ─────────────── */
-  static unsigned long lastDebugUpdate = 0;
-  if (now - lastDebugUpdate > 10000) {  // Every 10 seconds
-    debugTasksMonitor();
-    debugFramebufferCheckStale();
-    debugI2CCheckHealth();
-    lastDebugUpdate = now;
-  }
-  /* ─────────────────────────────────────────────────────────── */
+  Serial.println("[NVS-VERIFY] ========================================");
+}
 
-  /* ── Alert Escalation System Update ─────────────────────── */
-  // Process escalation state machine (level changes, buzzer/LED patterns)
-  updateAlertEscalation();
-  /* ─────────────────────────────────────────────────────────── */
+/* ── Debug instrumentation periodic monitoring ─────────────── */
+static void jobDebugMonitors() {
+  debugTasksMonitor();
+  perfCpuSample();
+  debugFramebufferCheckStale();
+  debugI2CCheckHealth();
+}
 
-  /* ── Claiming mode button check, polling, and timeout ──────── */
+static void jobButton() {
   checkButtonForClaimingMode();
+  // poll only while the button is (or was just) down; the ISR kicks us on a press
+  bool down = digitalRead(BUTTON_PIN) == LOW || lastButtonState == LOW;
+  loopJobPeriod(g_jobButton, down ? 20 : 0);
+}
+
+static void jobClaiming() {
   checkClaimCompletion();  // Poll server to check if claimed
   checkClaimingModeTimeout();
-  /* ─────────────────────────────────────────────────────────── */
+}
 
+static void jobOta() {
   ElegantOTA.loop();
+}
 
-  // WebSocket tunnel removed
-  // ws_tunnel_loop();  // REMOVED
-
+static void registerLoopJobs() {
+  g_jobDns = loopJobAdd("dns", jobDns, AP_DNS_LOOP_MS);
+  loopJobAdd("pendingSetup", jobPendingSetup, 250);
+  loopJobAdd("housekeeping", jobHousekeeping, 500);
+  // these first ran one period after boot under the old polling loop; keep that
+  loopJobAdd("heap", jobHeapMonitor, 60000, 60000);
+  loopJobAdd("nvsVerify", jobNvsVerify, 300000, 300000);
+  loopJobAdd("debug", jobDebugMonitors, 10000, 10000);
+  loopJobAdd("perf", publishPerfStats, PERF_PUBLISH_MS);
+  // Process escalation state machine (level changes, buzzer/LED patterns); it steps once a second
+  loopJobAdd("escalation", updateAlertEscalation, 250);
+  g_jobButton = loopJobAdd("button", jobButton, 20);
+  loopJobAdd("claiming", jobClaiming, 1000);
+  loopJobAdd("ota", jobOta, 250);
+  g_jobMqttOta = loopJobAdd("mqttOta", jobMqttOta, 1000);  // kicked by announcements
   // MQTT fleet management
-  mqttLoop();
+  loopJobAdd("mqtt", mqttLoop, MQTT_LOOP_MS);
+}
 
-  // If the high-power LED is on and has been on for 10 seconds, turn it off.
-  if (highPowerLedState && (millis() - highPowerLedOnTimestamp >= 10000)) {
-    Serial.println("Safety override: High-power LED turned off after 10 seconds.");
-    addSystemLog("Safety override: High-power LED turned off after 10 seconds.");
-    setHighPowerLED(false);
+void loop() {
+  static bool jobsRegistered = false;
+  if (!jobsRegistered) {
+    registerLoopJobs();
+    jobsRegistered = true;
   }
-
-
-
-  NET_YIELD();
-  TASK_YIELD_MS(10);
-}
\ No newline at end of file
+  loopSchedRun(LOOP_MAX_SLEEP_MS);
+}
@@ -0,0 +1,347 @@
+// nvs_store.h
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*  Coalesced NVS writes.
+
+    nvsPut*() only records the value in a RAM table of pending writes and
+    returns; the NvsW task commits everything pending NVS_DEBOUNCE_MS after
+    the first change, one Preferences session per namespace. A key written
+    again before then costs nothing, and at commit time a key whose flash
+    value already matches is skipped, so neither a burst of saves nor a
+    "save everything" call erases flash for values that did not change.
+
+      nvsPutInt("settings", "calibOff", calibrationOffset);   // debounced
+      nvsPutBool("trap", "disableServo", v, NVS_SOON);       // writer, now
+      nvsPutBool("settings", "srvArmFl", true, NVS_SYNC);    // this task, now
+      nvsCommit("device");                                   // pending device keys, now
+
+    NVS_SOON wakes the writer without the debounce; NVS_SYNC (and
+    nvsCommit) write on the calling task for the few values that must be on
+    flash before the caller goes on. nvsGet*() see pending values, so a page
+    that reads a setting back shows what was saved. A write that fails
+    (namespace won't open, put returns 0) stays pending and is retried
+    NVS_RETRY_MS later. Pending writes are flushed by a shutdown handler on
+    esp_restart() (g_nvsStats.shutdownHook says whether it registered); a
+    crash or power cut can lose at most the last debounce window of LAZY
+    values.
+
+    ns and key are kept by pointer and must be string literals. A key should
+    be written through here only - a direct Preferences write can be
+    overwritten by an older pending value.                                   */
+
+#define NVS_DEBOUNCE_MS 2000
+#define NVS_RETRY_MS    5000  // failed writes wait this long for the next round
+#define NVS_MAX_PENDING 32
+
+enum NvsWhen : uint8_t { NVS_LAZY, NVS_SOON, NVS_SYNC };
+
+enum NvsType : uint8_t { NVS_T_BOOL, NVS_T_U8, NVS_T_U16, NVS_T_I32, NVS_T_U32, NVS_T_STR };
+
+struct NvsPending {
+  const char *ns;
+  const char *key;
+  NvsType type;
+  uint32_t seq;  // bumped on every put; a commit removes only what it wrote
+  uint32_t failedRound;  // commit round that last failed it; skipped until the next
+  int64_t num;
+  String str;
+};
+
+struct NvsStats {
+  uint32_t puts = 0;
+  uint32_t coalesced = 0;  // put replaced a value that was still pending
+  uint32_t writes = 0;     // keys written to flash
+  uint32_t unchanged = 0;  // keys skipped because flash already matched
+  uint32_t commits = 0;    // Preferences sessions opened to write
+  uint32_t failures = 0;   // failed attempts; the entry stays pending
+  uint32_t maxPending = 0;
+  bool shutdownHook = false;  // flush on esp_restart() registered
+};
+
+static NvsPending g_nvsPending[NVS_MAX_PENDING];
+static uint8_t g_nvsCount = 0;
+static uint32_t g_nvsSeq = 0;
+static uint32_t g_nvsDueMs = 0;
+static uint32_t g_nvsRound = 0;  // under g_nvsFlash
+static volatile bool g_nvsSoon = false;
+static SemaphoreHandle_t g_nvsMux = nullptr;    // pending table
+static SemaphoreHandle_t g_nvsFlash = nullptr;  // one commit at a time
+static TaskHandle_t g_nvsTask = nullptr;
+static NvsStats g_nvsStats;
+
+static void nvsInit();
+
+// entry for ns/key or -1; caller holds g_nvsMux
+static int nvsFind(const char *ns, const char *key) {
+  for (int i = 0; i < g_nvsCount; i++) {
+    if (!strcmp(g_nvsPending[i].key, key) && !strcmp(g_nvsPending[i].ns, ns)) return i;
+  }
+  return -1;
+}
+
+// caller holds g_nvsMux
+static void nvsRemove(int i) {
+  if (i != g_nvsCount - 1) {
+    g_nvsPending[i] = g_nvsPending[g_nvsCount - 1];
+  }
+  g_nvsPending[--g_nvsCount].str = String();
+}
+
+// Writes e if flash differs; p is open on e.ns. False if the put failed.
+static bool nvsWriteOne(Preferences &p, const NvsPending &e) {
+  PreferenceType want;
+  switch (e.type) {
+    case NVS_T_BOOL:
+    case NVS_T_U8: want = PT_U8; break;
+    case NVS_T_U16: want = PT_U16; break;
+    case NVS_T_I32: want = PT_I32; break;
+    case NVS_T_U32: want = PT_U32; break;
+    default: want = PT_STR; break;
+  }
+  if (p.getType(e.key) == want) {
+    bool same;
+    switch (e.type) {
+      case NVS_T_BOOL: same = p.getBool(e.key) == (e.num != 0); break;
+      case NVS_T_U8: same = p.getUChar(e.key) == (uint8_t)e.num; break;
+      case NVS_T_U16: same = p.getUShort(e.key) == (uint16_t)e.num; break;
+      case NVS_T_I32: same = p.getInt(e.key) == (int32_t)e.num; break;
+      case NVS_T_U32: same = p.getUInt(e.key) == (uint32_t)e.num; break;
+      default: same = p.getString(e.key) == e.str; break;
+    }
+    if (same) {
+      g_nvsStats.unchanged++;
+      return true;
+    }
+  }
+  size_t n;
+  switch (e.type) {
+    case NVS_T_BOOL: n = p.putBool(e.key, e.num != 0); break;
+    case NVS_T_U8: n = p.putUChar(e.key, (uint8_t)e.num); break;
+    case NVS_T_U16: n = p.putUShort(e.key, (uint16_t)e.num); break;
+    case NVS_T_I32: n = p.putInt(e.key, (int32_t)e.num); break;
+    case NVS_T_U32: n = p.putUInt(e.key, (uint32_t)e.num); break;
+    default: n = p.putString(e.key, e.str); break;
+  }
+  if (n) g_nvsStats.writes++;
+  return n != 0;
+}
+
+// Commits pending writes of ns (nullptr = all) on the calling task. Entries
+// that fail stay pending for a later round; false if any did.
+static bool nvsCommit(const char *ns = nullptr) {
+  nvsInit();
+  xSemaphoreTake(g_nvsFlash, portMAX_DELAY);
+  const uint32_t round = ++g_nvsRound;
+  Preferences p;
+  const char *open = nullptr;
+  bool opened = false;
+  bool failed = false;
+  for (;;) {
+    NvsPending e;
+    bool found = false;
+    xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+    for (int pass = 0; pass < 2 && !found; pass++) {  // stay in the open namespace first
+      for (int i = 0; i < g_nvsCount && !found; i++) {
+        const NvsPending &c = g_nvsPending[i];
+        if ((ns && strcmp(c.ns, ns)) || c.failedRound == round) continue;
+        if (pass == 0 && (!open || strcmp(c.ns, open))) continue;
+        e = c;
+        found = true;
+      }
+    }
+    xSemaphoreGive(g_nvsMux);
+    if (!found) break;
+
+    if (!open || strcmp(open, e.ns)) {
+      if (opened) p.end();
+      open = e.ns;
+      opened = p.begin(e.ns, false);
+      if (opened) g_nvsStats.commits++;
+    }
+    bool ok = opened && nvsWriteOne(p, e);
+    if (!ok) {
+      g_nvsStats.failures++;
+      failed = true;
+    }
+
+    xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+    int i = nvsFind(e.ns, e.key);
+    if (i >= 0 && g_nvsPending[i].seq == e.seq) {  // else re-put meanwhile: next round
+      if (ok) nvsRemove(i);
+      else g_nvsPending[i].failedRound = round;
+    }
+    xSemaphoreGive(g_nvsMux);
+  }
+  if (opened) p.end();
+  if (failed) {
+    xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+    g_nvsDueMs = millis() + NVS_RETRY_MS;  // the writer retries what is left
+    unsigned left = g_nvsCount;
+    xSemaphoreGive(g_nvsMux);
+    Serial.printf("[NVS] commit failed, %u write(s) still pending\n", left);
+  }
+  xSemaphoreGive(g_nvsFlash);
+  return !failed;
+}
+
+static inline bool nvsFlush() {
+  return nvsCommit(nullptr);
+}
+
+static void nvsWriterTask(void *) {
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+    if (g_nvsCount) {
+      int32_t left = (int32_t)(g_nvsDueMs - millis());
+      wait = left > 0 ? pdMS_TO_TICKS(left) : 0;
+    }
+    xSemaphoreGive(g_nvsMux);
+    if (wait) ulTaskNotifyTake(pdTRUE, wait);
+
+    bool soon = g_nvsSoon;
+    g_nvsSoon = false;
+    xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+    bool due = g_nvsCount && (soon || (int32_t)(millis() - g_nvsDueMs) >= 0);
+    xSemaphoreGive(g_nvsMux);
+    if (due) nvsFlush();
+  }
+}
+
+static void nvsShutdown() {
+  nvsFlush();
+}
+
+static void nvsInit() {
+  if (g_nvsMux) return;
+  g_nvsMux = xSemaphoreCreateMutex();
+  g_nvsFlash = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(nvsWriterTask, "NvsW", 4096, nullptr, tskIDLE_PRIORITY + 1, &g_nvsTask, 0);
+  esp_err_t err = esp_register_shutdown_handler(nvsShutdown);
+  g_nvsStats.shutdownHook = err == ESP_OK;
+  if (err != ESP_OK) {
+    // table full: callers that restart must nvsFlush() first themselves
+    Serial.printf("[NVS] shutdown handler not registered (%s); pending writes are lost on restart\n",
+                  esp_err_to_name(err));
+  }
+}
+
+static void nvsPut(const char *ns, const char *key, NvsType type, int64_t num, const char *str, NvsWhen when,
+                   bool retryFull = true) {
+  nvsInit();
+  bool full = false;
+  xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+  g_nvsStats.puts++;
+  int i = nvsFind(ns, key);
+  if (i >= 0) {
+    g_nvsStats.coalesced++;
+  } else if (g_nvsCount < NVS_MAX_PENDING) {
+    if (!g_nvsCount) g_nvsDueMs = millis() + NVS_DEBOUNCE_MS;
+    i = g_nvsCount++;
+    if (g_nvsCount > g_nvsStats.maxPending) g_nvsStats.maxPending = g_nvsCount;
+    g_nvsPending[i].ns = ns;
+    g_nvsPending[i].key = key;
+  } else if (!retryFull) {
+    g_nvsStats.failures++;  // still full after a flush (flash failing): dropped
+  } else {
+    full = true;
+  }
+  if (i >= 0) {
+    NvsPending &e = g_nvsPending[i];
+    e.type = type;
+    e.seq = ++g_nvsSeq;
+    e.failedRound = 0;
+    e.num = num;
+    if (str) e.str = str;
+    else e.str = String();
+  }
+  xSemaphoreGive(g_nvsMux);
+
+  if (full) {  // table full: make room on this task, then queue again (once)
+    nvsFlush();
+    nvsPut(ns, key, type, num, str, when, false);
+    return;
+  }
+  if (when == NVS_SYNC) {
+    nvsCommit(ns);
+  } else {
+    if (when == NVS_SOON) g_nvsSoon = true;
+    xTaskNotifyGive(g_nvsTask);  // new deadline or commit now
+  }
+}
+
+static inline void nvsPutBool(const char *ns, const char *key, bool v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_BOOL, v, nullptr, when);
+}
+static inline void nvsPutUChar(const char *ns, const char *key, uint8_t v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_U8, v, nullptr, when);
+}
+static inline void nvsPutUShort(const char *ns, const char *key, uint16_t v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_U16, v, nullptr, when);
+}
+static inline void nvsPutInt(const char *ns, const char *key, int32_t v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_I32, v, nullptr, when);
+}
+// also Preferences::putULong (u32 on this target)
+static inline void nvsPutUInt(const char *ns, const char *key, uint32_t v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_U32, v, nullptr, when);
+}
+static inline void nvsPutString(const char *ns, const char *key, const String &v, NvsWhen when = NVS_LAZY) {
+  nvsPut(ns, key, NVS_T_STR, 0, v.c_str(), when);
+}
+
+// Drops pending writes of ns and erases the namespace now.
+static void nvsClear(const char *ns) {
+  nvsInit();
+  xSemaphoreTake(g_nvsFlash, portMAX_DELAY);
+  xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+  for (int i = g_nvsCount - 1; i >= 0; i--) {
+    if (!strcmp(g_nvsPending[i].ns, ns)) nvsRemove(i);
+  }
+  xSemaphoreGive(g_nvsMux);
+  Preferences p;
+  if (p.begin(ns, false)) {
+    p.clear();
+    p.end();
+  }
+  xSemaphoreGive(g_nvsFlash);
+}
+
+// Pending value if there is one, else flash, else def.
+static int64_t nvsGetNum(const char *ns, const char *key, NvsType type, int64_t def) {
+  nvsInit();
+  xSemaphoreTake(g_nvsMux, portMAX_DELAY);
+  int i = nvsFind(ns, key);
+  bool pending = i >= 0;
+  int64_t v = pending ? g_nvsPending[i].num : def;
+  xSemaphoreGive(g_nvsMux);
+  if (pending) return v;
+
+  Preferences p;
+  if (!p.begin(ns, true)) return def;
+  switch (type) {
+    case NVS_T_BOOL: v = p.getBool(key, def != 0); break;
+    case NVS_T_U8: v = p.getUChar(key, (uint8_t)def); break;
+    case NVS_T_U16: v = p.getUShort(key, (uint16_t)def); break;
+    case NVS_T_I32: v = p.getInt(key, (int32_t)def); break;
+    default: v = p.getUInt(key, (uint32_t)def); break;
+  }
+  p.end();
+  return v;
+}
+
+static inline bool nvsGetBool(const char *ns, const char *key, bool def) {
+  return nvsGetNum(ns, key, NVS_T_BOOL, def) != 0;
+}
+static inline int32_t nvsGetInt(const char *ns, const char *key, int32_t def) {
+  return (int32_t)nvsGetNum(ns, key, NVS_T_I32, def);
+}
+static inline uint32_t nvsGetUInt(const char *ns, const char *key, uint32_t def) {
+  return (uint32_t)nvsGetNum(ns, key, NVS_T_U32, def);
+}
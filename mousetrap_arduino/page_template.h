@@ -0,0 +1,139 @@
+// page_template.h
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <functional>
+#include <memory>
+#include <stdarg.h>
+
+/*  Streamed HTML pages.
+
+    A page is one flash string with {{name}} placeholders. pageSend() answers
+    with a chunked response whose filler copies the template out of flash
+    straight into the TCP buffer and asks the page's callback for each
+    placeholder when it gets there, so the page never exists in RAM as a
+    whole: a request costs one small PageRender, however long the page.
+
+      static const char kPage[] PROGMEM = R"rawliteral(<h1>{{name}}</h1>)rawliteral";
+      pageSend(req, kPage, [](const char *key, PageVar &v) {
+        if (!strcmp(key, "name")) v.html(claimedDeviceName);
+      });
+
+    The callback runs on the async_tcp task while the page is sent, so it
+    should copy request-time values into its capture. A placeholder it does
+    not set renders empty. v.raw() points at a fragment that outlives the
+    response (another flash string, no copy); v.printf() and v.html() fill a
+    PAGE_VAR_MAX scratch buffer and truncate beyond it.                      */
+
+#define PAGE_VAR_MAX 160
+#define PAGE_KEY_MAX 24
+
+struct PageVar {
+  const char *text = nullptr;
+  size_t len = 0;
+  char buf[PAGE_VAR_MAX];
+
+  void raw(const char *s) {
+    text = s;
+    len = strlen(s);
+  }
+
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    text = buf;
+    len = n < 0 ? 0 : (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1;
+  }
+
+  // s with & < > " ' escaped, for text and attribute values
+  void html(const char *s) {
+    size_t n = 0;
+    for (; *s; s++) {
+      const char *e = nullptr;
+      switch (*s) {
+        case '&': e = "&amp;"; break;
+        case '<': e = "&lt;"; break;
+        case '>': e = "&gt;"; break;
+        case '"': e = "&quot;"; break;
+        case '\'': e = "&#39;"; break;
+      }
+      size_t k = e ? strlen(e) : 1;
+      if (n + k >= sizeof(buf)) break;
+      if (e) memcpy(buf + n, e, k);
+      else buf[n] = *s;
+      n += k;
+    }
+    text = buf;
+    len = n;
+  }
+  void html(const String &s) { html(s.c_str()); }
+};
+
+typedef std::function<void(const char *key, PageVar &v)> PageVarFn;
+
+struct PageRender {
+  const char *pos;             // next template byte
+  const char *next = nullptr;  // next "{{" at or after pos (end of template if none); null = not searched
+  PageVar var;                 // value of the placeholder being copied out
+  size_t varPos = 0;
+  PageVarFn fn;
+};
+
+// Fills out with up to cap bytes of the page; 0 once it is complete.
+static size_t pageFill(PageRender &r, uint8_t *out, size_t cap) {
+  size_t n = 0;
+  while (n < cap) {
+    if (r.varPos < r.var.len) {
+      size_t k = min(cap - n, r.var.len - r.varPos);
+      memcpy(out + n, r.var.text + r.varPos, k);
+      r.varPos += k;
+      n += k;
+      continue;
+    }
+    if (!r.next) {
+      r.next = strstr(r.pos, "{{");
+      if (!r.next) r.next = r.pos + strlen(r.pos);
+    }
+    if (r.pos < r.next) {
+      size_t k = min(cap - n, (size_t)(r.next - r.pos));
+      memcpy(out + n, r.pos, k);
+      r.pos += k;
+      n += k;
+      continue;
+    }
+    if (!*r.pos) break;
+
+    const char *close = strstr(r.pos + 2, "}}");
+    if (!close) {  // unterminated: the rest goes out as literal text
+      r.next = r.pos + strlen(r.pos);
+      size_t k = min(cap - n, (size_t)2);
+      memcpy(out + n, r.pos, k);
+      r.pos += k;
+      n += k;
+      continue;
+    }
+    char key[PAGE_KEY_MAX];
+    size_t kl = min((size_t)(close - r.pos - 2), sizeof(key) - 1);
+    memcpy(key, r.pos + 2, kl);
+    key[kl] = '\0';
+    r.var.text = nullptr;
+    r.var.len = 0;
+    r.varPos = 0;
+    if (r.fn) r.fn(key, r.var);
+    r.pos = close + 2;
+    r.next = nullptr;
+  }
+  return n;
+}
+
+static void pageSend(AsyncWebServerRequest *req, const char *tpl, PageVarFn fn = nullptr,
+                     const char *contentType = "text/html") {
+  auto r = std::make_shared<PageRender>();
+  r->pos = tpl;
+  r->fn = std::move(fn);
+  req->send(req->beginChunkedResponse(contentType, [r](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+    return pageFill(*r, buf, maxLen);
+  }));
+}
@@ -0,0 +1,260 @@
+// perf_probes.h
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*  Hot-path latency histograms and per-task CPU share.
+
+    A probe is a fixed histogram of durations. PERF_SCOPE() times the rest
+    of the enclosing block with the CPU cycle counter and records it on the
+    way out; perfNow()/perfRecord() do the same for a span that is not a
+    block. Recording is a few adds under a spinlock with no allocation, so
+    it is safe on any task and cheap enough for every sensor read.
+
+      PERF_SCOPE(PERF_SENSOR);                 // rest of this block
+      PerfStamp t0 = perfNow();
+      fb = esp_camera_fb_get();
+      perfRecord(PERF_CAPTURE, t0);
+
+    Buckets are 4 per power of two of microseconds (0-3 us exact, then
+    4,5,6,7, 8,10,12,14, 16,20,...; bucket b >= 4 starts at
+    (4 + b%4) << (b/4 - 1) us), so a percentile read from them is within
+    1/8 of the true value, up to ~16 s. The two cores' cycle counters are
+    not in step, so a span that ends on the other core is counted as
+    migrated instead of being recorded with a wrong length.
+
+    perfCpuSample() (from the 10 s debug job) turns FreeRTOS run-time stats
+    into each task's share of both cores since the previous sample.
+    perfToJson() feeds /api/debug-stats and the periodic MQTT perf message;
+    with buckets=true it adds the raw counts, which - unlike percentiles -
+    can be summed across a fleet.                                           */
+
+enum PerfProbe : uint8_t {
+  PERF_SENSOR,      // one ToF read, bus wait included
+  PERF_CAPTURE,     // esp_camera_fb_get() for a stored photo
+  PERF_JPEG_WRITE,  // open + write + close of the photo file
+  PERF_MQTT_PUB,    // mqttPublish()
+  PERF_MQTT_IMAGE,  // streamed snapshot publish
+  PERF_HTTP,        // web handler body (PAGE_SCOPE)
+  PERF_LOG_FLUSH,   // one log pipeline batch to /logs.txt
+  PERF_PROBES
+};
+
+static const char *const kPerfProbeNames[PERF_PROBES] = {
+  "sensor", "capture", "jpegWrite", "mqttPub", "mqttImage", "http", "logFlush"
+};
+
+#define PERF_BUCKETS 92    // 0-3 us, then 4 per octave up to 2^24 us
+#define PERF_CPU_TASKS 40  // uxTaskGetSystemState() capacity
+#define PERF_CPU_ROWS 12   // busiest tasks kept for reporting
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+#define PERF_HAVE_CPU 1
+#else
+#define PERF_HAVE_CPU 0
+#endif
+
+#ifdef configRUN_TIME_COUNTER_TYPE
+typedef configRUN_TIME_COUNTER_TYPE PerfRunTime;  // uint64_t on some IDF configs
+#else
+typedef uint32_t PerfRunTime;
+#endif
+
+struct PerfHist {
+  uint32_t count;
+  uint32_t migrated;  // spans dropped because they ended on the other core
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t bucket[PERF_BUCKETS];
+};
+
+struct PerfStamp {
+  uint32_t cycles;
+  uint8_t core;
+};
+
+struct PerfCpuRow {
+  char name[configMAX_TASK_NAME_LEN];
+  uint16_t permille;  // of both cores
+};
+
+static PerfHist g_perf[PERF_PROBES];
+static portMUX_TYPE g_perfMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t g_perfCyclesPerUs = 240;
+static PerfCpuRow g_perfCpu[PERF_CPU_ROWS];  // busiest first, under g_perfMux
+static uint8_t g_perfCpuRows = 0;
+static uint32_t g_perfCpuWindowMs = 0;
+
+static void perfInit() {
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  if (mhz) g_perfCyclesPerUs = mhz;
+}
+
+static inline uint8_t perfBucket(uint32_t us) {
+  if (us < 4) return us;
+  uint32_t o = 31 - __builtin_clz(us);  // >= 2
+  uint32_t b = 4 * (o - 1) + ((us >> (o - 2)) & 3);
+  return b < PERF_BUCKETS ? b : PERF_BUCKETS - 1;
+}
+
+static inline uint32_t perfBucketLow(uint8_t b) {
+  return b < 4 ? b : (uint32_t)(4 + b % 4) << (b / 4 - 1);
+}
+
+static inline uint32_t perfBucketWidth(uint8_t b) {
+  return b < 4 ? 1 : 1UL << (b / 4 - 1);
+}
+
+static inline PerfStamp perfNow() {
+  return { ESP.getCycleCount(), (uint8_t)xPortGetCoreID() };
+}
+
+static void perfRecord(PerfProbe p, PerfStamp t0) {
+  uint32_t us = (ESP.getCycleCount() - t0.cycles) / g_perfCyclesPerUs;
+  bool moved = (uint8_t)xPortGetCoreID() != t0.core;
+  PerfHist &h = g_perf[p];
+  portENTER_CRITICAL(&g_perfMux);
+  if (moved) {
+    h.migrated++;
+  } else {
+    h.count++;
+    h.sumUs += us;
+    if (us > h.maxUs) h.maxUs = us;
+    h.bucket[perfBucket(us)]++;
+  }
+  portEXIT_CRITICAL(&g_perfMux);
+}
+
+struct PerfScope {
+  explicit PerfScope(PerfProbe p) : probe(p), t0(perfNow()) {}
+  ~PerfScope() { perfRecord(probe, t0); }
+  PerfProbe probe;
+  PerfStamp t0;
+};
+
+#define PERF_SCOPE(probe) PerfScope __perf_scope__(probe)
+
+// q in per mille; middle of the bucket holding that rank, never above max
+static uint32_t perfPercentile(const PerfHist &h, uint16_t q) {
+  if (!h.count) return 0;
+  uint32_t rank = ((uint64_t)h.count * q + 999) / 1000;
+  if (!rank) rank = 1;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < PERF_BUCKETS; b++) {
+    seen += h.bucket[b];
+    if (seen >= rank) {
+      uint32_t mid = perfBucketLow(b) + perfBucketWidth(b) / 2;
+      return mid < h.maxUs ? mid : h.maxUs;
+    }
+  }
+  return h.maxUs;
+}
+
+// Loop task only. Share of each task since the previous call.
+static void perfCpuSample() {
+#if PERF_HAVE_CPU
+  static TaskStatus_t st[PERF_CPU_TASKS];
+  static struct {
+    TaskHandle_t handle;
+    PerfRunTime runTime;
+  } prev[PERF_CPU_TASKS];
+  static UBaseType_t prevCount = 0;
+  static PerfRunTime prevTotal = 0;
+  static uint32_t prevMs = 0;
+
+  PerfRunTime total = 0;
+  UBaseType_t n = uxTaskGetSystemState(st, PERF_CPU_TASKS, &total);
+  if (!n) return;  // more tasks than PERF_CPU_TASKS
+
+  PerfRunTime window = total - prevTotal;
+  uint32_t now = millis();
+  PerfCpuRow rows[PERF_CPU_ROWS];
+  uint8_t rowCount = 0;
+  if (prevCount && window) {
+    uint64_t capacity = (uint64_t)window * portNUM_PROCESSORS;
+    for (UBaseType_t i = 0; i < n; i++) {
+      PerfRunTime before = 0;  // task started within the window
+      for (UBaseType_t j = 0; j < prevCount; j++) {
+        if (prev[j].handle == st[i].xHandle) {
+          before = prev[j].runTime;
+          break;
+        }
+      }
+      uint64_t pm = (uint64_t)(st[i].ulRunTimeCounter - before) * 1000 / capacity;
+      if (pm > 1000) pm = 1000;
+
+      uint8_t k;
+      if (rowCount < PERF_CPU_ROWS) k = rowCount++;
+      else if (pm > rows[PERF_CPU_ROWS - 1].permille) k = PERF_CPU_ROWS - 1;
+      else continue;
+      for (; k > 0 && rows[k - 1].permille < pm; k--) rows[k] = rows[k - 1];
+      strlcpy(rows[k].name, st[i].pcTaskName, sizeof(rows[k].name));
+      rows[k].permille = (uint16_t)pm;
+    }
+    portENTER_CRITICAL(&g_perfMux);
+    memcpy(g_perfCpu, rows, rowCount * sizeof(PerfCpuRow));
+    g_perfCpuRows = rowCount;
+    g_perfCpuWindowMs = now - prevMs;
+    portEXIT_CRITICAL(&g_perfMux);
+  }
+
+  for (UBaseType_t i = 0; i < n; i++) {
+    prev[i].handle = st[i].xHandle;
+    prev[i].runTime = st[i].ulRunTimeCounter;
+  }
+  prevCount = n;
+  prevTotal = total;
+  prevMs = now;
+#endif
+}
+
+static void perfToJson(JsonObject out, bool buckets) {
+  out["uptimeS"] = millis() / 1000;
+  JsonArray probes = out["probes"].to<JsonArray>();
+  for (uint8_t p = 0; p < PERF_PROBES; p++) {
+    PerfHist h;
+    portENTER_CRITICAL(&g_perfMux);
+    h = g_perf[p];
+    portEXIT_CRITICAL(&g_perfMux);
+
+    JsonObject o = probes.add<JsonObject>();
+    o["name"] = kPerfProbeNames[p];
+    o["n"] = h.count;
+    if (h.migrated) o["migrated"] = h.migrated;
+    if (!h.count) continue;
+    o["avgUs"] = (uint32_t)(h.sumUs / h.count);
+    o["p50Us"] = perfPercentile(h, 500);
+    o["p90Us"] = perfPercentile(h, 900);
+    o["p99Us"] = perfPercentile(h, 990);
+    o["maxUs"] = h.maxUs;
+    if (buckets) {
+      uint8_t lo = 0, hi = PERF_BUCKETS;
+      while (!h.bucket[lo]) lo++;
+      while (!h.bucket[hi - 1]) hi--;
+      o["b0"] = lo;  // index of the first count in "b"
+      JsonArray b = o["b"].to<JsonArray>();
+      for (uint8_t i = lo; i < hi; i++) b.add(h.bucket[i]);
+    }
+  }
+
+  PerfCpuRow rows[PERF_CPU_ROWS];
+  uint8_t rowCount;
+  uint32_t windowMs;
+  portENTER_CRITICAL(&g_perfMux);
+  rowCount = g_perfCpuRows;
+  windowMs = g_perfCpuWindowMs;
+  memcpy(rows, g_perfCpu, rowCount * sizeof(PerfCpuRow));
+  portEXIT_CRITICAL(&g_perfMux);
+
+  JsonObject cpu = out["cpu"].to<JsonObject>();
+  cpu["available"] = PERF_HAVE_CPU == 1;
+  cpu["windowMs"] = windowMs;
+  JsonArray tasks = cpu["tasks"].to<JsonArray>();
+  for (uint8_t i = 0; i < rowCount; i++) {
+    JsonObject t = tasks.add<JsonObject>();
+    t["name"] = rows[i].name;
+    t["permille"] = rows[i].permille;
+  }
+}
@@ -0,0 +1,104 @@
+// range_stats.h
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+
+/*  Streaming statistics for ToF range samples.
+
+    Every update is O(1) and allocation-free, so the sensor task can feed
+    them directly. Welford gives exact mean/variance over a window, Ewma a
+    slowly forgetting baseline, RingLog a fixed history that overwrites its
+    oldest entry, and RangeHistogram exact percentiles of 8-bit readings.   */
+
+// Running mean / variance (Welford); reset() starts a new window
+struct Welford {
+  uint32_t n = 0;
+  double mean = 0;
+  double m2 = 0;
+
+  void reset() {
+    n = 0;
+    mean = m2 = 0;
+  }
+  void add(double x) {
+    n++;
+    double d = x - mean;
+    mean += d / n;
+    m2 += d * (x - mean);
+  }
+  double variance() const { return n > 1 ? m2 / (n - 1) : 0; }
+  double stddev() const { return sqrt(variance()); }
+};
+
+// Exponentially weighted mean / variance; alpha = 1 / (time constant in samples)
+struct Ewma {
+  float alpha;
+  float mean = 0;
+  float var = 0;
+  bool primed = false;
+  uint32_t n = 0;  // samples folded in via add()
+
+  explicit Ewma(float a) : alpha(a) {}
+
+  void seed(float m, float sd) {
+    mean = m;
+    var = sd * sd;
+    primed = true;
+  }
+  void add(float x) {
+    n++;
+    if (!primed) return seed(x, 0);
+    float d = x - mean;
+    mean += alpha * d;
+    var = (1 - alpha) * (var + alpha * d * d);
+  }
+  float stddev() const { return sqrtf(var); }
+};
+
+// Fixed-size history; push() overwrites the oldest entry, at(0) is the oldest
+template <typename T, size_t N>
+struct RingLog {
+  T items[N];
+  size_t head = 0;   // next write
+  size_t count = 0;
+
+  void push(const T &v) {
+    items[head] = v;
+    head = (head + 1) % N;
+    if (count < N) count++;
+  }
+  const T &at(size_t i) const { return items[(head + N - count + i) % N]; }
+  const T &newest() const { return items[(head + N - 1) % N]; }
+  size_t size() const { return count; }
+  void clear() { head = count = 0; }
+};
+
+// Exact percentiles for readings in 0..255 mm: one counter per millimetre
+struct RangeHistogram {
+  uint16_t bins[256];
+  uint32_t total = 0;
+
+  RangeHistogram() { clear(); }
+
+  void clear() {
+    memset(bins, 0, sizeof(bins));
+    total = 0;
+  }
+  void add(uint8_t v) {
+    if (bins[v] == 0xFFFF) return;  // saturated; an hour at 1 Hz never gets here
+    bins[v]++;
+    total++;
+  }
+  // p in 0..100; nearest-rank
+  uint8_t percentile(float p) const {
+    if (!total) return 0;
+    uint32_t rank = (uint32_t)ceilf(p / 100.0f * total);
+    if (rank == 0) rank = 1;
+    uint32_t seen = 0;
+    for (int v = 0; v < 256; v++) {
+      seen += bins[v];
+      if (seen >= rank) return (uint8_t)v;
+    }
+    return 255;
+  }
+};
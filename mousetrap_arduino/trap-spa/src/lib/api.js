@@ -131,14 +131,24 @@ export async function getLEDStatus() {
 // ============================================================================
 
 export async function getCaptures() {
-  // Returns { files: [{ name, size, kind }] }
+  // Returns { total, files: [{ name, size, kind, ts, flash, thumb? }] }
   return apiFetch('/api/captures');
 }
 
+export function getThumbURL(capture) {
+  // Small JPEG made on the device; null for captures that have none
+  return capture.thumb ? `${BASE_URL}${capture.thumb}` : null;
+}
+
 export function getCaptureURL(filename) {
   return `${BASE_URL}/captures/${filename}`;
 }
 
+export function getClipFrameURL(filename, n = 0) {
+  // Single JPEG out of an .mjpg clip (seeks via the clip's frame index)
+  return `${BASE_URL}/clip/frame?f=${encodeURIComponent(filename)}&n=${n}`;
+}
+
 export async function deleteCapture(filename) {
   // TODO: Add DELETE endpoint on device
   return apiFetch(`/captures/${filename}`, { method: 'DELETE' });
@@ -287,12 +297,12 @@ export async function setMQTTConfig(config) {
 // ============================================================================
 
 export async function getCameraSettings() {
-  // Returns { videoMode, framesize, quality, brightness, contrast, saturation, vflip, hmirror }
+  // Returns { videoMode, snapshotBinary, preRollSec, preRollKB, framesize, quality, brightness, contrast, saturation, vflip, hmirror }
   return apiFetch('/api/camera-settings');
 }
 
 export async function setCameraSettings(settings) {
-  // settings: { videoMode?, framesize?, quality?, brightness?, contrast?, saturation?, vflip?, hmirror? }
+  // settings: { videoMode?, snapshotBinary?, preRollSec?, preRollKB?, framesize?, quality?, brightness?, contrast?, saturation?, vflip?, hmirror? }
   return apiFetch('/api/camera-settings', {
     method: 'POST',
     body: JSON.stringify(settings),
@@ -1,8 +1,19 @@
 /**
  * Motion Detection for Scout Device
  *
- * Frame-to-frame comparison with size-based filtering.
+ * Block comparison with size-based filtering.
  * Detects motion and calculates bounding box of changed region.
+ *
+ * JPEG frames are decoded at 1/8 scale (DC coefficients only) into a small
+ * luma plane, so the block comparison runs on real image content instead of
+ * guessing from the compressed size.
+ *
+ * Each block is flagged when either
+ *   - it differs from the previous plane (fast movement), or
+ *   - its mean drifts from a per-block running-average background
+ *     (slow movement that frame-to-frame differencing misses).
+ * The previous plane is double-buffered: planes swap roles instead of
+ * being copied after every detect().
  */
 
 #ifndef MOTION_DETECT_H
@@ -10,6 +21,10 @@
 
 #include <esp_camera.h>
 #include <esp_heap_caps.h>
+#include <img_converters.h>
+
+// JPEG frames are compared at 1/8 resolution (VGA -> 80x60 luma)
+#define MOTION_LUMA_SCALE 8
 
 // Motion detection configuration
 struct MotionConfig {
@@ -18,6 +33,8 @@ struct MotionConfig {
   float maxSizePercent;   // Maximum motion size (% of frame)
   uint16_t blockSize;     // Block size for comparison (8, 16, 32)
   uint16_t cooldownMs;    // Cooldown between detections
+  float bgAlpha;          // Background adaptation rate per frame (0 = background off)
+  uint8_t ghostFrames;    // Absorb a block into the background after N foreground frames (0 = never)
 };
 
 // Motion detection result
@@ -34,26 +51,155 @@ struct MotionResult {
   float confidence;       // Detection confidence (0-1)
 };
 
+// Per-stage timing of the last detect() call (microseconds)
+struct MotionTiming {
+  uint32_t decodeUs;      // JPEG -> luma decode (plane copy for grayscale frames)
+  uint32_t diffUs;        // Block comparison + bounding box
+  uint32_t totalUs;       // Whole detect() call
+  uint32_t maxTotalUs;    // Worst detect() seen since reset
+  uint16_t lumaWidth;     // Width of the plane that was compared
+  uint16_t lumaHeight;    // Height of the plane that was compared
+  bool jpegFallback;      // Decode failed, JPEG-size heuristic was used
+};
+
+/* ---- SAD kernel ---- */
+
+// |x - y| for two 8-bit values held in the low bytes of each 16-bit lane
+static inline uint32_t motionAbsDiff16x2(uint32_t x, uint32_t y) {
+  uint32_t d = (x | 0x01000100) - y;     // 256 + x - y per lane, never borrows
+  uint32_t keep = ((d >> 8) & 0x00010001) * 0xFFFF;  // lanes where x >= y
+  uint32_t low = d & 0x00FF00FF;         // (x - y) mod 256
+  return (low & keep) | ((0x01000100 - low) & ~keep & 0x00FF00FF);
+}
+
+/**
+ * Sum of absolute differences over n bytes.
+ * Word-aligned input is processed four pixels per 32-bit load (SWAR);
+ * anything else, and the tail, falls back to bytes.
+ */
+static inline uint32_t motionSadRow(const uint8_t* a, const uint8_t* b, uint16_t n) {
+  uint32_t sum = 0;
+  uint16_t i = 0;
+
+  if ((((uintptr_t)a | (uintptr_t)b) & 3) == 0) {
+    const uint32_t* wa = (const uint32_t*)a;
+    const uint32_t* wb = (const uint32_t*)b;
+    uint16_t words = n >> 2;
+    while (words) {
+      // 16-bit lanes hold 255 * 256 before they can overflow
+      uint16_t run = words > 256 ? 256 : words;
+      uint32_t accEven = 0, accOdd = 0;
+      for (uint16_t w = 0; w < run; w++) {
+        uint32_t x = wa[w], y = wb[w];
+        accEven += motionAbsDiff16x2(x & 0x00FF00FF, y & 0x00FF00FF);
+        accOdd += motionAbsDiff16x2((x >> 8) & 0x00FF00FF, (y >> 8) & 0x00FF00FF);
+      }
+      sum += (accEven & 0xFFFF) + (accEven >> 16) + (accOdd & 0xFFFF) + (accOdd >> 16);
+      wa += run;
+      wb += run;
+      words -= run;
+    }
+    i = n & ~3;
+  }
+
+  for (; i < n; i++) {
+    sum += abs((int)a[i] - (int)b[i]);
+  }
+  return sum;
+}
+
+// Plain byte sum over n bytes (block mean for the background model)
+static inline uint32_t motionSumRow(const uint8_t* a, uint16_t n) {
+  uint32_t sum = 0;
+  uint16_t i = 0;
+
+  if (((uintptr_t)a & 3) == 0) {
+    const uint32_t* wa = (const uint32_t*)a;
+    uint16_t words = n >> 2;
+    while (words) {
+      // Two bytes land in each 16-bit lane per word: 128 words max
+      uint16_t run = words > 128 ? 128 : words;
+      uint32_t acc = 0;
+      for (uint16_t w = 0; w < run; w++) {
+        uint32_t x = wa[w];
+        acc += (x & 0x00FF00FF) + ((x >> 8) & 0x00FF00FF);
+      }
+      sum += (acc & 0xFFFF) + (acc >> 16);
+      wa += run;
+      words -= run;
+    }
+    i = n & ~3;
+  }
+
+  for (; i < n; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+/**
+ * One row of a band of 2-pixel-wide blocks, the default 16 px block on the
+ * 1/8 plane: adds each block's SAD and pixel sum into sad[i] / sum[i].
+ * A 32-bit word holds two whole blocks, so the row goes through SWAR in one
+ * pass instead of a motionSadRow() call per 2-byte block (which is too
+ * short for its word path). a and b must be word-aligned.
+ */
+static inline void motionBandRow2(const uint8_t* a, const uint8_t* b, uint16_t blocks,
+                                  uint32_t* sad, uint32_t* sum, bool compare) {
+  const uint32_t* wa = (const uint32_t*)a;
+  const uint32_t* wb = (const uint32_t*)b;
+  uint16_t pairs = blocks >> 1;
+  for (uint16_t w = 0; w < pairs; w++, sad += 2, sum += 2) {
+    uint32_t x = wa[w];
+    // lanes: pixels 0+1 (block 2w) low, pixels 2+3 (block 2w+1) high
+    uint32_t s = (x & 0x00FF00FF) + ((x >> 8) & 0x00FF00FF);
+    sum[0] += s & 0xFFFF;
+    sum[1] += s >> 16;
+    if (!compare) continue;
+    uint32_t y = wb[w];
+    uint32_t d = motionAbsDiff16x2(x & 0x00FF00FF, y & 0x00FF00FF) +
+                 motionAbsDiff16x2((x >> 8) & 0x00FF00FF, (y >> 8) & 0x00FF00FF);
+    sad[0] += d & 0xFFFF;
+    sad[1] += d >> 16;
+  }
+  if (blocks & 1) {
+    const uint8_t* pa = a + pairs * 4;
+    const uint8_t* pb = b + pairs * 4;
+    sum[0] += pa[0] + pa[1];
+    if (compare) sad[0] += abs((int)pa[0] - (int)pb[0]) + abs((int)pa[1] - (int)pb[1]);
+  }
+}
+
 // Motion detector class
 class MotionDetector {
 public:
-  MotionDetector() : prevFrame(nullptr), prevWidth(0), prevHeight(0), lastDetectionTime(0) {
+  MotionDetector() : lastDetectionTime(0), planeWidth(0), planeHeight(0), backPlane(0),
+                     planesInternal(false), refValid(false),
+                     bgMean(nullptr), bgForeground(nullptr), bgBlocksX(0), bgBlocksY(0), bgValid(false),
+                     lineBuf(nullptr), bandSad(nullptr), bandSum(nullptr), bandState(nullptr),
+                     scratchStride(0) {
+    planes[0] = planes[1] = nullptr;
+    memset(&timing, 0, sizeof(timing));
     // Default configuration
     config.threshold = 25;
     config.minSizePercent = 1.0;
     config.maxSizePercent = 30.0;
     config.blockSize = 16;
     config.cooldownMs = 2000;
+    config.bgAlpha = 0.05;
+    config.ghostFrames = 40;
   }
 
   ~MotionDetector() {
-    if (prevFrame) {
-      heap_caps_free(prevFrame);
-      prevFrame = nullptr;
-    }
+    freePlanes();
+    freeBackground();
+    freeScratch();
   }
 
   void setConfig(const MotionConfig& cfg) {
+    if (cfg.blockSize != config.blockSize) {
+      bgValid = false;  // block grid changed - re-seed the background
+    }
     config = cfg;
   }
 
@@ -61,11 +207,16 @@ public:
     return config;
   }
 
+  MotionTiming getTiming() const {
+    return timing;
+  }
+
   /**
    * Detect motion by comparing current frame to previous.
-   * Frame must be in grayscale format.
+   * JPEG frames are decoded to a 1/8-scale luma plane first;
+   * grayscale frames are compared at full resolution.
    *
-   * @param frame Current camera frame (will be converted to grayscale if JPEG)
+   * @param frame Current camera frame (JPEG or grayscale)
    * @return MotionResult with detection info
    */
   MotionResult detect(camera_fb_t* frame) {
@@ -81,109 +232,34 @@ public:
       return result;
     }
 
-    // For JPEG frames, we need to decode first
-    // For now, we'll use a simple JPEG size heuristic
-    // (proper implementation would decode to grayscale)
-    if (frame->format == PIXFORMAT_JPEG) {
-      return detectFromJpegSize(frame);
-    }
-
-    // Grayscale frame comparison
-    if (frame->format != PIXFORMAT_GRAYSCALE) {
-      Serial.println("[Motion] Unsupported pixel format");
-      return result;
-    }
-
-    uint16_t width = frame->width;
-    uint16_t height = frame->height;
-    size_t frameSize = width * height;
+    uint32_t t0 = micros();
+    uint8_t scale;
+    timing.jpegFallback = false;
 
-    // First frame - just store it
-    if (!prevFrame || prevWidth != width || prevHeight != height) {
-      allocatePrevFrame(width, height);
-      if (prevFrame) {
-        memcpy(prevFrame, frame->buf, frameSize);
+    if (frame->format == PIXFORMAT_JPEG) {
+      if (!decodeLuma(frame)) {
+        // Corrupt/truncated JPEG - fall back to the size heuristic
+        timing.jpegFallback = true;
+        timing.decodeUs = 0;
+        result = detectFromJpegSize(frame);
+        finishTiming(t0, 0);
+        return result;
       }
+      scale = MOTION_LUMA_SCALE;
+    } else if (frame->format == PIXFORMAT_GRAYSCALE) {
+      // Camera owns frame->buf, so the plane has to be copied in
+      uint8_t* plane = acquirePlane(frame->width, frame->height);
+      if (!plane) return result;
+      memcpy(plane, frame->buf, (size_t)frame->width * frame->height);
+      scale = 1;
+    } else {
+      Serial.println("[Motion] Unsupported pixel format");
       return result;
     }
 
-    // Compare frames block by block
-    uint16_t blocksX = width / config.blockSize;
-    uint16_t blocksY = height / config.blockSize;
-    result.totalBlocks = blocksX * blocksY;
-
-    uint16_t minX = blocksX, minY = blocksY;
-    uint16_t maxX = 0, maxY = 0;
-
-    for (uint16_t by = 0; by < blocksY; by++) {
-      for (uint16_t bx = 0; bx < blocksX; bx++) {
-        uint32_t blockDiff = 0;
-        uint16_t pixelsInBlock = config.blockSize * config.blockSize;
-
-        // Calculate average difference in this block
-        for (uint16_t py = 0; py < config.blockSize; py++) {
-          for (uint16_t px = 0; px < config.blockSize; px++) {
-            uint32_t idx = (by * config.blockSize + py) * width + (bx * config.blockSize + px);
-            int diff = abs((int)frame->buf[idx] - (int)prevFrame[idx]);
-            blockDiff += diff;
-          }
-        }
-
-        uint8_t avgDiff = blockDiff / pixelsInBlock;
-
-        if (avgDiff > config.threshold) {
-          result.changedBlocks++;
-          if (bx < minX) minX = bx;
-          if (by < minY) minY = by;
-          if (bx > maxX) maxX = bx;
-          if (by > maxY) maxY = by;
-        }
-      }
-    }
-
-    // Store current frame for next comparison
-    memcpy(prevFrame, frame->buf, frameSize);
-
-    // Check if motion detected
-    if (result.changedBlocks > 0) {
-      result.detected = true;
-
-      // Calculate bounding box in pixels
-      result.x = minX * config.blockSize;
-      result.y = minY * config.blockSize;
-      result.width = (maxX - minX + 1) * config.blockSize;
-      result.height = (maxY - minY + 1) * config.blockSize;
-
-      // Calculate size percentage
-      float totalArea = (float)width * height;
-      float motionArea = (float)result.width * result.height;
-      result.sizePercent = (motionArea / totalArea) * 100.0;
-
-      // Apply size filter
-      if (result.sizePercent < config.minSizePercent) {
-        result.sizeFiltered = true;
-        result.detected = false;  // Too small - probably noise/dust
-        Serial.printf("[Motion] Filtered: too small (%.1f%% < %.1f%%)\n",
-                      result.sizePercent, config.minSizePercent);
-      } else if (result.sizePercent > config.maxSizePercent) {
-        result.sizeFiltered = true;
-        result.detected = false;  // Too large - probably person/pet
-        Serial.printf("[Motion] Filtered: too large (%.1f%% > %.1f%%)\n",
-                      result.sizePercent, config.maxSizePercent);
-      }
-
-      // Calculate confidence based on block coverage and size
-      float blockRatio = (float)result.changedBlocks / result.totalBlocks;
-      result.confidence = min(1.0f, blockRatio * 5.0f);  // Scale up small changes
-
-      if (result.detected) {
-        lastDetectionTime = millis();
-        Serial.printf("[Motion] Detected! Box: (%d,%d) %dx%d, Size: %.1f%%, Conf: %.2f\n",
-                      result.x, result.y, result.width, result.height,
-                      result.sizePercent, result.confidence);
-      }
-    }
-
+    timing.decodeUs = micros() - t0;
+    result = compareLuma(scale);
+    finishTiming(t0, micros() - t0 - timing.decodeUs);
     return result;
   }
 
@@ -257,44 +333,410 @@ public:
   }
 
   void reset() {
-    if (prevFrame) {
-      heap_caps_free(prevFrame);
-      prevFrame = nullptr;
-    }
-    prevWidth = 0;
-    prevHeight = 0;
+    freePlanes();
+    freeBackground();
     lastDetectionTime = 0;
+    memset(&timing, 0, sizeof(timing));
   }
 
 private:
   MotionConfig config;
-  uint8_t* prevFrame;
-  uint16_t prevWidth;
-  uint16_t prevHeight;
   uint32_t lastDetectionTime;
 
-  void allocatePrevFrame(uint16_t width, uint16_t height) {
-    if (prevFrame) {
-      heap_caps_free(prevFrame);
+  // Double-buffered luma planes: planes[backPlane] receives the new frame,
+  // the other one is the reference. They swap after every compare.
+  uint8_t* planes[2];
+  uint16_t planeWidth;
+  uint16_t planeHeight;
+  uint8_t backPlane;
+  bool planesInternal;     // false if the planes had to go to PSRAM
+  bool refValid;           // reference plane holds a real previous frame
+
+  // Per-block background: mean luma in 8.8 fixed point, plus how many
+  // consecutive frames the block has disagreed with it
+  uint16_t* bgMean;
+  uint8_t* bgForeground;
+  uint16_t bgBlocksX;
+  uint16_t bgBlocksY;
+  bool bgValid;
+
+  MotionTiming timing;
+
+  // Internal-SRAM scratch: two row buffers plus per-band block accumulators
+  enum : uint8_t { BLOCK_OPEN = 0, BLOCK_CHANGED = 1, BLOCK_STILL = 2 };
+  uint8_t* lineBuf;
+  uint32_t* bandSad;
+  uint32_t* bandSum;
+  uint8_t* bandState;
+  uint16_t scratchStride;
+
+  void finishTiming(uint32_t t0, uint32_t diffUs) {
+    timing.diffUs = diffUs;
+    timing.totalUs = micros() - t0;
+    if (timing.totalUs > timing.maxTotalUs) timing.maxTotalUs = timing.totalUs;
+  }
+
+  /**
+   * Block-by-block comparison of the back plane against the reference plane
+   * and the background model. `scale` maps plane coordinates back to sensor
+   * pixels, so blockSize, the bounding box and the size filter keep their
+   * full-resolution meaning.
+   */
+  MotionResult compareLuma(uint8_t scale) {
+    MotionResult result = {false, false, 0, 0, 0, 0, 0.0, 0, 0, 0.0};
+    const uint16_t width = planeWidth;
+    const uint16_t height = planeHeight;
+    const uint8_t* cur = planes[backPlane];
+    const uint8_t* ref = planes[backPlane ^ 1];
+
+    timing.lumaWidth = width;
+    timing.lumaHeight = height;
+
+    // Block size in plane pixels (16px sensor block = 2px at 1/8 scale)
+    uint16_t blockSize = config.blockSize / scale;
+    if (blockSize < 1) blockSize = 1;
+
+    // Compare frames block by block
+    uint16_t blocksX = width / blockSize;
+    uint16_t blocksY = height / blockSize;
+    result.totalBlocks = blocksX * blocksY;
+
+    if (!ensureScratch(width) || !ensureBackground(blocksX, blocksY)) {
+      swapPlanes();
+      return result;
     }
 
-    size_t size = width * height;
+    // First frame only seeds the reference / background
+    const bool compareRef = refValid;
+    const bool seedBg = !bgValid;
+    const bool useBg = config.bgAlpha > 0.0f;
+    const uint32_t alphaQ8 = (uint32_t)(constrain(config.bgAlpha, 0.0f, 1.0f) * 256.0f + 0.5f);
+
+    uint16_t minX = blocksX, minY = blocksY;
+    uint16_t maxX = 0, maxY = 0;
+
+    // avgDiff > threshold  <=>  blockDiff >= (threshold + 1) * pixels
+    const uint32_t pixelsInBlock = (uint32_t)blockSize * blockSize;
+    const uint32_t needDiff = ((uint32_t)config.threshold + 1) * pixelsInBlock;
+    const uint32_t rowMaxDiff = (uint32_t)blockSize * 255;
 
-    // Try PSRAM first, fall back to regular RAM
-    prevFrame = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!prevFrame) {
-      prevFrame = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    uint8_t* curLine = lineBuf;
+    uint8_t* prevLine = lineBuf + scratchStride;
+
+    // Walk one band of blocks at a time, row by row. Every block in the band
+    // accumulates its slice of each row. Planes that ended up in PSRAM are
+    // pulled into internal SRAM one row at a time first. 2 px blocks take
+    // the whole row in one motionBandRow2() pass and are judged once the
+    // band is done (two rows leave nothing to exit early from).
+    for (uint16_t by = 0; by < blocksY; by++) {
+      memset(bandSad, 0, blocksX * sizeof(uint32_t));
+      memset(bandSum, 0, blocksX * sizeof(uint32_t));
+      memset(bandState, BLOCK_OPEN, blocksX);
+
+      for (uint16_t py = 0; py < blockSize; py++) {
+        uint32_t rowOff = (uint32_t)(by * blockSize + py) * width;
+        const uint8_t* a = cur + rowOff;
+        const uint8_t* b = ref + rowOff;
+        if (!planesInternal) {
+          memcpy(curLine, a, width);
+          a = curLine;
+          if (compareRef) {
+            memcpy(prevLine, b, width);
+            b = prevLine;
+          }
+        }
+
+        if (blockSize == 2 && (((uintptr_t)a | (uintptr_t)b) & 3) == 0) {
+          motionBandRow2(a, b, blocksX, bandSad, bandSum, compareRef);
+          continue;
+        }
+
+        uint32_t rowsLeft = blockSize - py - 1;
+        for (uint16_t bx = 0; bx < blocksX; bx++, a += blockSize, b += blockSize) {
+          bandSum[bx] += motionSumRow(a, blockSize);
+          if (!compareRef || bandState[bx] != BLOCK_OPEN) continue;
+
+          uint32_t sad = bandSad[bx] + motionSadRow(a, b, blockSize);
+          bandSad[bx] = sad;
+
+          // Early exit: already over the line, or can no longer reach it
+          if (sad >= needDiff) {
+            bandState[bx] = BLOCK_CHANGED;
+          } else if (sad + rowsLeft * rowMaxDiff < needDiff) {
+            bandState[bx] = BLOCK_STILL;
+          }
+        }
+      }
+
+      if (blockSize == 2 && compareRef) {
+        // a row that took the per-block path already decided some blocks;
+        // the final SAD gives the same answer for those
+        for (uint16_t bx = 0; bx < blocksX; bx++) {
+          bandState[bx] = bandSad[bx] >= needDiff ? BLOCK_CHANGED : BLOCK_STILL;
+        }
+      }
+
+      for (uint16_t bx = 0; bx < blocksX; bx++) {
+        bool changed = (bandState[bx] == BLOCK_CHANGED);
+        if (updateBackground(by * blocksX + bx, bandSum[bx] / pixelsInBlock,
+                             seedBg, useBg, alphaQ8, changed)) {
+          changed = true;
+        }
+        if (!compareRef || !changed) continue;
+
+        result.changedBlocks++;
+        if (bx < minX) minX = bx;
+        if (by < minY) minY = by;
+        if (bx > maxX) maxX = bx;
+        if (by > maxY) maxY = by;
+      }
     }
 
-    if (prevFrame) {
-      prevWidth = width;
-      prevHeight = height;
-      Serial.printf("[Motion] Allocated %d bytes for previous frame\n", size);
-    } else {
+    bgValid = true;
+    refValid = true;
+    swapPlanes();
+
+    // Check if motion detected
+    if (result.changedBlocks > 0) {
+      result.detected = true;
+
+      // Calculate bounding box in sensor pixels
+      uint16_t cell = blockSize * scale;
+      result.x = minX * cell;
+      result.y = minY * cell;
+      result.width = (maxX - minX + 1) * cell;
+      result.height = (maxY - minY + 1) * cell;
+
+      // Calculate size percentage
+      float totalArea = (float)width * height * scale * scale;
+      float motionArea = (float)result.width * result.height;
+      result.sizePercent = (motionArea / totalArea) * 100.0;
+
+      // Apply size filter
+      if (result.sizePercent < config.minSizePercent) {
+        result.sizeFiltered = true;
+        result.detected = false;  // Too small - probably noise/dust
+        Serial.printf("[Motion] Filtered: too small (%.1f%% < %.1f%%)\n",
+                      result.sizePercent, config.minSizePercent);
+      } else if (result.sizePercent > config.maxSizePercent) {
+        result.sizeFiltered = true;
+        result.detected = false;  // Too large - probably person/pet
+        Serial.printf("[Motion] Filtered: too large (%.1f%% > %.1f%%)\n",
+                      result.sizePercent, config.maxSizePercent);
+      }
+
+      // Calculate confidence based on block coverage and size
+      float blockRatio = (float)result.changedBlocks / result.totalBlocks;
+      result.confidence = min(1.0f, blockRatio * 5.0f);  // Scale up small changes
+
+      if (result.detected) {
+        lastDetectionTime = millis();
+        Serial.printf("[Motion] Detected! Box: (%d,%d) %dx%d, Size: %.1f%%, Conf: %.2f\n",
+                      result.x, result.y, result.width, result.height,
+                      result.sizePercent, result.confidence);
+      }
+    }
+
+    return result;
+  }
+
+  /**
+   * Fold one block mean into the background model.
+   * Returns true if the block is foreground against the background.
+   *
+   * Only background blocks adapt, so a slow mouse is not averaged away.
+   * A block that stays foreground for ghostFrames frames (something parked,
+   * or the hole left behind by something that moved) is re-seeded, so it
+   * stops re-triggering.
+   */
+  bool updateBackground(uint32_t idx, uint32_t mean, bool seed, bool useBg,
+                        uint32_t alphaQ8, bool movedSinceLast) {
+    int32_t target = (int32_t)mean << 8;
+
+    if (seed) {
+      bgMean[idx] = target;
+      bgForeground[idx] = 0;
+      return false;
+    }
+    if (!useBg) return false;
+
+    int32_t bg = bgMean[idx];
+    int32_t level = (bg + 128) >> 8;
+    bool foreground = abs((int32_t)mean - level) > config.threshold;
+
+    if (foreground) {
+      if (bgForeground[idx] < 255) bgForeground[idx]++;
+      if (config.ghostFrames && bgForeground[idx] >= config.ghostFrames) {
+        bgMean[idx] = target;
+        bgForeground[idx] = 0;
+        return false;
+      }
+      return true;
+    }
+
+    bgForeground[idx] = 0;
+    if (!movedSinceLast) {
+      bgMean[idx] = bg + (((target - bg) * (int32_t)alphaQ8) >> 8);
+    }
+    return false;
+  }
+
+  void swapPlanes() {
+    backPlane ^= 1;
+  }
+
+  // Returns the back plane sized for width x height (reallocating both if needed)
+  uint8_t* acquirePlane(uint16_t width, uint16_t height) {
+    if (planes[0] && planeWidth == width && planeHeight == height) {
+      return planes[backPlane];
+    }
+
+    freePlanes();
+    size_t size = (size_t)width * height;
+
+    // Small planes (4.8KB at 1/8 VGA) fit in internal RAM; full-res goes to PSRAM
+    planesInternal = true;
+    for (int i = 0; i < 2; i++) {
+      planes[i] = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!planes[0] || !planes[1]) {
+      freePlanes();
+      planesInternal = false;
+      for (int i = 0; i < 2; i++) {
+        planes[i] = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      }
+    }
+
+    if (!planes[0] || !planes[1]) {
       Serial.println("[Motion] Failed to allocate memory for motion detection");
-      prevWidth = 0;
-      prevHeight = 0;
+      freePlanes();
+      return nullptr;
+    }
+
+    planeWidth = width;
+    planeHeight = height;
+    Serial.printf("[Motion] Allocated 2x%u bytes for luma planes (%s)\n",
+                  (unsigned)size, planesInternal ? "internal" : "PSRAM");
+    return planes[backPlane];
+  }
+
+  void freePlanes() {
+    for (int i = 0; i < 2; i++) {
+      if (planes[i]) heap_caps_free(planes[i]);
+      planes[i] = nullptr;
+    }
+    planeWidth = 0;
+    planeHeight = 0;
+    backPlane = 0;
+    refValid = false;
+  }
+
+  bool ensureBackground(uint16_t blocksX, uint16_t blocksY) {
+    if (bgMean && bgBlocksX == blocksX && bgBlocksY == blocksY) return true;
+
+    freeBackground();
+    size_t blocks = (size_t)blocksX * blocksY;
+    bgMean = (uint16_t*)heap_caps_malloc(blocks * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bgForeground = (uint8_t*)heap_caps_malloc(blocks, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!bgMean || !bgForeground) {
+      Serial.println("[Motion] Failed to allocate background model");
+      freeBackground();
+      return false;
+    }
+    bgBlocksX = blocksX;
+    bgBlocksY = blocksY;
+    return true;
+  }
+
+  void freeBackground() {
+    if (bgMean) heap_caps_free(bgMean);
+    if (bgForeground) heap_caps_free(bgForeground);
+    bgMean = nullptr;
+    bgForeground = nullptr;
+    bgBlocksX = 0;
+    bgBlocksY = 0;
+    bgValid = false;
+  }
+
+  bool ensureScratch(uint16_t width) {
+    uint16_t stride = (width + 3) & ~3;  // keep both rows word-aligned
+    if (lineBuf && scratchStride == stride) return true;
+
+    freeScratch();
+    lineBuf = (uint8_t*)heap_caps_aligned_alloc(4, stride * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bandSad = (uint32_t*)heap_caps_malloc(width * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bandSum = (uint32_t*)heap_caps_malloc(width * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bandState = (uint8_t*)heap_caps_malloc(width, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!lineBuf || !bandSad || !bandSum || !bandState) {
+      Serial.println("[Motion] Failed to allocate SAD scratch buffers");
+      freeScratch();
+      return false;
+    }
+    scratchStride = stride;
+    return true;
+  }
+
+  void freeScratch() {
+    if (lineBuf) heap_caps_free(lineBuf);
+    if (bandSad) heap_caps_free(bandSad);
+    if (bandSum) heap_caps_free(bandSum);
+    if (bandState) heap_caps_free(bandState);
+    lineBuf = nullptr;
+    bandSad = nullptr;
+    bandSum = nullptr;
+    bandState = nullptr;
+    scratchStride = 0;
+  }
+
+  /* ---- JPEG -> 1/8 luma decode ---- */
+
+  struct LumaDecodeCtx {
+    const uint8_t* src;
+    uint8_t* out;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  static size_t jpegReader(void* arg, size_t index, uint8_t* buf, size_t len) {
+    LumaDecodeCtx* ctx = (LumaDecodeCtx*)arg;
+    if (buf) {
+      memcpy(buf, ctx->src + index, len);
+    }
+    return len;
+  }
+
+  // Decoder hands us RGB888 MCU tiles; keep only luma (BT.601, integer)
+  static bool lumaWriter(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    if (!data) return true;  // start/end-of-image notifications
+
+    LumaDecodeCtx* ctx = (LumaDecodeCtx*)arg;
+    for (uint16_t row = 0; row < h; row++) {
+      uint16_t oy = y + row;
+      if (oy >= ctx->height) break;
+      uint8_t* dst = ctx->out + oy * ctx->width + x;
+      const uint8_t* rgb = data + row * w * 3;
+      for (uint16_t col = 0; col < w && (x + col) < ctx->width; col++) {
+        dst[col] = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+        rgb += 3;
+      }
+    }
+    return true;
+  }
+
+  bool decodeLuma(camera_fb_t* frame) {
+    uint16_t w = (frame->width + MOTION_LUMA_SCALE - 1) / MOTION_LUMA_SCALE;
+    uint16_t h = (frame->height + MOTION_LUMA_SCALE - 1) / MOTION_LUMA_SCALE;
+
+    uint8_t* plane = acquirePlane(w, h);
+    if (!plane) return false;
+
+    LumaDecodeCtx ctx = {frame->buf, plane, w, h};
+    esp_err_t err = esp_jpg_decode(frame->len, JPG_SCALE_8X, jpegReader, lumaWriter, &ctx);
+    if (err != ESP_OK) {
+      Serial.printf("[Motion] JPEG decode failed: 0x%x\n", err);
+      return false;
     }
+    return true;
   }
 };
 
@@ -0,0 +1,384 @@
+/**
+ * On-device rodent / not-rodent classifier for Scout
+ *
+ * Runs a quantized TFLite Micro model on the motion bounding box before an
+ * event is published, so shadows, insects and lighting flicker that pass
+ * the size filter no longer cost an upload and a server-side classification.
+ *
+ * The model is optional. The classifier is built in only when both
+ *   - the TFLite Micro library is installed (esp-tflite-micro, which picks
+ *     up the ESP-NN int8 kernels on the S3 by itself), and
+ *   - rodent_model.h sits next to the sketch, holding the .tflite file as
+ *       alignas(16) const unsigned char g_rodentModel[] = {...};
+ *     (xxd -i rodent.tflite, then rename the array).
+ * Without them accept() lets every detection through and the server keeps
+ * doing all of the classification, exactly as before.
+ *
+ * The model must take a square int8 or uint8 image (1 channel = luma,
+ * 3 = RGB, pixel values 0-255 mapped through the input quantization) and
+ * output either one rodent probability or per-class scores with rodent at
+ * RODENT_MODEL_CLASS.
+ *
+ * Only the crop is ever materialized: the JPEG is decoded at the largest
+ * scale that still leaves the crop at least as big as the model input, and
+ * the decoder callback keeps just the tiles' pixels inside the crop. Crop,
+ * tensor arena and interpreter all live in PSRAM.
+ */
+
+#ifndef RODENT_CLASSIFIER_H
+#define RODENT_CLASSIFIER_H
+
+#include <esp_camera.h>
+#include <esp_heap_caps.h>
+#include <img_converters.h>
+#include <new>
+
+#include "motion_detect.h"
+
+#if __has_include("rodent_model.h") && __has_include(<tensorflow/lite/micro/micro_interpreter.h>)
+#define RODENT_CLASSIFIER_TFLM 1
+#include "rodent_model.h"
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/micro/micro_mutable_op_resolver.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+#else
+#define RODENT_CLASSIFIER_TFLM 0
+#endif
+
+#ifndef RODENT_ARENA_BYTES
+#define RODENT_ARENA_BYTES (160 * 1024)  // tensor arena (PSRAM)
+#endif
+#ifndef RODENT_MODEL_CLASS
+#define RODENT_MODEL_CLASS 1             // rodent index in a multi-class output
+#endif
+#define RODENT_MIN_CROP 32               // smallest crop side (sensor pixels)
+
+// Classifier configuration (persisted with the motion config)
+struct ClassifierConfig {
+  bool enabled;           // Gate uploads on the score (if a model is built in)
+  float minScore;         // Publish only at or above this rodent score (0-1)
+};
+
+// Counters since boot (times in microseconds, crop + inference)
+struct ClassifierStats {
+  uint32_t runs;          // Detections classified
+  uint32_t passed;        // Scored >= minScore and published
+  uint32_t rejected;      // Scored below minScore and dropped
+  uint32_t failures;      // Decode/inference errors (detection passed through)
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  float lastScore;        // -1 until the first run
+};
+
+class RodentClassifier {
+public:
+  RodentClassifier() : ready(false), inSide(0), inChannels(0), inSigned(false),
+                       crop(nullptr), cropCap(0) {
+    config.enabled = true;
+    config.minScore = 0.6;
+    memset(&stats, 0, sizeof(stats));
+    stats.lastScore = -1.0;
+#if RODENT_CLASSIFIER_TFLM
+    interpreter = nullptr;
+    arena = nullptr;
+#endif
+  }
+
+  /**
+   * Load the model and allocate its tensors. Call once after the camera is up.
+   * @return true if a model is built in and ready to run
+   */
+  bool begin() {
+#if RODENT_CLASSIFIER_TFLM
+    if (ready) return true;
+
+    const tflite::Model* model = tflite::GetModel(g_rodentModel);
+    if (model->version() != TFLITE_SCHEMA_VERSION) {
+      Serial.printf("[Classifier] Model schema %u, runtime expects %u\n",
+                    (unsigned)model->version(), (unsigned)TFLITE_SCHEMA_VERSION);
+      return false;
+    }
+
+    static tflite::MicroMutableOpResolver<12> resolver;
+    static bool opsAdded = false;
+    if (!opsAdded) {
+      resolver.AddConv2D();
+      resolver.AddDepthwiseConv2D();
+      resolver.AddFullyConnected();
+      resolver.AddAveragePool2D();
+      resolver.AddMaxPool2D();
+      resolver.AddMean();
+      resolver.AddAdd();
+      resolver.AddReshape();
+      resolver.AddSoftmax();
+      resolver.AddLogistic();
+      resolver.AddQuantize();
+      resolver.AddDequantize();
+      opsAdded = true;
+    }
+
+    arena = (uint8_t*)heap_caps_aligned_alloc(16, RODENT_ARENA_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void* mem = heap_caps_malloc(sizeof(tflite::MicroInterpreter), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!arena || !mem) {
+      Serial.println("[Classifier] Failed to allocate tensor arena");
+      if (mem) heap_caps_free(mem);
+      freeArena();
+      return false;
+    }
+    interpreter = new (mem) tflite::MicroInterpreter(model, resolver, arena, RODENT_ARENA_BYTES);
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+      Serial.printf("[Classifier] AllocateTensors failed (arena %u bytes)\n", (unsigned)RODENT_ARENA_BYTES);
+      freeArena();
+      return false;
+    }
+
+    // Square NHWC image, 1 or 3 channels, int8/uint8
+    TfLiteTensor* in = interpreter->input(0);
+    if (in->dims->size != 4 || in->dims->data[1] != in->dims->data[2] ||
+        (in->dims->data[3] != 1 && in->dims->data[3] != 3) ||
+        (in->type != kTfLiteInt8 && in->type != kTfLiteUInt8)) {
+      Serial.println("[Classifier] Unsupported model input (need square int8/uint8 NHWC, 1 or 3 channels)");
+      freeArena();
+      return false;
+    }
+    inSide = in->dims->data[1];
+    inChannels = in->dims->data[3];
+    inSigned = in->type == kTfLiteInt8;
+
+    // 0-255 pixel -> quantized input value
+    float scale = in->params.scale > 0 ? in->params.scale : 1.0f / 255.0f;
+    int lo = inSigned ? -128 : 0, hi = inSigned ? 127 : 255;
+    for (int v = 0; v < 256; v++) {
+      int q = (int)lroundf(v / 255.0f / scale) + in->params.zero_point;
+      inLut[v] = (uint8_t)constrain(q, lo, hi);
+    }
+
+    ready = true;
+    Serial.printf("[Classifier] Model ready: %dx%dx%d %s, arena %u/%u bytes\n",
+                  inSide, inSide, inChannels, inSigned ? "int8" : "uint8",
+                  (unsigned)interpreter->arena_used_bytes(), (unsigned)RODENT_ARENA_BYTES);
+    return true;
+#else
+    Serial.println("[Classifier] No model built in - all detections go to the server");
+    return false;
+#endif
+  }
+
+  bool available() const {
+    return ready;
+  }
+
+  void setConfig(const ClassifierConfig& cfg) {
+    config = cfg;
+    config.minScore = constrain(config.minScore, 0.0f, 1.0f);
+  }
+
+  ClassifierConfig getConfig() const {
+    return config;
+  }
+
+  ClassifierStats getStats() const {
+    return stats;
+  }
+
+  /**
+   * Decide whether a detection is worth publishing.
+   * Fails open: with no model, the gate disabled, or an error, the detection
+   * goes out unscored and the server classifies it as before.
+   *
+   * @param frame JPEG frame the detection came from
+   * @param motion Detection; its bounding box is the crop
+   * @param score Rodent score 0-1, or -1 if the frame was not classified
+   * @return true to publish
+   */
+  bool accept(camera_fb_t* frame, const MotionResult& motion, float* score) {
+    *score = -1.0;
+    if (!ready || !config.enabled) return true;
+
+    uint32_t t0 = micros();
+    float s = classify(frame, motion);
+    uint32_t us = micros() - t0;
+    if (s < 0) {
+      stats.failures++;
+      return true;
+    }
+
+    stats.runs++;
+    stats.lastUs = us;
+    stats.sumUs += us;
+    if (us > stats.maxUs) stats.maxUs = us;
+    stats.lastScore = s;
+    *score = s;
+
+    bool pass = s >= config.minScore;
+    if (pass) stats.passed++;
+    else stats.rejected++;
+    Serial.printf("[Classifier] Score %.2f (%s, %u us)\n", s, pass ? "publish" : "drop", (unsigned)us);
+    return pass;
+  }
+
+private:
+  ClassifierConfig config;
+  ClassifierStats stats;
+  bool ready;
+
+  // Model input geometry and pixel -> input quantization
+  int inSide;
+  int inChannels;
+  bool inSigned;
+  uint8_t inLut[256];
+
+  // Crop buffer (PSRAM), cropSide x cropSide x inChannels at decode scale
+  uint8_t* crop;
+  size_t cropCap;
+
+#if RODENT_CLASSIFIER_TFLM
+  tflite::MicroInterpreter* interpreter;
+  uint8_t* arena;
+
+  void freeArena() {
+    if (interpreter) {
+      interpreter->~MicroInterpreter();
+      heap_caps_free(interpreter);
+    }
+    if (arena) heap_caps_free(arena);
+    interpreter = nullptr;
+    arena = nullptr;
+  }
+#endif
+
+  /* ---- JPEG -> crop decode ---- */
+
+  struct CropDecodeCtx {
+    const uint8_t* src;
+    uint8_t* out;
+    uint16_t x0;            // crop origin at decode scale
+    uint16_t y0;
+    uint16_t side;
+    uint8_t channels;
+  };
+
+  static size_t jpegReader(void* arg, size_t index, uint8_t* buf, size_t len) {
+    CropDecodeCtx* ctx = (CropDecodeCtx*)arg;
+    if (buf) {
+      memcpy(buf, ctx->src + index, len);
+    }
+    return len;
+  }
+
+  // RGB888 MCU tiles; keep the part inside the crop (as luma for 1 channel)
+  static bool cropWriter(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    if (!data) return true;  // start/end-of-image notifications
+
+    CropDecodeCtx* ctx = (CropDecodeCtx*)arg;
+    int cx0 = max((int)x, (int)ctx->x0);
+    int cx1 = min((int)x + w, (int)ctx->x0 + ctx->side);
+    int cy0 = max((int)y, (int)ctx->y0);
+    int cy1 = min((int)y + h, (int)ctx->y0 + ctx->side);
+    if (cx0 >= cx1 || cy0 >= cy1) return true;
+
+    for (int oy = cy0; oy < cy1; oy++) {
+      const uint8_t* rgb = data + ((oy - y) * w + (cx0 - x)) * 3;
+      uint8_t* dst = ctx->out + ((oy - ctx->y0) * ctx->side + (cx0 - ctx->x0)) * ctx->channels;
+      if (ctx->channels == 3) {
+        memcpy(dst, rgb, (cx1 - cx0) * 3);
+        continue;
+      }
+      for (int ox = cx0; ox < cx1; ox++, rgb += 3) {
+        *dst++ = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Square crop around the bounding box (plus a quarter of its size on every
+   * side, for context), decoded and resampled into the input tensor, then
+   * one inference.
+   * @return rodent score 0-1, or -1 on error
+   */
+  float classify(camera_fb_t* frame, const MotionResult& motion) {
+#if RODENT_CLASSIFIER_TFLM
+    if (!frame || frame->format != PIXFORMAT_JPEG) return -1.0;
+
+    int fw = frame->width, fh = frame->height;
+    int side = max(motion.width, motion.height);
+    side += side / 2;
+    side = constrain(side, RODENT_MIN_CROP, min(fw, fh));
+    int cx = motion.x + motion.width / 2;
+    int cy = motion.y + motion.height / 2;
+    int x0 = constrain(cx - side / 2, 0, fw - side);
+    int y0 = constrain(cy - side / 2, 0, fh - side);
+
+    // Coarsest decode that still gives the model full detail
+    uint8_t shift = 0;
+    while (shift < 3 && (side >> (shift + 1)) >= inSide) shift++;
+    static const jpg_scale_t scales[4] = {JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X};
+
+    CropDecodeCtx ctx;
+    ctx.src = frame->buf;
+    ctx.x0 = x0 >> shift;
+    ctx.y0 = y0 >> shift;
+    ctx.side = side >> shift;
+    ctx.channels = inChannels;
+    ctx.out = ensureCrop((size_t)ctx.side * ctx.side * inChannels);
+    if (!ctx.out) return -1.0;
+    memset(ctx.out, 0, (size_t)ctx.side * ctx.side * inChannels);
+
+    esp_err_t err = esp_jpg_decode(frame->len, scales[shift], jpegReader, cropWriter, &ctx);
+    if (err != ESP_OK) {
+      Serial.printf("[Classifier] JPEG decode failed: 0x%x\n", err);
+      return -1.0;
+    }
+
+    // Nearest-neighbour resample into the input tensor (16.16 step)
+    TfLiteTensor* in = interpreter->input(0);
+    uint8_t* dst = (uint8_t*)in->data.raw;
+    uint32_t step = ((uint32_t)ctx.side << 16) / inSide;
+    for (int oy = 0; oy < inSide; oy++) {
+      const uint8_t* row = ctx.out + (size_t)((oy * step) >> 16) * ctx.side * inChannels;
+      uint32_t sx = 0;
+      for (int ox = 0; ox < inSide; ox++, sx += step) {
+        const uint8_t* px = row + (sx >> 16) * inChannels;
+        for (int c = 0; c < inChannels; c++) *dst++ = inLut[px[c]];
+      }
+    }
+
+    if (interpreter->Invoke() != kTfLiteOk) {
+      Serial.println("[Classifier] Invoke failed");
+      return -1.0;
+    }
+
+    const TfLiteTensor* out = interpreter->output(0);
+    int classes = out->dims->data[out->dims->size - 1];
+    int idx = classes > 1 ? RODENT_MODEL_CLASS : 0;
+    if (idx >= classes) return -1.0;
+
+    float s;
+    if (out->type == kTfLiteInt8) {
+      s = (out->data.int8[idx] - out->params.zero_point) * out->params.scale;
+    } else if (out->type == kTfLiteUInt8) {
+      s = (out->data.uint8[idx] - out->params.zero_point) * out->params.scale;
+    } else if (out->type == kTfLiteFloat32) {
+      s = out->data.f[idx];
+    } else {
+      return -1.0;
+    }
+    return constrain(s, 0.0f, 1.0f);
+#else
+    return -1.0;
+#endif
+  }
+
+  uint8_t* ensureCrop(size_t bytes) {
+    if (crop && cropCap >= bytes) return crop;
+    if (crop) heap_caps_free(crop);
+    crop = (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    cropCap = crop ? bytes : 0;
+    if (!crop) Serial.println("[Classifier] Failed to allocate crop buffer");
+    return crop;
+  }
+};
+
+#endif // RODENT_CLASSIFIER_H
@@ -2,7 +2,8 @@
  * Scout Device Firmware
  *
  * Entry point monitoring with AI-powered rodent detection.
- * Detects motion, filters by size, and sends images to server for classification.
+ * Detects motion, filters by size, and sends images to server for classification
+ * (optionally pre-screened by an on-device classifier, see rodent_classifier.h).
  *
  * Hardware: ESP32-S3-CAM (same as trap device)
  * Features:
@@ -23,14 +24,16 @@
 #include <LittleFS.h>
 #include <Preferences.h>
 #include <esp_camera.h>
+#include <esp_heap_caps.h>
 #include <HTTPClient.h>
 #include <Update.h>
 #include <ElegantOTA.h>
 #include <time.h>
-#include <base64.h>
+#include <mbedtls/base64.h>
 
 #include "camera_pins.h"
 #include "motion_detect.h"
+#include "rodent_classifier.h"
 
 // =============================================================================
 // Version and Configuration
@@ -42,11 +45,12 @@
 
 // MQTT settings
 #define MQTT_PORT 1883
-#define MQTT_BUFFER_SIZE 50000  // 50KB for image payloads
+#define MQTT_BUFFER_SIZE 8192   // JSON only - images are streamed (mqttPublishImageJson)
 
 // Motion detection settings
-#define MOTION_CHECK_INTERVAL 500   // ms between motion checks
+#define MOTION_CHECK_INTERVAL 150   // ms between motion checks (~6-7 fps)
 #define MOTION_COOLDOWN 3000        // ms after detection
+#define SCOUT_MQTT_POLL_MS 50       // longest loop() sleep
 #define MAX_GALLERY_IMAGES 50       // FIFO limit
 #define GALLERY_DIR "/gallery"
 
@@ -90,10 +94,25 @@ bool mqttReallyConnected = false;
 // Camera
 bool cameraInitialized = false;
 
+// Serializes esp_camera_fb_get() between the motion loop, the MQTT capture
+// command and /api/capture's fallback grab. Held only around the grab.
+static SemaphoreHandle_t camMux = nullptr;  // created in initCamera()
+static inline bool cameraLock(TickType_t wait = portMAX_DELAY) {
+  return camMux && xSemaphoreTake(camMux, wait) == pdTRUE;
+}
+static inline void cameraUnlock() {
+  if (camMux) xSemaphoreGive(camMux);
+}
+
 // Motion detection
 MotionDetector motionDetector;
 unsigned long lastMotionCheck = 0;
 uint32_t motionEventCount = 0;
+uint32_t motionGrabUs = 0;          // Last esp_camera_fb_get() time
+uint32_t motionOverBudget = 0;      // Checks that took longer than MOTION_CHECK_INTERVAL
+
+// On-device pre-screen of detections (gates uploads if a model is built in)
+RodentClassifier rodentClassifier;
 
 // Web server
 AsyncWebServer server(80);
@@ -119,11 +138,12 @@ void mqttSetup();
 bool mqttConnect();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
 void publishDeviceStatus();
-void publishMotionEvent(camera_fb_t* frame, MotionResult& result);
+void publishMotionEvent(camera_fb_t* frame, MotionResult& result, float rodentScore = -1.0);
+bool mqttPublishImageJson(const char* topic, JsonDocument& meta, const uint8_t* jpg, size_t len);
 void checkMotion();
 void saveImageToGallery(camera_fb_t* frame, const String& classification);
-void cleanupGallery();
-String getGalleryJson();
+void loadGalleryIndex();
+String getGalleryJson(size_t offset = 0, size_t limit = MAX_GALLERY_IMAGES);
 void addSystemLog(const String& msg);
 
 // =============================================================================
@@ -230,17 +250,28 @@ void loadMotionConfig() {
   config.maxSizePercent = motionPrefs.getFloat("maxSize", 30.0);
   config.blockSize = motionPrefs.getUShort("blockSize", 16);
   config.cooldownMs = motionPrefs.getUShort("cooldown", MOTION_COOLDOWN);
+  config.bgAlpha = motionPrefs.getFloat("bgAlpha", 0.05);
+  config.ghostFrames = motionPrefs.getUChar("ghostFrames", 40);
+
+  ClassifierConfig clsConfig;
+  clsConfig.enabled = motionPrefs.getBool("clsOn", true);
+  clsConfig.minScore = motionPrefs.getFloat("clsMin", 0.6);
 
   motionPrefs.end();
 
   motionDetector.setConfig(config);
+  rodentClassifier.setConfig(clsConfig);
 
-  Serial.printf("[Motion] Config: thresh=%d, min=%.1f%%, max=%.1f%%\n",
-                config.threshold, config.minSizePercent, config.maxSizePercent);
+  Serial.printf("[Motion] Config: thresh=%d, min=%.1f%%, max=%.1f%%, bg=%.3f, ghost=%d\n",
+                config.threshold, config.minSizePercent, config.maxSizePercent,
+                config.bgAlpha, config.ghostFrames);
+  Serial.printf("[Classifier] Config: gate=%s, min score=%.2f\n",
+                clsConfig.enabled ? "on" : "off", clsConfig.minScore);
 }
 
 void saveMotionConfig() {
   MotionConfig config = motionDetector.getConfig();
+  ClassifierConfig clsConfig = rodentClassifier.getConfig();
 
   motionPrefs.begin("motion", false);
   motionPrefs.putUChar("threshold", config.threshold);
@@ -248,6 +279,10 @@ void saveMotionConfig() {
   motionPrefs.putFloat("maxSize", config.maxSizePercent);
   motionPrefs.putUShort("blockSize", config.blockSize);
   motionPrefs.putUShort("cooldown", config.cooldownMs);
+  motionPrefs.putFloat("bgAlpha", config.bgAlpha);
+  motionPrefs.putUChar("ghostFrames", config.ghostFrames);
+  motionPrefs.putBool("clsOn", clsConfig.enabled);
+  motionPrefs.putFloat("clsMin", clsConfig.minScore);
   motionPrefs.end();
 
   addSystemLog("Motion config saved");
@@ -314,6 +349,7 @@ void initCamera() {
     s->set_quality(s, 12);
   }
 
+  if (!camMux) camMux = xSemaphoreCreateMutex();
   cameraInitialized = true;
   addSystemLog("Camera initialized");
 }
@@ -415,7 +451,11 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
     } else if (command == "capture") {
       addSystemLog("Manual capture requested");
       // Trigger immediate capture
-      camera_fb_t* fb = esp_camera_fb_get();
+      camera_fb_t* fb = nullptr;
+      if (cameraLock()) {
+        fb = esp_camera_fb_get();
+        cameraUnlock();
+      }
       if (fb) {
         MotionResult result = {true, false, 0, 0, fb->width, fb->height, 100.0, 1, 1, 1.0};
         publishMotionEvent(fb, result);
@@ -464,11 +504,64 @@ void publishDeviceStatus() {
   lastStatusPublish = millis();
 }
 
+/**
+ * Publish {<meta fields>,"image":"<base64 jpeg>"} without building the
+ * base64/JSON payload in RAM. The JPEG is encoded 768 bytes at a time and
+ * written straight to the socket via beginPublish/write/endPublish.
+ */
+#define MQTT_IMG_RAW_CHUNK 768  // multiple of 3: no '=' padding mid-stream
+#define MQTT_IMG_B64_CHUNK ((MQTT_IMG_RAW_CHUNK / 3) * 4)
+
+bool mqttPublishImageJson(const char* topic, JsonDocument& meta, const uint8_t* jpg, size_t len) {
+  if (!mqttClient.connected() || !jpg || len == 0) return false;
+
+  String head;
+  serializeJson(meta, head);
+  if (head.length() < 2 || head[head.length() - 1] != '}') return false;
+  head.remove(head.length() - 1);
+  head += (head.length() > 1) ? ",\"image\":\"" : "\"image\":\"";
+  static const char tail[] = "\"}";
+
+  // MQTT needs the full length up front; base64 length is known exactly
+  size_t total = head.length() + 4 * ((len + 2) / 3) + (sizeof(tail) - 1);
+  if (!mqttClient.beginPublish(topic, total, false)) return false;
+
+  unsigned char enc[MQTT_IMG_B64_CHUNK + 1];
+  bool ok = mqttClient.write((const uint8_t*)head.c_str(), head.length()) == head.length();
+  size_t off = 0;
+  while (ok && off < len) {
+    size_t n = min((size_t)MQTT_IMG_RAW_CHUNK, len - off);
+    size_t olen = 0;
+    if (mbedtls_base64_encode(enc, sizeof(enc), &olen, jpg + off, n) != 0) {
+      ok = false;
+      break;
+    }
+    ok = mqttClient.write(enc, olen) == olen;
+    off += n;
+  }
+  if (ok) ok = mqttClient.write((const uint8_t*)tail, sizeof(tail) - 1) == sizeof(tail) - 1;
+
+  if (!ok) {
+    // Announced length can't be honoured - drop the socket so the broker
+    // doesn't read the next packet as payload; loop() reconnects.
+    Serial.printf("[MQTT] Image stream aborted at %u/%u bytes\n", (unsigned)off, (unsigned)len);
+    mqttWifiClient.stop();
+    return false;
+  }
+  return mqttClient.endPublish();
+}
+
 // =============================================================================
 // Motion Events
 // =============================================================================
 
-void publishMotionEvent(camera_fb_t* frame, MotionResult& result) {
+/**
+ * rodentScore is the on-device classifier's score, or -1 if the frame was
+ * not classified (no model, gate off, manual capture). A scored event is
+ * tagged "rodent" in the gallery, anything else stays "pending" for the
+ * server to classify.
+ */
+void publishMotionEvent(camera_fb_t* frame, MotionResult& result, float rodentScore) {
   if (!mqttClient.connected()) {
     Serial.println("[Motion] MQTT not connected, skipping publish");
     return;
@@ -482,14 +575,10 @@ void publishMotionEvent(camera_fb_t* frame, MotionResult& result) {
   snprintf(topic, sizeof(topic), "tenant/%s/device/%s/motion",
            claimedTenantId.c_str(), clientId.c_str());
 
-  // Base64 encode image
-  String base64Image = base64::encode(frame->buf, frame->len);
-
-  // Build JSON payload
+  // Build JSON metadata - the image itself is streamed into the payload
   JsonDocument doc;
   doc["type"] = "motion";
   doc["timestamp"] = time(nullptr);
-  doc["image"] = base64Image;
 
   JsonObject motion = doc["motion"].to<JsonObject>();
   motion["x"] = result.x;
@@ -499,41 +588,122 @@ void publishMotionEvent(camera_fb_t* frame, MotionResult& result) {
   motion["percent"] = result.sizePercent;
 
   doc["confidence"] = result.confidence;
+  if (rodentScore >= 0) {
+    doc["rodent_score"] = rodentScore;
+  }
 
-  String payload;
-  serializeJson(doc, payload);
-
-  Serial.printf("[Motion] Publishing event #%d (%d bytes)\n",
-                motionEventCount, payload.length());
+  Serial.printf("[Motion] Publishing event #%d (%d byte image)\n",
+                motionEventCount, frame->len);
 
-  bool published = mqttClient.publish(topic, payload.c_str());
+  bool published = mqttPublishImageJson(topic, doc, frame->buf, frame->len);
 
   if (published) {
     addSystemLog("Motion event published");
     // Save to gallery
-    saveImageToGallery(frame, "pending");
+    saveImageToGallery(frame, rodentScore >= 0 ? "rodent" : "pending");
   } else {
     Serial.println("[Motion] Publish failed");
   }
 }
 
+// Latest frame from the motion loop, shared with HTTP clients. /api/capture
+// sends a refcounted PSRAM copy, so viewers don't add camera grabs while
+// motion checks run and a slow client never holds a camera buffer. Frames
+// are only copied while someone has asked for one in the last
+// FRAME_LINGER_MS (three SPA polls); when there is no fresh copy (the first
+// request after an idle spell, or motion detection isn't running because
+// the scout is unclaimed) /api/capture grabs one itself under cameraLock().
+struct SharedFrame {
+  int refs;      // guarded by frameMux
+  uint32_t ms;   // millis() at grab
+  size_t len;
+  uint8_t* data; // JPEG, same allocation
+};
+static SharedFrame* latestFrame = nullptr;  // loop holds one ref
+static portMUX_TYPE frameMux = portMUX_INITIALIZER_UNLOCKED;
+#define FRAME_FRESH_MS (MOTION_CHECK_INTERVAL * 4)
+#define FRAME_LINGER_MS 15000
+static volatile uint32_t frameDemandMs = 0;  // last /api/capture, 0 = never
+
+static void releaseFrame(SharedFrame* f) {
+  if (!f) return;
+  portENTER_CRITICAL(&frameMux);
+  bool last = --f->refs == 0;
+  portEXIT_CRITICAL(&frameMux);
+  if (last) heap_caps_free(f);
+}
+
+static SharedFrame* acquireFrame() {
+  portENTER_CRITICAL(&frameMux);
+  SharedFrame* f = latestFrame;
+  if (f) f->refs++;
+  portEXIT_CRITICAL(&frameMux);
+  return f;
+}
+
+// PSRAM copy of fb with one ref, or nullptr when out of memory
+static SharedFrame* copyFrame(const camera_fb_t* fb) {
+  SharedFrame* f = (SharedFrame*)heap_caps_malloc(sizeof(SharedFrame) + fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!f) return nullptr;
+  f->refs = 1;
+  f->ms = millis();
+  f->len = fb->len;
+  f->data = (uint8_t*)(f + 1);
+  memcpy(f->data, fb->buf, fb->len);
+  return f;
+}
+
+static void publishFrame(const camera_fb_t* fb) {
+  SharedFrame* f = nullptr;
+  uint32_t demand = frameDemandMs;
+  if (demand && millis() - demand <= FRAME_LINGER_MS) {
+    f = copyFrame(fb);
+    if (!f) return;
+  } else if (!latestFrame) {
+    return;  // idle and nothing to give back
+  }
+
+  // swap in the copy; nullptr when idle, which frees the last one
+  portENTER_CRITICAL(&frameMux);
+  SharedFrame* old = latestFrame;
+  latestFrame = f;
+  portEXIT_CRITICAL(&frameMux);
+  releaseFrame(old);
+}
+
 void checkMotion() {
   if (!cameraInitialized) return;
   if (millis() - lastMotionCheck < MOTION_CHECK_INTERVAL) return;
 
   lastMotionCheck = millis();
 
-  camera_fb_t* fb = esp_camera_fb_get();
+  uint32_t t0 = micros();
+  camera_fb_t* fb = nullptr;
+  if (cameraLock()) {
+    fb = esp_camera_fb_get();
+    cameraUnlock();
+  }
+  motionGrabUs = micros() - t0;
   if (!fb) {
     Serial.println("[Motion] Failed to get frame");
     return;
   }
 
+  publishFrame(fb);
   MotionResult result = motionDetector.detect(fb);
 
+  // Grab + decode + compare must fit in one check interval
+  if (micros() - t0 > MOTION_CHECK_INTERVAL * 1000UL) {
+    motionOverBudget++;
+  }
+
   if (result.detected && !result.sizeFiltered) {
     // Motion detected and passed size filter - potential rodent!
-    publishMotionEvent(fb, result);
+    // The classifier drops the ones it scores below its minimum.
+    float score;
+    if (rodentClassifier.accept(fb, result, &score)) {
+      publishMotionEvent(fb, result, score);
+    }
   }
 
   esp_camera_fb_return(fb);
@@ -543,12 +713,72 @@ void checkMotion() {
 // Gallery (FIFO Storage)
 // =============================================================================
 
-void saveImageToGallery(camera_fb_t* frame, const String& classification) {
-  // Ensure gallery directory exists
+// In-RAM index of GALLERY_DIR, sorted by name (names embed the capture time,
+// so entry 0 is the oldest). Loaded once at boot, then kept current by
+// saveImageToGallery() - listing and FIFO eviction never walk the directory.
+struct GalleryEntry {
+  char name[40];
+  uint32_t size;
+};
+static GalleryEntry galleryIndex[MAX_GALLERY_IMAGES];
+static size_t galleryCount = 0;
+static portMUX_TYPE galleryMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Inserts name in order; when full, the oldest entry is dropped and its file
+// deleted (which may be the new one, if it is older than everything kept).
+static void galleryInsert(const char* name, uint32_t size) {
+  char evict[sizeof(GalleryEntry::name)] = "";
+
+  portENTER_CRITICAL(&galleryMux);
+  size_t i = 0;
+  while (i < galleryCount && strcmp(galleryIndex[i].name, name) < 0) i++;
+  if (i < galleryCount && strcmp(galleryIndex[i].name, name) == 0) {
+    galleryIndex[i].size = size;  // same-minute overwrite
+  } else if (galleryCount == MAX_GALLERY_IMAGES && i == 0) {
+    strlcpy(evict, name, sizeof(evict));
+  } else {
+    if (galleryCount == MAX_GALLERY_IMAGES) {
+      strlcpy(evict, galleryIndex[0].name, sizeof(evict));
+      memmove(&galleryIndex[0], &galleryIndex[1], (i - 1) * sizeof(GalleryEntry));
+      i--;
+    } else {
+      memmove(&galleryIndex[i + 1], &galleryIndex[i], (galleryCount - i) * sizeof(GalleryEntry));
+      galleryCount++;
+    }
+    strlcpy(galleryIndex[i].name, name, sizeof(galleryIndex[i].name));
+    galleryIndex[i].size = size;
+  }
+  portEXIT_CRITICAL(&galleryMux);
+
+  if (evict[0]) {
+    String oldest = String(GALLERY_DIR) + "/" + evict;
+    LittleFS.remove(oldest);
+    Serial.printf("[Gallery] Deleted oldest: %s\n", oldest.c_str());
+  }
+}
+
+void loadGalleryIndex() {
   if (!LittleFS.exists(GALLERY_DIR)) {
     LittleFS.mkdir(GALLERY_DIR);
   }
+  galleryCount = 0;
 
+  File dir = LittleFS.open(GALLERY_DIR);
+  if (!dir || !dir.isDirectory()) return;
+  File file = dir.openNextFile();
+  while (file) {
+    const char* name = strrchr(file.name(), '/');
+    name = name ? name + 1 : file.name();
+    if (!file.isDirectory() && strlen(name) < sizeof(GalleryEntry::name)) {
+      galleryInsert(name, file.size());  // trims an over-full gallery too
+    }
+    file.close();
+    file = dir.openNextFile();
+  }
+  Serial.printf("[Gallery] %u images indexed\n", (unsigned)galleryCount);
+}
+
+void saveImageToGallery(camera_fb_t* frame, const String& classification) {
   // Generate filename with timestamp
   time_t now = time(nullptr);
   struct tm* timeinfo = localtime(&now);
@@ -561,56 +791,31 @@ void saveImageToGallery(camera_fb_t* frame, const String& classification) {
 
   // Save image
   File file = LittleFS.open(filename, "w");
-  if (file) {
-    file.write(frame->buf, frame->len);
-    file.close();
-    Serial.printf("[Gallery] Saved: %s\n", filename);
-  }
-
-  // Cleanup old images if over limit
-  cleanupGallery();
+  if (!file) return;
+  size_t written = file.write(frame->buf, frame->len);
+  file.close();
+  Serial.printf("[Gallery] Saved: %s\n", filename);
+
+  // Index it; evicts the oldest image if over limit
+  const char* name = filename + sizeof(GALLERY_DIR);
+  if (strlen(name) < sizeof(GalleryEntry::name)) galleryInsert(name, written);
 }
 
-void cleanupGallery() {
-  File dir = LittleFS.open(GALLERY_DIR);
-  if (!dir || !dir.isDirectory()) return;
-
-  // Count files and find oldest
-  std::vector<String> files;
-  File file = dir.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      files.push_back(String(file.name()));
-    }
-    file = dir.openNextFile();
-  }
+// Newest first; offset/limit page through the index
+String getGalleryJson(size_t offset, size_t limit) {
+  static GalleryEntry snap[MAX_GALLERY_IMAGES];  // async_tcp task only
+  portENTER_CRITICAL(&galleryMux);
+  size_t n = galleryCount;
+  memcpy(snap, galleryIndex, n * sizeof(GalleryEntry));
+  portEXIT_CRITICAL(&galleryMux);
 
-  // Delete oldest files if over limit
-  while (files.size() > MAX_GALLERY_IMAGES) {
-    // Sort and remove oldest (filenames contain timestamps)
-    std::sort(files.begin(), files.end());
-    String oldest = String(GALLERY_DIR) + "/" + files[0];
-    LittleFS.remove(oldest);
-    Serial.printf("[Gallery] Deleted oldest: %s\n", oldest.c_str());
-    files.erase(files.begin());
-  }
-}
-
-String getGalleryJson() {
   JsonDocument doc;
   JsonArray arr = doc.to<JsonArray>();
-
-  File dir = LittleFS.open(GALLERY_DIR);
-  if (dir && dir.isDirectory()) {
-    File file = dir.openNextFile();
-    while (file) {
-      if (!file.isDirectory()) {
-        JsonObject obj = arr.add<JsonObject>();
-        obj["name"] = file.name();
-        obj["size"] = file.size();
-      }
-      file = dir.openNextFile();
-    }
+  for (size_t k = offset; k < n && k < offset + limit; k++) {
+    const GalleryEntry& e = snap[n - 1 - k];
+    JsonObject obj = arr.add<JsonObject>();
+    obj["name"] = e.name;
+    obj["size"] = e.size;
   }
 
   String result;
@@ -650,6 +855,36 @@ void setupWebServer() {
     motion["min_size"] = config.minSizePercent;
     motion["max_size"] = config.maxSizePercent;
 
+    // Per-stage timing of the last motion check (microseconds)
+    MotionTiming timing = motionDetector.getTiming();
+    JsonObject mt = doc["motion_timing"].to<JsonObject>();
+    mt["grab_us"] = motionGrabUs;
+    mt["decode_us"] = timing.decodeUs;
+    mt["diff_us"] = timing.diffUs;
+    mt["detect_us"] = timing.totalUs;
+    mt["detect_max_us"] = timing.maxTotalUs;
+    mt["plane"] = String(timing.lumaWidth) + "x" + String(timing.lumaHeight);
+    mt["jpeg_fallback"] = timing.jpegFallback;
+    mt["budget_us"] = MOTION_CHECK_INTERVAL * 1000UL;
+    mt["over_budget"] = motionOverBudget;
+
+    // On-device classifier: hit rate = published / classified
+    ClassifierConfig clsConfig = rodentClassifier.getConfig();
+    ClassifierStats cls = rodentClassifier.getStats();
+    JsonObject ct = doc["classifier"].to<JsonObject>();
+    ct["available"] = rodentClassifier.available();
+    ct["enabled"] = clsConfig.enabled;
+    ct["min_score"] = clsConfig.minScore;
+    ct["runs"] = cls.runs;
+    ct["passed"] = cls.passed;
+    ct["rejected"] = cls.rejected;
+    ct["failures"] = cls.failures;
+    ct["hit_rate"] = cls.runs ? (float)cls.passed / cls.runs : 0.0f;
+    ct["last_score"] = cls.lastScore;
+    ct["last_us"] = cls.lastUs;
+    ct["avg_us"] = cls.runs ? (uint32_t)(cls.sumUs / cls.runs) : 0;
+    ct["max_us"] = cls.maxUs;
+
     String response;
     serializeJson(doc, response);
     request->send(200, "application/json", response);
@@ -662,21 +897,61 @@ void setupWebServer() {
       return;
     }
 
-    camera_fb_t* fb = esp_camera_fb_get();
-    if (!fb) {
-      request->send(500, "text/plain", "Capture failed");
+    // served from the motion loop's latest frame when it has a fresh one;
+    // asking keeps the loop copying frames for FRAME_LINGER_MS
+    frameDemandMs = millis() | 1;  // never 0
+    SharedFrame* f = acquireFrame();
+    if (f && millis() - f->ms > FRAME_FRESH_MS) {
+      releaseFrame(f);
+      f = nullptr;
+    }
+    if (!f) {
+      // grab one directly; the camera buffer goes back as soon as it's copied.
+      // Bounded wait: this runs on the async_tcp task.
+      camera_fb_t* fb = nullptr;
+      if (cameraLock(pdMS_TO_TICKS(250))) {
+        fb = esp_camera_fb_get();
+        cameraUnlock();
+      }
+      if (fb) {
+        f = copyFrame(fb);
+        esp_camera_fb_return(fb);
+      }
+    }
+    if (!f) {
+      AsyncWebServerResponse* busy = request->beginResponse(503, "text/plain", "Camera busy");
+      busy->addHeader("Retry-After", "1");
+      request->send(busy);
       return;
     }
 
-    AsyncWebServerResponse* response = request->beginResponse_P(
-      200, "image/jpeg", fb->buf, fb->len);
+    SharedFrame** held = new SharedFrame*(f);
+    request->onDisconnect([held]() {
+      releaseFrame(*held);
+      delete held;
+    });
+    AsyncWebServerResponse* response = request->beginResponse(
+      "image/jpeg", f->len,
+      [held](uint8_t* buf, size_t maxLen, size_t index) -> size_t {
+        SharedFrame* fr = *held;
+        if (!fr) return 0;
+        size_t n = min(maxLen, fr->len - index);
+        memcpy(buf, fr->data + index, n);
+        if (index + n >= fr->len) {
+          releaseFrame(fr);
+          *held = nullptr;
+        }
+        return n;
+      });
+    response->addHeader("Cache-Control", "no-store");
     request->send(response);
-    esp_camera_fb_return(fb);
   });
 
   // API: Gallery list
   server.on("/api/gallery", HTTP_GET, [](AsyncWebServerRequest* request) {
-    request->send(200, "application/json", getGalleryJson());
+    size_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+    size_t limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : MAX_GALLERY_IMAGES;
+    request->send(200, "application/json", getGalleryJson(offset, limit));
   });
 
   // API: Gallery image
@@ -700,6 +975,12 @@ void setupWebServer() {
     doc["max_size"] = config.maxSizePercent;
     doc["block_size"] = config.blockSize;
     doc["cooldown"] = config.cooldownMs;
+    doc["bg_alpha"] = config.bgAlpha;
+    doc["ghost_frames"] = config.ghostFrames;
+
+    ClassifierConfig clsConfig = rodentClassifier.getConfig();
+    doc["classifier_enabled"] = clsConfig.enabled;
+    doc["classifier_min_score"] = clsConfig.minScore;
 
     String response;
     serializeJson(doc, response);
@@ -721,8 +1002,29 @@ void setupWebServer() {
       if (json.containsKey("max_size")) {
         config.maxSizePercent = json["max_size"].as<float>();
       }
+      if (json.containsKey("bg_alpha")) {
+        config.bgAlpha = constrain(json["bg_alpha"].as<float>(), 0.0f, 1.0f);
+      }
+      if (json.containsKey("ghost_frames")) {
+        // as<uint8_t>() would wrap 300 to 44
+        long ghost = json["ghost_frames"].as<long>();
+        if (!json["ghost_frames"].is<long>() || ghost < 0 || ghost > 255) {
+          request->send(400, "application/json", "{\"error\":\"ghost_frames must be 0-255\"}");
+          return;
+        }
+        config.ghostFrames = (uint8_t)ghost;
+      }
+
+      ClassifierConfig clsConfig = rodentClassifier.getConfig();
+      if (json.containsKey("classifier_enabled")) {
+        clsConfig.enabled = json["classifier_enabled"].as<bool>();
+      }
+      if (json.containsKey("classifier_min_score")) {
+        clsConfig.minScore = json["classifier_min_score"].as<float>();
+      }
 
       motionDetector.setConfig(config);
+      rodentClassifier.setConfig(clsConfig);
       saveMotionConfig();
 
       request->send(200, "application/json", "{\"success\":true}");
@@ -825,6 +1127,7 @@ void setup() {
     Serial.println("[FS] LittleFS mount failed");
   } else {
     Serial.println("[FS] LittleFS mounted");
+    loadGalleryIndex();
   }
 
   // Load configuration
@@ -865,6 +1168,9 @@ void setup() {
 
   // Initialize camera
   initCamera();
+  if (cameraInitialized) {
+    rodentClassifier.begin();
+  }
 
   // Setup MQTT
   if ((deviceClaimed || standaloneMode) && wifiConnected) {
@@ -904,6 +1210,13 @@ void loop() {
     checkMotion();
   }
 
-  // Small delay to prevent watchdog
-  delay(10);
+  // Sleep until the next motion check is due; MQTT still gets polled every
+  // SCOUT_MQTT_POLL_MS. delay() blocks the task, so the idle task (and
+  // modem sleep) get the time instead of a 10 ms spin.
+  uint32_t wait = SCOUT_MQTT_POLL_MS;
+  if (cameraInitialized && (deviceClaimed || standaloneMode)) {
+    uint32_t since = millis() - lastMotionCheck;
+    wait = since >= MOTION_CHECK_INTERVAL ? 1 : min(wait, (uint32_t)(MOTION_CHECK_INTERVAL - since));
+  }
+  delay(wait);
 }